@@ -21,6 +21,7 @@
 #include <QUrl>
 #include <QFile>
 #include <QFileInfo>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QNetworkProxy>
@@ -39,6 +40,7 @@
 #include "theme.h"
 #include "netrcparser.h"
 #include "libsync/logger.h"
+#include "watchdaemon.h"
 
 #include "config.h"
 
@@ -76,6 +78,10 @@ struct CmdOptions
     int restartTimes;
     int downlimit;
     int uplimit;
+    QString statsJson;
+    bool watch;
+    int pollInterval;
+    int fullScanInterval;
 };
 
 // we can't use csync_set_userdata because the SyncEngine sets it already.
@@ -188,6 +194,15 @@ void help()
     std::cout << "  -h                     Sync hidden files, do not ignore them" << std::endl;
     std::cout << "  --version, -v          Display version and exit" << std::endl;
     std::cout << "  --logdebug             More verbose logging" << std::endl;
+    std::cout << "  --stats-json <file>    Write phase timings and counters of each sync run" << std::endl;
+    std::cout << "                         as JSON to <file> (- for stdout)" << std::endl;
+    std::cout << "  --watch                Keep running and sync whenever something changed" << std::endl;
+    std::cout << "                         SIGUSR1 writes the statistics, see --stats-json" << std::endl;
+    std::cout << "  --poll-interval [n]    With --watch, check for remote changes every n seconds" << std::endl;
+    std::cout << "                         (default 30)" << std::endl;
+    std::cout << "  --full-scan-interval [n]" << std::endl;
+    std::cout << "                         With --watch, look at all local files every n seconds" << std::endl;
+    std::cout << "                         even if no change was reported (default 3600, -1 for never)" << std::endl;
     std::cout << "" << std::endl;
     exit(0);
 }
@@ -268,6 +283,14 @@ void parseOptions(const QStringList &app_args, CmdOptions *options)
         } else if (option == "--logdebug") {
             Logger::instance()->setLogFile("-");
             Logger::instance()->setLogDebug(true);
+        } else if (option == "--stats-json" && (it.peekNext() == "-" || !it.peekNext().startsWith("-"))) {
+            options->statsJson = it.next();
+        } else if (option == "--watch") {
+            options->watch = true;
+        } else if (option == "--poll-interval" && !it.peekNext().startsWith("-")) {
+            options->pollInterval = qMax(1, it.next().toInt());
+        } else if (option == "--full-scan-interval" && it.hasNext()) {
+            options->fullScanInterval = it.next().toInt();
         } else {
             help();
         }
@@ -302,6 +325,20 @@ void selectiveSyncFixup(OCC::SyncJournalDb *journal, const QStringList &newList)
     }
 }
 
+void writeStatsJson(const QString &target, const QJsonObject &stats)
+{
+    const QByteArray json = QJsonDocument(stats).toJson();
+
+    if (target == "-") {
+        std::cout << json.constData() << std::flush;
+        return;
+    }
+    QFile f(target);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate) || f.write(json) != json.size()) {
+        qCritical() << "Could not write the sync statistics to" << target << f.errorString();
+    }
+}
+
 int main(int argc, char **argv)
 {
     QCoreApplication app(argc, argv);
@@ -324,6 +361,9 @@ int main(int argc, char **argv)
     options.restartTimes = 3;
     options.uplimit = 0;
     options.downlimit = 0;
+    options.watch = false;
+    options.pollInterval = 30;
+    options.fullScanInterval = 3600;
 
     parseOptions(app.arguments(), &options);
 
@@ -476,9 +516,6 @@ int main(int argc, char **argv)
     // much lower age than the default since this utility is usually made to be run right after a change in the tests
     SyncEngine::minimumFileAgeForUpload = 0;
 
-    int restartCount = 0;
-restart_sync:
-
     opts = &options;
 
     QStringList selectiveSyncList;
@@ -498,6 +535,8 @@ restart_sync:
         }
     }
 
+    // The journal, the engine and the exclude lists are reused by the
+    // follow-up syncs and in --watch mode.
     Cmd cmd;
     QString dbPath = options.source_dir + SyncJournalDb::makeDbName(credentialFreeUrl, folder, user);
     SyncJournalDb db(dbPath);
@@ -509,8 +548,6 @@ restart_sync:
     SyncEngine engine(account, options.source_dir, folder, &db);
     engine.setIgnoreHiddenFiles(options.ignoreHiddenFiles);
     engine.setNetworkLimits(options.uplimit, options.downlimit);
-    QObject::connect(&engine, &SyncEngine::finished,
-        [&app](bool result) { app.exit(result ? EXIT_SUCCESS : EXIT_FAILURE); });
     QObject::connect(&engine, &SyncEngine::transmissionProgress, &cmd, &Cmd::transmissionProgressSlot);
 
 
@@ -533,19 +570,54 @@ restart_sync:
         return EXIT_FAILURE;
     }
 
+    if (options.watch) {
+        WatchDaemon daemon(account, &engine, &db, folder);
+        daemon.setPollInterval(options.pollInterval);
+        daemon.setFullScanInterval(options.fullScanInterval);
+        daemon.setMaxFollowUpSyncs(options.restartTimes);
+        QObject::connect(&daemon, &WatchDaemon::statisticsRequested, [&] {
+            writeStatsJson(options.statsJson.isEmpty() ? QStringLiteral("-") : options.statsJson, daemon.statistics());
+        });
+        QObject::connect(&daemon, &WatchDaemon::stopped, &app, &QCoreApplication::quit);
+        daemon.start();
 
-    // Have to be done async, else, an error before exec() does not terminate the event loop.
-    QMetaObject::invokeMethod(&engine, "startSync", Qt::QueuedConnection);
+        app.exec();
 
-    int resultCode = app.exec();
+        if (!options.statsJson.isEmpty()) {
+            writeStatsJson(options.statsJson, daemon.statistics());
+        }
+        return daemon.lastSyncSucceeded() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    QObject::connect(&engine, &SyncEngine::finished,
+        [&app](bool result) { app.exit(result ? EXIT_SUCCESS : EXIT_FAILURE); });
+
+    int resultCode = EXIT_SUCCESS;
+    QJsonArray statsRuns;
+    for (int restartCount = 0;; ++restartCount) {
+        // Have to be done async, else, an error before exec() does not terminate the event loop.
+        QMetaObject::invokeMethod(&engine, "startSync", Qt::QueuedConnection);
+
+        resultCode = app.exec();
 
-    if (engine.isAnotherSyncNeeded() != NoFollowUpSync) {
-        if (restartCount < options.restartTimes) {
-            restartCount++;
-            qDebug() << "Restarting Sync, because another sync is needed" << restartCount;
-            goto restart_sync;
+        if (!options.statsJson.isEmpty()) {
+            statsRuns.append(engine.syncStatistics().toJson());
         }
-        qWarning() << "Another sync is needed, but not done because restart count is exceeded" << restartCount;
+
+        if (engine.isAnotherSyncNeeded() == NoFollowUpSync) {
+            break;
+        }
+        if (restartCount >= options.restartTimes) {
+            qWarning() << "Another sync is needed, but not done because restart count is exceeded" << restartCount;
+            break;
+        }
+        qDebug() << "Restarting Sync, because another sync is needed" << restartCount + 1;
+    }
+
+    if (!options.statsJson.isEmpty()) {
+        QJsonObject stats;
+        stats.insert(QStringLiteral("runs"), statsRuns);
+        writeStatsJson(options.statsJson, stats);
     }
 
     return resultCode;
@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "watchdaemon.h"
+
+#include "account.h"
+#include "filesystem.h"
+#include "networkjobs.h"
+#include "syncengine.h"
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+
+#include "folderwatcher.h"
+
+// The folder watcher is only built into nextcloudcmd where it doesn't need
+// more than inotify, see CMakeLists.txt
+#if defined(Q_OS_UNIX) && !defined(Q_OS_MAC)
+#define WITH_FOLDERWATCHER
+#endif
+
+#include <QLoggingCategory>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcWatchDaemon, "nextcloud.cmd.watch", QtInfoMsg)
+
+#ifdef Q_OS_UNIX
+// The signal handler writes the signal number here, see installSignalHandlers()
+static int signalSockets[2] = { -1, -1 };
+
+static void signalHandler(int signal)
+{
+    const char c = char(signal);
+    auto unused = ::write(signalSockets[0], &c, 1);
+    Q_UNUSED(unused);
+}
+#endif
+
+WatchDaemon::WatchDaemon(AccountPtr account, SyncEngine *engine, SyncJournalDb *journal, const QString &remotePath)
+    : _account(account)
+    , _engine(engine)
+    , _journal(journal)
+    , _remotePath(remotePath)
+{
+    _syncTimer.setSingleShot(true);
+    connect(&_syncTimer, &QTimer::timeout, this, &WatchDaemon::startSync);
+
+    _pollTimer.setInterval(30 * 1000);
+    connect(&_pollTimer, &QTimer::timeout, this, &WatchDaemon::slotPollRemote);
+
+    connect(_engine, &SyncEngine::finished, this, &WatchDaemon::slotSyncFinished);
+    connect(_engine, &SyncEngine::itemCompleted, this, &WatchDaemon::slotItemCompleted);
+    connect(_engine, &SyncEngine::rootEtag, this, &WatchDaemon::slotRootEtag);
+}
+
+WatchDaemon::~WatchDaemon() = default;
+
+void WatchDaemon::start()
+{
+    _uptime.start();
+    installSignalHandlers();
+
+#ifdef WITH_FOLDERWATCHER
+    _watcher.reset(new FolderWatcher);
+    connect(_watcher.data(), &FolderWatcher::pathChanged, this, &WatchDaemon::slotPathChanged);
+    connect(_watcher.data(), &FolderWatcher::lostChanges, this, &WatchDaemon::slotLostChanges);
+    connect(_watcher.data(), &FolderWatcher::becameUnreliable, this, [](const QString &message) {
+        qCWarning(lcWatchDaemon) << "Local changes are found by full discoveries only:" << message;
+    });
+    _watcher->init(_engine->localPath());
+#else
+    qCInfo(lcWatchDaemon) << "No folder watcher on this platform, local changes are found at the remote polls";
+#endif
+
+    _pollTimer.start();
+    scheduleSync(0);
+}
+
+QJsonObject WatchDaemon::statistics() const
+{
+    QJsonObject watch;
+    watch.insert(QStringLiteral("uptimeMsec"), _uptime.isValid() ? _uptime.elapsed() : 0);
+    watch.insert(QStringLiteral("syncs"), _syncCount);
+    watch.insert(QStringLiteral("failedSyncs"), _failedSyncCount);
+    watch.insert(QStringLiteral("fullLocalDiscoveries"), _fullLocalDiscoveryCount);
+    watch.insert(QStringLiteral("localChanges"), _localChangeCount);
+    watch.insert(QStringLiteral("remoteChanges"), _remoteChangeCount);
+    watch.insert(QStringLiteral("watcherReliable"), watcherIsReliable());
+
+    QJsonObject result;
+    result.insert(QStringLiteral("watch"), watch);
+    result.insert(QStringLiteral("runs"), _runs);
+    return result;
+}
+
+void WatchDaemon::stop()
+{
+    if (_stopping)
+        return;
+    _stopping = true;
+    _syncTimer.stop();
+    _pollTimer.stop();
+    if (_engine->isSyncRunning()) {
+        qCInfo(lcWatchDaemon) << "Stopping after aborting the running sync";
+        _engine->abort();
+        return;
+    }
+    emit stopped();
+}
+
+void WatchDaemon::slotPathChanged(const QString &path)
+{
+    const QString root = _engine->localPath();
+    if (!path.startsWith(root))
+        return;
+    if (_engine->excludedFiles().isExcluded(path, root, _engine->ignoreHiddenFiles()))
+        return;
+
+    // Insert before checking for our own changes to make sure not to miss any
+    const QByteArray relativePath = path.midRef(root.size()).toUtf8();
+    _localDiscoveryPaths.insert(relativePath);
+
+    if (_engine->wasFileTouched(path)) {
+        qCDebug(lcWatchDaemon) << "Changed path was touched by the sync, ignoring:" << path;
+        return;
+    }
+
+    SyncJournalFileRecord record;
+    if (_journal->getFileRecord(relativePath, &record)
+        && record.isValid()
+        && !FileSystem::fileChanged(path, record._fileSize, record._modtime)) {
+        return; // probably a spurious notification
+    }
+
+    ++_localChangeCount;
+    scheduleSync(settleMsec);
+}
+
+void WatchDaemon::slotLostChanges()
+{
+    qCInfo(lcWatchDaemon) << "The folder watcher lost changes, the next sync discovers everything";
+    _fullLocalDiscoveryNeeded = true;
+    scheduleSync(settleMsec);
+}
+
+void WatchDaemon::slotPollRemote()
+{
+    if (_etagJob || _engine->isSyncRunning())
+        return;
+
+    if (!watcherIsReliable()) {
+        // Local changes can only be found by looking
+        scheduleSync(0);
+        return;
+    }
+
+    _etagJob = new RequestEtagJob(_account, _remotePath, this);
+    _etagJob->setTimeout(60 * 1000);
+    connect(_etagJob.data(), &RequestEtagJob::etagRetreived, this, &WatchDaemon::slotEtagRetrieved);
+    _etagJob->start();
+    // The job deletes itself when it is finished
+}
+
+void WatchDaemon::slotEtagRetrieved(const QString &etag)
+{
+    if (etag == _lastEtag)
+        return;
+    qCInfo(lcWatchDaemon) << "Remote etag changed from" << _lastEtag << "to" << etag;
+    _lastEtag = etag;
+    ++_remoteChangeCount;
+    scheduleSync(0);
+}
+
+void WatchDaemon::slotRootEtag(const QString &etag)
+{
+    _lastEtag = etag;
+}
+
+void WatchDaemon::slotItemCompleted(const SyncFileItemPtr &item)
+{
+#ifdef WITH_FOLDERWATCHER
+    if (_watcher && item->isDirectory()) {
+        const QString root = _engine->localPath();
+        switch (item->_instruction) {
+        case CSYNC_INSTRUCTION_NEW:
+            _watcher->addPath(root + item->_file);
+            break;
+        case CSYNC_INSTRUCTION_REMOVE:
+            _watcher->removePath(root + item->_file);
+            break;
+        case CSYNC_INSTRUCTION_RENAME:
+            _watcher->removePath(root + item->_file);
+            _watcher->addPath(root + item->destination());
+            break;
+        default:
+            break;
+        }
+    }
+#endif
+
+    // Failed items are discovered again by the next sync, see Folder::slotItemCompleted()
+    if (item->_status == SyncFileItem::Success
+        || item->_status == SyncFileItem::FileIgnored
+        || item->_status == SyncFileItem::Restoration
+        || item->_status == SyncFileItem::Conflict) {
+        _previousLocalDiscoveryPaths.erase(item->_file.toUtf8());
+    } else {
+        _localDiscoveryPaths.insert(item->_file.toUtf8());
+    }
+}
+
+void WatchDaemon::startSync()
+{
+    if (_stopping)
+        return;
+    if (_engine->isSyncRunning()) {
+        _syncRequested = true;
+        return;
+    }
+
+    const bool fullScanDue = _fullScanIntervalMsec >= 0
+        && _timeSinceFullLocalDiscovery.isValid()
+        && _timeSinceFullLocalDiscovery.hasExpired(_fullScanIntervalMsec);
+    if (!watcherIsReliable() || _fullLocalDiscoveryNeeded || fullScanDue) {
+        _engine->setLocalDiscoveryOptions(LocalDiscoveryStyle::FilesystemOnly);
+        _previousLocalDiscoveryPaths.clear();
+        _fullLocalDiscoveryNeeded = false;
+        ++_fullLocalDiscoveryCount;
+    } else {
+        qCInfo(lcWatchDaemon) << "Discovering" << _localDiscoveryPaths.size() << "changed local paths";
+        _engine->setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem, _localDiscoveryPaths);
+        _previousLocalDiscoveryPaths = std::move(_localDiscoveryPaths);
+    }
+    _localDiscoveryPaths.clear();
+
+    ++_syncCount;
+    QMetaObject::invokeMethod(_engine, "startSync", Qt::QueuedConnection);
+}
+
+void WatchDaemon::slotSyncFinished(bool success)
+{
+    _runs.append(_engine->syncStatistics().toJson());
+    while (_runs.size() > keptRuns)
+        _runs.removeFirst();
+
+    const bool wasFullLocalDiscovery = _engine->lastLocalDiscoveryStyle() == LocalDiscoveryStyle::FilesystemOnly;
+    if (success) {
+        if (wasFullLocalDiscovery)
+            _timeSinceFullLocalDiscovery.start();
+    } else {
+        ++_failedSyncCount;
+        // The paths of the failed sync have to be discovered again
+        _localDiscoveryPaths.insert(_previousLocalDiscoveryPaths.begin(), _previousLocalDiscoveryPaths.end());
+        if (wasFullLocalDiscovery)
+            _fullLocalDiscoveryNeeded = true;
+        // Retried at the next poll
+        _lastEtag.clear();
+    }
+    _previousLocalDiscoveryPaths.clear();
+
+    if (_stopping) {
+        // The sync was probably aborted by stop(), keep the previous result
+        emit stopped();
+        return;
+    }
+    _lastSyncSucceeded = success;
+
+    if (_engine->isAnotherSyncNeeded() != NoFollowUpSync && _followUpSyncs < _maxFollowUpSyncs) {
+        ++_followUpSyncs;
+        qCInfo(lcWatchDaemon) << "Another sync is needed" << _followUpSyncs;
+        scheduleSync(0);
+        return;
+    }
+    _followUpSyncs = 0;
+
+    // Changes that arrived during the sync
+    if (_syncRequested || _fullLocalDiscoveryNeeded) {
+        _syncRequested = false;
+        scheduleSync(settleMsec);
+    }
+}
+
+void WatchDaemon::scheduleSync(int delayMsec)
+{
+    if (_stopping)
+        return;
+    if (_engine->isSyncRunning()) {
+        _syncRequested = true;
+        return;
+    }
+    if (!_syncTimer.isActive() || _syncTimer.remainingTime() > delayMsec)
+        _syncTimer.start(delayMsec);
+}
+
+bool WatchDaemon::watcherIsReliable() const
+{
+#ifdef WITH_FOLDERWATCHER
+    return _watcher && _watcher->isReliable();
+#else
+    return false;
+#endif
+}
+
+void WatchDaemon::installSignalHandlers()
+{
+#ifdef Q_OS_UNIX
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalSockets) != 0) {
+        qCWarning(lcWatchDaemon) << "Could not set up the signal handlers";
+        return;
+    }
+    _signalNotifier.reset(new QSocketNotifier(signalSockets[1], QSocketNotifier::Read));
+    connect(_signalNotifier.data(), &QSocketNotifier::activated, this, &WatchDaemon::slotSignalReceived);
+
+    struct sigaction action = {};
+    action.sa_handler = signalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGUSR1, &action, nullptr);
+#endif
+}
+
+void WatchDaemon::slotSignalReceived()
+{
+#ifdef Q_OS_UNIX
+    char signal = 0;
+    if (::read(signalSockets[1], &signal, 1) != 1)
+        return;
+    if (signal == SIGUSR1) {
+        emit statisticsRequested();
+    } else {
+        qCInfo(lcWatchDaemon) << "Received signal" << int(signal) << ", stopping";
+        stop();
+    }
+#endif
+}
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef WATCHDAEMON_H
+#define WATCHDAEMON_H
+
+#include "accountfwd.h"
+#include "syncfileitem.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QPointer>
+#include <QScopedPointer>
+#include <QTimer>
+
+#include <set>
+
+class QSocketNotifier;
+
+namespace OCC {
+
+class SyncEngine;
+class SyncJournalDb;
+class FolderWatcher;
+class RequestEtagJob;
+
+/**
+ * @brief Keeps a folder in sync until it is told to stop (nextcloudcmd --watch)
+ *
+ * The SyncEngine, the journal and the exclude lists stay alive between the
+ * syncs. Where a FolderWatcher is available, its notifications let the syncs
+ * discover only the changed local paths; a full local discovery is done for
+ * the first sync, when the watcher lost changes and every fullScanInterval.
+ * Remote changes are found by polling the etag of the remote folder.
+ *
+ * On unix, SIGUSR1 requests the statistics of the recent syncs and SIGINT or
+ * SIGTERM stop the daemon after aborting the running sync.
+ *
+ * @ingroup cmd
+ */
+class WatchDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    /// How long a burst of local changes may settle before syncing
+    static const int settleMsec = 1000;
+
+    /// The number of sync runs whose statistics are kept
+    static const int keptRuns = 100;
+
+    WatchDaemon(AccountPtr account, SyncEngine *engine, SyncJournalDb *journal, const QString &remotePath);
+    ~WatchDaemon();
+
+    /// Seconds between two checks of the remote etag
+    void setPollInterval(int seconds) { _pollTimer.setInterval(seconds * 1000); }
+
+    /// Seconds between two full local discoveries, negative for never
+    void setFullScanInterval(int seconds) { _fullScanIntervalMsec = qint64(seconds) * 1000; }
+
+    /// The number of follow-up syncs started right away before waiting for changes
+    void setMaxFollowUpSyncs(int count) { _maxFollowUpSyncs = count; }
+
+    /// Starts the first sync and watching for changes
+    void start();
+
+    /// Statistics of the recent sync runs and of the daemon itself
+    QJsonObject statistics() const;
+
+    /// Whether the last sync that wasn't aborted by stop() succeeded
+    bool lastSyncSucceeded() const { return _lastSyncSucceeded; }
+
+signals:
+    void statisticsRequested();
+    void stopped();
+
+public slots:
+    /// Aborts the running sync and emits stopped() once it finished
+    void stop();
+
+private slots:
+    void slotPathChanged(const QString &path);
+    void slotLostChanges();
+    void slotPollRemote();
+    void slotEtagRetrieved(const QString &etag);
+    void slotRootEtag(const QString &etag);
+    void slotItemCompleted(const SyncFileItemPtr &item);
+    void slotSyncFinished(bool success);
+    void startSync();
+    void slotSignalReceived();
+
+private:
+    void scheduleSync(int delayMsec);
+    void installSignalHandlers();
+    bool watcherIsReliable() const;
+
+    AccountPtr _account;
+    SyncEngine *_engine;
+    SyncJournalDb *_journal;
+    QString _remotePath;
+
+    QScopedPointer<FolderWatcher> _watcher;
+    std::set<QByteArray> _localDiscoveryPaths;
+    std::set<QByteArray> _previousLocalDiscoveryPaths;
+    bool _fullLocalDiscoveryNeeded = true;
+    QElapsedTimer _timeSinceFullLocalDiscovery;
+    qint64 _fullScanIntervalMsec = 3600 * 1000;
+
+    QTimer _syncTimer;
+    QTimer _pollTimer;
+    QPointer<RequestEtagJob> _etagJob;
+    QString _lastEtag;
+
+    int _maxFollowUpSyncs = 3;
+    int _followUpSyncs = 0;
+    bool _syncRequested = false; // while a sync is running
+    bool _stopping = false;
+    bool _lastSyncSucceeded = true;
+
+    QScopedPointer<QSocketNotifier> _signalNotifier;
+
+    QElapsedTimer _uptime;
+    QJsonArray _runs;
+    int _syncCount = 0;
+    int _failedSyncCount = 0;
+    int _fullLocalDiscoveryCount = 0;
+    int _remoteChangeCount = 0;
+    int _localChangeCount = 0;
+};
+}
+
+#endif
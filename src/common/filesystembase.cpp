@@ -17,6 +17,8 @@
  */
 
 #include "filesystembase.h"
+#include "iouring.h"
+#include "performancecounters.h"
 
 #include <QDateTime>
 #include <QDir>
@@ -363,6 +365,31 @@ QString FileSystem::fileSystemForPath(const QString &path)
 
 #define BUFSIZE qint64(500 * 1024) // 500 KiB
 
+/* Passes the content of the opened file to consume, with several reads in
+ * flight if io_uring is available. Returns false on a read error. */
+static bool readContent(QFile &file, const std::function<void(const char *, qint64)> &consume)
+{
+    qint64 total = 0;
+    if (auto ring = IoUring::threadInstance()) {
+        total = ring->readFile(file.handle(), 0, -1, consume);
+        if (total < 0)
+            return false;
+    } else {
+        QByteArray buf(qMin(BUFSIZE, file.size() + 1), Qt::Uninitialized);
+        while (!file.atEnd()) {
+            const qint64 size = file.read(buf.data(), buf.size());
+            if (size < 0)
+                return false;
+            if (size == 0)
+                break;
+            consume(buf.constData(), size);
+            total += size;
+        }
+    }
+    PerformanceCounters::add(PerformanceCounters::BytesHashed, total);
+    return true;
+}
+
 static QByteArray readToCrypto( const QString& filename, QCryptographicHash::Algorithm algo )
  {
      QFile file(filename);
@@ -370,7 +397,7 @@ static QByteArray readToCrypto( const QString& filename, QCryptographicHash::Alg
      QCryptographicHash crypto( algo );
 
      if (file.open(QIODevice::ReadOnly)) {
-         if (crypto.addData(&file)) {
+         if (readContent(file, [&crypto](const char *data, qint64 size) { crypto.addData(data, int(size)); })) {
              arr = crypto.result().toHex();
          }
      }
@@ -391,17 +418,12 @@ QByteArray FileSystem::calcSha1(const QString &filename)
 QByteArray FileSystem::calcAdler32(const QString &filename)
 {
     QFile file(filename);
-    const qint64 bufSize = qMin(BUFSIZE, file.size() + 1);
-    QByteArray buf(bufSize, Qt::Uninitialized);
 
     unsigned int adler = adler32(0L, Z_NULL, 0);
     if (file.open(QIODevice::ReadOnly)) {
-        qint64 size = 0;
-        while (!file.atEnd()) {
-            size = file.read(buf.data(), bufSize);
-            if (size > 0)
-                adler = adler32(adler, (const Bytef *)buf.data(), size);
-        }
+        readContent(file, [&adler](const char *data, qint64 size) {
+            adler = adler32(adler, (const Bytef *)data, uInt(size));
+        });
     }
 
     return QByteArray::number(adler, 16);
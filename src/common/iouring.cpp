@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config_csync.h"
+#include "iouring.h"
+
+#include <QLoggingCategory>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcIoUring, "nextcloud.sync.iouring", QtInfoMsg)
+
+static std::atomic<bool> &enabledFlag()
+{
+    static std::atomic<bool> enabled(qEnvironmentVariableIsEmpty("OWNCLOUD_DISABLE_IO_URING"));
+    return enabled;
+}
+
+// Set when the kernel refused to set up a ring, so the other threads don't try again
+static std::atomic<bool> s_unsupported(false);
+
+struct IoUring::Private
+{
+#ifdef HAVE_IO_URING
+    int fd = -1;
+    void *sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void *cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe *cqes = nullptr;
+    unsigned entries = 0;
+
+    unsigned sqeTail = 0; // includes the prepared entries that are not submitted yet
+    unsigned toSubmit = 0;
+    unsigned inFlight = 0; // submitted and not popped
+
+    io_uring_sqe *nextSqe()
+    {
+        if (inFlight + toSubmit >= entries)
+            return nullptr;
+        io_uring_sqe *sqe = &sqes[sqeTail & sqMask];
+        std::memset(sqe, 0, sizeof(*sqe));
+        ++sqeTail;
+        ++toSubmit;
+        return sqe;
+    }
+
+    bool submit()
+    {
+        __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+        while (toSubmit > 0) {
+            const int ret = int(syscall(__NR_io_uring_enter, fd, toSubmit, 0, 0, nullptr, 0));
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret <= 0) {
+                // The kernel only takes entries during the syscall, the rest can be taken back
+                if (ret == 0)
+                    errno = EIO;
+                sqeTail -= toSubmit;
+                toSubmit = 0;
+                __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+                return false;
+            }
+            toSubmit -= unsigned(ret);
+            inFlight += unsigned(ret);
+        }
+        return true;
+    }
+
+    // Waits for the next completion
+    bool pop(quint64 *userData, int *result)
+    {
+        while (true) {
+            const unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe &cqe = cqes[head & cqMask];
+                *userData = cqe.user_data;
+                *result = cqe.res;
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                --inFlight;
+                return true;
+            }
+            if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                return false;
+        }
+    }
+
+    // The buffers of the requests must stay valid until they completed
+    void drain()
+    {
+        quint64 userData = 0;
+        int result = 0;
+        while (inFlight > 0) {
+            if (!pop(&userData, &result)) {
+                qCWarning(lcIoUring) << "Waiting for io_uring completions failed" << errno;
+                return;
+            }
+        }
+    }
+#endif
+};
+
+IoUring::IoUring()
+    : d(new Private)
+{
+}
+
+IoUring::~IoUring()
+{
+#ifdef HAVE_IO_URING
+    if (d->fd >= 0)
+        d->drain();
+    if (d->sqes != MAP_FAILED)
+        munmap(d->sqes, d->sqesSize);
+    if (d->cqRing != MAP_FAILED && d->cqRing != d->sqRing)
+        munmap(d->cqRing, d->cqRingSize);
+    if (d->sqRing != MAP_FAILED)
+        munmap(d->sqRing, d->sqRingSize);
+    if (d->fd >= 0)
+        close(d->fd);
+#endif
+}
+
+IoUring *IoUring::threadInstance()
+{
+#ifdef HAVE_IO_URING
+    if (!enabledFlag().load(std::memory_order_relaxed) || s_unsupported.load(std::memory_order_relaxed))
+        return nullptr;
+
+    thread_local std::unique_ptr<IoUring> ring;
+    thread_local bool setupDone = false;
+    if (!setupDone) {
+        setupDone = true;
+        std::unique_ptr<IoUring> newRing(new IoUring);
+        if (newRing->setup(64)) {
+            ring = std::move(newRing);
+        } else if (!s_unsupported.exchange(true)) {
+            qCInfo(lcIoUring) << "io_uring is not available, using plain syscalls:" << strerror(errno);
+        }
+    }
+    return ring.get();
+#else
+    return nullptr;
+#endif
+}
+
+void IoUring::setEnabled(bool enabled)
+{
+    enabledFlag().store(enabled, std::memory_order_relaxed);
+}
+
+bool IoUring::setup(unsigned int entries)
+{
+#ifdef HAVE_IO_URING
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    d->fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (d->fd < 0)
+        return false;
+
+    d->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    d->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        d->sqRingSize = d->cqRingSize = std::max(d->sqRingSize, d->cqRingSize);
+    }
+    d->sqRing = mmap(nullptr, d->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, d->fd, IORING_OFF_SQ_RING);
+    if (d->sqRing == MAP_FAILED)
+        return false;
+    d->cqRing = singleMmap ? d->sqRing
+                           : mmap(nullptr, d->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, d->fd, IORING_OFF_CQ_RING);
+    if (d->cqRing == MAP_FAILED)
+        return false;
+    d->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    d->sqes = static_cast<io_uring_sqe *>(
+        mmap(nullptr, d->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, d->fd, IORING_OFF_SQES));
+    if (d->sqes == MAP_FAILED)
+        return false;
+
+    auto sq = static_cast<char *>(d->sqRing);
+    d->sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    d->sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    d->sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    // Submission queue entry i is always in slot i
+    auto array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i)
+        array[i] = i;
+    d->sqeTail = *d->sqTail;
+
+    auto cq = static_cast<char *>(d->cqRing);
+    d->cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    d->cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    d->cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    d->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    d->entries = params.sq_entries;
+
+    // The kernel may be older than the operations we use
+    const unsigned probeOps = 256;
+    std::vector<char> probeBuffer(sizeof(io_uring_probe) + probeOps * sizeof(io_uring_probe_op), 0);
+    auto probe = reinterpret_cast<io_uring_probe *>(probeBuffer.data());
+    if (syscall(__NR_io_uring_register, d->fd, IORING_REGISTER_PROBE, probe, probeOps) < 0)
+        return false;
+    auto supported = [probe](int op) {
+        return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    };
+    if (!supported(IORING_OP_STATX) || !supported(IORING_OP_READ)) {
+        errno = ENOSYS;
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(entries);
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+bool IoUring::statxBatch(int dirFd, const char *const *names, unsigned int mask,
+    struct statx *stats, int *results, int count)
+{
+#ifdef HAVE_IO_URING
+    for (int done = 0; done < count;) {
+        const int batch = std::min(count - done, int(d->entries));
+        for (int i = done; i < done + batch; ++i) {
+            io_uring_sqe *sqe = d->nextSqe();
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirFd;
+            sqe->addr = reinterpret_cast<quintptr>(names[i]);
+            sqe->len = mask;
+            sqe->off = reinterpret_cast<quintptr>(&stats[i]);
+            sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+            sqe->user_data = quint64(i);
+        }
+        // The kernel writes into stats until the requests completed, and
+        // leftover completions would be taken for the next batch
+        auto fail = [this] {
+            const int error = errno;
+            d->drain();
+            errno = error;
+            return false;
+        };
+        if (!d->submit())
+            return fail();
+        while (d->inFlight > 0) {
+            quint64 index = 0;
+            int result = 0;
+            if (!d->pop(&index, &result))
+                return fail();
+            results[index] = result;
+        }
+        done += batch;
+    }
+    return true;
+#else
+    Q_UNUSED(dirFd);
+    Q_UNUSED(names);
+    Q_UNUSED(mask);
+    Q_UNUSED(stats);
+    Q_UNUSED(results);
+    Q_UNUSED(count);
+    return false;
+#endif
+}
+
+qint64 IoUring::readFile(int fd, qint64 offset, qint64 length,
+    const std::function<void(const char *data, qint64 size)> &consume)
+{
+#ifdef HAVE_IO_URING
+    const qint64 blockSize = 256 * 1024;
+    unsigned depth = std::min(d->entries, 8u);
+    if (length >= 0)
+        depth = unsigned(qBound<qint64>(1, (length + blockSize - 1) / blockSize, depth));
+    std::unique_ptr<char[]> buffers(new char[depth * blockSize]);
+
+    // The reads are numbered, read n uses slot n % depth
+    struct Slot
+    {
+        qint64 offset = 0;
+        qint64 length = 0;
+        int result = 0;
+        bool done = false;
+    };
+    std::vector<Slot> slots(depth);
+    quint64 head = 0; // the next read to be consumed
+    quint64 tail = 0; // the next read to be submitted
+    qint64 nextOffset = offset;
+    qint64 total = 0;
+    int error = 0;
+
+    auto blockLength = [&](qint64 from) {
+        return length < 0 ? blockSize : std::min(blockSize, offset + length - from);
+    };
+    auto restartAt = [&](qint64 from) {
+        // The reads after head are for the wrong offsets now, drop them
+        d->drain();
+        tail = head;
+        nextOffset = from;
+    };
+
+    while (true) {
+        while (tail - head < depth && blockLength(nextOffset) > 0) {
+            Slot &slot = slots[tail % depth];
+            slot = Slot();
+            slot.offset = nextOffset;
+            slot.length = blockLength(nextOffset);
+            io_uring_sqe *sqe = d->nextSqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<quintptr>(buffers.get() + (tail % depth) * blockSize);
+            sqe->len = unsigned(slot.length);
+            sqe->off = quint64(slot.offset);
+            sqe->user_data = tail;
+            nextOffset += slot.length;
+            ++tail;
+        }
+        if (head == tail)
+            break;
+        if (!d->submit()) {
+            error = errno;
+            break;
+        }
+
+        Slot &slot = slots[head % depth];
+        while (!slot.done) {
+            quint64 number = 0;
+            int result = 0;
+            if (!d->pop(&number, &result)) {
+                error = errno;
+                break;
+            }
+            slots[number % depth].result = result;
+            slots[number % depth].done = true;
+        }
+        if (error)
+            break;
+
+        if (slot.result == -EINTR || slot.result == -EAGAIN) {
+            restartAt(slot.offset);
+            continue;
+        }
+        if (slot.result < 0) {
+            error = -slot.result;
+            break;
+        }
+        if (slot.result == 0) // end of file
+            break;
+
+        consume(buffers.get() + (head % depth) * blockSize, slot.result);
+        total += slot.result;
+        ++head;
+        if (slot.result < slot.length)
+            restartAt(slot.offset + slot.result);
+    }
+
+    d->drain();
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return total;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+    Q_UNUSED(consume);
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+} // namespace OCC
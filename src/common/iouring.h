@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <QtGlobal>
+
+#include <functional>
+#include <memory>
+
+#include "ocsynclib.h"
+
+struct statx;
+
+namespace OCC {
+
+/**
+ * @brief Batched local I/O with io_uring
+ *
+ * Keeps many stat and read requests in flight with a single syscall
+ * instead of doing one blocking syscall per request.
+ *
+ * It is only available on Linux when the running kernel supports the
+ * operations used, threadInstance() returns nullptr everywhere else and
+ * the callers use the plain syscalls. Setting the environment variable
+ * OWNCLOUD_DISABLE_IO_URING disables it as well.
+ *
+ * @ingroup libcsync
+ */
+class OCSYNC_EXPORT IoUring
+{
+public:
+    ~IoUring();
+
+    /**
+     * The ring of the calling thread, created on first use.
+     *
+     * Returns nullptr if io_uring can't be used. The ring must only be used
+     * by the thread that got it.
+     */
+    static IoUring *threadInstance();
+
+    /// Allows switching io_uring off and on at runtime, for tests and benchmarks
+    static void setEnabled(bool enabled);
+
+    /**
+     * statx()es the names relative to dirFd, not following symlinks.
+     *
+     * results[i] is set to 0 on success or to the negative errno of names[i].
+     * Returns false if the requests couldn't be submitted, the results are
+     * undefined then.
+     */
+    bool statxBatch(int dirFd, const char *const *names, unsigned int mask,
+        struct statx *stats, int *results, int count);
+
+    /**
+     * Reads length bytes starting at offset from fd, or up to the end of
+     * the file if length is negative, with several reads in flight.
+     *
+     * The data is passed to consume in file order. Returns the number of
+     * bytes read, or -1 with errno set.
+     */
+    qint64 readFile(int fd, qint64 offset, qint64 length,
+        const std::function<void(const char *data, qint64 size)> &consume);
+
+private:
+    IoUring();
+    bool setup(unsigned int entries);
+
+    struct Private;
+    std::unique_ptr<Private> d;
+};
+
+} // namespace OCC
@@ -26,6 +26,7 @@
 #include "ownsql.h"
 #include "common/utility.h"
 #include "common/asserts.h"
+#include "common/performancecounters.h"
 #include <sqlite3.h>
 
 #define SQLITE_SLEEP_TIME_USEC 100000
@@ -301,6 +302,7 @@ bool SqlQuery::exec()
         qCWarning(lcSql) << "Can't exec query, statement unprepared.";
         return false;
     }
+    PerformanceCounters::add(PerformanceCounters::SqlQueries);
 
     // Don't do anything for selects, that is how we use the lib :-|
     if (!isSelect() && !isPragma()) {
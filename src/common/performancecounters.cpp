@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "performancecounters.h"
+
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QtMath>
+
+namespace OCC {
+namespace PerformanceCounters {
+
+static QAtomicInteger<qint64> s_counters[CounterCount];
+
+static QMutex s_latencyMutex;
+static QMap<QByteArray, LatencyHistogram> s_latencies;
+
+void add(Counter counter, qint64 amount)
+{
+    s_counters[counter].fetchAndAddRelaxed(amount);
+}
+
+qint64 value(Counter counter)
+{
+    return s_counters[counter].load();
+}
+
+const char *name(Counter counter)
+{
+    switch (counter) {
+    case SqlQueries:
+        return "sqlQueries";
+    case PropfindRequests:
+        return "propfindRequests";
+    case BytesHashed:
+        return "bytesHashed";
+    case StatCalls:
+        return "statCalls";
+    case CounterCount:
+        break;
+    }
+    return "";
+}
+
+void LatencyHistogram::add(qint64 msecs)
+{
+    msecs = qMax<qint64>(msecs, 0);
+    int bucket = 0;
+    for (qint64 rest = msecs; rest > 0 && bucket < bucketCount - 1; rest >>= 1)
+        ++bucket;
+    ++buckets[bucket];
+    ++count;
+    totalMsecs += msecs;
+}
+
+LatencyHistogram LatencyHistogram::minus(const LatencyHistogram &base) const
+{
+    LatencyHistogram result = *this;
+    for (int i = 0; i < bucketCount; ++i)
+        result.buckets[i] -= base.buckets[i];
+    result.count -= base.count;
+    result.totalMsecs -= base.totalMsecs;
+    return result;
+}
+
+qint64 LatencyHistogram::quantileUpperBound(double quantile) const
+{
+    const qint64 wanted = qCeil(quantile * count);
+    qint64 seen = 0;
+    for (int i = 0; i < bucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= wanted && seen > 0)
+            return qint64(1) << i;
+    }
+    return 0;
+}
+
+void addJobLatency(const QByteArray &jobType, qint64 msecs)
+{
+    QMutexLocker lock(&s_latencyMutex);
+    s_latencies[jobType].add(msecs);
+}
+
+QMap<QByteArray, LatencyHistogram> jobLatencies()
+{
+    QMutexLocker lock(&s_latencyMutex);
+    return s_latencies;
+}
+
+} // namespace PerformanceCounters
+} // namespace OCC
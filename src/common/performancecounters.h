@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QMap>
+#include <QVector>
+
+#include "ocsynclib.h"
+
+namespace OCC {
+
+/**
+ * @brief Process wide counters for performance instrumentation
+ *
+ * The values only ever grow and may be updated from any thread. Consumers
+ * like SyncStatistics look at the difference between two snapshots.
+ *
+ * @ingroup libsync
+ */
+namespace PerformanceCounters {
+
+    enum Counter {
+        SqlQueries,
+        PropfindRequests,
+        BytesHashed,
+        StatCalls,
+
+        CounterCount
+    };
+
+    OCSYNC_EXPORT void add(Counter counter, qint64 amount = 1);
+    OCSYNC_EXPORT qint64 value(Counter counter);
+
+    /// Name of the counter as used in the json output
+    OCSYNC_EXPORT const char *name(Counter counter);
+
+    /**
+     * Latency distribution of one kind of job.
+     *
+     * Bucket i counts the durations d with 2^(i-1) <= d < 2^i milliseconds,
+     * bucket 0 counts durations below one millisecond. The last bucket is open ended.
+     */
+    struct OCSYNC_EXPORT LatencyHistogram
+    {
+        static const int bucketCount = 20;
+
+        void add(qint64 msecs);
+        /// Returns the distribution of the jobs added to this but not to \a base
+        LatencyHistogram minus(const LatencyHistogram &base) const;
+        /// Upper bound in milliseconds of the bucket the requested quantile (0..1) falls into
+        qint64 quantileUpperBound(double quantile) const;
+
+        QVector<qint64> buckets = QVector<qint64>(bucketCount, 0);
+        qint64 count = 0;
+        qint64 totalMsecs = 0;
+    };
+
+    /// Records the duration of a finished job of the given type (usually the class name)
+    OCSYNC_EXPORT void addJobLatency(const QByteArray &jobType, qint64 msecs);
+    OCSYNC_EXPORT QMap<QByteArray, LatencyHistogram> jobLatencies();
+}
+
+} // namespace OCC
@@ -25,6 +25,8 @@
 #include <QDir>
 #include <QStandardPaths>
 #include <sqlite3.h>
+#include <algorithm>
+#include <map>
 
 #include "common/syncjournaldb.h"
 #include "version.h"
@@ -471,6 +473,22 @@ bool SyncJournalDb::checkConnect()
         return sqlFail("Create table datafingerprint", createQuery);
     }
 
+    // create the synctoken table.
+    createQuery.prepare("CREATE TABLE IF NOT EXISTS synctoken("
+                        "token TEXT UNIQUE"
+                        ");");
+    if (!createQuery.exec()) {
+        return sqlFail("Create table synctoken", createQuery);
+    }
+
+    // create the excludesfingerprint table.
+    createQuery.prepare("CREATE TABLE IF NOT EXISTS excludesfingerprint("
+                        "fingerprint TEXT UNIQUE"
+                        ");");
+    if (!createQuery.exec()) {
+        return sqlFail("Create table excludesfingerprint", createQuery);
+    }
+
     // create the conflicts table.
     createQuery.prepare("CREATE TABLE IF NOT EXISTS conflicts("
                         "path TEXT PRIMARY KEY,"
@@ -541,6 +559,12 @@ bool SyncJournalDb::checkConnect()
             if (!createQuery.exec()) {
                 return sqlFail("Update version", createQuery);
             }
+
+            // The built-in excludes may differ between versions
+            createQuery.prepare("DELETE FROM excludesfingerprint;");
+            if (!createQuery.exec()) {
+                return sqlFail("Reset excludesfingerprint", createQuery);
+            }
         }
     }
 
@@ -685,6 +709,16 @@ bool SyncJournalDb::updateMetadataTableStructure()
         commitInternal("update database structure: add path index");
     }
 
+    if (true) {
+        SqlQuery query(_db);
+        query.prepare("CREATE INDEX IF NOT EXISTS metadata_content_checksum ON metadata(contentChecksum);");
+        if (!query.exec()) {
+            sqlFail("updateMetadataTableStructure: create index contentChecksum", query);
+            re = false;
+        }
+        commitInternal("update database structure: add contentChecksum index");
+    }
+
     if (columns.indexOf("ignoredChildrenRemote") == -1) {
         SqlQuery query(_db);
         query.prepare("ALTER TABLE metadata ADD COLUMN ignoredChildrenRemote INT;");
@@ -1071,6 +1105,37 @@ bool SyncJournalDb::getFileRecordsByFileId(const QByteArray &fileId, const std::
     return true;
 }
 
+bool SyncJournalDb::getFileRecordsByChecksum(const QByteArray &checksumHeader, qint64 size, const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    QMutexLocker locker(&_mutex);
+
+    QByteArray checksumType, checksum;
+    if (!parseChecksumHeader(checksumHeader, &checksumType, &checksum) || checksum.isEmpty() || _metadataTableIsEmpty)
+        return true; // no error, yet nothing found
+
+    if (!checkConnect())
+        return false;
+
+    if (!_getFileRecordQueryByChecksum.initOrReset(QByteArrayLiteral(GET_FILE_RECORD_QUERY
+            " WHERE contentChecksum=?1 AND contentchecksumtype.name=?2 AND filesize=?3"), _db))
+        return false;
+
+    _getFileRecordQueryByChecksum.bindValue(1, checksum);
+    _getFileRecordQueryByChecksum.bindValue(2, checksumType);
+    _getFileRecordQueryByChecksum.bindValue(3, size);
+
+    if (!_getFileRecordQueryByChecksum.exec())
+        return false;
+
+    while (_getFileRecordQueryByChecksum.next()) {
+        SyncJournalFileRecord rec;
+        fillFileRecordFromGetQuery(rec, _getFileRecordQueryByChecksum);
+        rowCallback(rec);
+    }
+
+    return true;
+}
+
 bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback)
 {
     QMutexLocker locker(&_mutex);
@@ -1123,6 +1188,132 @@ bool SyncJournalDb::getFilesBelowPath(const QByteArray &path, const std::functio
     return true;
 }
 
+bool SyncJournalDb::getFilesBelowPathPruned(const QByteArray &path, bool skipInvalidEtags, const QVector<QByteArray> &skipPaths,
+    const std::function<void(const SyncJournalFileRecord &)> &rowCallback)
+{
+    QMutexLocker locker(&_mutex);
+
+    if (_metadataTableIsEmpty)
+        return true; // no error, yet nothing found
+
+    if (!checkConnect())
+        return false;
+
+    if (skipPaths.size() == 1 && skipPaths.first() == "/")
+        return true; // everything is skipped
+    for (const auto &skipPath : skipPaths) {
+        if ((path + '/').startsWith(skipPath))
+            return true;
+    }
+
+    // The rows are read in path order through the path index. All entries below
+    // a directory d are in the range [d/, d0), a skipped subtree is left out by
+    // starting a new range behind it once the reading gets there. Paths are
+    // UTF-8, which never contains the byte 0xff, so "\xff" is above all of them.
+    QByteArray from = path.isEmpty() ? QByteArray() : path + '/';
+    const QByteArray to = path.isEmpty() ? QByteArray("\xff") : path + '0';
+
+    // The skipped ranges that were not reached yet, by their start
+    std::map<QByteArray, QByteArray> skipRanges;
+    const auto skipBelow = [&skipRanges](const QByteArray &dir) {
+        skipRanges.emplace(dir + '/', dir + '0');
+    };
+    for (const auto &skipPath : skipPaths) {
+        if (skipPath.startsWith(from))
+            skipBelow(skipPath.left(skipPath.size() - 1));
+    }
+
+    bool restart = true;
+    while (restart) {
+        restart = false;
+        if (!_getFilesInRangeQuery.initOrReset(QByteArrayLiteral(
+                GET_FILE_RECORD_QUERY " WHERE path >= ?1 AND path < ?2 ORDER BY path ASC"), _db)) {
+            return false;
+        }
+        _getFilesInRangeQuery.bindValue(1, from);
+        _getFilesInRangeQuery.bindValue(2, to);
+        if (!_getFilesInRangeQuery.exec())
+            return false;
+
+        while (_getFilesInRangeQuery.next()) {
+            const QByteArray rowPath = _getFilesInRangeQuery.baValue(0);
+
+            // Reached a skipped range: continue behind it
+            while (!skipRanges.empty() && rowPath >= skipRanges.begin()->first) {
+                const auto range = skipRanges.begin();
+                if (rowPath < range->second) {
+                    from = range->second;
+                    restart = true;
+                }
+                skipRanges.erase(range);
+                if (restart)
+                    break;
+            }
+            if (restart)
+                break;
+
+            if (!skipPaths.isEmpty() && std::binary_search(skipPaths.begin(), skipPaths.end(), rowPath + '/'))
+                continue;
+
+            SyncJournalFileRecord rec;
+            fillFileRecordFromGetQuery(rec, _getFilesInRangeQuery);
+            if (skipInvalidEtags && rec._etag == "_invalid_") {
+                qCDebug(lcDb) << "Skipping" << rec._path << "and its contents, the etag is invalid";
+                skipBelow(rec._path);
+                continue;
+            }
+            rowCallback(rec);
+        }
+    }
+
+    return true;
+}
+
+/* Deletes the given phashes from the metadata table in batches of bounded size.
+ *
+ * A single statement with a fixed number of placeholders is prepared and reused for
+ * all full batches, only the trailing partial batch needs its own statement.
+ */
+static bool deleteMetadataByPhashBatched(SqlDatabase &db, const QVector<qint64> &phashes)
+{
+    static const int batchSize = 500;
+
+    auto makeSql = [](int count) {
+        QByteArray sql = "DELETE FROM metadata WHERE phash IN (";
+        for (int i = 1; i <= count; ++i) {
+            if (i > 1)
+                sql += ',';
+            sql += '?' + QByteArray::number(i);
+        }
+        sql += ')';
+        return sql;
+    };
+
+    SqlQuery fullBatchQuery(db);
+    if (phashes.size() >= batchSize && fullBatchQuery.prepare(makeSql(batchSize)) != SQLITE_OK)
+        return false;
+
+    int pos = 0;
+    while (pos < phashes.size()) {
+        const int count = qMin(batchSize, phashes.size() - pos);
+        SqlQuery partialBatchQuery(db);
+        SqlQuery *query = &fullBatchQuery;
+        if (count < batchSize) {
+            if (partialBatchQuery.prepare(makeSql(count)) != SQLITE_OK)
+                return false;
+            query = &partialBatchQuery;
+        } else {
+            query->reset_and_clear_bindings();
+        }
+        for (int i = 0; i < count; ++i)
+            query->bindValue(i + 1, phashes.at(pos + i));
+        if (!query->exec())
+            return false;
+        pos += count;
+    }
+    return true;
+}
+
 bool SyncJournalDb::postSyncCleanup(const QSet<QString> &filepathsToKeep,
     const QSet<QString> &prefixesToKeep)
 {
@@ -1132,37 +1323,63 @@ bool SyncJournalDb::postSyncCleanup(const QSet<QString> &filepathsToKeep,
         return false;
     }
 
+    // The metadata rows are streamed in path order (binary collation, i.e. memcmp on
+    // the utf8 bytes) and merged against sorted copies of the keep sets, so every row
+    // costs amortized O(1) instead of a hash lookup plus a scan over all prefixes.
+    QVector<QByteArray> keep;
+    keep.reserve(filepathsToKeep.size());
+    for (const auto &file : filepathsToKeep)
+        keep.append(file.toUtf8());
+    std::sort(keep.begin(), keep.end());
+
+    // Prefixes that are covered by a shorter prefix are redundant. Dropping them leaves
+    // disjoint ranges, so only the last prefix that sorts before a path can match it.
+    QVector<QByteArray> prefixes;
+    {
+        QVector<QByteArray> sortedPrefixes;
+        sortedPrefixes.reserve(prefixesToKeep.size());
+        for (const auto &prefix : prefixesToKeep)
+            sortedPrefixes.append(prefix.toUtf8());
+        std::sort(sortedPrefixes.begin(), sortedPrefixes.end());
+        for (const auto &prefix : sortedPrefixes) {
+            if (prefixes.isEmpty() || !prefix.startsWith(prefixes.last()))
+                prefixes.append(prefix);
+        }
+    }
+
     SqlQuery query(_db);
-    query.prepare("SELECT phash, path FROM metadata order by path");
+    query.prepare("SELECT phash, path FROM metadata ORDER BY path");
 
     if (!query.exec()) {
         return false;
     }
 
-    QByteArrayList superfluousItems;
+    QVector<qint64> superfluousItems;
+    int keepPos = 0;
+    int prefixPos = -1;
 
     while (query.next()) {
-        const QString file = query.baValue(1);
-        bool keep = filepathsToKeep.contains(file);
-        if (!keep) {
-            foreach (const QString &prefix, prefixesToKeep) {
-                if (file.startsWith(prefix)) {
-                    keep = true;
-                    break;
-                }
-            }
+        const QByteArray file = query.baValue(1);
+
+        while (keepPos < keep.size() && keep.at(keepPos) < file)
+            ++keepPos;
+        bool keepFile = keepPos < keep.size() && keep.at(keepPos) == file;
+
+        if (!keepFile) {
+            while (prefixPos + 1 < prefixes.size() && prefixes.at(prefixPos + 1) <= file)
+                ++prefixPos;
+            keepFile = prefixPos >= 0 && file.startsWith(prefixes.at(prefixPos));
         }
-        if (!keep) {
-            superfluousItems.append(query.baValue(0));
+
+        if (!keepFile) {
+            qCDebug(lcDb) << "Sync Journal cleanup for" << file;
+            superfluousItems.append(static_cast<qint64>(query.int64Value(0)));
         }
     }
 
-    if (superfluousItems.count()) {
-        QByteArray sql = "DELETE FROM metadata WHERE phash in (" + superfluousItems.join(",") + ")";
-        qCInfo(lcDb) << "Sync Journal cleanup for" << superfluousItems;
-        SqlQuery delQuery(_db);
-        delQuery.prepare(sql);
-        if (!delQuery.exec()) {
+    if (!superfluousItems.isEmpty()) {
+        qCInfo(lcDb) << "Sync Journal cleanup removes" << superfluousItems.size() << "entries";
+        if (!deleteMetadataByPhashBatched(_db, superfluousItems)) {
             return false;
         }
     }
@@ -1847,6 +2064,42 @@ void SyncJournalDb::forceRemoteDiscoveryNextSyncLocked()
     deleteRemoteFolderEtagsQuery.exec();
 }
 
+bool SyncJournalDb::hasInvalidatedEtags()
+{
+    QMutexLocker locker(&_mutex);
+
+    if (!checkConnect()) {
+        return true;
+    }
+
+    // Note: CSYNC_FTW_TYPE_DIR == 2
+    SqlQuery query(_db);
+    if (query.prepare("SELECT 1 FROM metadata WHERE md5='_invalid_' AND type=2 LIMIT 1;") != SQLITE_OK
+        || !query.exec()) {
+        return true;
+    }
+    return query.next();
+}
+
+bool SyncJournalDb::hasErrorBlacklistEntriesToRetry()
+{
+    QMutexLocker locker(&_mutex);
+
+    if (!checkConnect()) {
+        return true;
+    }
+
+    SqlQuery query(_db);
+    if (query.prepare("SELECT 1 FROM blacklist WHERE lastTryTime + ignoreDuration <= ?1 LIMIT 1;") != SQLITE_OK) {
+        return true;
+    }
+    query.bindValue(1, Utility::qDateTimeToTime_t(QDateTime::currentDateTimeUtc()));
+    if (!query.exec()) {
+        return true;
+    }
+    return query.next();
+}
+
 
 QByteArray SyncJournalDb::getChecksumType(int checksumTypeId)
 {
@@ -1938,6 +2191,74 @@ void SyncJournalDb::setDataFingerprint(const QByteArray &dataFingerprint)
     _setDataFingerprintQuery2.exec();
 }
 
+QByteArray SyncJournalDb::syncToken()
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect()) {
+        return QByteArray();
+    }
+
+    SqlQuery query(_db);
+    if (query.prepare("SELECT token FROM synctoken;") != SQLITE_OK
+        || !query.exec() || !query.next()) {
+        return QByteArray();
+    }
+    return query.baValue(0);
+}
+
+QByteArray SyncJournalDb::excludesFingerprint()
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect()) {
+        return QByteArray();
+    }
+
+    SqlQuery query(_db);
+    if (query.prepare("SELECT fingerprint FROM excludesfingerprint;") != SQLITE_OK
+        || !query.exec() || !query.next()) {
+        return QByteArray();
+    }
+    return query.baValue(0);
+}
+
+void SyncJournalDb::setExcludesFingerprint(const QByteArray &fingerprint)
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect()) {
+        return;
+    }
+
+    SqlQuery deleteQuery(_db);
+    deleteQuery.prepare("DELETE FROM excludesfingerprint;");
+    deleteQuery.exec();
+
+    if (fingerprint.isEmpty())
+        return;
+    SqlQuery insertQuery(_db);
+    insertQuery.prepare("INSERT INTO excludesfingerprint (fingerprint) VALUES (?1);");
+    insertQuery.bindValue(1, fingerprint);
+    insertQuery.exec();
+}
+
+void SyncJournalDb::setSyncToken(const QByteArray &syncToken)
+{
+    QMutexLocker locker(&_mutex);
+    if (!checkConnect()) {
+        return;
+    }
+
+    SqlQuery deleteQuery(_db);
+    deleteQuery.prepare("DELETE FROM synctoken;");
+    deleteQuery.exec();
+
+    if (syncToken.isEmpty())
+        return;
+    SqlQuery insertQuery(_db);
+    insertQuery.prepare("INSERT INTO synctoken (token) VALUES (?1);");
+    insertQuery.bindValue(1, syncToken);
+    insertQuery.exec();
+}
+
 void SyncJournalDb::setConflictRecord(const ConflictRecord &record)
 {
     QMutexLocker locker(&_mutex);
@@ -2052,6 +2373,12 @@ bool SyncJournalDb::isConnected()
     return checkConnect();
 }
 
+bool SyncJournalDb::isMetadataTableEmpty()
+{
+    QMutexLocker lock(&_mutex);
+    return checkConnect() && _metadataTableIsEmpty;
+}
+
 bool operator==(const SyncJournalDb::DownloadInfo &lhs,
     const SyncJournalDb::DownloadInfo &rhs)
 {
@@ -59,7 +59,19 @@ public:
     bool getFileRecordByE2eMangledName(const QString &mangledName, SyncJournalFileRecord *rec);
     bool getFileRecordByInode(quint64 inode, SyncJournalFileRecord *rec);
     bool getFileRecordsByFileId(const QByteArray &fileId, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
+    /// Records with the given content checksum header ("type:checksum") and size
+    bool getFileRecordsByChecksum(const QByteArray &checksumHeader, qint64 size, const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
     bool getFilesBelowPath(const QByteArray &path, const std::function<void(const SyncJournalFileRecord&)> &rowCallback);
+    /**
+     * Like getFilesBelowPath(), but leaves out whole subtrees without reading them.
+     *
+     * Left out are the entries with the etag _invalid_ if skipInvalidEtags is set
+     * and the entries at or below the paths in skipPaths, which must be sorted and
+     * end with '/', each together with everything below it. The records are passed
+     * in path order, so a directory always comes before its contents.
+     */
+    bool getFilesBelowPathPruned(const QByteArray &path, bool skipInvalidEtags, const QVector<QByteArray> &skipPaths,
+        const std::function<void(const SyncJournalFileRecord &)> &rowCallback);
     bool setFileRecord(const SyncJournalFileRecord &record);
 
     /// Like setFileRecord, but preserves checksums
@@ -183,6 +195,21 @@ public:
      */
     void forceRemoteDiscoveryNextSync();
 
+    /**
+     * Returns true if some directory has the _invalid_ etag (or on error).
+     *
+     * That is the case while a remote rediscovery of these directories is pending,
+     * see avoidReadFromDbOnNextSync().
+     */
+    bool hasInvalidatedEtags();
+
+    /**
+     * Returns whether an error blacklist entry reached its retry time.
+     *
+     * Also returns true if the database can't be read.
+     */
+    bool hasErrorBlacklistEntriesToRetry();
+
     bool postSyncCleanup(const QSet<QString> &filepathsToKeep,
         const QSet<QString> &prefixesToKeep);
 
@@ -210,6 +237,20 @@ public:
     void setDataFingerprint(const QByteArray &dataFingerprint);
     QByteArray dataFingerprint();
 
+    /**
+     * The WebDAV sync-token (RFC 6578) of the remote folder the database
+     * state corresponds to. Empty if unknown.
+     */
+    void setSyncToken(const QByteArray &syncToken);
+    QByteArray syncToken();
+
+    /**
+     * A fingerprint of the exclude patterns the database state was last
+     * synced with, see ExcludedFiles::fingerprint(). Empty if unknown.
+     */
+    void setExcludesFingerprint(const QByteArray &fingerprint);
+    QByteArray excludesFingerprint();
+
 
     // Conflict record functions
 
@@ -233,6 +274,9 @@ public:
      */
     void clearFileTable();
 
+    /// Whether there are no file records at all, like before the first sync
+    bool isMetadataTableEmpty();
+
 private:
     int getFileRecordCount();
     bool updateDatabaseStructure();
@@ -263,7 +307,9 @@ private:
     SqlQuery _getFileRecordQueryByMangledName;
     SqlQuery _getFileRecordQueryByInode;
     SqlQuery _getFileRecordQueryByFileId;
+    SqlQuery _getFileRecordQueryByChecksum;
     SqlQuery _getFilesBelowPathQuery;
+    SqlQuery _getFilesInRangeQuery;
     SqlQuery _getAllFilesQuery;
     SqlQuery _setFileRecordQuery;
     SqlQuery _setFileRecordChecksumQuery;
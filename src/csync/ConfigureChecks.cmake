@@ -17,6 +17,13 @@ set(SOURCEDIR ${CMAKE_CURRENT_SOURCE_DIR})
 # HEADER FILES
 check_include_file(argp.h HAVE_ARGP_H)
 
+# io_uring with the operations OCC::IoUring uses (Linux 5.6)
+check_cxx_source_compiles("
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+int main() { return IORING_OP_STATX + IORING_OP_READ + IORING_REGISTER_PROBE + __NR_io_uring_register; }
+" HAVE_IO_URING)
+
 # FUNCTIONS
 if (NOT LINUX)
     # librt
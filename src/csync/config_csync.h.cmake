@@ -7,6 +7,7 @@
 #cmakedefine SOURCEDIR "${SOURCEDIR}"
 
 #cmakedefine HAVE_ARGP_H 1
+#cmakedefine HAVE_IO_URING 1
 
 #cmakedefine HAVE_TIMEGM 1
 #cmakedefine HAVE_STRERROR_R 1
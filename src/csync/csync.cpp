@@ -96,7 +96,8 @@ int csync_update(CSYNC *ctx) {
     return rc;
   }
 
-  qCInfo(lcCSync) << "Update detection for local replica took" << timer.elapsed() / 1000.
+  ctx->local_discovery_msecs = timer.elapsed();
+  qCInfo(lcCSync) << "Update detection for local replica took" << ctx->local_discovery_msecs / 1000.
                   << "seconds walking" << ctx->local.files.size() << "files";
   csync_memstat_check();
 
@@ -106,7 +107,13 @@ int csync_update(CSYNC *ctx) {
 
   qCInfo(lcCSync, "## Starting remote discovery ##");
 
-  rc = csync_ftw(ctx, "", csync_walker, MAX_DEPTH);
+  rc = 0;
+  if (ctx->callbacks.remote_delta_hook) {
+      rc = csync_update_remote_from_delta(ctx);
+  }
+  if (rc == 0) {
+      rc = csync_ftw(ctx, "", csync_walker, MAX_DEPTH);
+  }
   if (rc < 0) {
       if(ctx->status_code == CSYNC_STATUS_OK) {
           ctx->status_code = csync_errno_to_status(errno, CSYNC_STATUS_UPDATE_ERROR);
@@ -115,7 +122,8 @@ int csync_update(CSYNC *ctx) {
   }
 
 
-  qCInfo(lcCSync) << "Update detection for remote replica took" << timer.elapsed() / 1000.
+  ctx->remote_discovery_msecs = timer.elapsed();
+  qCInfo(lcCSync) << "Update detection for remote replica took" << ctx->remote_discovery_msecs / 1000.
                   << "seconds walking" << ctx->remote.files.size() << "files";
   csync_memstat_check();
 
@@ -246,6 +254,9 @@ int csync_s::reinitialize() {
   status = CSYNC_STATUS_INIT;
   SAFE_FREE(error_string);
 
+  local_discovery_msecs = 0;
+  remote_discovery_msecs = 0;
+
   rc = 0;
   return rc;
 }
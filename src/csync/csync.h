@@ -42,6 +42,7 @@
 #include <config_csync.h>
 #include <functional>
 #include <memory>
+#include <vector>
 #include <QByteArray>
 #include "common/remotepermissions.h"
 
@@ -212,6 +213,24 @@ typedef void (*csync_vio_closedir_hook) (csync_vio_handle_t *dhhandle,
 typedef QByteArray (*csync_checksum_hook)(
     const QByteArray &path, const QByteArray &otherChecksumHeader, void *userdata);
 
+/**
+ * The remote changes since the previous sync, as far as the server can tell.
+ *
+ * Paths are relative to the remote root of the sync folder.
+ */
+struct csync_remote_delta_s {
+  /* Input: false if the remote tree will be walked anyway and only the
+   * state for the next sync should be recorded. */
+  bool wanted = false;
+  /* Output: true if changed and deleted are complete */
+  bool available = false;
+  std::vector<std::unique_ptr<csync_file_stat_t>> changed;
+  std::vector<QByteArray> deleted;
+};
+
+/* Fill \a delta with the remote changes since the last sync, see csync_remote_delta_s */
+typedef void (*csync_remote_delta_hook)(csync_remote_delta_s *delta, void *userdata);
+
 /**
  * @brief Update detection
  *
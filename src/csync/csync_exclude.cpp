@@ -36,6 +36,7 @@
 
 #include <QString>
 #include <QFileInfo>
+#include <QCryptographicHash>
 
 
 /** Expands C-like escape sequences (in place)
@@ -277,6 +278,7 @@ void ExcludedFiles::addInTreeExcludeFilePath(const QString &path)
 void ExcludedFiles::setExcludeConflictFiles(bool onoff)
 {
     _excludeConflictFiles = onoff;
+    _fingerprint.clear();
 }
 
 void ExcludedFiles::addManualExclude(const QByteArray &expr)
@@ -296,6 +298,7 @@ void ExcludedFiles::addManualExclude(const QByteArray &expr, const QByteArray &b
     auto key = basePath;
     _manualExcludes[key].append(expr);
     _allExcludes[key].append(expr);
+    _fingerprint.clear();
     prepare(key);
 }
 
@@ -308,6 +311,7 @@ void ExcludedFiles::clearManualExcludes()
 void ExcludedFiles::setWildcardsMatchSlash(bool onoff)
 {
     _wildcardsMatchSlash = onoff;
+    _fingerprint.clear();
     prepare();
 }
 
@@ -324,6 +328,7 @@ bool ExcludedFiles::loadExcludeFile(const QByteArray & basePath, const QString &
         csync_exclude_expand_escapes(line);
         _allExcludes[basePath].append(line);
     }
+    _fingerprint.clear();
 
     // nothing to prepare if the user decided to not exclude anything
     if(_allExcludes.size())
@@ -335,6 +340,7 @@ bool ExcludedFiles::loadExcludeFile(const QByteArray & basePath, const QString &
 bool ExcludedFiles::reloadExcludeFiles()
 {
     _allExcludes.clear();
+    _fingerprint.clear();
     // clear all regex
     _bnameTraversalRegexFile.clear();
     _bnameTraversalRegexDir.clear();
@@ -525,6 +531,27 @@ auto ExcludedFiles::csyncTraversalMatchFun()
     return [this](const char *path, ItemType filetype) { return this->traversalPatternMatch(path, filetype); };
 }
 
+QByteArray ExcludedFiles::fingerprint() const
+{
+    if (!_fingerprint.isEmpty())
+        return _fingerprint;
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(_excludeConflictFiles ? "c" : "-", 1);
+    hash.addData(_wildcardsMatchSlash ? "w" : "-", 1);
+    for (auto it = _allExcludes.cbegin(); it != _allExcludes.cend(); ++it) {
+        hash.addData(it.key());
+        hash.addData("\n", 1);
+        for (const auto &pattern : it.value()) {
+            hash.addData(pattern);
+            hash.addData("\n", 1);
+        }
+        hash.addData("\0", 1);
+    }
+    _fingerprint = hash.result().toHex();
+    return _fingerprint;
+}
+
 /**
  * On linux we used to use fnmatch with FNM_PATHNAME, but the windows function we used
  * didn't have that behavior. wildcardsMatchSlash can be used to control which behavior
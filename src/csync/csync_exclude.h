@@ -126,6 +126,14 @@ public:
     auto csyncTraversalMatchFun()
         -> std::function<CSYNC_EXCLUDE_TYPE(const char *path, ItemType filetype)>;
 
+    /**
+     * A hash of the active exclude patterns and options.
+     *
+     * If it is the same as during an earlier sync, nothing can have become
+     * excluded since then.
+     */
+    QByteArray fingerprint() const;
+
 public slots:
     /**
      * Reloads the exclude patterns from the registered paths.
@@ -248,6 +256,9 @@ private:
      */
     bool _wildcardsMatchSlash = false;
 
+    /// see fingerprint(), empty when the patterns changed since it was computed
+    mutable QByteArray _fingerprint;
+
     friend class ExcludedFilesTest;
 };
 
@@ -120,17 +120,6 @@ struct OCSYNC_EXPORT csync_s {
           auto it = find(key);
           return it != end() ? it->second.get() : nullptr;
       }
-      csync_file_stat_t *findFileMangledName(const ByteArrayRef &key) const {
-          auto it = begin();
-          while (it != end()) {
-              csync_file_stat_t *fs = it->second.get();
-              if (fs->e2eMangledName == key) {
-                  return fs;
-              }
-              ++it;
-          }
-          return nullptr;
-      }
   };
 
   struct {
@@ -147,6 +136,8 @@ struct OCSYNC_EXPORT csync_s {
       csync_vio_opendir_hook remote_opendir_hook = nullptr;
       csync_vio_readdir_hook remote_readdir_hook = nullptr;
       csync_vio_closedir_hook remote_closedir_hook = nullptr;
+      /* optional, if set the remote tree may be built from the db and the delta (uses vio_userdata) */
+      csync_remote_delta_hook remote_delta_hook = nullptr;
       void *vio_userdata = nullptr;
 
       /* hook for comparing checksums of files during discovery */
@@ -165,6 +156,19 @@ struct OCSYNC_EXPORT csync_s {
    */
   std::function<CSYNC_EXCLUDE_TYPE(const char *path, ItemType filetype)> exclude_traversal_fn;
 
+  /**
+   * Whether the excludes changed since the last sync, so that the entries
+   * read from the db need to be checked against them again. If unset they
+   * are always checked.
+   */
+  std::function<bool()> db_excludes_changed_fn;
+
+  /**
+   * The selective sync black list, sorted, every path ending with '/'.
+   * Its subtrees are left out when the remote tree is read from the db.
+   */
+  QVector<QByteArray> selective_sync_black_list;
+
   struct {
     std::unordered_map<ByteArrayRef, QByteArray, ByteArrayRefHash> folder_renamed_to; // map from->to
     std::unordered_map<ByteArrayRef, QByteArray, ByteArrayRefHash> folder_renamed_from; // map to->from
@@ -207,6 +211,16 @@ struct OCSYNC_EXPORT csync_s {
 
   bool upload_conflict_files = false;
 
+  /**
+   * Trees with at least this many entries are reconciled with the lookups
+   * into the other tree done in parallel. Negative for never.
+   */
+  int parallel_reconcile_threshold = 10000;
+
+  /* Wall clock time the last csync_update spent in each discovery phase */
+  qint64 local_discovery_msecs = 0;
+  qint64 remote_discovery_msecs = 0;
+
   csync_s(const char *localUri, OCC::SyncJournalDb *statedb);
   ~csync_s();
   int reinitialize();
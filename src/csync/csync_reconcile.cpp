@@ -30,15 +30,20 @@
 #include "common/syncjournalfilerecord.h"
 
 #include <QLoggingCategory>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+#include <vector>
+
 Q_LOGGING_CATEGORY(lcReconcile, "nextcloud.sync.csync.reconciler", QtInfoMsg)
 
 // Needed for PRIu64 on MinGW in C++ mode.
 #define __STDC_FORMAT_MACROS
 #include "inttypes.h"
 
-/* Check if a file is ignored because one parent is ignored.
- * return the node of the ignored directoy if it's the case, or \c nullptr if it is not ignored */
-static csync_file_stat_t *_csync_check_ignored(csync_s::FileMap *tree, const ByteArrayRef &path)
+/* Find the closest parent directory of path that is in the tree.
+ * return \c nullptr if no parent is in the tree */
+static csync_file_stat_t *_csync_find_parent(const csync_s::FileMap *tree, const ByteArrayRef &path)
 {
     /* compute the size of the parent directory */
     int parentlen = path.size() - 1;
@@ -51,17 +56,66 @@ static csync_file_stat_t *_csync_check_ignored(csync_s::FileMap *tree, const Byt
     ByteArrayRef parentPath = path.left(parentlen);
     csync_file_stat_t *fs = tree->findFile(parentPath);
     if (fs) {
-        if (fs->instruction == CSYNC_INSTRUCTION_IGNORE) {
-            /* Yes, we are ignored */
-            return fs;
+        return fs;
+    } else {
+        /* Try the parent of the parent */
+        return _csync_find_parent(tree, parentPath);
+    }
+}
+
+/* The e2e mangled names of the entries of a tree, to the first entry having it */
+using MangledNameIndex = std::unordered_map<ByteArrayRef, csync_file_stat_t *, ByteArrayRefHash>;
+
+static MangledNameIndex _csync_mangled_name_index(const csync_s::FileMap &tree)
+{
+    MangledNameIndex index;
+    for (const auto &pair : tree) {
+        if (!pair.second->e2eMangledName.isEmpty())
+            index.emplace(pair.second->e2eMangledName, pair.second.get());
+    }
+    return index;
+}
+
+/**
+ * The entries of the other tree that the reconcile of an entry depends on.
+ *
+ * Finding them only reads the trees, so it can be done for many entries in
+ * parallel before the visitor runs.
+ */
+struct ReconcileLookup
+{
+    /* found by path, mangled name or renamed parent directory */
+    csync_file_stat_t *other = nullptr;
+    /* if other wasn't found: the closest parent, which makes the entry
+     * ignored if it is ignored by the time the entry is visited */
+    csync_file_stat_t *parent = nullptr;
+};
+
+static ReconcileLookup _csync_reconcile_lookup(const csync_file_stat_t *cur, CSYNC *ctx,
+    const csync_s::FileMap *other_tree, const MangledNameIndex &other_mangled_names)
+{
+    ReconcileLookup lookup;
+    lookup.other = other_tree->findFile(cur->path);
+    if (!lookup.other) {
+        if (ctx->current == REMOTE_REPLICA) {
+            // The file was not found and the other tree is the local one
+            // check if the path doesn't match a mangled file name
+            auto it = other_mangled_names.find(cur->path);
+            if (it != other_mangled_names.end())
+                lookup.other = it->second;
         } else {
-            /* Not ignored */
-            return nullptr;
+            lookup.other = other_tree->findFile(cur->e2eMangledName);
         }
-    } else {
-        /* Try if the parent itself is ignored */
-        return _csync_check_ignored(tree, parentPath);
     }
+
+    if (!lookup.other) {
+        /* Check the renamed path as well. */
+        lookup.other = other_tree->findFile(csync_rename_adjust_parent_path(ctx, cur->path));
+    }
+    if (!lookup.other) {
+        lookup.parent = _csync_find_parent(other_tree, cur->path);
+    }
+    return lookup;
 }
 
 
@@ -92,7 +146,7 @@ static csync_file_stat_t *_csync_check_ignored(csync_s::FileMap *tree, const Byt
  * (timestamp is newer), it is not overwritten. If both files, on the
  * source and the destination, have been changed, the newer file wins.
  */
-static void _csync_merge_algorithm_visitor(csync_file_stat_t *cur, CSYNC * ctx) {
+static void _csync_merge_algorithm_visitor(csync_file_stat_t *cur, CSYNC * ctx, const ReconcileLookup &lookup) {
     csync_s::FileMap *our_tree = nullptr;
     csync_s::FileMap *other_tree = nullptr;
 
@@ -110,25 +164,10 @@ static void _csync_merge_algorithm_visitor(csync_file_stat_t *cur, CSYNC * ctx)
         break;
     }
 
-    csync_file_stat_t *other = other_tree->findFile(cur->path);
-    if (!other) {
-        if (ctx->current == REMOTE_REPLICA) {
-            // The file was not found and the other tree is the local one
-            // check if the path doesn't match a mangled file name
-            other = other_tree->findFileMangledName(cur->path);
-        } else {
-            other = other_tree->findFile(cur->e2eMangledName);
-        }
-    }
-
-    if (!other) {
-        /* Check the renamed path as well. */
-        other = other_tree->findFile(csync_rename_adjust_parent_path(ctx, cur->path));
-    }
-    if (!other) {
-        /* Check if it is ignored */
-        other = _csync_check_ignored(other_tree, cur->path);
-        /* If it is ignored, other->instruction will be  IGNORE so this one will also be ignored */
+    csync_file_stat_t *other = lookup.other;
+    if (!other && lookup.parent && lookup.parent->instruction == CSYNC_INSTRUCTION_IGNORE) {
+        /* A parent is ignored: other->instruction is IGNORE so this one will also be ignored */
+        other = lookup.parent;
     }
 
     /* file only found on current replica */
@@ -450,20 +489,61 @@ static void _csync_merge_algorithm_visitor(csync_file_stat_t *cur, CSYNC * ctx)
 
 void csync_reconcile_updates(CSYNC *ctx) {
   csync_s::FileMap *tree = nullptr;
+  csync_s::FileMap *other_tree = nullptr;
 
   switch (ctx->current) {
     case LOCAL_REPLICA:
       tree = &ctx->local.files;
+      other_tree = &ctx->remote.files;
       break;
     case REMOTE_REPLICA:
       tree = &ctx->remote.files;
+      other_tree = &ctx->local.files;
       break;
     default:
-      break;
+      return;
+  }
+
+  MangledNameIndex other_mangled_names;
+  if (ctx->current == REMOTE_REPLICA) {
+    other_mangled_names = _csync_mangled_name_index(*other_tree);
+  }
+
+  const bool parallel = ctx->parallel_reconcile_threshold >= 0
+      && tree->size() >= size_t(ctx->parallel_reconcile_threshold);
+  if (!parallel) {
+    for (auto &pair : *tree) {
+      csync_file_stat_t *cur = pair.second.get();
+      _csync_merge_algorithm_visitor(cur, ctx, _csync_reconcile_lookup(cur, ctx, other_tree, other_mangled_names));
+    }
+    return;
   }
 
+  /* The lookups are done for ranges of entries in parallel. The visitor then
+   * runs over the entries in the same order as above: it changes the
+   * instructions of entries in both trees and reads the journal, so a visit
+   * can depend on the visits before it. */
+  std::vector<csync_file_stat_t *> entries;
+  entries.reserve(tree->size());
   for (auto &pair : *tree) {
-    _csync_merge_algorithm_visitor(pair.second.get(), ctx);
+    entries.push_back(pair.second.get());
+  }
+  std::vector<ReconcileLookup> lookups(entries.size());
+
+  const size_t rangeSize = 4096;
+  std::vector<size_t> ranges;
+  for (size_t begin = 0; begin < entries.size(); begin += rangeSize) {
+    ranges.push_back(begin);
+  }
+  QtConcurrent::blockingMap(ranges, [&](size_t begin) {
+    const size_t end = std::min(begin + rangeSize, entries.size());
+    for (size_t i = begin; i < end; ++i) {
+      lookups[i] = _csync_reconcile_lookup(entries[i], ctx, other_tree, other_mangled_names);
+    }
+  });
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    _csync_merge_algorithm_visitor(entries[i], ctx, lookups[i]);
   }
 }
 
@@ -47,6 +47,9 @@
 #include "common/asserts.h"
 
 #include <QtCore/QTextCodec>
+#include <QSet>
+
+#include <algorithm>
 
 // Needed for PRIu64 on MinGW in C++ mode.
 #define __STDC_FORMAT_MACROS
@@ -504,41 +507,21 @@ int csync_walker(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> fs) {
 static bool fill_tree_from_db(CSYNC *ctx, const char *uri)
 {
     int64_t count = 0;
-    QByteArray skipbase;
     auto &files = ctx->current == LOCAL_REPLICA ? ctx->local.files : ctx->remote.files;
-    auto rowCallback = [ctx, &count, &skipbase, &files](const OCC::SyncJournalFileRecord &rec) {
-        if (ctx->current == REMOTE_REPLICA) {
-            /* When selective sync is used, the database may have subtrees with a parent
-             * whose etag is _invalid_. These are ignored and shall not appear in the
-             * remote tree.
-             * Sometimes folders that are not ignored by selective sync get marked as
-             * _invalid_, but that is not a problem as the next discovery will retrieve
-             * their correct etags again and we don't run into this case.
-             */
-            if (rec._etag == "_invalid_") {
-                qCInfo(lcUpdate, "%s selective sync excluded", rec._path.constData());
-                skipbase = rec._path;
-                skipbase += '/';
-                return;
-            }
 
-            /* Skip over all entries with the same base path. Note that this depends
-             * strongly on the ordering of the retrieved items. */
-            if (!skipbase.isEmpty() && rec._path.startsWith(skipbase)) {
-                qCDebug(lcUpdate, "%s selective sync excluded because the parent is", rec._path.constData());
-                return;
-            } else {
-                skipbase.clear();
-            }
-        }
+    /* The entries were checked against the excludes when they were discovered,
+     * so that only needs to be repeated when the excludes changed since. */
+    const bool checkExcludes = ctx->exclude_traversal_fn
+        && (!ctx->db_excludes_changed_fn || ctx->db_excludes_changed_fn());
 
+    auto rowCallback = [ctx, &count, &files, checkExcludes](const OCC::SyncJournalFileRecord &rec) {
         std::unique_ptr<csync_file_stat_t> st = csync_file_stat_t::fromSyncJournalFileRecord(rec);
 
         /* Check for exclusion from the tree.
          * Note that this is only a safety net in case the ignore list changes
          * without a full remote discovery being triggered. */
         CSYNC_EXCLUDE_TYPE excluded = CSYNC_NOT_EXCLUDED;
-        if (ctx->exclude_traversal_fn)
+        if (checkExcludes)
             excluded = ctx->exclude_traversal_fn(st->path, st->type);
         if (excluded != CSYNC_NOT_EXCLUDED) {
             qInfo(lcUpdate, "%s excluded from db read (%d)", st->path.constData(), excluded);
@@ -556,7 +539,17 @@ static bool fill_tree_from_db(CSYNC *ctx, const char *uri)
         ++count;
     };
 
-    if (!ctx->statedb->getFilesBelowPath(uri, rowCallback)) {
+    /* When selective sync is used, the database may have subtrees with a parent
+     * whose etag is _invalid_, or that are on the selective sync black list.
+     * These are ignored and shall not appear in the remote tree, the db leaves
+     * them out without reading them.
+     * Sometimes folders that are not ignored by selective sync get marked as
+     * _invalid_, but that is not a problem as the next discovery will retrieve
+     * their correct etags again and we don't run into this case.
+     */
+    const bool remote = ctx->current == REMOTE_REPLICA;
+    if (!ctx->statedb->getFilesBelowPathPruned(uri, remote,
+            remote ? ctx->selective_sync_black_list : QVector<QByteArray>(), rowCallback)) {
         ctx->status_code = CSYNC_STATUS_STATEDB_LOAD_ERROR;
         return false;
     }
@@ -789,4 +782,185 @@ error:
   return -1;
 }
 
+/* Return the path of the directory containing \a path, empty for top level entries */
+static QByteArray _parent_path(const QByteArray &path)
+{
+    int slash = path.lastIndexOf('/');
+    return slash < 0 ? QByteArray() : path.left(slash);
+}
+
+/* Remove all entries below the \a roots (but not the roots themselves) from \a files */
+static void _erase_below(csync_s::FileMap &files, const QSet<QByteArray> &roots)
+{
+    if (roots.isEmpty())
+        return;
+    for (auto it = files.begin(); it != files.end();) {
+        bool below = false;
+        for (auto p = _parent_path(it->second->path); !p.isEmpty(); p = _parent_path(p)) {
+            if (roots.contains(p)) {
+                below = true;
+                break;
+            }
+        }
+        if (below) {
+            it = files.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int csync_update_remote_from_delta(CSYNC *ctx)
+{
+  csync_remote_delta_s delta;
+  /* The delta is relative to the remote state recorded in the database. If a full
+   * rediscovery was requested (read_remote_from_db unset or _invalid_ etags) the
+   * database can't be trusted and the tree needs to be walked. */
+  delta.wanted = ctx->read_remote_from_db && !ctx->statedb->hasInvalidatedEtags();
+  ctx->callbacks.remote_delta_hook(&delta, ctx->callbacks.vio_userdata);
+  if (!delta.wanted || !delta.available) {
+      return 0;
+  }
+  if (ctx->abort) {
+      ctx->status_code = CSYNC_STATUS_ABORTED;
+      return -1;
+  }
+
+  qCInfo(lcUpdate) << "Building the remote tree from the db with" << delta.changed.size()
+                   << "changed and" << delta.deleted.size() << "deleted remote entries";
+
+  auto &files = ctx->remote.files;
+  if (!fill_tree_from_db(ctx, "")) {
+      return -1;
+  }
+
+  QSet<QByteArray> erasedDirs;
+  for (const auto &path : delta.deleted) {
+      files.erase(path);
+      erasedDirs.insert(path);
+  }
+  _erase_below(files, erasedDirs);
+  erasedDirs.clear();
+
+  // Same order as the db query: the contents of a directory directly follow it
+  std::sort(delta.changed.begin(), delta.changed.end(),
+      [](const std::unique_ptr<csync_file_stat_t> &a, const std::unique_ptr<csync_file_stat_t> &b) {
+          return a->path + '/' < b->path + '/';
+      });
+
+  std::vector<QByteArray> changedPaths;
+  QByteArray skipbase;
+  const int read_from_db = ctx->remote.read_from_db;
+  for (auto &fs : delta.changed) {
+      const QByteArray path = fs->path;
+      if (path.isEmpty()) {
+          continue;
+      }
+      if (!skipbase.isEmpty() && path.startsWith(skipbase)) {
+          continue;
+      }
+      skipbase.clear();
+
+      /* The server propagates etag changes to the parent directories, so the parent
+       * of a changed entry is either unchanged and in the db, or part of the delta. */
+      csync_file_stat_t *parent = nullptr;
+      const QByteArray parentPath = _parent_path(path);
+      if (!parentPath.isEmpty()) {
+          parent = files.findFile(parentPath);
+          if (!parent || parent->type != ItemTypeDirectory) {
+              if (ctx->callbacks.checkSelectiveSyncBlackListHook
+                  && ctx->callbacks.checkSelectiveSyncBlackListHook(ctx->callbacks.update_callback_userdata, path)) {
+                  continue;
+              }
+              qCWarning(lcUpdate, "parent of %s is unknown, walking the remote tree instead", path.constData());
+              files.clear();
+              ctx->current_fs = nullptr;
+              return 0;
+          }
+          if (parent->instruction == CSYNC_INSTRUCTION_IGNORE) {
+              continue;
+          }
+          /* Same as DiscoverySingleDirectoryJob: only the root of an external storage has 'M' */
+          if (fs->remotePerm.hasPermission(OCC::RemotePermissions::IsMounted)
+              && (parent->remotePerm.hasPermission(OCC::RemotePermissions::IsMounted)
+                     || parent->remotePerm.hasPermission(OCC::RemotePermissions::IsMountedSub))) {
+              fs->remotePerm.unsetPermission(OCC::RemotePermissions::IsMounted);
+              fs->remotePerm.setPermission(OCC::RemotePermissions::IsMountedSub);
+          }
+      }
+
+      /* Nothing is known about the contents of directories that were not in the db */
+      const csync_file_stat_t *previous = files.findFile(path);
+      const bool needsListing = fs->type == ItemTypeDirectory
+          && (!previous || previous->type != ItemTypeDirectory);
+
+      ctx->current_fs = parent;
+      int rc = csync_walker(ctx, std::move(fs));
+      // The walker may switch to reading from the db for unchanged directories
+      ctx->remote.read_from_db = read_from_db;
+      if (rc < 0) {
+          ctx->current_fs = nullptr;
+          return -1;
+      }
+      csync_file_stat_t *current = files.findFile(path);
+      if (rc > 0) {
+          /* Excluded or not selected: not part of the remote tree at all */
+          files.erase(path);
+          erasedDirs.insert(path);
+          skipbase = path + '/';
+          continue;
+      }
+      if (current->instruction == CSYNC_INSTRUCTION_IGNORE) {
+          erasedDirs.insert(path);
+          skipbase = path + '/';
+      } else if (needsListing) {
+          ctx->current_fs = current;
+          ctx->remote.read_from_db = false;
+          rc = csync_ftw(ctx, path, csync_walker, MAX_DEPTH);
+          ctx->remote.read_from_db = read_from_db;
+          if (rc < 0) {
+              ctx->current_fs = nullptr;
+              return -1;
+          }
+          // The listing already covered everything below
+          skipbase = path + '/';
+      }
+      changedPaths.push_back(path);
+  }
+  ctx->current_fs = nullptr;
+  _erase_below(files, erasedDirs);
+
+  /* Propagate the flags to the parent directories like csync_ftw() does */
+  for (const auto &path : changedPaths) {
+      const csync_file_stat_t *fs = files.findFile(path);
+      if (!fs) {
+          continue;
+      }
+      const bool childModified = fs->child_modified;
+      const bool hasIgnoredFiles = fs->has_ignored_files || fs->instruction == CSYNC_INSTRUCTION_IGNORE;
+      if (!childModified && !hasIgnoredFiles) {
+          continue;
+      }
+      for (auto p = _parent_path(path); !p.isEmpty(); p = _parent_path(p)) {
+          csync_file_stat_t *dir = files.findFile(p);
+          if (!dir) {
+              break;
+          }
+          if (childModified)
+              dir->child_modified = true;
+          if (hasIgnoredFiles)
+              dir->has_ignored_files = true;
+      }
+  }
+  for (const auto &path : changedPaths) {
+      csync_file_stat_t *fs = files.findFile(path);
+      if (fs && fs->type == ItemTypeDirectory && fs->instruction == CSYNC_INSTRUCTION_EVAL
+          && !fs->child_modified) {
+          fs->instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
+      }
+  }
+
+  return 1;
+}
+
 /* vim: set ts=8 sw=2 et cindent: */
@@ -77,6 +77,20 @@ int csync_walker(CSYNC *ctx, std::unique_ptr<csync_file_stat_t> fs);
 int csync_ftw(CSYNC *ctx, const char *uri, csync_walker_fn fn,
     unsigned int depth);
 
+/**
+ * @brief Build the remote tree from the database and the remote changes.
+ *
+ * Asks the remote_delta_hook for the changes since the last sync. If they are
+ * available, the remote tree is filled from the database and the changed entries
+ * run through csync_walker(). New directories are listed with csync_ftw().
+ *
+ * @param  ctx          The csync context to use.
+ *
+ * @return 1 if the remote tree was built, 0 if the remote tree must be walked
+ *         with csync_ftw() instead and < 0 on error.
+ */
+int csync_update_remote_from_delta(CSYNC *ctx);
+
 #endif /* _CSYNC_UPDATE_H */
 
 /* vim: set ft=c.doxygen ts=8 sw=2 et cindent: */
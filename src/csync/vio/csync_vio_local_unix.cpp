@@ -26,7 +26,14 @@
 #include <dirent.h>
 #include <stdio.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
 #include <memory>
+#include <vector>
 
 #include "c_private.h"
 #include "c_lib.h"
@@ -36,6 +43,8 @@
 #include "csync_vio.h"
 
 #include "vio/csync_vio_local.h"
+#include "common/performancecounters.h"
+#include "common/iouring.h"
 
 Q_LOGGING_CATEGORY(lcCSyncVIOLocal, "sync.csync.vio_local", QtInfoMsg)
 
@@ -43,28 +52,79 @@ Q_LOGGING_CATEGORY(lcCSyncVIOLocal, "sync.csync.vio_local", QtInfoMsg)
  * directory functions
  */
 
+#ifdef __linux__
+/* The entries of a directory are read directly with getdents64 in large
+ * batches, and stat'ed relative to the directory fd. */
+#define CSYNC_VIO_LOCAL_GETDENTS 1
+
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+static const int dirent_buffer_size = 64 * 1024;
+
+#if defined(HAVE_IO_URING) && defined(STATX_BASIC_STATS)
+/* With io_uring all entries of a getdents64 batch are stat'ed together */
+#define CSYNC_VIO_LOCAL_STATX_BATCH 1
+#endif
+#endif
+
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+static const unsigned int statx_mask = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME;
+#endif
+
 typedef struct dhandle_s {
-  DIR *dh;
-  char *path;
+#ifdef CSYNC_VIO_LOCAL_GETDENTS
+  int fd = -1;
+  char *buffer = nullptr; /* entries read with getdents64 */
+  int buffer_pos = 0;
+  int buffer_end = 0;
+#else
+  DIR *dh = nullptr;
+#endif
+#ifdef CSYNC_VIO_LOCAL_STATX_BATCH
+  std::vector<const char *> batch_names;
+  std::vector<struct statx> batch_stats;
+  std::vector<int> batch_results;
+  int batch_next = -1; /* -1 if the buffer wasn't stat'ed as a batch */
+  int batch_current = -1; /* of the entry returned last */
+#endif
+  char *path = nullptr;
 } dhandle_t;
 
-static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf);
+static int _csync_vio_local_stat_at(int dir_fd, const char *name, csync_file_stat_t *buf);
+static void _csync_vio_local_fill_stat(const csync_stat_t &sb, csync_file_stat_t *buf);
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+static void _csync_vio_local_fill_statx(const struct statx &stx, csync_file_stat_t *buf);
+#endif
 
 csync_vio_handle_t *csync_vio_local_opendir(const char *name) {
   dhandle_t *handle = nullptr;
   mbchar_t *dirname = nullptr;
 
-  handle = (dhandle_t*)c_malloc(sizeof(dhandle_t));
+  handle = new dhandle_t;
 
   dirname = c_utf8_path_to_locale(name);
 
+#ifdef CSYNC_VIO_LOCAL_GETDENTS
+  handle->fd = open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (handle->fd < 0) {
+#else
   handle->dh = _topendir( dirname );
   if (!handle->dh) {
+#endif
     c_free_locale_string(dirname);
-    SAFE_FREE(handle);
+    delete handle;
     return nullptr;
   }
 
+#ifdef CSYNC_VIO_LOCAL_GETDENTS
+  handle->buffer = (char *)c_malloc(dirent_buffer_size);
+#endif
   handle->path = c_strdup(name);
   c_free_locale_string(dirname);
 
@@ -81,51 +141,126 @@ int csync_vio_local_closedir(csync_vio_handle_t *dhandle) {
   }
 
   handle = (dhandle_t *) dhandle;
+#ifdef CSYNC_VIO_LOCAL_GETDENTS
+  rc = close(handle->fd);
+  SAFE_FREE(handle->buffer);
+#else
   rc = _tclosedir(handle->dh);
+#endif
 
   SAFE_FREE(handle->path);
-  SAFE_FREE(handle);
+  delete handle;
 
   return rc;
 }
 
+static bool _csync_vio_local_is_dot_entry(const char *name)
+{
+  return qstrcmp(name, ".") == 0 || qstrcmp(name, "..") == 0;
+}
+
+#ifdef CSYNC_VIO_LOCAL_STATX_BATCH
+/* Stats all entries of the getdents64 buffer with io_uring, in their order */
+static void _csync_vio_local_stat_batch(dhandle_t *handle)
+{
+  handle->batch_next = -1;
+  OCC::IoUring *ring = OCC::IoUring::threadInstance();
+  if (!ring)
+    return;
+
+  handle->batch_names.clear();
+  for (int pos = 0; pos < handle->buffer_end;) {
+    auto dirent = reinterpret_cast<struct linux_dirent64 *>(handle->buffer + pos);
+    pos += dirent->d_reclen;
+    if (!_csync_vio_local_is_dot_entry(dirent->d_name))
+      handle->batch_names.push_back(dirent->d_name);
+  }
+  const int count = int(handle->batch_names.size());
+  handle->batch_stats.resize(count);
+  handle->batch_results.resize(count);
+  // A failed batch only means the entries are stat'ed one by one, it must not
+  // look like a readdir error
+  const int saved_errno = errno;
+  if (ring->statxBatch(handle->fd, handle->batch_names.data(), statx_mask,
+          handle->batch_stats.data(), handle->batch_results.data(), count)) {
+    handle->batch_next = 0;
+  }
+  errno = saved_errno;
+}
+#endif
+
+/* The name and d_type of the next entry other than "." and "..", false at
+ * the end of the directory or on error (with errno set). */
+static bool _csync_vio_local_next_entry(dhandle_t *handle, const char **name, unsigned char *type)
+{
+#ifdef CSYNC_VIO_LOCAL_GETDENTS
+  struct linux_dirent64 *dirent = nullptr;
+  do {
+    if (handle->buffer_pos >= handle->buffer_end) {
+      long nread = syscall(SYS_getdents64, handle->fd, handle->buffer, dirent_buffer_size);
+      if (nread <= 0) {
+        // errno is set by the syscall on error and is untouched at the end
+        return false;
+      }
+      handle->buffer_pos = 0;
+      handle->buffer_end = int(nread);
+#ifdef CSYNC_VIO_LOCAL_STATX_BATCH
+      _csync_vio_local_stat_batch(handle);
+#endif
+    }
+    dirent = reinterpret_cast<struct linux_dirent64 *>(handle->buffer + handle->buffer_pos);
+    handle->buffer_pos += dirent->d_reclen;
+  } while (_csync_vio_local_is_dot_entry(dirent->d_name));
+#ifdef CSYNC_VIO_LOCAL_STATX_BATCH
+  handle->batch_current = handle->batch_next >= 0 ? handle->batch_next++ : -1;
+#endif
+  *name = dirent->d_name;
+  *type = dirent->d_type;
+  return true;
+#else
+  struct _tdirent *dirent = nullptr;
+  do {
+    dirent = _treaddir(handle->dh);
+    if (!dirent)
+      return false;
+  } while (_csync_vio_local_is_dot_entry(dirent->d_name));
+  *name = dirent->d_name;
+#if defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__)
+  *type = dirent->d_type;
+#else
+  *type = 0;
+#endif
+  return true;
+#endif
+}
+
 std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *dhandle) {
 
   dhandle_t *handle = nullptr;
 
   handle = (dhandle_t *) dhandle;
-  struct _tdirent *dirent = nullptr;
+  const char *name = nullptr;
+  unsigned char type = 0;
   std::unique_ptr<csync_file_stat_t> file_stat;
 
-  do {
-      dirent = _treaddir(handle->dh);
-      if (!dirent)
-          return {};
-  } while (qstrcmp(dirent->d_name, ".") == 0 || qstrcmp(dirent->d_name, "..") == 0);
+  if (!_csync_vio_local_next_entry(handle, &name, &type))
+      return {};
 
   file_stat = std::make_unique<csync_file_stat_t>();
-  file_stat->path = c_utf8_from_locale(dirent->d_name);
-  QByteArray fullPath = QByteArray() % const_cast<const char *>(handle->path) % '/' % QByteArray() % const_cast<const char *>(dirent->d_name);
+  file_stat->path = c_utf8_from_locale(name);
   if (file_stat->path.isNull()) {
-      file_stat->original_path = fullPath;
-      qCWarning(lcCSyncVIOLocal) << "Invalid characters in file/directory name, please rename:" << dirent->d_name << handle->path;
+      file_stat->original_path = QByteArray() % const_cast<const char *>(handle->path) % '/' % QByteArray() % name;
+      qCWarning(lcCSyncVIOLocal) << "Invalid characters in file/directory name, please rename:" << name << handle->path;
   }
 
   /* Check for availability of d_type, see manpage. */
-#if defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__)
-  switch (dirent->d_type) {
-    case DT_FIFO:
-    case DT_SOCK:
-    case DT_CHR:
-    case DT_BLK:
-      break;
+#if defined(CSYNC_VIO_LOCAL_GETDENTS) || defined(_DIRENT_HAVE_D_TYPE) || defined(__APPLE__)
+  switch (type) {
     case DT_DIR:
+      file_stat->type = ItemTypeDirectory;
+      break;
     case DT_REG:
-      if (dirent->d_type == DT_DIR) {
-        file_stat->type = ItemTypeDirectory;
-      } else {
-        file_stat->type = ItemTypeFile;
-      }
+      file_stat->type = ItemTypeFile;
       break;
     default:
       break;
@@ -135,7 +270,23 @@ std::unique_ptr<csync_file_stat_t> csync_vio_local_readdir(csync_vio_handle_t *d
   if (file_stat->path.isNull())
       return file_stat;
 
-  if (_csync_vio_local_stat_mb(fullPath.constData(), file_stat.get()) < 0) {
+#ifdef CSYNC_VIO_LOCAL_STATX_BATCH
+  // Failed ones are tried again below, for the same errors as without io_uring
+  if (handle->batch_current >= 0 && handle->batch_results[handle->batch_current] == 0) {
+      OCC::PerformanceCounters::add(OCC::PerformanceCounters::StatCalls);
+      _csync_vio_local_fill_statx(handle->batch_stats[handle->batch_current], file_stat.get());
+      return file_stat;
+  }
+#endif
+
+  // The entry is stat'ed relative to the directory, so the kernel doesn't
+  // have to resolve the full path again for every entry
+#ifdef CSYNC_VIO_LOCAL_GETDENTS
+  const int dir_fd = handle->fd;
+#else
+  const int dir_fd = dirfd(handle->dh);
+#endif
+  if (_csync_vio_local_stat_at(dir_fd, name, file_stat.get()) < 0) {
       // Will get excluded by _csync_detect_update.
       file_stat->type = ItemTypeSkip;
   }
@@ -147,19 +298,53 @@ int csync_vio_local_stat(const char *uri, csync_file_stat_t *buf)
 {
     mbchar_t *wuri = c_utf8_path_to_locale(uri);
     *buf = csync_file_stat_t();
-    int rc = _csync_vio_local_stat_mb(wuri, buf);
+    int rc = _csync_vio_local_stat_at(AT_FDCWD, wuri, buf);
     c_free_locale_string(wuri);
     return rc;
 }
 
-static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf)
+static int _csync_vio_local_stat_at(int dir_fd, const char *name, csync_file_stat_t *buf)
 {
-    csync_stat_t sb;
+    OCC::PerformanceCounters::add(OCC::PerformanceCounters::StatCalls);
+
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+    // statx only fetches what we need, which is cheaper on some file systems.
+    // It may be missing in the kernel though, then fstatat is used.
+    static std::atomic<bool> statxMissing(false);
+    if (!statxMissing.load(std::memory_order_relaxed)) {
+        struct statx stx;
+        if (statx(dir_fd, name, AT_SYMLINK_NOFOLLOW, statx_mask, &stx) == 0) {
+            _csync_vio_local_fill_statx(stx, buf);
+            return 0;
+        }
+        if (errno != ENOSYS)
+            return -1;
+        statxMissing.store(true, std::memory_order_relaxed);
+    }
+#endif
 
-    if (_tstat(wuri, &sb) < 0) {
+    csync_stat_t sb;
+    if (fstatat(dir_fd, name, &sb, AT_SYMLINK_NOFOLLOW) < 0) {
         return -1;
     }
+    _csync_vio_local_fill_stat(sb, buf);
+    return 0;
+}
 
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+static void _csync_vio_local_fill_statx(const struct statx &stx, csync_file_stat_t *buf)
+{
+    csync_stat_t sb = {};
+    sb.st_mode = stx.stx_mode;
+    sb.st_ino = stx.stx_ino;
+    sb.st_size = stx.stx_size;
+    sb.st_mtime = stx.stx_mtime.tv_sec;
+    _csync_vio_local_fill_stat(sb, buf);
+}
+#endif
+
+static void _csync_vio_local_fill_stat(const csync_stat_t &sb, csync_file_stat_t *buf)
+{
     switch (sb.st_mode & S_IFMT) {
     case S_IFDIR:
       buf->type = ItemTypeDirectory;
@@ -185,5 +370,4 @@ static int _csync_vio_local_stat_mb(const mbchar_t *wuri, csync_file_stat_t *buf
   buf->inode = sb.st_ino;
   buf->modtime = sb.st_mtime;
   buf->size = sb.st_size;
-  return 0;
 }
@@ -26,6 +26,7 @@
 #include "syncresult.h"
 #include "clientproxy.h"
 #include "syncengine.h"
+#include "bandwidthmanager.h"
 #include "syncrunfilelog.h"
 #include "socketapi.h"
 #include "theme.h"
@@ -108,6 +109,9 @@ Folder::Folder(const FolderDefinition &definition,
     connect(&_scheduleSelfTimer, &QTimer::timeout,
         this, &Folder::slotScheduleThisFolder);
 
+    _progressTimer.setSingleShot(true);
+    connect(&_progressTimer, &QTimer::timeout, this, &Folder::slotEmitPendingProgress);
+
     connect(ProgressDispatcher::instance(), &ProgressDispatcher::folderConflicts,
         this, &Folder::slotFolderConflicts);
 }
@@ -697,6 +701,11 @@ void Folder::setSyncOptions()
     opt._newBigFolderSizeLimit = newFolderLimit.first ? newFolderLimit.second * 1000LL * 1000LL : -1; // convert from MB to B
     opt._confirmExternalStorage = cfgFile.confirmExternalStorage();
     opt._moveFilesToTrash = cfgFile.moveToTrash();
+    opt._incrementalRemoteDiscovery = cfgFile.incrementalRemoteDiscovery();
+    opt._bulkInitialDiscovery = cfgFile.bulkInitialDiscovery();
+    opt._serverSideCopy = cfgFile.serverSideCopy();
+    opt._localCopyForDownloads = cfgFile.localCopyForDownloads();
+    opt._deltaDownloads = cfgFile.deltaDownloads();
 
     QByteArray chunkSizeEnv = qgetenv("OWNCLOUD_CHUNK_SIZE");
     if (!chunkSizeEnv.isEmpty()) {
@@ -754,6 +763,9 @@ void Folder::setDirtyNetworkLimits()
     }
 
     _engine->setNetworkLimits(uploadLimit, downloadLimit);
+
+    // The configured limits are for all folders together
+    BandwidthManager::setGlobalLimits(qMax(0, uploadLimit), qMax(0, downloadLimit));
 }
 
 void Folder::slotSyncError(const QString &message, ErrorCategory category)
@@ -790,6 +802,8 @@ void Folder::slotSyncFinished(bool success)
     _fileLog->finish();
     showSyncResultPopup();
 
+    _syncResult.setSyncStatistics(_engine->syncStatistics());
+
     auto anotherSyncNeeded = _engine->isAnotherSyncNeeded();
 
     if (syncError) {
@@ -889,6 +903,31 @@ void Folder::slotEmitFinishedDelayed()
 // and hand the result over to the progress dispatcher.
 void Folder::slotTransmissionProgress(const ProgressInfo &pi)
 {
+    // The engine reports every bit of transferred data, far more often than
+    // the UI can show it. Updates that only change the byte counts are held
+    // back; completed items and status changes go through right away since
+    // the receivers count them.
+    const bool onlyBytes = pi.status() == ProgressInfo::Propagation && pi._lastCompletedItem.isEmpty();
+    if (onlyBytes && _lastProgressEmit.isValid() && _lastProgressEmit.elapsed() < progressIntervalMsec) {
+        _pendingProgress = &pi;
+        if (!_progressTimer.isActive())
+            _progressTimer.start(progressIntervalMsec - int(_lastProgressEmit.elapsed()));
+        return;
+    }
+    emitProgress(pi);
+}
+
+void Folder::slotEmitPendingProgress()
+{
+    if (_pendingProgress)
+        emitProgress(*_pendingProgress);
+}
+
+void Folder::emitProgress(const ProgressInfo &pi)
+{
+    _progressTimer.stop();
+    _pendingProgress.clear();
+    _lastProgressEmit.start();
     emit progressInfo(pi);
     ProgressDispatcher::instance()->setProgressInfo(alias(), pi);
 }
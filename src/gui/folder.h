@@ -276,6 +276,12 @@ public slots:
        */
     void slotWatchedPathChanged(const QString &path);
 
+    /**
+      * The remote etag of the folder, either from our own RequestEtagJob
+      * or from the batched check of FolderMan. Schedules a sync if it changed.
+      */
+    void etagRetreived(const QString &);
+
 private slots:
     void slotSyncStarted();
     void slotSyncFinished(bool);
@@ -287,10 +293,10 @@ private slots:
     void slotCsyncUnavailable();
 
     void slotTransmissionProgress(const ProgressInfo &pi);
+    void slotEmitPendingProgress();
     void slotItemCompleted(const SyncFileItemPtr &);
 
     void slotRunEtagJob();
-    void etagRetreived(const QString &);
     void etagRetreivedFromSyncEngine(const QString &);
 
     void slotEmitFinishedDelayed();
@@ -371,6 +377,17 @@ private:
 
     QTimer _scheduleSelfTimer;
 
+    /// Minimum time between two progress updates that only report bytes
+    static const int progressIntervalMsec = 200;
+
+    /// Delivers the last held back progress update, see slotTransmissionProgress()
+    QTimer _progressTimer;
+    QElapsedTimer _lastProgressEmit;
+    /// The engine's progress object, it has the latest state when the timer fires
+    QPointer<const ProgressInfo> _pendingProgress;
+
+    void emitProgress(const ProgressInfo &pi);
+
     /**
      * When the same local path is synced to multiple accounts, only one
      * of them can be stored in the settings in a way that's compatible
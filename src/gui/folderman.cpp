@@ -24,6 +24,9 @@
 #include "filesystem.h"
 #include "lockwatcher.h"
 #include "common/asserts.h"
+#ifdef WITH_PUSH_NOTIFICATIONS
+#include "pushnotifications.h"
+#endif
 #include <syncengine.h>
 
 #ifdef Q_OS_MAC
@@ -104,6 +107,7 @@ void FolderMan::unloadFolder(Folder *f)
     _socketApi->slotUnregisterPath(f->alias());
 
     _folderMap.remove(f->alias());
+    _batchedEtagFolders.remove(f);
 
     disconnect(f, &Folder::syncStarted,
         this, &FolderMan::slotFolderSyncStarted);
@@ -611,6 +615,8 @@ void FolderMan::slotAccountStateChanged()
     }
     QString accountName = accountState->account()->displayName();
 
+    updatePushNotifications(accountState);
+
     if (accountState->isConnected()) {
         qCInfo(lcFolderMan) << "Account" << accountName << "connected, scheduling its folders";
 
@@ -739,10 +745,168 @@ void FolderMan::slotStartScheduledFolderSync()
     }
 }
 
+void FolderMan::updatePushNotifications(AccountState *accountState)
+{
+#ifdef WITH_PUSH_NOTIFICATIONS
+    const auto &capabilities = accountState->account()->capabilities();
+    const QUrl endpoint = accountState->isConnected()
+        ? capabilities.pushNotificationsWebSocketUrl()
+        : QUrl();
+
+    auto *push = _pushNotifications.value(accountState);
+    if (push && push->webSocketUrl() == endpoint) {
+        return;
+    }
+    if (push) {
+        _pushNotifications.remove(accountState);
+        push->stop();
+        push->deleteLater();
+    }
+    if (!endpoint.isValid()) {
+        return;
+    }
+
+    push = new PushNotifications(accountState->account(), endpoint, capabilities.pushNotificationsPreAuthUrl(), this);
+    connect(push, &PushNotifications::filesChanged, this, &FolderMan::slotRemoteFilesChanged);
+    connect(push, &PushNotifications::connectedChanged, this, &FolderMan::slotPushNotificationsConnectedChanged);
+    _pushNotifications.insert(accountState, push);
+    push->start();
+#else
+    // Built without QtWebSockets, the etag polling notices remote changes
+    Q_UNUSED(accountState);
+#endif
+}
+
+bool FolderMan::hasPushNotifications(AccountState *accountState) const
+{
+#ifdef WITH_PUSH_NOTIFICATIONS
+    auto *push = _pushNotifications.value(accountState);
+    return push && push->isConnected();
+#else
+    Q_UNUSED(accountState);
+    return false;
+#endif
+}
+
+void FolderMan::slotRemoteFilesChanged()
+{
+#ifdef WITH_PUSH_NOTIFICATIONS
+    auto *push = qobject_cast<PushNotifications *>(sender());
+    if (push) {
+        runEtagJobsOfAccount(push->account());
+    }
+#endif
+}
+
+void FolderMan::slotPushNotificationsConnectedChanged(bool connected)
+{
+#ifdef WITH_PUSH_NOTIFICATIONS
+    auto *push = qobject_cast<PushNotifications *>(sender());
+    if (push && connected) {
+        runEtagJobsOfAccount(push->account());
+    }
+#else
+    Q_UNUSED(connected);
+#endif
+}
+
+void FolderMan::runEtagJobsOfAccount(const AccountPtr &account)
+{
+    QList<Folder *> folders;
+    foreach (Folder *f, _folderMap) {
+        if (f && f->canSync() && f->accountState()->account() == account
+            && !f->etagJob() && !_batchedEtagFolders.contains(f)
+            && !f->isBusy() && !_scheduledFolders.contains(f)) {
+            folders.append(f);
+        }
+    }
+    runEtagJobs(folders);
+}
+
+static QString etagParentPath(const QString &remotePath)
+{
+    QString path = remotePath;
+    while (path.endsWith('/'))
+        path.chop(1);
+    if (path.isEmpty())
+        return QStringLiteral("/"); // the root folder is reported by the listing of itself
+    path.truncate(path.lastIndexOf('/'));
+    return path.isEmpty() ? QStringLiteral("/") : path;
+}
+
+static QString etagChildName(const QString &remotePath)
+{
+    QString path = remotePath;
+    while (path.endsWith('/'))
+        path.chop(1);
+    return path.mid(path.lastIndexOf('/') + 1);
+}
+
+void FolderMan::runEtagJobs(const QList<Folder *> &folders)
+{
+    // Folders below the same remote directory share one PROPFIND
+    QMap<QPair<AccountState *, QString>, QList<Folder *>> groups;
+    foreach (Folder *f, folders) {
+        // Old servers don't update the etag of a directory when something
+        // deep inside it changes, their folders need the Depth:1 check of
+        // RequestEtagJob.
+        if (!f->accountState()->account()->rootEtagChangesNotOnlySubFolderEtags()) {
+            QMetaObject::invokeMethod(f, "slotRunEtagJob", Qt::QueuedConnection);
+            continue;
+        }
+        groups[qMakePair(f->accountState(), etagParentPath(f->remotePath()))].append(f);
+    }
+
+    for (auto it = groups.constBegin(); it != groups.constEnd(); ++it) {
+        if (it.value().size() == 1) {
+            QMetaObject::invokeMethod(it.value().first(), "slotRunEtagJob", Qt::QueuedConnection);
+            continue;
+        }
+
+        // Each folder is guarded separately, it might be unloaded meanwhile.
+        // Several folders can sync the same remote directory.
+        auto pending = QSharedPointer<QMultiHash<QString, QPointer<Folder>>>::create();
+        foreach (Folder *f, it.value()) {
+            pending->insert(etagChildName(f->remotePath()), f);
+            _batchedEtagFolders.insert(f);
+        }
+
+        qCInfo(lcFolderMan) << "Checking the ETags of" << pending->size() << "folders below" << it.key().second;
+        auto *job = new RequestEtagsJob(it.key().first->account(), it.key().second, this);
+        job->setTimeout(60 * 1000);
+        connect(job, &RequestEtagsJob::etagRetreived, this, [this, pending](const QString &name, const QString &etag) {
+            const auto folders = pending->values(name);
+            pending->remove(name);
+            for (const auto &f : folders) {
+                if (f) {
+                    _batchedEtagFolders.remove(f.data());
+                    f->etagRetreived(etag);
+                }
+            }
+        });
+        // Whatever wasn't reported (error, folder moved away...) gets its own check
+        auto checkRemaining = [this, pending]() {
+            for (const auto &f : *pending) {
+                if (f) {
+                    _batchedEtagFolders.remove(f.data());
+                    QMetaObject::invokeMethod(f.data(), "slotRunEtagJob", Qt::QueuedConnection);
+                }
+            }
+            pending->clear();
+        };
+        connect(job, &RequestEtagsJob::finishedWithoutError, this, checkRemaining);
+        connect(job, &RequestEtagsJob::finishedWithError, this, checkRemaining);
+        job->start();
+    }
+}
+
 void FolderMan::slotEtagPollTimerTimeout()
 {
     ConfigFile cfg;
     auto polltime = cfg.remotePollInterval();
+    auto pushPolltime = cfg.pushFallbackPollInterval();
+
+    QList<Folder *> folders;
 
     foreach (Folder *f, _folderMap) {
         if (!f) {
@@ -757,18 +921,27 @@ void FolderMan::slotEtagPollTimerTimeout()
         if (_disabledFolders.contains(f)) {
             continue;
         }
-        if (f->etagJob() || f->isBusy() || !f->canSync()) {
+        if (f->etagJob() || _batchedEtagFolders.contains(f) || f->isBusy() || !f->canSync()) {
             continue;
         }
-        if (f->msecSinceLastSync() < polltime) {
+        // Push notifications report changes, polling only guards against lost ones
+        if (f->msecSinceLastSync() < (hasPushNotifications(f->accountState()) ? pushPolltime : polltime)) {
             continue;
         }
-        QMetaObject::invokeMethod(f, "slotRunEtagJob", Qt::QueuedConnection);
+        folders.append(f);
     }
+    runEtagJobs(folders);
 }
 
 void FolderMan::slotRemoveFoldersForAccount(AccountState *accountState)
 {
+#ifdef WITH_PUSH_NOTIFICATIONS
+    if (auto *push = _pushNotifications.take(accountState)) {
+        push->stop();
+        push->deleteLater();
+    }
+#endif
+
     QVarLengthArray<Folder *, 16> foldersToRemove;
     Folder::MapIterator i(_folderMap);
     while (i.hasNext()) {
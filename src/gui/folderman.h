@@ -33,6 +33,7 @@ class Application;
 class SyncResult;
 class SocketApi;
 class LockWatcher;
+class PushNotifications;
 
 /**
  * @brief The FolderMan class
@@ -49,7 +50,9 @@ class LockWatcher;
  *   (_folderWatchers and Folder::slotWatchedPathChanged())
  *
  * - The folder etag on the server has changed
- *   (_etagPollTimer)
+ *   (_etagPollTimer and runEtagJobs(), slower while push notifications
+ *    are connected; the server's notify_push app triggers an immediate
+ *    check, see _pushNotifications and slotRemoteFilesChanged())
  *
  * - The locks of a monitored file are released
  *   (_lockWatcher and slotWatchedFileUnlocked())
@@ -276,6 +279,18 @@ private slots:
      */
     void slotScheduleFolderByTime();
 
+    /**
+     * Checks the etags of the folders of the notifying account: the
+     * server doesn't say which files changed.
+     */
+    void slotRemoteFilesChanged();
+
+    /**
+     * Checks the etags of the folders of the notifying account once the
+     * channel (re)connects: changes may have been missed while it was down.
+     */
+    void slotPushNotificationsConnectedChanged(bool connected);
+
 private:
     /** Adds a new folder, does not add it to the account settings and
      *  does not set an account on the new folder.
@@ -301,6 +316,21 @@ private:
 
     void setupFoldersHelper(QSettings &settings, AccountStatePtr account, bool backwardsCompatible);
 
+    /// Starts or stops the push notifications of the account depending on its state
+    void updatePushNotifications(AccountState *accountState);
+
+    /**
+     * Checks the remote etags of the folders, with a single request for
+     * all folders of an account below the same remote directory.
+     */
+    void runEtagJobs(const QList<Folder *> &folders);
+
+    /// runEtagJobs() for the folders of \a account that aren't busy anyway
+    void runEtagJobsOfAccount(const AccountPtr &account);
+
+    /// Whether remote changes of the account are reported by push notifications
+    bool hasPushNotifications(AccountState *accountState) const;
+
     QSet<Folder *> _disabledFolders;
     Folder::Map _folderMap;
     QString _folderConfigPath;
@@ -312,6 +342,11 @@ private:
     QTimer _etagPollTimer;
     /// The currently running etag query
     QPointer<RequestEtagJob> _currentEtagJob;
+    /// Folders whose etag is being checked by a RequestEtagsJob
+    QSet<Folder *> _batchedEtagFolders;
+
+    /// Remote change notifications per connected account
+    QHash<AccountState *, PushNotifications *> _pushNotifications;
 
     /// Watches files that couldn't be synced due to locks
     QScopedPointer<LockWatcher> _lockWatcher;
@@ -59,7 +59,7 @@ bool FolderWatcher::pathIsIgnored(const QString &path)
     if (!_folder)
         return false;
 
-#ifndef OWNCLOUD_TEST
+#if !defined(OWNCLOUD_TEST) && !defined(OWNCLOUD_CMD)
     if (_folder->isFileExcludedAbsolute(path)) {
         qCDebug(lcFolderWatcher) << "* Ignoring file" << path;
         return true;
@@ -34,6 +34,7 @@
 #include "owncloudpropagator.h"
 
 #include "creds/abstractcredentials.h"
+#include "common/performancecounters.h"
 
 Q_DECLARE_METATYPE(QTimer *)
 
@@ -139,6 +140,10 @@ void AbstractNetworkJob::adoptRequest(QNetworkReply *reply)
     setReply(reply);
     setupConnections(reply);
     newReplyHook(reply);
+
+    _requestTimer.start();
+    if (requestVerb(*reply) == "PROPFIND")
+        PerformanceCounters::add(PerformanceCounters::PropfindRequests);
 }
 
 QUrl AbstractNetworkJob::makeAccountUrl(const QString &relativePath) const
@@ -192,6 +197,8 @@ void AbstractNetworkJob::slotFinished()
     }
 #endif
 
+    PerformanceCounters::addJobLatency(metaObject()->className(), _requestTimer.elapsed());
+
     if (_reply->error() != QNetworkReply::NoError) {
         if (!_ignoreCredentialFailure || _reply->error() != QNetworkReply::AuthenticationRequiredError) {
             qCWarning(lcNetworkJob) << _reply->error() << errorString()
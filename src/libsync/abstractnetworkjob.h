@@ -188,6 +188,7 @@ private:
     QPointer<QNetworkReply> _reply; // (QPointer because the NetworkManager may be destroyed before the jobs at exit)
     QString _path;
     QTimer _timer;
+    QElapsedTimer _requestTimer; // for the job latency statistics
     int _redirectCount = 0;
 #if (QT_VERSION >= 0x050800)
     int _http2ResendCount = 0;
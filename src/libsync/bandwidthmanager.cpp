@@ -27,367 +27,298 @@
 #include <QTimer>
 #include <QObject>
 
+#include <algorithm>
+#include <numeric>
+
 namespace OCC {
 
 Q_LOGGING_CATEGORY(lcBandwidthManager, "nextcloud.sync.bandwidthmanager", QtInfoMsg)
 
+// What a transfer without a known size can use in one tick
+static const qint64 unlimitedC = qint64(1) << 40;
+
 // Because of the many layers of buffering inside Qt (and probably the OS and the network)
-// we cannot lower this value much more. If we do, the estimated bw will be very high
-// because the buffers fill fast while the actual network algorithms are not relevant yet.
-static qint64 relativeLimitMeasuringTimerIntervalMsec = 1000 * 2;
+// the capacity measured over a short time is too high for uploads: the buffers fill fast
+// while the actual network algorithms are not relevant yet. Hence the long probes.
 // See also WritingState in http://code.woboq.org/qt5/qtbase/src/network/access/qhttpprotocolhandler.cpp.html#_ZN20QHttpProtocolHandler11sendRequestEv
 
-// FIXME At some point:
-//  * Register device only after the QNR received its metaDataChanged() signal
-//  * Incorporate Qt buffer fill state (it's a negative absolute delta).
-//  * Incorporate SSL overhead (percentage)
-//  * For relative limiting, do less measuring and more delaying+giving quota
-//  * For relative limiting, smoothen measurements
+namespace {
+    /// Shared by the BandwidthManagers of all propagators
+    struct GlobalLimits
+    {
+        TokenBucket upload;
+        TokenBucket download;
+        QElapsedTimer clock;
+        int uploadUsers = 0; // propagators with active uploads
+        int downloadUsers = 0;
+
+        void refill()
+        {
+            if (!clock.isValid()) {
+                clock.start();
+                return;
+            }
+            const qint64 elapsed = clock.restart();
+            upload.refill(elapsed);
+            download.refill(elapsed);
+        }
+    };
+}
 
-BandwidthManager::BandwidthManager(OwncloudPropagator *p)
-    : QObject()
-    , _propagator(p)
-    , _relativeLimitCurrentMeasuredDevice(nullptr)
-    , _relativeUploadLimitProgressAtMeasuringRestart(0)
-    , _currentUploadLimit(0)
-    , _relativeLimitCurrentMeasuredJob(nullptr)
-    , _currentDownloadLimit(0)
+static GlobalLimits &globalLimits()
 {
-    _currentUploadLimit = _propagator->_uploadLimit.fetchAndAddAcquire(0);
-    _currentDownloadLimit = _propagator->_downloadLimit.fetchAndAddAcquire(0);
-
-    QObject::connect(&_switchingTimer, &QTimer::timeout, this, &BandwidthManager::switchingTimerExpired);
-    _switchingTimer.setInterval(10 * 1000);
-    _switchingTimer.start();
-    QMetaObject::invokeMethod(this, "switchingTimerExpired", Qt::QueuedConnection);
-
-    // absolute uploads/downloads
-    QObject::connect(&_absoluteLimitTimer, &QTimer::timeout, this, &BandwidthManager::absoluteLimitTimerExpired);
-    _absoluteLimitTimer.setInterval(1000);
-    _absoluteLimitTimer.start();
-
-    // Relative uploads
-    QObject::connect(&_relativeUploadMeasuringTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeUploadMeasuringTimerExpired);
-    _relativeUploadMeasuringTimer.setInterval(relativeLimitMeasuringTimerIntervalMsec);
-    _relativeUploadMeasuringTimer.start();
-    _relativeUploadMeasuringTimer.setSingleShot(true); // will be restarted from the delay timer
-    QObject::connect(&_relativeUploadDelayTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeUploadDelayTimerExpired);
-    _relativeUploadDelayTimer.setSingleShot(true); // will be restarted from the measuring timer
-
-    // Relative downloads
-    QObject::connect(&_relativeDownloadMeasuringTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeDownloadMeasuringTimerExpired);
-    _relativeDownloadMeasuringTimer.setInterval(relativeLimitMeasuringTimerIntervalMsec);
-    _relativeDownloadMeasuringTimer.start();
-    _relativeDownloadMeasuringTimer.setSingleShot(true); // will be restarted from the delay timer
-    QObject::connect(&_relativeDownloadDelayTimer, &QTimer::timeout,
-        this, &BandwidthManager::relativeDownloadDelayTimerExpired);
-    _relativeDownloadDelayTimer.setSingleShot(true); // will be restarted from the measuring timer
+    static GlobalLimits limits;
+    return limits;
 }
 
-BandwidthManager::~BandwidthManager() = default;
+static qint64 demand(UploadDevice *device)
+{
+    return device->bytesAvailable();
+}
 
-void BandwidthManager::registerUploadDevice(UploadDevice *p)
+static qint64 demand(GETFileJob *)
 {
-    _absoluteUploadDeviceList.append(p);
-    _relativeUploadDeviceList.append(p);
-    QObject::connect(p, &QObject::destroyed, this, &BandwidthManager::unregisterUploadDevice);
+    return unlimitedC;
+}
 
-    if (usingAbsoluteUploadLimit()) {
-        p->setBandwidthLimited(true);
-        p->setChoked(false);
-    } else if (usingRelativeUploadLimit()) {
-        p->setBandwidthLimited(true);
-        p->setChoked(true);
-    } else {
-        p->setBandwidthLimited(false);
-        p->setChoked(false);
-    }
+void TokenBucket::setRate(qint64 rate)
+{
+    _rate = qMax<qint64>(rate, 0);
+    _tokens = qMin(_tokens, burst());
 }
 
-void BandwidthManager::unregisterUploadDevice(QObject *o)
+qint64 TokenBucket::burst() const
 {
-    auto p = reinterpret_cast<UploadDevice *>(o); // note, we might already be in the ~QObject
-    _absoluteUploadDeviceList.removeAll(p);
-    _relativeUploadDeviceList.removeAll(p);
-    if (p == _relativeLimitCurrentMeasuredDevice) {
-        _relativeLimitCurrentMeasuredDevice = nullptr;
-        _relativeUploadLimitProgressAtMeasuringRestart = 0;
-    }
+    return qMax<qint64>(_rate * burstMsec / 1000, 1);
 }
 
-void BandwidthManager::registerDownloadJob(GETFileJob *j)
+void TokenBucket::refill(qint64 msec)
 {
-    _downloadJobList.append(j);
-    QObject::connect(j, &QObject::destroyed, this, &BandwidthManager::unregisterDownloadJob);
+    if (!isLimited() || msec <= 0)
+        return;
+    _fraction += _rate * msec;
+    _tokens = qMin(_tokens + _fraction / 1000, burst());
+    _fraction %= 1000;
+}
 
-    if (usingAbsoluteDownloadLimit()) {
-        j->setBandwidthLimited(true);
-        j->setChoked(false);
-    } else if (usingRelativeDownloadLimit()) {
-        j->setBandwidthLimited(true);
-        j->setChoked(true);
-    } else {
-        j->setBandwidthLimited(false);
-        j->setChoked(false);
-    }
+qint64 TokenBucket::available() const
+{
+    return isLimited() ? _tokens : unlimitedC;
 }
 
-void BandwidthManager::unregisterDownloadJob(QObject *o)
+qint64 TokenBucket::take(qint64 wanted)
 {
-    auto *j = reinterpret_cast<GETFileJob *>(o); // note, we might already be in the ~QObject
-    _downloadJobList.removeAll(j);
-    if (_relativeLimitCurrentMeasuredJob == j) {
-        _relativeLimitCurrentMeasuredJob = nullptr;
-        _relativeDownloadLimitProgressAtMeasuringRestart = 0;
-    }
+    if (!isLimited())
+        return wanted;
+    const qint64 taken = qBound<qint64>(0, wanted, _tokens);
+    _tokens -= taken;
+    return taken;
 }
 
-void BandwidthManager::relativeUploadMeasuringTimerExpired()
+void TokenBucket::giveBack(qint64 tokens)
 {
-    if (!usingRelativeUploadLimit() || _relativeUploadDeviceList.count() == 0) {
-        // Not in this limiting mode, just wait 1 sec to continue the cycle
-        _relativeUploadDelayTimer.setInterval(1000);
-        _relativeUploadDelayTimer.start();
-        return;
-    }
-    if (!_relativeLimitCurrentMeasuredDevice) {
-        qCDebug(lcBandwidthManager) << "No device set, just waiting 1 sec";
-        _relativeUploadDelayTimer.setInterval(1000);
-        _relativeUploadDelayTimer.start();
-        return;
-    }
+    if (isLimited())
+        _tokens = qMin(_tokens + qMax<qint64>(tokens, 0), burst());
+}
 
-    qCDebug(lcBandwidthManager) << _relativeUploadDeviceList.count() << "Starting Delay";
-
-    qint64 relativeLimitProgressMeasured = (_relativeLimitCurrentMeasuredDevice->_readWithProgress
-                                               + _relativeLimitCurrentMeasuredDevice->_read)
-        / 2;
-    qint64 relativeLimitProgressDifference = relativeLimitProgressMeasured - _relativeUploadLimitProgressAtMeasuringRestart;
-    qCDebug(lcBandwidthManager) << _relativeUploadLimitProgressAtMeasuringRestart
-                                << relativeLimitProgressMeasured << relativeLimitProgressDifference;
-
-    qint64 speedkBPerSec = (relativeLimitProgressDifference / relativeLimitMeasuringTimerIntervalMsec * 1000.0) / 1024.0;
-    qCDebug(lcBandwidthManager) << relativeLimitProgressDifference / 1024 << "kB =>" << speedkBPerSec << "kB/sec on full speed ("
-                                << _relativeLimitCurrentMeasuredDevice->_readWithProgress << _relativeLimitCurrentMeasuredDevice->_read
-                                << qAbs(_relativeLimitCurrentMeasuredDevice->_readWithProgress
-                                       - _relativeLimitCurrentMeasuredDevice->_read)
-                                << ")";
-
-    qint64 uploadLimitPercent = -_currentUploadLimit;
-    // don't use too extreme values
-    uploadLimitPercent = qMin(uploadLimitPercent, qint64(90));
-    uploadLimitPercent = qMax(qint64(10), uploadLimitPercent);
-    qint64 wholeTimeMsec = (100.0 / uploadLimitPercent) * relativeLimitMeasuringTimerIntervalMsec;
-    qint64 waitTimeMsec = wholeTimeMsec - relativeLimitMeasuringTimerIntervalMsec;
-    qint64 realWaitTimeMsec = waitTimeMsec + wholeTimeMsec;
-    qCDebug(lcBandwidthManager) << waitTimeMsec << " - " << realWaitTimeMsec << " msec for " << uploadLimitPercent << "%";
-
-    // We want to wait twice as long since we want to give all
-    // devices the same quota we used now since we don't want
-    // any upload to timeout
-    _relativeUploadDelayTimer.setInterval(realWaitTimeMsec);
-    _relativeUploadDelayTimer.start();
-
-    int deviceCount = _relativeUploadDeviceList.count();
-    qint64 quotaPerDevice = relativeLimitProgressDifference * (uploadLimitPercent / 100.0) / deviceCount + 1.0;
-    Q_FOREACH (UploadDevice *ud, _relativeUploadDeviceList) {
-        ud->setBandwidthLimited(true);
-        ud->setChoked(false);
-        ud->giveBandwidthQuota(quotaPerDevice);
-        qCDebug(lcBandwidthManager) << "Gave" << quotaPerDevice / 1024.0 << "kB to" << ud;
+QVector<qint64> fairShares(qint64 tokens, const QVector<qint64> &demands)
+{
+    // Serve the smallest demands first, each gets at most an equal part of the rest
+    QVector<int> order(demands.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&demands](int a, int b) { return demands[a] < demands[b]; });
+
+    QVector<qint64> shares(demands.size(), 0);
+    qint64 left = qMax<qint64>(tokens, 0);
+    for (int i = 0; i < order.size(); ++i) {
+        const qint64 share = qBound<qint64>(0, demands[order[i]], left / (order.size() - i));
+        shares[order[i]] = share;
+        left -= share;
     }
-    _relativeLimitCurrentMeasuredDevice = nullptr;
+    return shares;
 }
 
-void BandwidthManager::relativeUploadDelayTimerExpired()
+BandwidthManager::BandwidthManager(OwncloudPropagator *p)
+    : QObject()
+    , _propagator(p)
 {
-    // Switch to measuring state
-    _relativeUploadMeasuringTimer.start(); // always start to continue the cycle
+    _timer.setInterval(tickMsec);
+    _timer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&_timer, &QTimer::timeout, this, &BandwidthManager::tick);
+}
 
-    if (!usingRelativeUploadLimit()) {
-        return; // oh, not actually needed
-    }
+BandwidthManager::~BandwidthManager()
+{
+    _uploadDevices.clear();
+    _downloadJobs.clear();
+    updateTimer();
+}
 
-    if (_relativeUploadDeviceList.isEmpty()) {
-        return;
+void BandwidthManager::setGlobalLimits(qint64 upload, qint64 download)
+{
+    auto &global = globalLimits();
+    if (global.upload.rate() != upload || global.download.rate() != download) {
+        qCInfo(lcBandwidthManager) << "Global bandwidth limits (up/down)" << upload << download;
     }
+    global.upload.setRate(upload);
+    global.download.setRate(download);
+}
 
-    qCDebug(lcBandwidthManager) << _relativeUploadDeviceList.count() << "Starting measuring";
+void BandwidthManager::registerUploadDevice(UploadDevice *p)
+{
+    _uploadDevices.append({ p, 0 });
+    QObject::connect(p, &QObject::destroyed, this, &BandwidthManager::unregisterUploadDevice);
 
-    // Take first device and then append it again (= we round robin all devices)
-    _relativeLimitCurrentMeasuredDevice = _relativeUploadDeviceList.takeFirst();
-    _relativeUploadDeviceList.append(_relativeLimitCurrentMeasuredDevice);
+    // Limited devices wait for their quota, the next tick hands it out
+    p->setBandwidthLimited(_propagator->_uploadLimit.fetchAndAddAcquire(0) != 0 || globalLimits().upload.isLimited());
+    QMetaObject::invokeMethod(this, "tick", Qt::QueuedConnection);
+    updateTimer();
+}
 
-    _relativeUploadLimitProgressAtMeasuringRestart = (_relativeLimitCurrentMeasuredDevice->_readWithProgress
-                                                         + _relativeLimitCurrentMeasuredDevice->_read)
-        / 2;
-    _relativeLimitCurrentMeasuredDevice->setBandwidthLimited(false);
-    _relativeLimitCurrentMeasuredDevice->setChoked(false);
+void BandwidthManager::unregisterUploadDevice(QObject *o)
+{
+    unregister(_uploadDevices, reinterpret_cast<UploadDevice *>(o)); // note, we might already be in the ~QObject
+}
 
-    // choke all other UploadDevices
-    Q_FOREACH (UploadDevice *ud, _relativeUploadDeviceList) {
-        if (ud != _relativeLimitCurrentMeasuredDevice) {
-            ud->setBandwidthLimited(true);
-            ud->setChoked(true);
-        }
-    }
+void BandwidthManager::registerDownloadJob(GETFileJob *j)
+{
+    _downloadJobs.append({ j, 0 });
+    QObject::connect(j, &QObject::destroyed, this, &BandwidthManager::unregisterDownloadJob);
 
-    // now we're in measuring state
+    j->setBandwidthLimited(_propagator->_downloadLimit.fetchAndAddAcquire(0) != 0 || globalLimits().download.isLimited());
+    QMetaObject::invokeMethod(this, "tick", Qt::QueuedConnection);
+    updateTimer();
 }
 
-// for downloads:
-void BandwidthManager::relativeDownloadMeasuringTimerExpired()
+void BandwidthManager::unregisterDownloadJob(QObject *o)
 {
-    if (!usingRelativeDownloadLimit() || _downloadJobList.count() == 0) {
-        // Not in this limiting mode, just wait 1 sec to continue the cycle
-        _relativeDownloadDelayTimer.setInterval(1000);
-        _relativeDownloadDelayTimer.start();
-        return;
+    unregister(_downloadJobs, reinterpret_cast<GETFileJob *>(o)); // note, we might already be in the ~QObject
+}
+
+template <typename T>
+void BandwidthManager::unregister(QVector<Transfer<T>> &transfers, T *transfer)
+{
+    // The unused quota is lost, which errs on the side of the limit
+    transfers.erase(std::remove_if(transfers.begin(), transfers.end(),
+                        [transfer](const Transfer<T> &t) { return t.transfer == transfer; }),
+        transfers.end());
+    updateTimer();
+}
+
+void BandwidthManager::updateTimer()
+{
+    auto &global = globalLimits();
+    const bool uploading = !_uploadDevices.isEmpty();
+    if (uploading != _upload.active) {
+        _upload.active = uploading;
+        global.uploadUsers += uploading ? 1 : -1;
     }
-    if (!_relativeLimitCurrentMeasuredJob) {
-        qCDebug(lcBandwidthManager) << "No job set, just waiting 1 sec";
-        _relativeDownloadDelayTimer.setInterval(1000);
-        _relativeDownloadDelayTimer.start();
-        return;
+    const bool downloading = !_downloadJobs.isEmpty();
+    if (downloading != _download.active) {
+        _download.active = downloading;
+        global.downloadUsers += downloading ? 1 : -1;
     }
 
-    qCDebug(lcBandwidthManager) << _downloadJobList.count() << "Starting Delay";
-
-    qint64 relativeLimitProgressMeasured = _relativeLimitCurrentMeasuredJob->currentDownloadPosition();
-    qint64 relativeLimitProgressDifference = relativeLimitProgressMeasured - _relativeDownloadLimitProgressAtMeasuringRestart;
-    qCDebug(lcBandwidthManager) << _relativeDownloadLimitProgressAtMeasuringRestart
-                                << relativeLimitProgressMeasured << relativeLimitProgressDifference;
-
-    qint64 speedkBPerSec = (relativeLimitProgressDifference / relativeLimitMeasuringTimerIntervalMsec * 1000.0) / 1024.0;
-    qCDebug(lcBandwidthManager) << relativeLimitProgressDifference / 1024 << "kB =>" << speedkBPerSec << "kB/sec on full speed ("
-                                << _relativeLimitCurrentMeasuredJob->currentDownloadPosition();
-
-    qint64 downloadLimitPercent = -_currentDownloadLimit;
-    // don't use too extreme values
-    downloadLimitPercent = qMin(downloadLimitPercent, qint64(90));
-    downloadLimitPercent = qMax(qint64(10), downloadLimitPercent);
-    qint64 wholeTimeMsec = (100.0 / downloadLimitPercent) * relativeLimitMeasuringTimerIntervalMsec;
-    qint64 waitTimeMsec = wholeTimeMsec - relativeLimitMeasuringTimerIntervalMsec;
-    qint64 realWaitTimeMsec = waitTimeMsec + wholeTimeMsec;
-    qCDebug(lcBandwidthManager) << waitTimeMsec << " - " << realWaitTimeMsec << " msec for " << downloadLimitPercent << "%";
-
-    // We want to wait twice as long since we want to give all
-    // devices the same quota we used now since we don't want
-    // any download to timeout
-    _relativeDownloadDelayTimer.setInterval(realWaitTimeMsec);
-    _relativeDownloadDelayTimer.start();
-
-    int jobCount = _downloadJobList.count();
-    qint64 quota = relativeLimitProgressDifference * (downloadLimitPercent / 100.0);
-    if (quota > 20 * 1024) {
-        qCInfo(lcBandwidthManager) << "ADJUSTING QUOTA FROM " << quota << " TO " << quota - 20 * 1024;
-        quota -= 20 * 1024;
+    if (!uploading && !downloading) {
+        _timer.stop();
+    } else if (!_timer.isActive()) {
+        _clock.start();
+        _timer.start();
     }
-    qint64 quotaPerJob = quota / jobCount + 1.0;
-    Q_FOREACH (GETFileJob *gfj, _downloadJobList) {
-        gfj->setBandwidthLimited(true);
-        gfj->setChoked(false);
-        gfj->giveBandwidthQuota(quotaPerJob);
-        qCDebug(lcBandwidthManager) << "Gave" << quotaPerJob / 1024.0 << "kB to" << gfj;
-    }
-    _relativeLimitCurrentMeasuredDevice = nullptr;
 }
 
-void BandwidthManager::relativeDownloadDelayTimerExpired()
+void BandwidthManager::tick()
 {
-    // Switch to measuring state
-    _relativeDownloadMeasuringTimer.start(); // always start to continue the cycle
+    if (!_timer.isActive())
+        return; // a queued tick after the last transfer finished
+    const qint64 elapsed = _clock.restart();
+    auto &global = globalLimits();
+    global.refill();
+    pace(_upload, global.upload, global.uploadUsers, _uploadDevices,
+        _propagator->_uploadLimit.fetchAndAddAcquire(0), elapsed);
+    pace(_download, global.download, global.downloadUsers, _downloadJobs,
+        _propagator->_downloadLimit.fetchAndAddAcquire(0), elapsed);
+}
 
-    if (!usingRelativeDownloadLimit()) {
-        return; // oh, not actually needed
+template <typename T>
+void BandwidthManager::pace(Pacer &pacer, TokenBucket &global, int globalUsers,
+    QVector<Transfer<T>> &transfers, qint64 newLimit, qint64 elapsed)
+{
+    if (newLimit != pacer.limit) {
+        qCInfo(lcBandwidthManager) << "Bandwidth limit changed" << pacer.limit << newLimit;
+        pacer.limit = newLimit;
+        pacer.capacity = 0;
+        pacer.cycleElapsed = 0;
+        pacer.probeElapsed = 0;
+        pacer.probeUsed = 0;
     }
 
-    if (_downloadJobList.isEmpty()) {
-        qCDebug(lcBandwidthManager) << _downloadJobList.count() << "No jobs?";
-        return;
+    // Take back the quota that wasn't used
+    qint64 used = 0;
+    for (auto &t : transfers) {
+        const qint64 left = qBound<qint64>(0, t.transfer->bandwidthQuota(), t.quota);
+        used += t.quota - left;
+        pacer.bucket.giveBack(left);
+        global.giveBack(left);
+        t.quota = 0;
     }
 
-    qCDebug(lcBandwidthManager) << _downloadJobList.count() << "Starting measuring";
-
-    // Take first device and then append it again (= we round robin all devices)
-    _relativeLimitCurrentMeasuredJob = _downloadJobList.takeFirst();
-    _downloadJobList.append(_relativeLimitCurrentMeasuredJob);
+    qint64 rate = qMax<qint64>(pacer.limit, 0);
+    if (pacer.limit < 0) {
+        // don't use too extreme values
+        const qint64 percent = qBound<qint64>(10, -pacer.limit, 90);
+        const qint64 cycle = qMax<qint64>(10 * 1000, 2 * probeMsec * 100 / percent);
 
-    _relativeDownloadLimitProgressAtMeasuringRestart = _relativeLimitCurrentMeasuredJob->currentDownloadPosition();
-    _relativeLimitCurrentMeasuredJob->setBandwidthLimited(false);
-    _relativeLimitCurrentMeasuredJob->setChoked(false);
-
-    // choke all other download jobs
-    Q_FOREACH (GETFileJob *gfj, _downloadJobList) {
-        if (gfj != _relativeLimitCurrentMeasuredJob) {
-            gfj->setBandwidthLimited(true);
-            gfj->setChoked(true);
+        if (pacer.cycleElapsed < probeMsec) {
+            pacer.probeUsed += used;
+            pacer.probeElapsed += elapsed;
         }
-    }
-
-    // now we're in measuring state
-}
-
-// end downloads
-
-void BandwidthManager::switchingTimerExpired()
-{
-    qint64 newUploadLimit = _propagator->_uploadLimit.fetchAndAddAcquire(0);
-    if (newUploadLimit != _currentUploadLimit) {
-        qCInfo(lcBandwidthManager) << "Upload Bandwidth limit changed" << _currentUploadLimit << newUploadLimit;
-        _currentUploadLimit = newUploadLimit;
-        Q_FOREACH (UploadDevice *ud, _relativeUploadDeviceList) {
-            if (newUploadLimit == 0) {
-                ud->setBandwidthLimited(false);
-                ud->setChoked(false);
-            } else if (newUploadLimit > 0) {
-                ud->setBandwidthLimited(true);
-                ud->setChoked(false);
-            } else if (newUploadLimit < 0) {
-                ud->setBandwidthLimited(true);
-                ud->setChoked(true);
-            }
+        pacer.cycleElapsed += elapsed;
+        if (pacer.cycleElapsed >= probeMsec && pacer.probeElapsed > 0) {
+            const qint64 measured = pacer.probeUsed * 1000 / pacer.probeElapsed;
+            pacer.capacity = pacer.capacity > 0 ? (pacer.capacity + measured) / 2 : measured;
+            qCDebug(lcBandwidthManager) << "Measured" << measured << "bytes/s, capacity" << pacer.capacity;
+            pacer.probeElapsed = 0;
+            pacer.probeUsed = 0;
         }
-    }
-    qint64 newDownloadLimit = _propagator->_downloadLimit.fetchAndAddAcquire(0);
-    if (newDownloadLimit != _currentDownloadLimit) {
-        qCInfo(lcBandwidthManager) << "Download Bandwidth limit changed" << _currentDownloadLimit << newDownloadLimit;
-        _currentDownloadLimit = newDownloadLimit;
-        Q_FOREACH (GETFileJob *j, _downloadJobList) {
-            if (usingAbsoluteDownloadLimit()) {
-                j->setBandwidthLimited(true);
-                j->setChoked(false);
-            } else if (usingRelativeDownloadLimit()) {
-                j->setBandwidthLimited(true);
-                j->setChoked(true);
-            } else {
-                j->setBandwidthLimited(false);
-                j->setChoked(false);
-            }
+        if (pacer.cycleElapsed >= cycle || (pacer.cycleElapsed >= probeMsec && pacer.capacity == 0)) {
+            // Without a capacity there is nothing to take a percentage of, so probe again
+            pacer.cycleElapsed = 0;
         }
-    }
-}
 
-void BandwidthManager::absoluteLimitTimerExpired()
-{
-    if (usingAbsoluteUploadLimit() && _absoluteUploadDeviceList.count() > 0) {
-        qint64 quotaPerDevice = _currentUploadLimit / qMax(1, _absoluteUploadDeviceList.count());
-        qCDebug(lcBandwidthManager) << quotaPerDevice << _absoluteUploadDeviceList.count() << _currentUploadLimit;
-        Q_FOREACH (UploadDevice *device, _absoluteUploadDeviceList) {
-            device->giveBandwidthQuota(quotaPerDevice);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerDevice / 1024.0 << " kB to" << device;
+        if (pacer.cycleElapsed < probeMsec) {
+            rate = 0;
+        } else {
+            // Slower than the percentage between the probes so that the average matches it
+            rate = qMax<qint64>(1, (pacer.capacity * percent / 100 * cycle - pacer.capacity * probeMsec) / (cycle - probeMsec));
         }
     }
-    if (usingAbsoluteDownloadLimit() && _downloadJobList.count() > 0) {
-        qint64 quotaPerJob = _currentDownloadLimit / qMax(1, _downloadJobList.count());
-        qCDebug(lcBandwidthManager) << quotaPerJob << _downloadJobList.count() << _currentDownloadLimit;
-        Q_FOREACH (GETFileJob *j, _downloadJobList) {
-            j->giveBandwidthQuota(quotaPerJob);
-            qCDebug(lcBandwidthManager) << "Gave " << quotaPerJob / 1024.0 << " kB to" << j;
-        }
+    pacer.bucket.setRate(rate);
+    pacer.bucket.refill(elapsed);
+
+    const bool limited = pacer.limit != 0 || global.isLimited();
+    if (!limited) {
+        for (auto &t : transfers)
+            t.transfer->setBandwidthLimited(false);
+        return;
+    }
+
+    QVector<qint64> demands;
+    demands.reserve(transfers.size());
+    for (const auto &t : transfers)
+        demands.append(demand(t.transfer));
+    qint64 tokens = pacer.bucket.available();
+    if (global.isLimited())
+        tokens = qMin(tokens, global.available() / qMax(1, globalUsers));
+
+    const auto shares = fairShares(tokens, demands);
+    for (int i = 0; i < transfers.size(); ++i) {
+        auto &t = transfers[i];
+        t.quota = shares[i];
+        pacer.bucket.take(t.quota);
+        global.take(t.quota);
+        t.transfer->setBandwidthLimited(true);
+        t.transfer->giveBandwidthQuota(t.quota);
     }
 }
 }
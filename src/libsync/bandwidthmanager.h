@@ -15,10 +15,12 @@
 #ifndef BANDWIDTHMANAGER_H
 #define BANDWIDTHMANAGER_H
 
+#include "owncloudlib.h"
+
 #include <QObject>
-#include <QLinkedList>
+#include <QElapsedTimer>
 #include <QTimer>
-#include <QIODevice>
+#include <QVector>
 
 namespace OCC {
 
@@ -27,78 +29,144 @@ class GETFileJob;
 class OwncloudPropagator;
 
 /**
- * @brief The BandwidthManager class
+ * @brief Paces transfers to a rate in bytes per second
+ *
+ * Tokens accumulate with the elapsed time and transfers take them before
+ * sending or receiving that many bytes. At most burstMsec worth of tokens
+ * are kept: enough to even out timer jitter, but not enough to exceed the
+ * rate noticeably after an idle period.
+ *
  * @ingroup libsync
  */
-class BandwidthManager : public QObject
+class OWNCLOUDSYNC_EXPORT TokenBucket
 {
-    Q_OBJECT
 public:
-    BandwidthManager(OwncloudPropagator *p);
-    ~BandwidthManager();
-
-    bool usingAbsoluteUploadLimit() { return _currentUploadLimit > 0; }
-    bool usingRelativeUploadLimit() { return _currentUploadLimit < 0; }
-    bool usingAbsoluteDownloadLimit() { return _currentDownloadLimit > 0; }
-    bool usingRelativeDownloadLimit() { return _currentDownloadLimit < 0; }
+    static const int burstMsec = 200;
 
+    /** Sets the rate in bytes per second, 0 means unlimited */
+    void setRate(qint64 rate);
+    qint64 rate() const { return _rate; }
+    bool isLimited() const { return _rate > 0; }
 
-public slots:
-    void registerUploadDevice(UploadDevice *);
-    void unregisterUploadDevice(QObject *);
-
-    void registerDownloadJob(GETFileJob *);
-    void unregisterDownloadJob(QObject *);
+    /** Adds the tokens for \a msec elapsed milliseconds */
+    void refill(qint64 msec);
 
-    void absoluteLimitTimerExpired();
-    void switchingTimerExpired();
+    /** The tokens that can be taken right now */
+    qint64 available() const;
 
-    void relativeUploadMeasuringTimerExpired();
-    void relativeUploadDelayTimerExpired();
+    /** Takes up to \a wanted tokens and returns how many were taken */
+    qint64 take(qint64 wanted);
 
-    void relativeDownloadMeasuringTimerExpired();
-    void relativeDownloadDelayTimerExpired();
+    /** Returns tokens that were taken but not used */
+    void giveBack(qint64 tokens);
 
 private:
-    // for switching between absolute and relative bw limiting
-    QTimer _switchingTimer;
+    qint64 burst() const;
 
-    // FIXME this timer and this variable should be replaced
-    // by the propagator emitting the changed limit values to us as signal
-    OwncloudPropagator *_propagator;
+    qint64 _rate = 0;
+    qint64 _tokens = 0;
+    qint64 _fraction = 0; // refill remainder, in 1/1000 tokens
+};
 
-    // for absolute up/down bw limiting
-    QTimer _absoluteLimitTimer;
+/**
+ * Splits \a tokens between transfers that can use at most \a demands
+ * bytes each. Nobody gets more than it can use, the rest is shared equally
+ * by the others (max-min fairness). Small transfers therefore get all they
+ * need right away.
+ */
+OWNCLOUDSYNC_EXPORT QVector<qint64> fairShares(qint64 tokens, const QVector<qint64> &demands);
 
-    // FIXME merge these two lists
-    QLinkedList<UploadDevice *> _absoluteUploadDeviceList;
-    QLinkedList<UploadDevice *> _relativeUploadDeviceList;
+/**
+ * @brief Limits the bandwidth used by the transfers of a propagator
+ *
+ * The limits come from OwncloudPropagator::_uploadLimit and _downloadLimit:
+ * positive values are bytes per second, negative values a percentage of
+ * the measured capacity of the connection and 0 means unlimited. On top of
+ * that, all propagators share the global limits, see setGlobalLimits().
+ *
+ * Every tickMsec the token buckets are refilled and the tokens shared
+ * fairly between the active UploadDevices and GETFileJobs by giving them
+ * bandwidth quota. Quota a transfer didn't use is taken back at the next
+ * tick.
+ *
+ * For percentage limits the capacity is measured by letting the transfers
+ * run without limit for probeMsec regularly. The rate in between is lowered
+ * so the average matches the percentage.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT BandwidthManager : public QObject
+{
+    Q_OBJECT
+public:
+    static const int tickMsec = 100;
+    static const int probeMsec = 2000;
 
-    QTimer _relativeUploadMeasuringTimer;
+    BandwidthManager(OwncloudPropagator *p);
+    ~BandwidthManager();
 
-    // for relative bw limiting, we need to wait this amount before measuring again
-    QTimer _relativeUploadDelayTimer;
+    bool usingAbsoluteUploadLimit() { return _upload.limit > 0; }
+    bool usingRelativeUploadLimit() { return _upload.limit < 0; }
+    bool usingAbsoluteDownloadLimit() { return _download.limit > 0; }
+    bool usingRelativeDownloadLimit() { return _download.limit < 0; }
 
-    // the device measured
-    UploadDevice *_relativeLimitCurrentMeasuredDevice;
+    /**
+     * Sets the limits in bytes per second for the transfers of all
+     * propagators together. 0 means unlimited.
+     */
+    static void setGlobalLimits(qint64 upload, qint64 download);
 
-    // for measuring how much progress we made at start
-    qint64 _relativeUploadLimitProgressAtMeasuringRestart;
-    qint64 _currentUploadLimit;
+public slots:
+    void registerUploadDevice(UploadDevice *);
+    void unregisterUploadDevice(QObject *);
 
-    QLinkedList<GETFileJob *> _downloadJobList;
-    QTimer _relativeDownloadMeasuringTimer;
+    void registerDownloadJob(GETFileJob *);
+    void unregisterDownloadJob(QObject *);
 
-    // for relative bw limiting, we need to wait this amount before measuring again
-    QTimer _relativeDownloadDelayTimer;
+private slots:
+    void tick();
 
-    // the device measured
-    GETFileJob *_relativeLimitCurrentMeasuredJob;
+private:
+    template <typename T>
+    struct Transfer
+    {
+        T *transfer;
+        qint64 quota; // the quota given at the last tick
+    };
+
+    /// The state for one direction
+    struct Pacer
+    {
+        qint64 limit = 0; // as in OwncloudPropagator
+        TokenBucket bucket;
+        bool active = false; // whether there are transfers
+
+        // For relative limits
+        qint64 capacity = 0; // in bytes per second
+        qint64 cycleElapsed = 0; // a cycle starts with a probe
+        qint64 probeElapsed = 0;
+        qint64 probeUsed = 0;
+    };
+
+    template <typename T>
+    void pace(Pacer &pacer, TokenBucket &global, int globalUsers, QVector<Transfer<T>> &transfers,
+        qint64 newLimit, qint64 elapsed);
+
+    template <typename T>
+    void unregister(QVector<Transfer<T>> &transfers, T *transfer);
+
+    void updateTimer();
+
+    // FIXME the propagator should emit the changed limits instead
+    OwncloudPropagator *_propagator;
 
-    // for measuring how much progress we made at start
-    qint64 _relativeDownloadLimitProgressAtMeasuringRestart;
+    QTimer _timer;
+    QElapsedTimer _clock;
 
-    qint64 _currentDownloadLimit;
+    Pacer _upload;
+    Pacer _download;
+    QVector<Transfer<UploadDevice>> _uploadDevices;
+    QVector<Transfer<GETFileJob>> _downloadJobs;
 };
 }
 
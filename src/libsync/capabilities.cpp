@@ -16,6 +16,7 @@
 
 #include <QVariantMap>
 #include <QLoggingCategory>
+#include <QUrl>
 
 #include <QDebug>
 
@@ -162,6 +163,15 @@ QList<int> Capabilities::httpErrorCodesThatResetFailingChunkedUploads() const
     return list;
 }
 
+QList<QByteArray> Capabilities::supportedContentEncodings() const
+{
+    QList<QByteArray> list;
+    foreach (const auto &t, _capabilities["dav"].toMap()["contentEncodings"].toList()) {
+        list.push_back(t.toByteArray());
+    }
+    return list;
+}
+
 QString Capabilities::invalidFilenameRegex() const
 {
     return _capabilities["dav"].toMap()["invalidFilenameRegex"].toString();
@@ -177,6 +187,20 @@ bool Capabilities::uploadConflictFiles() const
     return _capabilities["uploadConflictFiles"].toBool();
 }
 
+QUrl Capabilities::pushNotificationsWebSocketUrl() const
+{
+    const auto notifyPush = _capabilities["notify_push"].toMap();
+    if (!notifyPush["type"].toStringList().contains(QStringLiteral("files")) || pushNotificationsPreAuthUrl().isEmpty())
+        return QUrl();
+    return QUrl(notifyPush["endpoints"].toMap()["websocket"].toString());
+}
+
+QUrl Capabilities::pushNotificationsPreAuthUrl() const
+{
+    const auto endpoints = _capabilities["notify_push"].toMap()["endpoints"].toMap();
+    return QUrl(endpoints["pre_auth"].toString());
+}
+
 /*-------------------------------------------------------------------------------------*/
 
 // Direct Editing
@@ -114,6 +114,16 @@ public:
      */
     QList<int> httpErrorCodesThatResetFailingChunkedUploads() const;
 
+    /**
+     * Content encodings the server accepts for uploads and uses for
+     * downloads, see ContentEncoding.
+     *
+     * Path: dav/contentEncodings
+     * Default: []
+     * Example: ["gzip"]
+     */
+    QList<QByteArray> supportedContentEncodings() const;
+
     /**
      * Regex that, if contained in a filename, will result in it not being uploaded.
      *
@@ -130,6 +140,24 @@ public:
      */
     bool uploadConflictFiles() const;
 
+    /**
+     * The websocket of the notify_push app that reports file changes, see
+     * PushNotifications. Only set if the server pushes file notifications
+     * and has a pre_auth endpoint too.
+     *
+     * Path: notify_push/endpoints/websocket
+     * Default: empty, no push notifications
+     */
+    QUrl pushNotificationsWebSocketUrl() const;
+
+    /**
+     * Hands out tokens to authenticate on the websocket of notify_push.
+     *
+     * Path: notify_push/endpoints/pre_auth
+     * Default: empty
+     */
+    QUrl pushNotificationsPreAuthUrl() const;
+
     // Direct Editing
     void addDirectEditor(DirectEditor* directEditor);
     DirectEditor* getDirectEditorForMimetype(const QMimeType &mimeType);
@@ -64,6 +64,11 @@ namespace {
 } // ns
 
 namespace {
+    // Size of the blocks read, encrypted/decrypted and written at once by the
+    // file encryption functions. Large blocks amortize the per-call overhead of
+    // EVP (which uses AES-NI where available) and of the file I/O.
+    const int fileCryptoBlockSize = 1024 * 1024;
+
     unsigned char* unsignedData(QByteArray& array)
     {
         return (unsigned char*)array.data();
@@ -733,7 +738,10 @@ QByteArray encryptStringAsymmetric(EVP_PKEY *publicKey, const QByteArray& data)
 }
 
 }
-ClientSideEncryption::ClientSideEncryption() = default;
+ClientSideEncryption::ClientSideEncryption()
+    : _metadataCache(new FolderMetadataCache)
+{
+}
 
 void ClientSideEncryption::setAccount(AccountPtr account)
 {
@@ -918,6 +926,7 @@ void ClientSideEncryption::forgetSensitiveData()
     _certificate = QSslCertificate();
     _publicKey = QSslKey();
     _mnemonic = QString();
+    _metadataCache->clear();
 
     auto startDeleteJob = [this](QString user) {
         auto *job = new DeletePasswordJob(Theme::instance()->appName());
@@ -1112,6 +1121,11 @@ bool ClientSideEncryption::newMnemonicGenerated() const
     return _newMnemonicGenerated;
 }
 
+FolderMetadataCache *ClientSideEncryption::metadataCache() const
+{
+    return _metadataCache.data();
+}
+
 void ClientSideEncryption::decryptPrivateKey(const QByteArray &key) {
     QString msg = tr("Please enter your end to end encryption passphrase:<br>"
                      "<br>"
@@ -1477,6 +1491,52 @@ QVector<EncryptedFile> FolderMetadata::files() const {
     return _files;
 }
 
+FolderMetadata FolderMetadataCache::metadata(const AccountPtr &account, const QByteArray &folderId,
+    const QJsonDocument &json, int statusCode)
+{
+    if (statusCode == 404) {
+        _entries.remove(folderId);
+        return FolderMetadata(account, QByteArray(), statusCode);
+    }
+
+    // The encrypted metadata as the server stores it, see setupExistingMetadata()
+    const QByteArray encryptedMetadata = json.object()["ocs"]
+                                             .toObject()["data"]
+                                             .toObject()["meta-data"]
+                                             .toString()
+                                             .toUtf8();
+    auto it = _entries.constFind(folderId);
+    if (it != _entries.constEnd() && it->encryptedMetadata == encryptedMetadata) {
+        qCDebug(lcCseMetadata) << "Metadata of folder" << folderId << "is unchanged, reusing it";
+        return it->metadata;
+    }
+
+    FolderMetadata metadata(account, json.toJson(QJsonDocument::Compact), statusCode);
+    // Without the private key nothing could be decrypted, don't keep that
+    if (account->e2e()->hasPrivateKey()) {
+        insert(folderId, encryptedMetadata, metadata);
+    } else {
+        _entries.remove(folderId);
+    }
+    return metadata;
+}
+
+void FolderMetadataCache::insert(const QByteArray &folderId, const QByteArray &encryptedMetadata,
+    const FolderMetadata &metadata)
+{
+    _entries.insert(folderId, Entry{ encryptedMetadata, metadata });
+}
+
+void FolderMetadataCache::remove(const QByteArray &folderId)
+{
+    _entries.remove(folderId);
+}
+
+void FolderMetadataCache::clear()
+{
+    _entries.clear();
+}
+
 bool ClientSideEncryption::isFolderEncrypted(const QString& path) const {
   auto it = _folder2encryptedStatus.constFind(path);
   if (it == _folder2encryptedStatus.constEnd())
@@ -1504,9 +1564,11 @@ bool EncryptionHelper::fileEncryption(const QByteArray &key, const QByteArray &i
 {
     if (!input->open(QIODevice::ReadOnly)) {
       qCDebug(lcCse) << "Could not open input file for reading" << input->errorString();
+      return false;
     }
     if (!output->open(QIODevice::WriteOnly)) {
       qCDebug(lcCse) << "Could not oppen output file for writing" << output->errorString();
+      return false;
     }
 
     // Init
@@ -1538,35 +1600,38 @@ bool EncryptionHelper::fileEncryption(const QByteArray &key, const QByteArray &i
         return false;
     }
 
-    QByteArray out(1024 + 16 - 1, '\0');
+    // Both buffers are allocated once and reused for every block.
+    QByteArray in(fileCryptoBlockSize, Qt::Uninitialized);
+    QByteArray out(fileCryptoBlockSize + 16 - 1, Qt::Uninitialized);
     int len = 0;
-    int total_len = 0;
-
-    qCDebug(lcCse) << "Starting to encrypt the file" << input->fileName() << input->atEnd();
-    while(!input->atEnd()) {
-        QByteArray data = input->read(1024);
 
-        if (data.size() == 0) {
-            qCInfo(lcCse()) << "Could not read data from file";
+    qCDebug(lcCse) << "Starting to encrypt the file" << input->fileName() << input->size();
+    forever {
+        const qint64 read = input->read(in.data(), in.size());
+        if (read < 0) {
+            qCInfo(lcCse()) << "Could not read data from file" << input->errorString();
             return false;
         }
+        if (read == 0) {
+            break;
+        }
 
-        qCDebug(lcCse) << "Encrypting " << data;
-        if(!EVP_EncryptUpdate(ctx, unsignedData(out), &len, (unsigned char *)data.constData(), data.size())) {
+        if(!EVP_EncryptUpdate(ctx, unsignedData(out), &len, (const unsigned char *)in.constData(), static_cast<int>(read))) {
             qCInfo(lcCse()) << "Could not encrypt";
             return false;
         }
 
-        output->write(out, len);
-        total_len += len;
+        if (output->write(out.constData(), len) != len) {
+            qCInfo(lcCse()) << "Could not write encrypted data" << output->errorString();
+            return false;
+        }
     }
 
     if(1 != EVP_EncryptFinal_ex(ctx, unsignedData(out), &len)) {
         qCInfo(lcCse()) << "Could finalize encryption";
         return false;
     }
-    output->write(out, len);
-    total_len += len;
+    output->write(out.constData(), len);
 
     /* Get the tag */
     QByteArray tag(16, '\0');
@@ -1576,7 +1641,10 @@ bool EncryptionHelper::fileEncryption(const QByteArray &key, const QByteArray &i
     }
 
     returnTag = tag;
-    output->write(tag, 16);
+    if (output->write(tag, 16) != 16) {
+        qCInfo(lcCse()) << "Could not write tag" << output->errorString();
+        return false;
+    }
 
     input->close();
     output->close();
@@ -1584,84 +1652,162 @@ bool EncryptionHelper::fileEncryption(const QByteArray &key, const QByteArray &i
     return true;
 }
 
+namespace {
+    bool initFileDecryption(CipherCtx &ctx, const QByteArray &key, const QByteArray &iv, const QByteArray &tag)
+    {
+        /* Create and initialise the context */
+        if(!ctx) {
+            qCInfo(lcCse()) << "Could not create context";
+            return false;
+        }
+
+        /* Initialise the decryption operation. */
+        if(!EVP_DecryptInit_ex(ctx, EVP_aes_128_gcm(), nullptr, nullptr, nullptr)) {
+            qCInfo(lcCse()) << "Could not init cipher";
+            return false;
+        }
+
+        EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+        /* Set IV length. */
+        if(!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN,  iv.size(), nullptr)) {
+            qCInfo(lcCse()) << "Could not set iv length";
+            return false;
+        }
+
+        /* Initialise key and IV */
+        if(!EVP_DecryptInit_ex(ctx, nullptr, nullptr, (const unsigned char *) key.constData(), (const unsigned char *) iv.constData())) {
+            qCInfo(lcCse()) << "Could not set key and iv";
+            return false;
+        }
+
+        /* Set expected tag value. Works in OpenSSL 1.0.1d and later */
+        if(!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, tag.size(), (unsigned char *)tag.constData())) {
+            qCInfo(lcCse()) << "Could not set expected tag";
+            return false;
+        }
+        return true;
+    }
+} // ns
+
 bool EncryptionHelper::fileDecryption(const QByteArray &key, const QByteArray& iv,
                                QFile *input, QFile *output)
 {
-    input->open(QIODevice::ReadOnly);
-    output->open(QIODevice::WriteOnly);
+    if (!input->open(QIODevice::ReadOnly)) {
+        qCInfo(lcCse()) << "Could not open input file for reading" << input->errorString();
+        return false;
+    }
+    if (!output->open(QIODevice::WriteOnly)) {
+        qCInfo(lcCse()) << "Could not open output file for writing" << output->errorString();
+        return false;
+    }
+
+    const qint64 size = input->size() - 16;
+    if (size < 0 || !input->seek(size)) {
+        qCInfo(lcCse()) << "Encrypted file is too short" << input->fileName();
+        return false;
+    }
+    const QByteArray tag = input->read(16);
+    input->seek(0);
 
     // Init
     CipherCtx ctx;
-
-    /* Create and initialise the context */
-    if(!ctx) {
-        qCInfo(lcCse()) << "Could not create context";
+    if (!initFileDecryption(ctx, key, iv, tag)) {
         return false;
     }
 
-    /* Initialise the decryption operation. */
-    if(!EVP_DecryptInit_ex(ctx, EVP_aes_128_gcm(), nullptr, nullptr, nullptr)) {
-        qCInfo(lcCse()) << "Could not init cipher";
+    QByteArray in(fileCryptoBlockSize, Qt::Uninitialized);
+    QByteArray out(fileCryptoBlockSize + 16 - 1, Qt::Uninitialized);
+    int len = 0;
+
+    while(input->pos() < size) {
+        const qint64 toRead = qMin<qint64>(size - input->pos(), in.size());
+        if (input->read(in.data(), toRead) != toRead) {
+            qCInfo(lcCse()) << "Could not read data from file" << input->errorString();
+            return false;
+        }
+
+        if(!EVP_DecryptUpdate(ctx, unsignedData(out), &len, (const unsigned char *)in.constData(), static_cast<int>(toRead))) {
+            qCInfo(lcCse()) << "Could not decrypt";
+            return false;
+        }
+
+        if (output->write(out.constData(), len) != len) {
+            qCInfo(lcCse()) << "Could not write decrypted data" << output->errorString();
+            return false;
+        }
+    }
+
+    if(1 != EVP_DecryptFinal_ex(ctx, unsignedData(out), &len)) {
+        qCInfo(lcCse()) << "Could finalize decryption";
         return false;
     }
+    output->write(out.constData(), len);
 
-    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    input->close();
+    output->close();
+    return true;
+}
 
-    /* Set IV length. */
-    if(!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN,  iv.size(), nullptr)) {
-        qCInfo(lcCse()) << "Could not set iv length";
+bool EncryptionHelper::fileDecryptionInPlace(const QByteArray &key, const QByteArray &iv, QFile *file)
+{
+    if (!file->open(QIODevice::ReadWrite)) {
+        qCInfo(lcCse()) << "Could not open file for decryption" << file->errorString();
         return false;
     }
 
-    /* Initialise key and IV */
-    if(!EVP_DecryptInit_ex(ctx, nullptr, nullptr, (const unsigned char *) key.constData(), (const unsigned char *) iv.constData())) {
-        qCInfo(lcCse()) << "Could not set key and iv";
+    const qint64 size = file->size() - 16;
+    if (size < 0 || !file->seek(size)) {
+        qCInfo(lcCse()) << "Encrypted file is too short" << file->fileName();
         return false;
     }
+    const QByteArray tag = file->read(16);
 
-    qint64 size = input->size() - 16;
+    CipherCtx ctx;
+    if (!initFileDecryption(ctx, key, iv, tag)) {
+        return false;
+    }
 
-    QByteArray out(1024 + 16 - 1, '\0');
+    // AES-GCM is a stream mode: every block of ciphertext decrypts to exactly as many
+    // bytes of plaintext, so each block can be written back where it was read from.
+    QByteArray in(fileCryptoBlockSize, Qt::Uninitialized);
+    QByteArray out(fileCryptoBlockSize + 16 - 1, Qt::Uninitialized);
     int len = 0;
+    qint64 pos = 0;
 
-    while(input->pos() < size) {
-
-        int toRead = size - input->pos();
-        if (toRead > 1024) {
-            toRead = 1024;
-        }
-
-        QByteArray data = input->read(toRead);
-
-        if (data.size() == 0) {
-            qCInfo(lcCse()) << "Could not read data from file";
+    while (pos < size) {
+        const qint64 toRead = qMin<qint64>(size - pos, in.size());
+        if (!file->seek(pos) || file->read(in.data(), toRead) != toRead) {
+            qCInfo(lcCse()) << "Could not read data from file" << file->errorString();
             return false;
         }
 
-        if(!EVP_DecryptUpdate(ctx, unsignedData(out), &len, (unsigned char *)data.constData(), data.size())) {
+        if (!EVP_DecryptUpdate(ctx, unsignedData(out), &len, (const unsigned char *)in.constData(), static_cast<int>(toRead))
+            || len != toRead) {
             qCInfo(lcCse()) << "Could not decrypt";
             return false;
         }
 
-        output->write(out, len);
+        if (!file->seek(pos) || file->write(out.constData(), len) != len) {
+            qCInfo(lcCse()) << "Could not write decrypted data" << file->errorString();
+            return false;
+        }
+        pos += toRead;
     }
 
-    QByteArray tag = input->read(16);
-
-    /* Set expected tag value. Works in OpenSSL 1.0.1d and later */
-    if(!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, tag.size(), (unsigned char *)tag.constData())) {
-        qCInfo(lcCse()) << "Could not set expected tag";
+    // The tag is only checked here; on failure the file holds garbage and
+    // must be discarded by the caller.
+    if (1 != EVP_DecryptFinal_ex(ctx, unsignedData(out), &len)) {
+        qCInfo(lcCse()) << "Could finalize decryption";
         return false;
     }
 
-    if(1 != EVP_DecryptFinal_ex(ctx, unsignedData(out), &len)) {
-        qCInfo(lcCse()) << "Could finalize decryption";
+    if (!file->resize(size)) {
+        qCInfo(lcCse()) << "Could not remove the tag from the decrypted file" << file->errorString();
         return false;
     }
-    output->write(out, len);
 
-    input->close();
-    output->close();
+    file->close();
     return true;
 }
 
@@ -9,6 +9,8 @@
 #include <QFile>
 #include <QVector>
 #include <QMap>
+#include <QHash>
+#include <QSharedPointer>
 
 #include <openssl/evp.h>
 
@@ -23,6 +25,8 @@ class ReadPasswordJob;
 
 namespace OCC {
 
+class FolderMetadataCache;
+
 QString baseUrl();
 
 namespace EncryptionHelper {
@@ -64,6 +68,12 @@ namespace EncryptionHelper {
 
     bool fileDecryption(const QByteArray &key, const QByteArray& iv,
                                QFile *input, QFile *output);
+
+    /* Decrypts an encrypted file (ciphertext followed by the 16 byte tag) without
+     * needing space for a second copy: the plaintext overwrites the ciphertext and
+     * the tag is truncated. If false is returned, the file content is undefined.
+     */
+    bool fileDecryptionInPlace(const QByteArray &key, const QByteArray &iv, QFile *file);
 }
 
 class OWNCLOUDSYNC_EXPORT ClientSideEncryption : public QObject {
@@ -90,6 +100,9 @@ public:
 
     bool newMnemonicGenerated() const;
 
+    /// The decrypted metadata of the encrypted folders of this account
+    FolderMetadataCache *metadataCache() const;
+
 public slots:
     void slotRequestMnemonic();
 
@@ -123,6 +136,7 @@ private:
     //TODO: Save this on disk.
     QMap<QByteArray, QByteArray> _folder2token;
     QMap<QString, bool> _folder2encryptedStatus;
+    QSharedPointer<FolderMetadataCache> _metadataCache;
 
 public:
     //QSslKey _privateKey;
@@ -173,5 +187,39 @@ private:
     QVector<QPair<QString, QString>> _sharing;
 };
 
+/**
+ * @brief Decrypted metadata of the encrypted folders of an account
+ *
+ * Decrypting the metadata of a folder needs the private key, and a sync
+ * that touches many files of one folder gets the same metadata for each
+ * of them. The decrypted metadata is kept per folder id together with the
+ * encrypted metadata it came from and is reused for as long as the server
+ * returns that same encrypted metadata.
+ */
+class OWNCLOUDSYNC_EXPORT FolderMetadataCache
+{
+public:
+    /**
+     * The metadata of folderId from the reply of a GetMetadataApiJob,
+     * only decrypted if it changed since it was seen last.
+     */
+    FolderMetadata metadata(const AccountPtr &account, const QByteArray &folderId,
+        const QJsonDocument &json, int statusCode = -1);
+
+    /// Remembers metadata after it was stored on the server as encryptedMetadata
+    void insert(const QByteArray &folderId, const QByteArray &encryptedMetadata,
+        const FolderMetadata &metadata);
+    void remove(const QByteArray &folderId);
+    void clear();
+
+private:
+    struct Entry
+    {
+        QByteArray encryptedMetadata;
+        FolderMetadata metadata;
+    };
+    QHash<QByteArray, Entry> _entries;
+};
+
 } // namespace OCC
 #endif
@@ -54,6 +54,7 @@ Q_LOGGING_CATEGORY(lcConfigFile, "sync.configfile", QtInfoMsg)
 
 //static const char caCertsKeyC[] = "CaCertificates"; only used from account.cpp
 static const char remotePollIntervalC[] = "remotePollInterval";
+static const char pushFallbackPollIntervalC[] = "pushFallbackPollInterval";
 static const char forceSyncIntervalC[] = "forceSyncInterval";
 static const char fullLocalDiscoveryIntervalC[] = "fullLocalDiscoveryInterval";
 static const char notificationRefreshIntervalC[] = "notificationRefreshInterval";
@@ -90,6 +91,11 @@ static const char newBigFolderSizeLimitC[] = "newBigFolderSizeLimit";
 static const char useNewBigFolderSizeLimitC[] = "useNewBigFolderSizeLimit";
 static const char confirmExternalStorageC[] = "confirmExternalStorage";
 static const char moveToTrashC[] = "moveToTrash";
+static const char incrementalRemoteDiscoveryC[] = "incrementalRemoteDiscovery";
+static const char bulkInitialDiscoveryC[] = "bulkInitialDiscovery";
+static const char serverSideCopyC[] = "serverSideCopy";
+static const char localCopyForDownloadsC[] = "localCopyForDownloads";
+static const char deltaDownloadsC[] = "deltaDownloads";
 
 static const char maxLogLinesC[] = "Logging/maxLogLines";
 
@@ -490,6 +496,24 @@ void ConfigFile::setRemotePollInterval(chrono::milliseconds interval, const QStr
     settings.sync();
 }
 
+chrono::milliseconds ConfigFile::pushFallbackPollInterval(const QString &connection) const
+{
+    auto pollInterval = remotePollInterval(connection);
+
+    QString con(connection);
+    if (connection.isEmpty())
+        con = defaultConnection();
+    QSettings settings(configFile(), QSettings::IniFormat);
+    settings.beginGroup(con);
+
+    auto interval = millisecondsValue(settings, pushFallbackPollIntervalC, chrono::minutes(5));
+    if (interval < pollInterval) {
+        qCWarning(lcConfigFile) << "Push fallback poll interval is less than the remote poll inteval, reverting to" << pollInterval.count();
+        interval = pollInterval;
+    }
+    return interval;
+}
+
 chrono::milliseconds ConfigFile::forceSyncInterval(const QString &connection) const
 {
     auto pollInterval = remotePollInterval(connection);
@@ -800,6 +824,31 @@ void ConfigFile::setMoveToTrash(bool isChecked)
     setValue(moveToTrashC, isChecked);
 }
 
+bool ConfigFile::incrementalRemoteDiscovery() const
+{
+    return getValue(incrementalRemoteDiscoveryC, QString(), false).toBool();
+}
+
+bool ConfigFile::bulkInitialDiscovery() const
+{
+    return getValue(bulkInitialDiscoveryC, QString(), false).toBool();
+}
+
+bool ConfigFile::serverSideCopy() const
+{
+    return getValue(serverSideCopyC, QString(), false).toBool();
+}
+
+bool ConfigFile::localCopyForDownloads() const
+{
+    return getValue(localCopyForDownloadsC, QString(), false).toBool();
+}
+
+bool ConfigFile::deltaDownloads() const
+{
+    return getValue(deltaDownloadsC, QString(), false).toBool();
+}
+
 bool ConfigFile::promptDeleteFiles() const
 {
     QSettings settings(configFile(), QSettings::IniFormat);
@@ -67,6 +67,9 @@ public:
     /* Set poll interval. Value in milliseconds has to be larger than 5000 */
     void setRemotePollInterval(std::chrono::milliseconds interval, const QString &connection = QString());
 
+    /* Server poll interval while push notifications report remote changes */
+    std::chrono::milliseconds pushFallbackPollInterval(const QString &connection = QString()) const;
+
     /* Interval to check for new notifications */
     std::chrono::milliseconds notificationRefreshInterval(const QString &connection = QString()) const;
 
@@ -126,6 +129,21 @@ public:
     bool moveToTrash() const;
     void setMoveToTrash(bool);
 
+    /** If the server should be asked for the remote changes since the last sync, see SyncOptions */
+    bool incrementalRemoteDiscovery() const;
+
+    /** If the first sync of a folder may list the remote tree in one go, see SyncOptions */
+    bool bulkInitialDiscovery() const;
+
+    /** If new files may be copied on the server instead of uploaded, see SyncOptions */
+    bool serverSideCopy() const;
+
+    /** If new remote files may be copied from identical local ones, see SyncOptions */
+    bool localCopyForDownloads() const;
+
+    /** If only the changed blocks of large files may be downloaded, see SyncOptions */
+    bool deltaDownloads() const;
+
     static bool setConfDir(const QString &value);
 
     bool optionalServerNotifications() const;
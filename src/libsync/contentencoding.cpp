@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "contentencoding.h"
+
+#include <QLoggingCategory>
+
+#include <zlib.h>
+
+#include <cstring>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcContentEncoding, "nextcloud.sync.contentencoding", QtInfoMsg)
+
+// windowBits for deflate and inflate that select the gzip format
+static const int gzipWindowBits = 15 + 16;
+
+// Compressing a sample of this size is quick and good enough to guess
+static const int sampleSize = 64 * 1024;
+
+static QByteArray compress(const char *data, qint64 size, int level)
+{
+    z_stream stream = {};
+    if (deflateInit2(&stream, level, Z_DEFLATED, gzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        qCWarning(lcContentEncoding) << "Could not initialize compression";
+        return QByteArray();
+    }
+
+    QByteArray result(int(deflateBound(&stream, uLong(size))), Qt::Uninitialized);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = uInt(size);
+    stream.next_out = reinterpret_cast<Bytef *>(result.data());
+    stream.avail_out = uInt(result.size());
+    const int rc = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (rc != Z_STREAM_END) {
+        qCWarning(lcContentEncoding) << "Compression failed" << rc;
+        return QByteArray();
+    }
+    result.resize(int(stream.total_out));
+    return result;
+}
+
+bool ContentEncoding::isCompressedFormat(const QByteArray &data)
+{
+    static const struct
+    {
+        int offset;
+        const char *magic;
+    } formats[] = {
+        { 0, "\x1f\x8b" }, // gzip
+        { 0, "PK\x03\x04" }, // zip and the office formats based on it
+        { 0, "\x28\xb5\x2f\xfd" }, // zstd
+        { 0, "\xfd" "7zXZ" }, // xz
+        { 0, "BZh" }, // bzip2
+        { 0, "7z\xbc\xaf\x27\x1c" }, // 7-Zip
+        { 0, "Rar!" },
+        { 0, "\xff\xd8\xff" }, // JPEG
+        { 0, "\x89PNG" },
+        { 0, "GIF8" },
+        { 8, "WEBP" },
+        { 4, "ftyp" }, // MP4, MOV, HEIC
+        { 0, "\x1a\x45\xdf\xa3" }, // Matroska, WebM
+        { 0, "OggS" },
+        { 0, "ID3" }, // MP3
+        { 0, "fLaC" },
+    };
+    for (const auto &format : formats) {
+        const int length = int(qstrlen(format.magic));
+        if (data.size() >= format.offset + length
+            && memcmp(data.constData() + format.offset, format.magic, size_t(length)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ContentEncoding::isLikelyCompressible(const QByteArray &data)
+{
+    if (isCompressedFormat(data))
+        return false;
+    const auto sample = qMin(data.size(), sampleSize);
+    if (sample == 0)
+        return false;
+    const auto compressed = compress(data.constData(), sample, 1);
+    return !compressed.isEmpty() && compressed.size() < sample * 9 / 10;
+}
+
+QByteArray ContentEncoding::gzipCompress(const QByteArray &data)
+{
+    // The higher levels take several times longer for a few percent
+    return compress(data.constData(), data.size(), Z_BEST_SPEED);
+}
+
+QByteArray ContentEncoding::gzipCompressIfSmaller(const QByteArray &data)
+{
+    if (!isLikelyCompressible(data))
+        return QByteArray();
+    auto compressed = gzipCompress(data);
+    if (compressed.size() >= data.size() * 95 / 100)
+        return QByteArray();
+    return compressed;
+}
+
+GzipDecompressor::GzipDecompressor()
+    : _stream(new z_stream())
+{
+    _valid = inflateInit2(_stream, gzipWindowBits) == Z_OK;
+    if (!_valid)
+        qCWarning(lcContentEncoding) << "Could not initialize decompression";
+}
+
+GzipDecompressor::~GzipDecompressor()
+{
+    if (_valid)
+        inflateEnd(_stream);
+    delete _stream;
+}
+
+bool GzipDecompressor::decompress(const char *data, qint64 size, QByteArray *out)
+{
+    if (!_valid || (_finished && size > 0))
+        return false;
+
+    const int chunkSize = 64 * 1024;
+    _stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    _stream->avail_in = uInt(size);
+    while (_stream->avail_in > 0 && !_finished) {
+        const int oldSize = out->size();
+        out->resize(oldSize + chunkSize);
+        _stream->next_out = reinterpret_cast<Bytef *>(out->data() + oldSize);
+        _stream->avail_out = chunkSize;
+        const int rc = inflate(_stream, Z_NO_FLUSH);
+        out->resize(oldSize + chunkSize - int(_stream->avail_out));
+        if (rc == Z_STREAM_END) {
+            _finished = true;
+        } else if (rc != Z_OK) {
+            qCWarning(lcContentEncoding) << "Decompression failed" << rc << (_stream->msg ? _stream->msg : "");
+            return false;
+        }
+    }
+    // Data after the end of the stream
+    return _stream->avail_in == 0;
+}
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include "owncloudlib.h"
+
+#include <QByteArray>
+
+struct z_stream_s;
+
+namespace OCC {
+
+/**
+ * @brief Helpers for compressed transfers of file contents
+ *
+ * Uploads and downloads use the gzip Content-Encoding if the server
+ * announces it in its capabilities, see Capabilities::supportedContentEncodings().
+ * Checksums are always computed over the uncompressed content.
+ *
+ * @ingroup libsync
+ */
+namespace ContentEncoding {
+    static const char gzipC[] = "gzip";
+
+    /**
+     * Whether \a data starts like a format that is compressed already,
+     * like images, videos and archives. Only looks at the first bytes.
+     */
+    OWNCLOUDSYNC_EXPORT bool isCompressedFormat(const QByteArray &data);
+
+    /**
+     * Guesses whether compressing \a data is worthwhile by compressing a
+     * sample from its start. Media files and archives don't get smaller.
+     */
+    OWNCLOUDSYNC_EXPORT bool isLikelyCompressible(const QByteArray &data);
+
+    /**
+     * Compresses \a data in gzip format, favoring speed over size.
+     * Returns an empty array on error.
+     */
+    OWNCLOUDSYNC_EXPORT QByteArray gzipCompress(const QByteArray &data);
+
+    /**
+     * Compresses \a data with gzipCompress() if isLikelyCompressible() and the
+     * result saves at least 5%. Returns an empty array otherwise.
+     *
+     * Takes a while for large data, it can run in any thread.
+     */
+    OWNCLOUDSYNC_EXPORT QByteArray gzipCompressIfSmaller(const QByteArray &data);
+}
+
+/**
+ * @brief Decompresses a gzip stream that arrives in pieces
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT GzipDecompressor
+{
+public:
+    GzipDecompressor();
+    ~GzipDecompressor();
+
+    /**
+     * Appends what can be decompressed from \a data to \a out.
+     *
+     * Returns false if the data is corrupt or continues after the end of
+     * the stream.
+     */
+    bool decompress(const char *data, qint64 size, QByteArray *out);
+
+    /** Whether the complete stream was decompressed */
+    bool isFinished() const { return _finished; }
+
+private:
+    Q_DISABLE_COPY(GzipDecompressor)
+
+    z_stream_s *_stream;
+    bool _valid = false;
+    bool _finished = false;
+};
+}
@@ -260,11 +260,8 @@ DiscoverySingleDirectoryJob::DiscoverySingleDirectoryJob(const AccountPtr &accou
 {
 }
 
-void DiscoverySingleDirectoryJob::start()
+QList<QByteArray> DiscoverySingleDirectoryJob::properties(const AccountPtr &account, bool isRootPath)
 {
-    // Start the actual HTTP job
-    auto *lsColJob = new LsColJob(_account, _subPath, this);
-
     QList<QByteArray> props;
     props << "resourcetype"
           << "getlastmodified"
@@ -275,14 +272,20 @@ void DiscoverySingleDirectoryJob::start()
           << "http://owncloud.org/ns:dDC"
           << "http://owncloud.org/ns:permissions"
           << "http://owncloud.org/ns:checksums";
-    if (_isRootPath)
+    if (isRootPath)
         props << "http://owncloud.org/ns:data-fingerprint";
-    if (_account->serverVersionInt() >= Account::makeServerVersion(10, 0, 0)) {
+    if (account->serverVersionInt() >= Account::makeServerVersion(10, 0, 0)) {
         // Server older than 10.0 have performances issue if we ask for the share-types on every PROPFIND
         props << "http://owncloud.org/ns:share-types";
     }
+    return props;
+}
 
-    lsColJob->setProperties(props);
+void DiscoverySingleDirectoryJob::start()
+{
+    // Start the actual HTTP job
+    auto *lsColJob = new LsColJob(_account, _subPath, this);
+    lsColJob->setProperties(properties(_account, _isRootPath));
 
     QObject::connect(lsColJob, &LsColJob::directoryListingIterated,
         this, &DiscoverySingleDirectoryJob::directoryListingIteratedSlot);
@@ -349,6 +352,37 @@ static void propertyMapToFileStat(const QMap<QString, QString> &map, csync_file_
     }
 }
 
+/* Creates the entry for a file of a directory listing. Sets *missingData if the
+   server didn't report enough to sync it. */
+static std::unique_ptr<csync_file_stat_t> propertyMapToRemoteEntry(const QString &file, const QMap<QString, QString> &map, bool *missingData)
+{
+    std::unique_ptr<csync_file_stat_t> file_stat(new csync_file_stat_t);
+    file_stat->path = file.toUtf8();
+    file_stat->size = -1;
+    propertyMapToFileStat(map, file_stat.get());
+    if (file_stat->type == ItemTypeDirectory)
+        file_stat->size = 0;
+    if (file_stat->remotePerm.hasPermission(RemotePermissions::IsShared) && file_stat->etag.isEmpty()) {
+        /* Handle broken shared file error gracefully instead of stopping sync in the desktop client.
+           DO not set _error */
+        qCWarning(lcDiscovery)
+            << "Missing path to a share :" << file << file_stat->path << file_stat->type << file_stat->size
+            << file_stat->modtime << file_stat->remotePerm.toString()
+            << file_stat->etag << file_stat->file_id;
+    } else if (file_stat->type == ItemTypeSkip
+        || file_stat->size == -1
+        || file_stat->remotePerm.isNull()
+        || file_stat->etag.isEmpty()
+        || file_stat->file_id.isEmpty()) {
+        *missingData = true;
+        qCWarning(lcDiscovery)
+            << "Missing properties:" << file << file_stat->type << file_stat->size
+            << file_stat->modtime << file_stat->remotePerm.toString()
+            << file_stat->etag << file_stat->file_id;
+    }
+    return file_stat;
+}
+
 void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, const QMap<QString, QString> &map)
 {
     if (!_ignoredFirst) {
@@ -378,29 +412,10 @@ void DiscoverySingleDirectoryJob::directoryListingIteratedSlot(QString file, con
             file = file.remove(0, 1);
         }
 
-        std::unique_ptr<csync_file_stat_t> file_stat(new csync_file_stat_t);
-        file_stat->path = file.toUtf8();
-        file_stat->size = -1;
-        propertyMapToFileStat(map, file_stat.get());
-        if (file_stat->type == ItemTypeDirectory)
-            file_stat->size = 0;
-        if (file_stat->remotePerm.hasPermission(RemotePermissions::IsShared) && file_stat->etag.isEmpty()) {
-            /* Handle broken shared file error gracefully instead of stopping sync in the desktop client.
-               DO not set _error */
-            qCWarning(lcDiscovery)
-                << "Missing path to a share :" << file << file_stat->path << file_stat->type << file_stat->size
-                << file_stat->modtime << file_stat->remotePerm.toString()
-                << file_stat->etag << file_stat->file_id;
-        } else if (file_stat->type == ItemTypeSkip
-            || file_stat->size == -1
-            || file_stat->remotePerm.isNull()
-            || file_stat->etag.isEmpty()
-            || file_stat->file_id.isEmpty()) {
+        bool missingData = false;
+        auto file_stat = propertyMapToRemoteEntry(file, map, &missingData);
+        if (missingData) {
             _error = tr("The server file discovery reply is missing data.");
-            qCWarning(lcDiscovery)
-                << "Missing properties:" << file << file_stat->type << file_stat->size
-                << file_stat->modtime << file_stat->remotePerm.toString()
-                << file_stat->etag << file_stat->file_id;
         }
 
         if (_isExternalStorage && file_stat->remotePerm.hasPermission(RemotePermissions::IsMounted)) {
@@ -471,6 +486,142 @@ void DiscoverySingleDirectoryJob::lsJobFinishedWithErrorSlot(QNetworkReply *r)
     deleteLater();
 }
 
+DiscoveryBulkJob::DiscoveryBulkJob(const AccountPtr &account, const QString &path, QObject *parent)
+    : QObject(parent)
+    , _account(account)
+    , _path(path)
+{
+}
+
+void DiscoveryBulkJob::start()
+{
+    // Only the server knows how big the subtree is, so this can take a while.
+    // The entries are processed while they come in.
+    auto lsColJob = new LsColJob(_account, _path, this);
+    lsColJob->setDepth("infinity");
+    lsColJob->setProperties(DiscoverySingleDirectoryJob::properties(_account, _isRootPath));
+
+    QObject::connect(lsColJob, &LsColJob::directoryListingIterated,
+        this, &DiscoveryBulkJob::directoryListingIteratedSlot);
+    QObject::connect(lsColJob, &LsColJob::finishedWithError, this, &DiscoveryBulkJob::lsJobFinishedWithErrorSlot);
+    QObject::connect(lsColJob, &LsColJob::finishedWithoutError, this, &DiscoveryBulkJob::lsJobFinishedWithoutErrorSlot);
+    lsColJob->start();
+
+    _lsColJob = lsColJob;
+}
+
+void DiscoveryBulkJob::abort()
+{
+    if (_lsColJob && _lsColJob->reply()) {
+        _lsColJob->reply()->abort();
+    }
+}
+
+bool DiscoveryBulkJob::isBelowMountPoint(const QString &relativePath) const
+{
+    for (const auto &mountPoint : _mountPoints) {
+        if (relativePath.startsWith(mountPoint + QLatin1Char('/')))
+            return true;
+    }
+    return false;
+}
+
+void DiscoveryBulkJob::directoryListingIteratedSlot(const QString &href, const QMap<QString, QString> &map)
+{
+    if (!_receivedFirst) {
+        // The first entry is for the folder itself
+        _receivedFirst = true;
+        _rootProperties = map;
+        _isExternalStorage = RemotePermissions(map.value("permissions")).hasPermission(RemotePermissions::IsMounted);
+        _directories[QString()].etag = map.value("getetag");
+        _validDirectories.insert(QString());
+        return;
+    }
+
+    // Remove <webDAV-Url>/folder/ from <webDAV-Url>/folder/sub/file.txt
+    QString file = href.mid(_lsColJob->reply()->request().url().path().length());
+    while (file.endsWith('/')) {
+        file.chop(1);
+    }
+    while (file.startsWith('/')) {
+        file.remove(0, 1);
+    }
+    if (file.isEmpty()) {
+        return;
+    }
+    const int slashPos = file.lastIndexOf(QLatin1Char('/'));
+    const QString parent = slashPos > -1 ? file.left(slashPos) : QString();
+    const QString name = file.mid(slashPos + 1);
+
+    bool missingData = false;
+    auto file_stat = propertyMapToRemoteEntry(name, map, &missingData);
+    if (missingData) {
+        // The fallback listing of the parent will report the error
+        _brokenDirectories.insert(parent);
+    }
+
+    if (file_stat->remotePerm.hasPermission(RemotePermissions::IsMounted)) {
+        if (_isExternalStorage || isBelowMountPoint(file)) {
+            // Like in DiscoverySingleDirectoryJob, only the mount points keep their 'M'
+            file_stat->remotePerm.unsetPermission(RemotePermissions::IsMounted);
+            file_stat->remotePerm.setPermission(RemotePermissions::IsMountedSub);
+        } else {
+            // The content of an external storage is not guaranteed to be complete
+            // in this listing; it gets listed on its own
+            _mountPoints.append(file);
+        }
+    }
+
+    if (file_stat->type == ItemTypeDirectory && !missingData) {
+        _directories[file].etag = map.value("getetag");
+        _validDirectories.insert(file);
+    }
+    _directories[parent].entries.push_back(std::move(file_stat));
+}
+
+void DiscoveryBulkJob::lsJobFinishedWithoutErrorSlot()
+{
+    if (!_receivedFirst) {
+        qCWarning(lcDiscovery) << "Bulk listing of" << _path << "is empty";
+        emit finishedWithError();
+        deleteLater();
+        return;
+    }
+    emit finishedWithResult();
+    deleteLater();
+}
+
+void DiscoveryBulkJob::lsJobFinishedWithErrorSlot(QNetworkReply *r)
+{
+    int httpCode = r->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    qCWarning(lcDiscovery) << "Bulk listing of" << _path << "failed" << r->errorString() << httpCode << r->error();
+    // Sabre refuses Depth:infinity with 403 unless it is enabled
+    _depthInfinityRefused = httpCode == 403 || httpCode == 400 || httpCode == 501;
+    emit finishedWithError();
+    deleteLater();
+}
+
+DiscoveryBulkJob::DirectoryMap DiscoveryBulkJob::takeDirectories()
+{
+    DirectoryMap result;
+    for (auto &it : _directories) {
+        const QString &relativePath = it.first;
+        if (!_validDirectories.contains(relativePath)
+            || _brokenDirectories.contains(relativePath)
+            || _mountPoints.contains(relativePath)
+            || isBelowMountPoint(relativePath)) {
+            continue;
+        }
+        QString fullPath = _path;
+        if (!relativePath.isEmpty()) {
+            fullPath += QLatin1Char('/') + relativePath;
+        }
+        result[fullPath] = std::move(it.second);
+    }
+    _directories.clear();
+    return result;
+}
+
 void DiscoveryMainThread::setupHooks(DiscoveryJob *discoveryJob, const QString &pathPrefix)
 {
     _discoveryJob = discoveryJob;
@@ -482,10 +633,12 @@ void DiscoveryMainThread::setupHooks(DiscoveryJob *discoveryJob, const QString &
     connect(discoveryJob, &DiscoveryJob::doGetSizeSignal,
         this, &DiscoveryMainThread::doGetSizeSlot,
         Qt::QueuedConnection);
+    connect(discoveryJob, &DiscoveryJob::doRemoteDeltaSignal,
+        this, &DiscoveryMainThread::doRemoteDeltaSlot,
+        Qt::QueuedConnection);
 }
 
-// Coming from owncloud_opendir -> DiscoveryJob::vio_opendir_hook -> doOpendirSignal
-void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirectoryResult *r)
+QString DiscoveryMainThread::fullRemotePath(const QString &subPath) const
 {
     QString fullPath = _pathPrefix;
     if (!_pathPrefix.endsWith('/')) {
@@ -496,6 +649,13 @@ void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirecto
     while (fullPath.endsWith('/')) {
         fullPath.chop(1);
     }
+    return fullPath;
+}
+
+// Coming from owncloud_opendir -> DiscoveryJob::vio_opendir_hook -> doOpendirSignal
+void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirectoryResult *r)
+{
+    QString fullPath = fullRemotePath(subPath);
 
     _discoveryJob->update_job_update_callback(/*local=*/false, subPath.toUtf8(), _discoveryJob);
 
@@ -503,6 +663,29 @@ void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirecto
     _currentDiscoveryDirectoryResult = r;
     _currentDiscoveryDirectoryResult->path = fullPath;
 
+    if (takeBulkDirectory(fullPath)) {
+        return;
+    }
+
+    if (canUseBulkJob(subPath, fullPath)) {
+        _bulkListedPaths.append(fullPath);
+        _bulkJob = new DiscoveryBulkJob(_account, fullPath, this);
+        QObject::connect(_bulkJob.data(), &DiscoveryBulkJob::finishedWithResult,
+            this, &DiscoveryMainThread::bulkJobResultSlot);
+        QObject::connect(_bulkJob.data(), &DiscoveryBulkJob::finishedWithError,
+            this, &DiscoveryMainThread::bulkJobFinishedWithErrorSlot);
+        if (!_firstFolderProcessed) {
+            _bulkJob->setIsRootPath();
+        }
+        _bulkJob->start();
+        return;
+    }
+
+    startSingleDirectoryJob(fullPath);
+}
+
+void DiscoveryMainThread::startSingleDirectoryJob(const QString &fullPath)
+{
     // Schedule the DiscoverySingleDirectoryJob
     _singleDirJob = new DiscoverySingleDirectoryJob(_account, fullPath, this);
     QObject::connect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::finishedWithResult,
@@ -524,6 +707,98 @@ void DiscoveryMainThread::doOpendirSlot(const QString &subPath, DiscoveryDirecto
 }
 
 
+bool DiscoveryMainThread::canUseBulkJob(const QString &subPath, const QString &fullPath) const
+{
+    if (!_discoveryJob->_useBulkDiscovery) {
+        return false;
+    }
+    // Don't ask again for what a bulk job failed to list or left out on purpose
+    for (const auto &listedPath : _bulkListedPaths) {
+        if (fullPath == listedPath || fullPath.startsWith(listedPath + QLatin1Char('/'))) {
+            return false;
+        }
+    }
+    // The excluded folders must not be listed, so only use it for subtrees without any
+    const QString prefix = subPath.isEmpty() ? QString() : subPath + QLatin1Char('/');
+    for (const auto &excluded : _discoveryJob->_selectiveSyncBlackList) {
+        if (excluded.startsWith(prefix)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Answers the opendir from the listing of a previous bulk job
+bool DiscoveryMainThread::takeBulkDirectory(const QString &fullPath)
+{
+    auto it = _bulkDirectories.find(fullPath);
+    if (it == _bulkDirectories.end()) {
+        return false;
+    }
+
+    if (!_firstFolderProcessed) {
+        _firstFolderProcessed = true;
+        if (_bulkRootProperties.contains("permissions")) {
+            singleDirectoryJobFirstDirectoryPermissionsSlot(RemotePermissions(_bulkRootProperties.value("permissions")));
+        }
+        if (_bulkRootProperties.contains("data-fingerprint")) {
+            _dataFingerprint = _bulkRootProperties.value("data-fingerprint").toUtf8();
+            if (_dataFingerprint.isEmpty()) {
+                // Placeholder that means that the server supports the feature even if it did not set one.
+                _dataFingerprint = "[empty]";
+            }
+        }
+    }
+    emit etag(it->second.etag);
+
+    _currentDiscoveryDirectoryResult->list = std::move(it->second.entries);
+    _currentDiscoveryDirectoryResult->code = 0;
+    _bulkDirectories.erase(it);
+
+    qCDebug(lcDiscovery) << "Have" << _currentDiscoveryDirectoryResult->list.size() << "bulk results for " << _currentDiscoveryDirectoryResult->path;
+
+    _currentDiscoveryDirectoryResult = nullptr; // the sync thread owns it now
+
+    _discoveryJob->_vioMutex.lock();
+    _discoveryJob->_vioWaitCondition.wakeAll();
+    _discoveryJob->_vioMutex.unlock();
+    return true;
+}
+
+void DiscoveryMainThread::bulkJobResultSlot()
+{
+    if (!_currentDiscoveryDirectoryResult) {
+        return; // possibly aborted
+    }
+
+    auto directories = _bulkJob->takeDirectories();
+    qCInfo(lcDiscovery) << "Bulk listing of" << _currentDiscoveryDirectoryResult->path << "has" << directories.size() << "complete directories";
+    if (!_firstFolderProcessed) {
+        _bulkRootProperties = _bulkJob->rootProperties();
+    }
+    for (auto &it : directories) {
+        _bulkDirectories[it.first] = std::move(it.second);
+    }
+
+    // The directory itself may be incomplete, then it is listed on its own
+    if (!takeBulkDirectory(_currentDiscoveryDirectoryResult->path)) {
+        startSingleDirectoryJob(_currentDiscoveryDirectoryResult->path);
+    }
+}
+
+void DiscoveryMainThread::bulkJobFinishedWithErrorSlot()
+{
+    if (!_currentDiscoveryDirectoryResult) {
+        return; // possibly aborted
+    }
+
+    if (_bulkJob->isDepthInfinityRefused()) {
+        qCInfo(lcDiscovery) << "Server doesn't allow bulk listings, listing each directory";
+        _discoveryJob->_useBulkDiscovery = false;
+    }
+    startSingleDirectoryJob(_currentDiscoveryDirectoryResult->path);
+}
+
 void DiscoveryMainThread::singleDirectoryJobResultSlot()
 {
     if (!_currentDiscoveryDirectoryResult) {
@@ -574,15 +849,7 @@ void DiscoveryMainThread::singleDirectoryJobFirstDirectoryPermissionsSlot(Remote
 
 void DiscoveryMainThread::doGetSizeSlot(const QString &path, qint64 *result)
 {
-    QString fullPath = _pathPrefix;
-    if (!_pathPrefix.endsWith('/')) {
-        fullPath += '/';
-    }
-    fullPath += path;
-    // remove trailing slash
-    while (fullPath.endsWith('/')) {
-        fullPath.chop(1);
-    }
+    QString fullPath = fullRemotePath(path);
 
     _currentGetSizeResult = result;
 
@@ -623,6 +890,176 @@ void DiscoveryMainThread::slotGetSizeResult(const QVariantMap &map)
     _discoveryJob->_vioWaitCondition.wakeAll();
 }
 
+// Coming from csync_update_remote_from_delta -> DiscoveryJob::remote_vio_delta_hook -> doRemoteDeltaSignal
+//
+// First fetches the current sync-token of the root, so that a full walk also records
+// the state for the next sync, then asks for the changes since the previous token.
+void DiscoveryMainThread::doRemoteDeltaSlot(csync_remote_delta_s *delta)
+{
+    _currentRemoteDelta = delta;
+    _rootProperties.clear();
+    _remoteDeltaIncomplete = false;
+
+    auto job = new LsColJob(_account, fullRemotePath(QString()), this);
+    job->setDepth("0");
+    job->setProperties(QList<QByteArray>() << "getetag"
+                                           << "sync-token"
+                                           << "http://owncloud.org/ns:permissions"
+                                           << "http://owncloud.org/ns:data-fingerprint");
+    QObject::connect(job, &LsColJob::directoryListingIterated,
+        this, &DiscoveryMainThread::slotRootPropertiesIterated);
+    QObject::connect(job, &LsColJob::finishedWithoutError,
+        this, &DiscoveryMainThread::slotRootPropertiesFinished);
+    QObject::connect(job, &LsColJob::finishedWithError,
+        this, &DiscoveryMainThread::slotRemoteDeltaFinishedWithError);
+    job->start();
+    _remoteDeltaJob = job;
+}
+
+void DiscoveryMainThread::slotRootPropertiesIterated(const QString &, const QMap<QString, QString> &properties)
+{
+    _rootProperties = properties;
+}
+
+void DiscoveryMainThread::slotRootPropertiesFinished()
+{
+    if (!_currentRemoteDelta) {
+        return; // possibly aborted
+    }
+
+    _newSyncToken = _rootProperties.value(QStringLiteral("sync-token")).toUtf8();
+    if (_newSyncToken.isEmpty()) {
+        qCInfo(lcDiscovery) << "The server does not provide a sync-token";
+        _remoteDeltaUnsupported = true;
+        finishRemoteDelta();
+        return;
+    }
+    if (!_currentRemoteDelta->wanted || _syncToken.isEmpty()) {
+        finishRemoteDelta();
+        return;
+    }
+
+    qCInfo(lcDiscovery) << "Asking for the remote changes since" << _syncToken;
+    auto job = new SyncCollectionJob(_account, fullRemotePath(QString()), _syncToken, this);
+    job->setProperties(DiscoverySingleDirectoryJob::properties(_account, false));
+    QObject::connect(job, &SyncCollectionJob::itemChanged,
+        this, &DiscoveryMainThread::slotSyncCollectionItemChanged);
+    QObject::connect(job, &SyncCollectionJob::itemDeleted,
+        this, &DiscoveryMainThread::slotSyncCollectionItemDeleted);
+    QObject::connect(job, &SyncCollectionJob::finishedWithoutError,
+        this, &DiscoveryMainThread::slotSyncCollectionFinished);
+    QObject::connect(job, &SyncCollectionJob::finishedWithError,
+        this, &DiscoveryMainThread::slotRemoteDeltaFinishedWithError);
+    job->start();
+    _remoteDeltaJob = job;
+}
+
+void DiscoveryMainThread::slotSyncCollectionItemChanged(const QString &path, const QMap<QString, QString> &properties)
+{
+    if (!_currentRemoteDelta) {
+        return; // possibly aborted
+    }
+
+    std::unique_ptr<csync_file_stat_t> file_stat(new csync_file_stat_t);
+    file_stat->path = path.toUtf8();
+    file_stat->size = -1;
+    propertyMapToFileStat(properties, file_stat.get());
+    if (file_stat->type == ItemTypeDirectory)
+        file_stat->size = 0;
+    if (file_stat->type == ItemTypeSkip
+        || file_stat->size == -1
+        || file_stat->remotePerm.isNull()
+        || file_stat->etag.isEmpty()
+        || file_stat->file_id.isEmpty()) {
+        // Let the directory listing deal with it
+        qCWarning(lcDiscovery)
+            << "Missing properties in the remote changes:" << path << file_stat->type << file_stat->size
+            << file_stat->modtime << file_stat->remotePerm.toString()
+            << file_stat->etag << file_stat->file_id;
+        _remoteDeltaIncomplete = true;
+        return;
+    }
+    _currentRemoteDelta->changed.push_back(std::move(file_stat));
+}
+
+void DiscoveryMainThread::slotSyncCollectionItemDeleted(const QString &path)
+{
+    if (!_currentRemoteDelta) {
+        return; // possibly aborted
+    }
+    _currentRemoteDelta->deleted.push_back(path.toUtf8());
+}
+
+void DiscoveryMainThread::slotSyncCollectionFinished()
+{
+    auto job = qobject_cast<SyncCollectionJob *>(sender());
+    if (!_currentRemoteDelta || !job) {
+        return; // possibly aborted
+    }
+    if (_remoteDeltaIncomplete) {
+        _currentRemoteDelta->changed.clear();
+        _currentRemoteDelta->deleted.clear();
+        finishRemoteDelta();
+        return;
+    }
+
+    qCInfo(lcDiscovery) << "Got" << _currentRemoteDelta->changed.size() << "changed and"
+                        << _currentRemoteDelta->deleted.size() << "deleted remote entries";
+    _newSyncToken = job->syncToken();
+    _currentRemoteDelta->available = true;
+
+    // The root is not listed, take what DiscoverySingleDirectoryJob would have reported for it
+    _firstFolderProcessed = true;
+    if (_rootProperties.contains("permissions")) {
+        singleDirectoryJobFirstDirectoryPermissionsSlot(RemotePermissions(_rootProperties.value("permissions")));
+    }
+    if (_rootProperties.contains("data-fingerprint")) {
+        _dataFingerprint = _rootProperties.value("data-fingerprint").toUtf8();
+        if (_dataFingerprint.isEmpty()) {
+            _dataFingerprint = "[empty]";
+        }
+    }
+    if (_rootProperties.contains("getetag")) {
+        emit etag(_rootProperties.value("getetag"));
+    }
+
+    finishRemoteDelta();
+}
+
+void DiscoveryMainThread::slotRemoteDeltaFinishedWithError(QNetworkReply *reply)
+{
+    if (!_currentRemoteDelta) {
+        return; // possibly aborted
+    }
+
+    if (auto job = qobject_cast<SyncCollectionJob *>(sender())) {
+        if (job->isTokenInvalid()) {
+            // The sync-token of the root is still good for the next sync
+            qCInfo(lcDiscovery) << "The sync-token is no longer valid, listing the whole tree";
+        } else if (job->isUnsupported()) {
+            qCInfo(lcDiscovery) << "The server does not support the sync-collection REPORT";
+            _remoteDeltaUnsupported = true;
+            _newSyncToken.clear();
+        } else {
+            qCWarning(lcDiscovery) << "Error getting the remote changes" << reply->errorString();
+        }
+    } else {
+        // The root itself failed, the listing will report the error
+        qCWarning(lcDiscovery) << "Error getting the sync-token" << reply->errorString();
+        _newSyncToken.clear();
+    }
+    _currentRemoteDelta->changed.clear();
+    _currentRemoteDelta->deleted.clear();
+    finishRemoteDelta();
+}
+
+void DiscoveryMainThread::finishRemoteDelta()
+{
+    _currentRemoteDelta = nullptr; // the sync thread owns it now
+    QMutexLocker locker(&_discoveryJob->_vioMutex);
+    _discoveryJob->_vioWaitCondition.wakeAll();
+}
+
 
 // called from SyncEngine
 void DiscoveryMainThread::abort()
@@ -633,6 +1070,10 @@ void DiscoveryMainThread::abort()
         disconnect(_singleDirJob.data(), &DiscoverySingleDirectoryJob::finishedWithResult, this, nullptr);
         _singleDirJob->abort();
     }
+    if (_bulkJob) {
+        disconnect(_bulkJob.data(), nullptr, this, nullptr);
+        _bulkJob->abort();
+    }
     if (_currentDiscoveryDirectoryResult) {
         if (_discoveryJob->_vioMutex.tryLock()) {
             _currentDiscoveryDirectoryResult->msg = tr("Aborted by the user"); // Actually also created somewhere else by sync engine
@@ -647,6 +1088,17 @@ void DiscoveryMainThread::abort()
         QMutexLocker locker(&_discoveryJob->_vioMutex);
         _discoveryJob->_vioWaitCondition.wakeAll();
     }
+    if (_currentRemoteDelta) {
+        // csync_update_remote_from_delta checks for the abort
+        _currentRemoteDelta->available = false;
+        finishRemoteDelta();
+    }
+    if (_remoteDeltaJob) {
+        // Aborting the reply finishes the job right away, the delta is not ours anymore
+        disconnect(_remoteDeltaJob.data(), nullptr, this, nullptr);
+        if (_remoteDeltaJob->reply())
+            _remoteDeltaJob->reply()->abort();
+    }
 }
 
 csync_vio_handle_t *DiscoveryJob::remote_vio_opendir_hook(const char *url,
@@ -709,6 +1161,21 @@ void DiscoveryJob::remote_vio_closedir_hook(csync_vio_handle_t *dhandle, void *u
     }
 }
 
+void DiscoveryJob::remote_vio_delta_hook(csync_remote_delta_s *delta, void *userdata)
+{
+    auto *discoveryJob = static_cast<DiscoveryJob *>(userdata);
+    if (discoveryJob) {
+        qCDebug(lcDiscovery) << discoveryJob << "Asking the main thread for the remote changes...";
+
+        discoveryJob->_vioMutex.lock();
+        emit discoveryJob->doRemoteDeltaSignal(delta);
+        discoveryJob->_vioWaitCondition.wait(&discoveryJob->_vioMutex, ULONG_MAX);
+        discoveryJob->_vioMutex.unlock();
+
+        qCDebug(lcDiscovery) << discoveryJob << "...Returned from main thread";
+    }
+}
+
 void DiscoveryJob::start()
 {
     _selectiveSyncBlackList.sort();
@@ -717,10 +1184,16 @@ void DiscoveryJob::start()
     _csync_ctx->callbacks.update_callback = update_job_update_callback;
     _csync_ctx->callbacks.checkSelectiveSyncBlackListHook = isInSelectiveSyncBlackListCallback;
     _csync_ctx->callbacks.checkSelectiveSyncNewFolderHook = checkSelectiveSyncNewFolderCallback;
+    // The db compares the UTF-8 bytes, which sort differently than UTF-16
+    _csync_ctx->selective_sync_black_list.clear();
+    for (const auto &path : qAsConst(_selectiveSyncBlackList))
+        _csync_ctx->selective_sync_black_list.append(path.toUtf8());
+    std::sort(_csync_ctx->selective_sync_black_list.begin(), _csync_ctx->selective_sync_black_list.end());
 
     _csync_ctx->callbacks.remote_opendir_hook = remote_vio_opendir_hook;
     _csync_ctx->callbacks.remote_readdir_hook = remote_vio_readdir_hook;
     _csync_ctx->callbacks.remote_closedir_hook = remote_vio_closedir_hook;
+    _csync_ctx->callbacks.remote_delta_hook = _useRemoteDelta ? remote_vio_delta_hook : nullptr;
     _csync_ctx->callbacks.vio_userdata = this;
 
     _lastUpdateProgressCallbackCall.invalidate();
@@ -728,6 +1201,8 @@ void DiscoveryJob::start()
 
     _csync_ctx->callbacks.checkSelectiveSyncNewFolderHook = nullptr;
     _csync_ctx->callbacks.checkSelectiveSyncBlackListHook = nullptr;
+    _csync_ctx->selective_sync_black_list.clear();
+    _csync_ctx->callbacks.remote_delta_hook = nullptr;
     _csync_ctx->callbacks.update_callback = nullptr;
     _csync_ctx->callbacks.update_callback_userdata = nullptr;
 
@@ -24,6 +24,8 @@
 #include <QWaitCondition>
 #include <QLinkedList>
 #include <deque>
+#include <map>
+#include <QSet>
 #include "syncoptions.h"
 
 namespace OCC {
@@ -62,6 +64,9 @@ public:
     void abort();
     std::deque<std::unique_ptr<csync_file_stat_t>> &&takeResults() { return std::move(_results); }
 
+    /// The properties requested for every entry
+    static QList<QByteArray> properties(const AccountPtr &account, bool isRootPath);
+
     // This is not actually a network job, it is just a job
 signals:
     void firstDirectoryPermissions(RemotePermissions);
@@ -95,6 +100,75 @@ public:
     QByteArray _dataFingerprint;
 };
 
+/**
+ * @brief Lists a whole remote subtree with one Depth:infinity PROPFIND
+ *
+ * Used for the first sync of a folder: the entries are sorted into their
+ * directories while the reply comes in, and the DiscoveryMainThread then
+ * answers the opendir calls of these directories without asking the server
+ * again.
+ *
+ * Only directories whose listing can be trusted are kept. A directory with
+ * an entry that misses properties, and everything inside an external storage
+ * that starts below the listed path, must be listed on its own.
+ *
+ * @ingroup libsync
+ */
+class DiscoveryBulkJob : public QObject
+{
+    Q_OBJECT
+public:
+    struct Directory
+    {
+        QString etag;
+        std::deque<std::unique_ptr<csync_file_stat_t>> entries;
+    };
+    /// The listings by full remote path, like DiscoveryDirectoryResult::path
+    using DirectoryMap = std::map<QString, Directory>;
+
+    explicit DiscoveryBulkJob(const AccountPtr &account, const QString &path, QObject *parent = nullptr);
+    // Specify that this is the root and we need to check the data-fingerprint
+    void setIsRootPath() { _isRootPath = true; }
+    void start();
+    void abort();
+
+    /// The complete listings, valid after finishedWithResult()
+    DirectoryMap takeDirectories();
+    /// The properties of the listed directory itself
+    const QMap<QString, QString> &rootProperties() const { return _rootProperties; }
+    /// Whether the server refused to list more than one level at once
+    bool isDepthInfinityRefused() const { return _depthInfinityRefused; }
+
+signals:
+    void finishedWithResult();
+    void finishedWithError();
+private slots:
+    void directoryListingIteratedSlot(const QString &href, const QMap<QString, QString> &map);
+    void lsJobFinishedWithoutErrorSlot();
+    void lsJobFinishedWithErrorSlot(QNetworkReply *);
+
+private:
+    bool isBelowMountPoint(const QString &relativePath) const;
+
+    AccountPtr _account;
+    QString _path;
+    bool _isRootPath = false;
+    bool _depthInfinityRefused = false;
+    // The first entry is the directory itself
+    bool _receivedFirst = false;
+    bool _isExternalStorage = false;
+    QMap<QString, QString> _rootProperties;
+    // By path relative to _path, "" is the listed directory
+    std::map<QString, Directory> _directories;
+    // The directories that were reported with all their properties
+    QSet<QString> _validDirectories;
+    // The directories with an entry that can't be used
+    QSet<QString> _brokenDirectories;
+    // External storages below _path, their content is listed separately
+    QStringList _mountPoints;
+    QPointer<LsColJob> _lsColJob;
+};
+
 // Lives in main thread. Deleted by the SyncEngine
 class DiscoveryJob;
 class DiscoveryMainThread : public QObject
@@ -103,12 +177,28 @@ class DiscoveryMainThread : public QObject
 
     QPointer<DiscoveryJob> _discoveryJob;
     QPointer<DiscoverySingleDirectoryJob> _singleDirJob;
+    QPointer<DiscoveryBulkJob> _bulkJob;
+    // Listings received by bulk jobs that haven't been asked for yet
+    DiscoveryBulkJob::DirectoryMap _bulkDirectories;
+    QMap<QString, QString> _bulkRootProperties;
+    // The subtrees bulk jobs were started for, what they left out is listed directory by directory
+    QStringList _bulkListedPaths;
     QString _pathPrefix; // remote path
     AccountPtr _account;
     DiscoveryDirectoryResult *_currentDiscoveryDirectoryResult;
     qint64 *_currentGetSizeResult;
+    csync_remote_delta_s *_currentRemoteDelta = nullptr;
+    QPointer<AbstractNetworkJob> _remoteDeltaJob;
+    QMap<QString, QString> _rootProperties;
+    bool _remoteDeltaIncomplete = false;
     bool _firstFolderProcessed;
 
+    QString fullRemotePath(const QString &subPath) const;
+    void finishRemoteDelta();
+    void startSingleDirectoryJob(const QString &fullPath);
+    bool canUseBulkJob(const QString &subPath, const QString &fullPath) const;
+    bool takeBulkDirectory(const QString &fullPath);
+
 public:
     DiscoveryMainThread(AccountPtr account)
         : QObject()
@@ -122,19 +212,36 @@ public:
 
     QByteArray _dataFingerprint;
 
+    // The sync-token recorded after the last successful sync, set by the SyncEngine
+    QByteArray _syncToken;
+    // The sync-token describing the remote state this discovery is based on
+    QByteArray _newSyncToken;
+    // Set if the server can't report the changes since a sync-token
+    bool _remoteDeltaUnsupported = false;
+
 
 public slots:
     // From DiscoveryJob:
     void doOpendirSlot(const QString &url, DiscoveryDirectoryResult *);
     void doGetSizeSlot(const QString &path, qint64 *result);
+    void doRemoteDeltaSlot(csync_remote_delta_s *delta);
 
     // From Job:
     void singleDirectoryJobResultSlot();
     void singleDirectoryJobFinishedWithErrorSlot(int csyncErrnoCode, const QString &msg);
     void singleDirectoryJobFirstDirectoryPermissionsSlot(RemotePermissions);
+    void bulkJobResultSlot();
+    void bulkJobFinishedWithErrorSlot();
 
     void slotGetSizeFinishedWithError();
     void slotGetSizeResult(const QVariantMap &);
+
+    void slotRootPropertiesIterated(const QString &, const QMap<QString, QString> &properties);
+    void slotRootPropertiesFinished();
+    void slotSyncCollectionItemChanged(const QString &path, const QMap<QString, QString> &properties);
+    void slotSyncCollectionItemDeleted(const QString &path);
+    void slotSyncCollectionFinished();
+    void slotRemoteDeltaFinishedWithError(QNetworkReply *reply);
 signals:
     void etag(const QString &);
     void etagConcatenation(const QString &);
@@ -178,6 +285,7 @@ class DiscoveryJob : public QObject
         void *userdata);
     static void remote_vio_closedir_hook(csync_vio_handle_t *dhandle,
         void *userdata);
+    static void remote_vio_delta_hook(csync_remote_delta_s *delta, void *userdata);
     QMutex _vioMutex;
     QWaitCondition _vioWaitCondition;
 
@@ -191,6 +299,10 @@ public:
     QStringList _selectiveSyncBlackList;
     QStringList _selectiveSyncWhiteList;
     SyncOptions _syncOptions;
+    // Whether the remote tree may be built from the db and the server's list of changes
+    bool _useRemoteDelta = false;
+    // Whether whole subtrees may be listed with one request, see DiscoveryBulkJob
+    bool _useBulkDiscovery = false;
     Q_INVOKABLE void start();
 signals:
     void finished(int result);
@@ -199,6 +311,7 @@ signals:
     // After the discovery job has been woken up again (_vioWaitCondition)
     void doOpendirSignal(QString url, DiscoveryDirectoryResult *);
     void doGetSizeSignal(const QString &path, qint64 *result);
+    void doRemoteDeltaSignal(csync_remote_delta_s *delta);
 
     // A new folder was discovered and was not synced because of the confirmation feature
     void newBigFolder(const QString &folder, bool isExternal);
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "encryptedfoldersession.h"
+#include "clientsideencryptionjobs.h"
+#include "account.h"
+
+#include <QLoggingCategory>
+#include <QTimer>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcEncryptedFolderSession, "nextcloud.sync.propagator.encryptedfolder", QtInfoMsg)
+
+EncryptedFolderSession::EncryptedFolderSession(const AccountPtr &account, const QByteArray &folderId,
+    EncryptedFolderSession *previous, QObject *parent)
+    : QObject(parent)
+    , _account(account)
+    , _folderId(folderId)
+    , _previous(previous)
+{
+}
+
+EncryptedFolderSession::~EncryptedFolderSession()
+{
+    // The propagator went away while the folder was locked, don't leave it locked
+    if (_locked) {
+        qCInfo(lcEncryptedFolderSession) << "Unlocking folder" << _folderId << "on destruction";
+        auto job = new UnlockEncryptFolderApiJob(_account, _folderId, _token);
+        job->start();
+    }
+}
+
+bool EncryptedFolderSession::isAcquirable() const
+{
+    return _state == Idle || _state == Locking || _state == Ready;
+}
+
+void EncryptedFolderSession::acquire(QObject *context, const ReadyCallback &ready, const FailedCallback &failed)
+{
+    ++_users;
+    switch (_state) {
+    case Ready:
+        ready(_metadata.data());
+        return;
+    case Failed:
+    case Unlocking:
+        failed();
+        return;
+    case Idle:
+        _state = Locking;
+        _waiters.append({ context, ready, failed });
+        lockFolder();
+        return;
+    case Locking:
+        _waiters.append({ context, ready, failed });
+        return;
+    }
+}
+
+void EncryptedFolderSession::lockFolder()
+{
+    if (_previous) {
+        qCDebug(lcEncryptedFolderSession) << "Waiting for the folder" << _folderId << "to be unlocked";
+        connect(_previous.data(), &QObject::destroyed, this, [this] {
+            _previous.clear();
+            lockFolder();
+        });
+        return;
+    }
+
+    qCDebug(lcEncryptedFolderSession) << "Locking folder" << _folderId;
+    auto job = new LockEncryptFolderApiJob(_account, _folderId, this);
+    connect(job, &LockEncryptFolderApiJob::success, this, &EncryptedFolderSession::slotFolderLocked);
+    connect(job, &LockEncryptFolderApiJob::error, this, [this](const QByteArray &, int httpErrorCode) {
+        qCWarning(lcEncryptedFolderSession) << "Could not lock folder" << _folderId << httpErrorCode;
+        fail();
+    });
+    job->start();
+}
+
+void EncryptedFolderSession::slotFolderLocked(const QByteArray &folderId, const QByteArray &token)
+{
+    qCDebug(lcEncryptedFolderSession) << "Folder" << folderId << "locked, fetching the metadata";
+    _locked = true;
+    _token = token;
+
+    auto job = new GetMetadataApiJob(_account, _folderId, this);
+    connect(job, &GetMetadataApiJob::jsonReceived, this, &EncryptedFolderSession::slotMetadataReceived);
+    connect(job, &GetMetadataApiJob::error, this, [this](const QByteArray &, int httpReturnCode) {
+        // A folder that was just marked encrypted has no metadata yet
+        if (httpReturnCode == 404) {
+            slotMetadataReceived(QJsonDocument(), httpReturnCode);
+            return;
+        }
+        qCWarning(lcEncryptedFolderSession) << "Could not get the metadata of folder" << _folderId << httpReturnCode;
+        fail();
+    });
+    job->start();
+}
+
+void EncryptedFolderSession::slotMetadataReceived(const QJsonDocument &json, int statusCode)
+{
+    _metadata.reset(new FolderMetadata(_account->e2e()->metadataCache()->metadata(_account, _folderId, json, statusCode)));
+    _metadataExists = statusCode != 404;
+    _state = Ready;
+
+    const auto waiters = std::move(_waiters);
+    _waiters.clear();
+    for (const auto &waiter : waiters) {
+        if (waiter.context)
+            waiter.ready(_metadata.data());
+    }
+    unlockIfUnused();
+}
+
+void EncryptedFolderSession::fail()
+{
+    _state = Failed;
+    const auto waiters = std::move(_waiters);
+    _waiters.clear();
+    for (const auto &waiter : waiters) {
+        if (waiter.context)
+            waiter.failed();
+    }
+    unlockIfUnused();
+}
+
+void EncryptedFolderSession::storeMetadata(QObject *context, const StoredCallback &stored)
+{
+    if (_state == Failed) {
+        // An update failed, the change can't be sent on top of that
+        QTimer::singleShot(0, context, [stored] { stored(false); });
+        return;
+    }
+    Q_ASSERT(_state == Ready);
+    _pendingStores.append({ context, stored, ++_changes });
+    if (_sendingChanges == 0)
+        sendMetadata();
+}
+
+void EncryptedFolderSession::sendMetadata()
+{
+    _sendingChanges = _changes;
+    const QByteArray encryptedMetadata = _metadata->encryptedMetadata();
+    // What is sent, later changes to _metadata are not part of it
+    const FolderMetadata metadata = *_metadata;
+    auto onSuccess = [this, encryptedMetadata, metadata](const QByteArray &) {
+        metadataSent(true, encryptedMetadata, metadata);
+    };
+    auto onError = [this, encryptedMetadata, metadata](const QByteArray &, int httpReturnCode) {
+        qCWarning(lcEncryptedFolderSession) << "Could not update the metadata of folder" << _folderId << httpReturnCode;
+        metadataSent(false, encryptedMetadata, metadata);
+    };
+
+    qCDebug(lcEncryptedFolderSession) << "Sending the metadata of folder" << _folderId
+                                      << "with" << _pendingStores.size() << "changes";
+    if (!_metadataExists) {
+        auto job = new StoreMetaDataApiJob(_account, _folderId, encryptedMetadata, this);
+        connect(job, &StoreMetaDataApiJob::success, this, onSuccess);
+        connect(job, &StoreMetaDataApiJob::error, this, onError);
+        job->start();
+    } else {
+        auto job = new UpdateMetadataApiJob(_account, _folderId, encryptedMetadata, _token, this);
+        connect(job, &UpdateMetadataApiJob::success, this, onSuccess);
+        connect(job, &UpdateMetadataApiJob::error, this, onError);
+        job->start();
+    }
+}
+
+void EncryptedFolderSession::metadataSent(bool success, const QByteArray &encryptedMetadata, const FolderMetadata &metadata)
+{
+    auto cache = _account->e2e()->metadataCache();
+    const int sentChanges = _sendingChanges;
+    _sendingChanges = 0;
+    QVector<PendingStore> done;
+    if (success) {
+        _metadataExists = true;
+        cache->insert(_folderId, encryptedMetadata, metadata);
+
+        for (auto it = _pendingStores.begin(); it != _pendingStores.end();) {
+            if (it->change <= sentChanges) {
+                done.append(*it);
+                it = _pendingStores.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!_pendingStores.isEmpty())
+            sendMetadata();
+    } else {
+        // _metadata has the change the server didn't take and everything
+        // done on top of it, none of that may be sent. The jobs still waiting
+        // fail as well, the next session fetches the metadata again.
+        cache->remove(_folderId);
+        _state = Failed;
+        done = std::move(_pendingStores);
+        _pendingStores.clear();
+    }
+
+    for (const auto &store : qAsConst(done)) {
+        if (store.context)
+            store.stored(success);
+    }
+    unlockIfUnused();
+}
+
+void EncryptedFolderSession::release()
+{
+    Q_ASSERT(_users > 0);
+    --_users;
+    unlockIfUnused();
+}
+
+void EncryptedFolderSession::unlockIfUnused()
+{
+    if (_users > 0 || _sendingChanges != 0 || _state == Idle || _state == Locking || _state == Unlocking)
+        return;
+    _state = Unlocking;
+
+    if (!_locked) {
+        deleteLater();
+        return;
+    }
+
+    qCDebug(lcEncryptedFolderSession) << "Unlocking folder" << _folderId;
+    auto job = new UnlockEncryptFolderApiJob(_account, _folderId, _token, this);
+    connect(job, &UnlockEncryptFolderApiJob::success, this, [this] {
+        qCDebug(lcEncryptedFolderSession) << "Folder" << _folderId << "unlocked";
+        _locked = false;
+        deleteLater();
+    });
+    connect(job, &UnlockEncryptFolderApiJob::error, this, [this](const QByteArray &, int httpReturnCode) {
+        qCWarning(lcEncryptedFolderSession) << "Could not unlock folder" << _folderId << httpReturnCode;
+        _locked = false;
+        deleteLater();
+    });
+    job->start();
+}
+
+} // namespace OCC
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef ENCRYPTEDFOLDERSESSION_H
+#define ENCRYPTEDFOLDERSESSION_H
+
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+#include <QScopedPointer>
+
+#include <functional>
+
+#include "owncloudlib.h"
+#include "accountfwd.h"
+#include "clientsideencryption.h"
+
+namespace OCC {
+
+/**
+ * @brief The lock and metadata of an encrypted folder, shared by the jobs of a sync
+ *
+ * Uploading into or deleting from an encrypted folder needs the folder locked
+ * and its metadata updated. Instead of locking, fetching the metadata,
+ * updating it and unlocking for every file, the jobs of one folder acquire a
+ * shared session: the folder is locked and its metadata is fetched once, the
+ * updates of all jobs are sent one after the other with everything changed
+ * meanwhile folded into the next one, and the folder is unlocked when the
+ * last job released the session.
+ *
+ * Sessions are created by OwncloudPropagator::encryptedFolderSession() and
+ * delete themselves once the folder is unlocked.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT EncryptedFolderSession : public QObject
+{
+    Q_OBJECT
+public:
+    using ReadyCallback = std::function<void(FolderMetadata *metadata)>;
+    using FailedCallback = std::function<void()>;
+    using StoredCallback = std::function<void(bool success)>;
+
+    /**
+     * previous is the session that still unlocks the same folder, if any.
+     * The folder is only locked again once it is done.
+     */
+    EncryptedFolderSession(const AccountPtr &account, const QByteArray &folderId,
+        EncryptedFolderSession *previous, QObject *parent = nullptr);
+    ~EncryptedFolderSession();
+
+    QByteArray folderId() const { return _folderId; }
+    QByteArray token() const { return _token; }
+
+    /// False once the session failed or started unlocking the folder
+    bool isAcquirable() const;
+
+    /**
+     * Starts using the session.
+     *
+     * Calls ready with the metadata once the folder is locked and the
+     * metadata is there, possibly right away, or failed if that didn't work.
+     * The callbacks are not called anymore after context was destroyed.
+     * Every acquire() needs a release().
+     */
+    void acquire(QObject *context, const ReadyCallback &ready, const FailedCallback &failed);
+
+    /**
+     * Sends the metadata to the server after the caller changed it.
+     *
+     * stored is called once an update containing the change finished. If an
+     * update fails the session fails with it: the changes not sent yet are
+     * dropped and their stored callbacks get false as well.
+     */
+    void storeMetadata(QObject *context, const StoredCallback &stored);
+
+    /// Stops using the session, the folder is unlocked after the last release()
+    void release();
+
+private:
+    enum State {
+        Idle,
+        Locking,
+        Ready,
+        Failed,
+        Unlocking
+    };
+
+    struct Waiter
+    {
+        QPointer<QObject> context;
+        ReadyCallback ready;
+        FailedCallback failed;
+    };
+
+    struct PendingStore
+    {
+        QPointer<QObject> context;
+        StoredCallback stored;
+        int change;
+    };
+
+    void lockFolder();
+    void slotFolderLocked(const QByteArray &folderId, const QByteArray &token);
+    void slotMetadataReceived(const QJsonDocument &json, int statusCode);
+    void fail();
+    void sendMetadata();
+    void metadataSent(bool success, const QByteArray &encryptedMetadata, const FolderMetadata &metadata);
+    void unlockIfUnused();
+
+    AccountPtr _account;
+    QByteArray _folderId;
+    QPointer<EncryptedFolderSession> _previous;
+    State _state = Idle;
+    bool _locked = false;
+    QByteArray _token;
+    QScopedPointer<FolderMetadata> _metadata;
+    bool _metadataExists = false; // on the server, decides between store and update
+    int _users = 0;
+    QVector<Waiter> _waiters;
+
+    QVector<PendingStore> _pendingStores;
+    int _changes = 0;
+    int _sendingChanges = 0; // the changes in the running update, 0 if there is none
+};
+
+}
+
+#endif // ENCRYPTEDFOLDERSESSION_H
@@ -18,6 +18,12 @@
 #include <QFile>
 #include <QFileInfo>
 
+#ifdef Q_OS_LINUX
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <unistd.h>
+#endif
+
 // We use some internals of csync:
 extern "C" int c_utimes(const char *, const struct timeval *);
 
@@ -113,6 +119,65 @@ bool FileSystem::verifyFileUnchanged(const QString &fileName,
     return true;
 }
 
+bool FileSystem::cloneFile(const QString &source, const QString &destination, QString *errorString)
+{
+    QFile in(source);
+    QFile out(destination);
+    if (!in.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        if (errorString)
+            *errorString = in.errorString();
+        return false;
+    }
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        if (errorString)
+            *errorString = out.errorString();
+        return false;
+    }
+
+#ifdef Q_OS_LINUX
+#ifdef FICLONE
+    if (ioctl(out.handle(), FICLONE, in.handle()) == 0) {
+        return true;
+    }
+#endif
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 27)
+    qint64 remaining = in.size();
+    while (remaining > 0) {
+        const auto copied = copy_file_range(in.handle(), nullptr, out.handle(), nullptr, remaining, 0);
+        if (copied <= 0) // e.g. EXDEV on older kernels, or the file was truncated
+            break;
+        remaining -= copied;
+    }
+    if (remaining == 0) {
+        return true;
+    }
+    if (!in.seek(0) || !out.seek(0) || !out.resize(0)) {
+        if (errorString)
+            *errorString = out.errorString();
+        return false;
+    }
+#endif
+#endif
+
+    const int BufferSize = 256 * 1024;
+    QByteArray buffer(BufferSize, Qt::Uninitialized);
+    while (true) {
+        const qint64 r = in.read(buffer.data(), BufferSize);
+        if (r < 0) {
+            if (errorString)
+                *errorString = in.errorString();
+            return false;
+        }
+        if (r == 0)
+            return true;
+        if (out.write(buffer.constData(), r) != r) {
+            if (errorString)
+                *errorString = out.errorString();
+            return false;
+        }
+    }
+}
+
 #ifdef Q_OS_WIN
 static qint64 getSizeWithCsync(const QString &filename)
 {
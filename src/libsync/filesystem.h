@@ -77,6 +77,18 @@ namespace FileSystem {
     bool verifyFileUnchanged(const QString &fileName,
         qint64 previousSize,
         time_t previousMtime);
+
+    /**
+     * @brief Copies the content of \a source into \a destination, replacing it
+     *
+     * Shares the data blocks where the file system supports it (FICLONE on Linux)
+     * and lets the kernel do the copy otherwise (copy_file_range), before falling
+     * back to reading and writing the data.
+     *
+     * Does not copy the mtime or the permissions.
+     */
+    bool OWNCLOUDSYNC_EXPORT cloneFile(const QString &source, const QString &destination,
+        QString *errorString = nullptr);
 }
 
 /** @} */
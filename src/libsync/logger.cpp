@@ -17,16 +17,136 @@
 #include "config.h"
 
 #include <QDir>
+#include <QSemaphore>
 #include <QStringList>
 #include <QThread>
+#include <QThreadStorage>
+#include <QVarLengthArray>
 #include <qmetaobject.h>
 
 #include <zlib.h>
 
+#include <memory>
+
 namespace OCC {
 
 QtMessageHandler s_originalMessageHandler = nullptr;
 
+/* A message as queued by the logging thread. Formatting happens on the drain thread. */
+struct LogEntry
+{
+    enum Kind {
+        Formatted, // message is the final line
+        MessageHandler, // message needs qFormatLogMessage() with the stored context
+        Timestamped // message needs the time stamp and thread prefix of Logger::log()
+    };
+    Kind kind = Formatted;
+    QtMsgType type = QtDebugMsg;
+    int line = 0;
+    // file, function and category of the QMessageLogContext, separated by '\0'.
+    // They are copied because the context pointers may not outlive the handler call.
+    QByteArray context;
+    QString message;
+    qint64 timeStamp = 0;
+    const void *thread = nullptr;
+    quint64 sequence = 0; // global order of the messages of all threads
+};
+
+/* Single producer (the logging thread), single consumer (whoever holds Logger::_mutex)
+ * ring buffer. The producer never waits on the consumer, when the buffer is full the
+ * message is dropped and counted. */
+struct LogRing
+{
+    explicit LogRing(quint32 size)
+        : capacity(size)
+        , entries(new LogEntry[size])
+    {
+    }
+
+    // Returns the number of queued entries including the new one, 0 if the buffer
+    // is full. The entry is only moved from if it was queued.
+    quint32 push(LogEntry &entry)
+    {
+        const quint32 h = head.load();
+        const quint32 queued = h - tail.loadAcquire();
+        if (queued >= capacity)
+            return 0;
+        entries[h & (capacity - 1)] = std::move(entry);
+        head.storeRelease(h + 1);
+        return queued + 1;
+    }
+
+    LogEntry &at(quint32 index) { return entries[index & (capacity - 1)]; }
+
+    const quint32 capacity; // a power of two
+    std::unique_ptr<LogEntry[]> entries;
+    QAtomicInteger<quint32> head; // next slot the producer writes
+    QAtomicInteger<quint32> tail; // next slot the consumer reads
+    QAtomicInteger<quint32> dropped;
+    QAtomicInt orphaned; // set when the producing thread has finished
+};
+
+/* The number of entries of each ring buffer, OWNCLOUD_LOG_QUEUE_SIZE overrides it */
+static quint32 logRingSize()
+{
+    static const quint32 size = [] {
+        quint32 wanted = qgetenv("OWNCLOUD_LOG_QUEUE_SIZE").toUInt();
+        if (wanted == 0)
+            wanted = 8192;
+        quint32 size = 64;
+        while (size < wanted && size < (1u << 24))
+            size *= 2;
+        return size;
+    }();
+    return size;
+}
+
+/* Owned by the QThreadStorage of the producing thread, marks the ring as orphaned on thread exit */
+struct LogRingHandle
+{
+    ~LogRingHandle() { ring->orphaned.storeRelease(1); }
+    QSharedPointer<LogRing> ring;
+};
+
+static QThreadStorage<LogRingHandle *> s_logRingHandle;
+
+class LogDrainThread : public QThread
+{
+public:
+    explicit LogDrainThread(Logger *logger)
+        : _logger(logger)
+    {
+        setObjectName(QStringLiteral("LogDrainThread"));
+    }
+
+    void stop()
+    {
+        _stop.storeRelease(1);
+        _wakeUp.release();
+        wait();
+    }
+
+    /// Called by the logging threads when a ring buffer stops being empty
+    void wakeUp() { _wakeUp.release(); }
+
+protected:
+    void run() override
+    {
+        while (!_stop.loadAcquire()) {
+            if (!_logger->drain()) {
+                _wakeUp.acquire();
+                // Wake ups that piled up meanwhile are handled by the next drain
+                _wakeUp.tryAcquire(_wakeUp.available());
+            }
+        }
+    }
+
+private:
+    Logger *_logger;
+    QAtomicInt _stop;
+    QSemaphore _wakeUp;
+};
+
 static void mirallLogCatcher(QtMsgType type, const QMessageLogContext &ctx, const QString &message)
 {
     auto logger = Logger::instance();
@@ -35,7 +155,7 @@ static void mirallLogCatcher(QtMsgType type, const QMessageLogContext &ctx, cons
             s_originalMessageHandler(type, ctx, message);
         }
     } else if (!logger->isNoop()) {
-        logger->doLog(qFormatLogMessage(type, ctx, message));
+        logger->doLog(type, ctx, message);
     }
 }
 
@@ -48,6 +168,8 @@ Logger *Logger::instance()
 
 Logger::Logger(QObject *parent)
     : QObject(parent)
+    , _isNoop(1)
+    , _drainThread(new LogDrainThread(this))
 {
     qSetMessagePattern("[%{function} \t%{message}");
 #ifndef NO_MSG_HANDLER
@@ -55,6 +177,7 @@ Logger::Logger(QObject *parent)
 #else
     Q_UNUSED(mirallLogCatcher)
 #endif
+    _drainThread->start(QThread::LowPriority);
 }
 
 Logger::~Logger()
@@ -62,6 +185,8 @@ Logger::~Logger()
 #ifndef NO_MSG_HANDLER
     qInstallMessageHandler(nullptr);
 #endif
+    _drainThread->stop();
+    flush();
 }
 
 
@@ -82,17 +207,16 @@ void Logger::postGuiMessage(const QString &title, const QString &message)
 
 void Logger::log(Log log)
 {
-    QString msg;
-    if (_showTime) {
-        msg = log.timeStamp.toString(QLatin1String("MM-dd hh:mm:ss:zzz")) + QLatin1Char(' ');
-    }
-
-    msg += QString().sprintf("%p ", (void *)QThread::currentThread());
-    msg += log.message;
+    LogEntry entry;
+    entry.kind = LogEntry::Timestamped;
+    entry.message = std::move(log.message);
+    if (_showTime)
+        entry.timeStamp = log.timeStamp.toMSecsSinceEpoch();
+    entry.thread = QThread::currentThread();
     // _logs.append(log);
     // std::cout << qPrintable(log.message) << std::endl;
 
-    doLog(msg);
+    enqueue(std::move(entry));
 }
 
 /**
@@ -100,8 +224,7 @@ void Logger::log(Log log)
  */
 bool Logger::isNoop() const
 {
-    QMutexLocker lock(&_mutex);
-    return !_logstream && !_logWindowActivated;
+    return _isNoop.loadAcquire();
 }
 
 bool Logger::isLoggingToFile() const
@@ -110,17 +233,226 @@ bool Logger::isLoggingToFile() const
     return _logstream;
 }
 
+void Logger::updateIsNoop()
+{
+    _isNoop.storeRelease(!_logstream && !_logWindowActivated);
+}
+
 void Logger::doLog(const QString &msg)
 {
+    LogEntry entry;
+    entry.message = msg;
+    enqueue(std::move(entry));
+}
+
+void Logger::doLog(QtMsgType type, const QMessageLogContext &ctx, const QString &message)
+{
+    LogEntry entry;
+    entry.kind = LogEntry::MessageHandler;
+    entry.type = type;
+    entry.line = ctx.line;
+    entry.context.append(ctx.file).append('\0').append(ctx.function).append('\0').append(ctx.category);
+    entry.message = message;
+    enqueue(std::move(entry));
+
+    // The process is about to be terminated, get everything out now
+    if (type == QtFatalMsg)
+        flush();
+}
+
+LogRing *Logger::currentThreadRing()
+{
+    if (!s_logRingHandle.hasLocalData()) {
+        // Happens once per thread
+        auto handle = new LogRingHandle;
+        handle->ring.reset(new LogRing(logRingSize()));
+        {
+            QMutexLocker lock(&_ringsMutex);
+            _rings.append(handle->ring);
+        }
+        s_logRingHandle.setLocalData(handle);
+    }
+    return s_logRingHandle.localData()->ring.data();
+}
+
+void Logger::enqueue(LogEntry &&entry)
+{
+    LogRing *ring = currentThreadRing();
+    entry.sequence = _sequence.fetchAndAddRelaxed(1);
+    const quint32 queued = ring->push(entry);
+    if (queued == 0) {
+        // The drain thread doesn't keep up. Logging must never block, the
+        // drain thread reports the number of lost messages.
+        ring->dropped.fetchAndAddRelaxed(1);
+        _drainThread->wakeUp();
+    } else if (queued == 1) {
+        // The drain thread sleeps until there is something to do
+        _drainThread->wakeUp();
+    }
+}
+
+static bool compressLog(const QString &originalName, const QString &targetName)
+{
+    QFile original(originalName);
+    if (!original.open(QIODevice::ReadOnly))
+        return false;
+    auto compressed = gzopen(targetName.toUtf8(), "wb");
+    if (!compressed) {
+        return false;
+    }
+
+    while (!original.atEnd()) {
+        auto data = original.read(1024 * 1024);
+        auto written = gzwrite(compressed, data.data(), data.size());
+        if (written != data.size()) {
+            gzclose(compressed);
+            return false;
+        }
+    }
+    gzclose(compressed);
+    return true;
+}
+
+static QString formatLogEntry(const LogEntry &entry)
+{
+    switch (entry.kind) {
+    case LogEntry::Formatted:
+        break;
+    case LogEntry::MessageHandler: {
+        const char *file = entry.context.constData();
+        const char *function = file + qstrlen(file) + 1;
+        const char *category = function + qstrlen(function) + 1;
+        QMessageLogContext ctx(file, entry.line, function, category);
+        return qFormatLogMessage(entry.type, ctx, entry.message);
+    }
+    case LogEntry::Timestamped: {
+        QString msg;
+        if (entry.timeStamp) {
+            msg = QDateTime::fromMSecsSinceEpoch(entry.timeStamp, Qt::UTC).toString(QLatin1String("MM-dd hh:mm:ss:zzz")) + QLatin1Char(' ');
+        }
+        msg += QLatin1String("0x") + QString::number(reinterpret_cast<quintptr>(entry.thread), 16) + QLatin1Char(' ');
+        msg += entry.message;
+        return msg;
+    }
+    }
+    return entry.message;
+}
+
+bool Logger::drainLocked(QStringList *windowLines)
+{
+    QVector<QSharedPointer<LogRing>> rings;
     {
-        QMutexLocker lock(&_mutex);
-        if (_logstream) {
+        QMutexLocker lock(&_ringsMutex);
+        rings = _rings;
+    }
+
+    auto write = [&](const QString &msg) {
+        if (_logstream)
             (*_logstream) << msg << endl;
-            if (_doFileFlush)
-                _logstream->flush();
+        if (_logWindowActivated)
+            windowLines->append(msg);
+    };
+
+    struct Queued
+    {
+        LogRing *ring;
+        quint32 tail;
+        quint32 head;
+    };
+    QVarLengthArray<Queued, 16> queued;
+    QVector<QSharedPointer<LogRing>> orphans;
+    bool didWork = false;
+    for (const auto &ring : rings) {
+        // Check before draining: everything the thread pushed is visible once orphaned is set
+        if (ring->orphaned.loadAcquire())
+            orphans.append(ring);
+
+        if (const quint32 dropped = ring->dropped.fetchAndStoreRelaxed(0)) {
+            _droppedMessages += dropped;
+            write(QStringLiteral("[ Logger: %1 messages were dropped because the log queue was full ]").arg(dropped));
+            didWork = true;
+        }
+
+        const quint32 tail = ring->tail.load();
+        const quint32 head = ring->head.loadAcquire();
+        if (tail != head)
+            queued.append({ ring.data(), tail, head });
+    }
+
+    // Merge the rings so that the messages of all threads come out in the order they were logged
+    while (!queued.isEmpty()) {
+        int next = 0;
+        for (int i = 1; i < queued.size(); ++i) {
+            if (queued[i].ring->at(queued[i].tail).sequence < queued[next].ring->at(queued[next].tail).sequence)
+                next = i;
+        }
+        auto &q = queued[next];
+        // Moving out leaves an empty slot behind, the producer may reuse it once the tail moved past it
+        const LogEntry entry = std::move(q.ring->at(q.tail));
+        write(formatLogEntry(entry));
+        if (++q.tail == q.head) {
+            q.ring->tail.storeRelease(q.tail);
+            queued.remove(next);
+        }
+        didWork = true;
+    }
+
+    if (!orphans.isEmpty()) {
+        QMutexLocker lock(&_ringsMutex);
+        for (const auto &ring : orphans)
+            _rings.removeOne(ring);
+    }
+
+    if (didWork && _logstream && _doFileFlush)
+        _logstream->flush();
+
+    return didWork;
+}
+
+bool Logger::drain()
+{
+    QStringList windowLines;
+    bool didWork = false;
+    QStringList compressions;
+    {
+        QMutexLocker lock(&_mutex);
+        didWork = drainLocked(&windowLines);
+        compressions.swap(_pendingCompressions);
+    }
+
+    for (const auto &line : windowLines)
+        emit logWindowLog(line);
+
+    for (const auto &previousLog : compressions) {
+        QString compressedName = previousLog + ".gz";
+        if (compressLog(previousLog, compressedName)) {
+            QFile::remove(previousLog);
+        } else {
+            QFile::remove(compressedName);
         }
+        didWork = true;
     }
-    emit logWindowLog(msg);
+
+    return didWork;
+}
+
+void Logger::flush()
+{
+    QStringList windowLines;
+    {
+        QMutexLocker lock(&_mutex);
+        drainLocked(&windowLines);
+        if (_logstream)
+            _logstream->flush();
+    }
+    for (const auto &line : windowLines)
+        emit logWindowLog(line);
+}
+
+quint64 Logger::droppedMessageCount() const
+{
+    QMutexLocker lock(&_mutex);
+    return _droppedMessages;
 }
 
 void Logger::mirallLog(const QString &message)
@@ -136,15 +468,20 @@ void Logger::setLogWindowActivated(bool activated)
 {
     QMutexLocker locker(&_mutex);
     _logWindowActivated = activated;
+    updateIsNoop();
 }
 
 void Logger::setLogFile(const QString &name)
 {
+    // Messages queued so far belong into the previous file
+    flush();
+
     QMutexLocker locker(&_mutex);
     if (_logstream) {
         _logstream.reset(nullptr);
         _logFile.close();
     }
+    updateIsNoop();
 
     if (name.isEmpty()) {
         return;
@@ -168,6 +505,7 @@ void Logger::setLogFile(const QString &name)
     }
 
     _logstream.reset(new QTextStream(&_logFile));
+    updateIsNoop();
 }
 
 void Logger::setLogExpire(int expire)
@@ -220,28 +558,6 @@ void Logger::disableTemporaryFolderLogDir()
     _temporaryFolderLogDir = false;
 }
 
-static bool compressLog(const QString &originalName, const QString &targetName)
-{
-    QFile original(originalName);
-    if (!original.open(QIODevice::ReadOnly))
-        return false;
-    auto compressed = gzopen(targetName.toUtf8(), "wb");
-    if (!compressed) {
-        return false;
-    }
-
-    while (!original.atEnd()) {
-        auto data = original.read(1024 * 1024);
-        auto written = gzwrite(compressed, data.data(), data.size());
-        if (written != data.size()) {
-            gzclose(compressed);
-            return false;
-        }
-    }
-    gzclose(compressed);
-    return true;
-}
-
 void Logger::enterNextLogFile()
 {
     if (!_logDirectory.isEmpty()) {
@@ -276,13 +592,11 @@ void Logger::enterNextLogFile()
         auto previousLog = _logFile.fileName();
         setLogFile(dir.filePath(newLogName));
 
+        // Compressing can take a while, leave it to the drain thread
         if (!previousLog.isEmpty()) {
-            QString compressedName = previousLog + ".gz";
-            if (compressLog(previousLog, compressedName)) {
-                QFile::remove(previousLog);
-            } else {
-                QFile::remove(compressedName);
-            }
+            QMutexLocker locker(&_mutex);
+            _pendingCompressions.append(previousLog);
+            _drainThread->wakeUp();
         }
     }
 }
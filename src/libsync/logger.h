@@ -20,6 +20,9 @@
 #include <QDateTime>
 #include <QFile>
 #include <QTextStream>
+#include <QSharedPointer>
+#include <QVector>
+#include <QStringList>
 #include <qmutex.h>
 
 #include "common/utility.h"
@@ -28,6 +31,10 @@
 
 namespace OCC {
 
+struct LogEntry;
+struct LogRing;
+class LogDrainThread;
+
 struct Log
 {
     QDateTime timeStamp;
@@ -36,6 +43,16 @@ struct Log
 
 /**
  * @brief The Logger class
+ *
+ * Logging threads never wait for file I/O: every thread appends its messages to
+ * its own lock-free ring buffer. A background thread drains the buffers, formats
+ * the messages, writes them to the log file and compresses rotated log files.
+ * It sleeps until a ring buffer stops being empty and merges the buffers so that
+ * the log stays in chronological order across threads. When a ring buffer is
+ * full its thread drops the message; the number of dropped messages is logged.
+ *
+ * Each ring buffer holds 8192 messages, OWNCLOUD_LOG_QUEUE_SIZE changes that.
+ *
  * @ingroup libsync
  */
 class OWNCLOUDSYNC_EXPORT Logger : public QObject
@@ -47,6 +64,13 @@ public:
 
     void log(Log log);
     void doLog(const QString &log);
+    void doLog(QtMsgType type, const QMessageLogContext &ctx, const QString &message);
+
+    /** Synchronously writes all queued messages */
+    void flush();
+
+    /** Number of messages dropped so far because a ring buffer was full */
+    quint64 droppedMessageCount() const;
 
     static void mirallLog(const QString &message);
 
@@ -96,6 +120,15 @@ public slots:
 private:
     Logger(QObject *parent = nullptr);
     ~Logger();
+
+    friend class LogDrainThread;
+    LogRing *currentThreadRing();
+    void enqueue(LogEntry &&entry);
+    // Returns whether anything was done. Must be called with _mutex held.
+    bool drainLocked(QStringList *windowLines);
+    bool drain();
+    void updateIsNoop();
+
     QList<Log> _logs;
     bool _showTime = true;
     bool _logWindowActivated = false;
@@ -107,6 +140,14 @@ private:
     mutable QMutex _mutex;
     QString _logDirectory;
     bool _temporaryFolderLogDir = false;
+
+    QAtomicInt _isNoop;
+    QAtomicInteger<quint64> _sequence; // numbers the messages across all threads
+    QMutex _ringsMutex; // Only taken once per logging thread and by the consumer
+    QVector<QSharedPointer<LogRing>> _rings;
+    quint64 _droppedMessages = 0; // protected by _mutex
+    QStringList _pendingCompressions; // rotated log files, protected by _mutex
+    QScopedPointer<LogDrainThread> _drainThread;
 };
 
 } // namespace OCC
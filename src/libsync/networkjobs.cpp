@@ -45,6 +45,7 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcEtagJob, "nextcloud.sync.networkjob.etag", QtInfoMsg)
 Q_LOGGING_CATEGORY(lcLsColJob, "nextcloud.sync.networkjob.lscol", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcSyncCollectionJob, "nextcloud.sync.networkjob.synccollection", QtInfoMsg)
 Q_LOGGING_CATEGORY(lcCheckServerJob, "nextcloud.sync.networkjob.checkserver", QtInfoMsg)
 Q_LOGGING_CATEGORY(lcPropfindJob, "nextcloud.sync.networkjob.propfind", QtInfoMsg)
 Q_LOGGING_CATEGORY(lcAvatarJob, "nextcloud.sync.networkjob.avatar", QtInfoMsg)
@@ -117,6 +118,29 @@ bool RequestEtagJob::finished()
 
 /*********************************************************************************************/
 
+RequestEtagsJob::RequestEtagsJob(AccountPtr account, const QString &path, QObject *parent)
+    : LsColJob(account, path, parent)
+{
+    setProperties({ "getetag" });
+    connect(this, &LsColJob::directoryListingIterated, this, &RequestEtagsJob::slotListingIterated);
+}
+
+void RequestEtagsJob::slotListingIterated(const QString &href, const QMap<QString, QString> &properties)
+{
+    // The hrefs are normalized like the request path, see LsColXMLParser::parse
+    QString collection = reply()->request().url().path();
+    if (collection.endsWith('/'))
+        collection.chop(1);
+    QString name = href.mid(collection.size());
+    if (name.startsWith('/'))
+        name.remove(0, 1);
+    if (name.contains('/') || !properties.contains("getetag"))
+        return;
+    emit etagRetreived(name, properties.value("getetag"));
+}
+
+/*********************************************************************************************/
+
 MkColJob::MkColJob(AccountPtr account, const QString &path, QObject *parent)
     : AbstractNetworkJob(account, path, parent)
 {
@@ -187,107 +211,176 @@ LsColXMLParser::LsColXMLParser() = default;
 
 bool LsColXMLParser::parse(const QByteArray &xml, QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
 {
-    // Parse DAV response
-    QXmlStreamReader reader(xml);
-    reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    start(fileInfo, expectedPath);
+    addData(xml);
+    return finish();
+}
 
-    QStringList folders;
-    QString currentHref;
-    QMap<QString, QString> currentTmpProperties;
-    QMap<QString, QString> currentHttp200Properties;
-    bool currentPropsHaveHttp200 = false;
-    bool insidePropstat = false;
-    bool insideProp = false;
-    bool insideMultiStatus = false;
+void LsColXMLParser::start(QHash<QString, ExtraFolderInfo> *fileInfo, const QString &expectedPath)
+{
+    _reader.clear();
+    _reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+    _fileInfo = fileInfo;
+    _expectedPath = expectedPath;
+    _failed = false;
+    _folders.clear();
+    _currentHref.clear();
+    _currentTmpProperties.clear();
+    _currentHttp200Properties.clear();
+    _currentPropsHaveHttp200 = false;
+    _insidePropstat = false;
+    _insideProp = false;
+    _insideMultiStatus = false;
+    _capture = Capture::None;
+}
 
-    while (!reader.atEnd()) {
-        QXmlStreamReader::TokenType type = reader.readNext();
-        QString name = reader.name().toString();
-        // Start elements with DAV:
-        if (type == QXmlStreamReader::StartElement && reader.namespaceUri() == QLatin1String("DAV:")) {
-            if (name == QLatin1String("href")) {
-                // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
-                // but the result will have URL encoding..
-                QString hrefString = QUrl::fromLocalFile(QUrl::fromPercentEncoding(reader.readElementText().toUtf8()))
-                        .adjusted(QUrl::NormalizePathSegments)
-                        .path();
-                if (!hrefString.startsWith(expectedPath)) {
-                    qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << expectedPath;
-                    return false;
+bool LsColXMLParser::addData(const QByteArray &data)
+{
+    if (_failed)
+        return false;
+    _reader.addData(data);
+    return parseAvailable();
+}
+
+bool LsColXMLParser::finish()
+{
+    if (_failed)
+        return false;
+    if (_reader.hasError()) {
+        // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
+        qCWarning(lcLsColJob) << "ERROR" << _reader.errorString();
+        return false;
+    } else if (!_insideMultiStatus) {
+        qCWarning(lcLsColJob) << "ERROR no WebDAV response?";
+        return false;
+    }
+    emit directoryListingSubfolders(_folders);
+    emit finishedWithoutError();
+    return true;
+}
+
+// Only reacts to complete tokens, the element texts are collected as they come
+// so that a reply can be fed in arbitrary chunks.
+bool LsColXMLParser::parseAvailable()
+{
+    while (!_reader.atEnd()) {
+        QXmlStreamReader::TokenType type = _reader.readNext();
+        if (type == QXmlStreamReader::Invalid)
+            break;
+
+        if (_capture != Capture::None) {
+            if (type == QXmlStreamReader::Characters) {
+                _captureText += _reader.text();
+            } else if (type == QXmlStreamReader::StartElement) {
+                if (_capture != Capture::Property) {
+                    _reader.raiseError(QStringLiteral("Expected character data."));
+                    break;
                 }
-                currentHref = hrefString;
-            } else if (name == QLatin1String("response")) {
-            } else if (name == QLatin1String("propstat")) {
-                insidePropstat = true;
-            } else if (name == QLatin1String("status") && insidePropstat) {
-                QString httpStatus = reader.readElementText();
-                if (httpStatus.startsWith("HTTP/1.1 200")) {
-                    currentPropsHaveHttp200 = true;
+                // Nested elements are kept as text, see readContentsAsString
+                _captureLevel++;
+                _captureText += "<" + _reader.name().toString() + ">";
+            } else if (type == QXmlStreamReader::EndElement) {
+                if (_captureLevel > 0) {
+                    _captureLevel--;
+                    _captureText += "</" + _reader.name().toString() + ">";
                 } else {
-                    currentPropsHaveHttp200 = false;
+                    finishElement();
+                    if (_failed)
+                        return false;
                 }
-            } else if (name == QLatin1String("prop")) {
-                insideProp = true;
-                continue;
-            } else if (name == QLatin1String("multistatus")) {
-                insideMultiStatus = true;
-                continue;
             }
+            continue;
         }
 
-        if (type == QXmlStreamReader::StartElement && insidePropstat && insideProp) {
-            // All those elements are properties
-            QString propertyContent = readContentsAsString(reader);
-            if (name == QLatin1String("resourcetype") && propertyContent.contains("collection")) {
-                folders.append(currentHref);
-            } else if (name == QLatin1String("size")) {
-                bool ok = false;
-                auto s = propertyContent.toLongLong(&ok);
-                if (ok && fileInfo) {
-                    (*fileInfo)[currentHref].size = s;
-                }
-            } else if (name == QLatin1String("fileid")) {
-                (*fileInfo)[currentHref].fileId = propertyContent.toUtf8();
+        if (type == QXmlStreamReader::StartElement) {
+            if (_insidePropstat && _insideProp) {
+                // All those elements are properties
+                _capture = Capture::Property;
+                _captureName = _reader.name().toString();
+                _captureText.clear();
+                _captureLevel = 0;
+                continue;
             }
-            currentTmpProperties.insert(reader.name().toString(), propertyContent);
-        }
-
-        // End elements with DAV:
-        if (type == QXmlStreamReader::EndElement) {
-            if (reader.namespaceUri() == QLatin1String("DAV:")) {
-                if (reader.name() == "response") {
-                    if (currentHref.endsWith('/')) {
-                        currentHref.chop(1);
-                    }
-                    emit directoryListingIterated(currentHref, currentHttp200Properties);
-                    currentHref.clear();
-                    currentHttp200Properties.clear();
-                } else if (reader.name() == "propstat") {
-                    insidePropstat = false;
-                    if (currentPropsHaveHttp200) {
-                        currentHttp200Properties = QMap<QString, QString>(currentTmpProperties);
-                    }
-                    currentTmpProperties.clear();
-                    currentPropsHaveHttp200 = false;
-                } else if (reader.name() == "prop") {
-                    insideProp = false;
+            if (_reader.namespaceUri() != QLatin1String("DAV:"))
+                continue;
+            const QStringRef name = _reader.name();
+            if (name == QLatin1String("href")) {
+                _capture = Capture::Href;
+                _captureText.clear();
+            } else if (name == QLatin1String("propstat")) {
+                _insidePropstat = true;
+            } else if (name == QLatin1String("status") && _insidePropstat) {
+                _capture = Capture::Status;
+                _captureText.clear();
+            } else if (name == QLatin1String("prop")) {
+                _insideProp = true;
+            } else if (name == QLatin1String("multistatus")) {
+                _insideMultiStatus = true;
+            }
+        } else if (type == QXmlStreamReader::EndElement && _reader.namespaceUri() == QLatin1String("DAV:")) {
+            const QStringRef name = _reader.name();
+            if (name == QLatin1String("response")) {
+                if (_currentHref.endsWith('/')) {
+                    _currentHref.chop(1);
+                }
+                emit directoryListingIterated(_currentHref, _currentHttp200Properties);
+                _currentHref.clear();
+                _currentHttp200Properties.clear();
+            } else if (name == QLatin1String("propstat")) {
+                _insidePropstat = false;
+                if (_currentPropsHaveHttp200) {
+                    _currentHttp200Properties = QMap<QString, QString>(_currentTmpProperties);
                 }
+                _currentTmpProperties.clear();
+                _currentPropsHaveHttp200 = false;
+            } else if (name == QLatin1String("prop")) {
+                _insideProp = false;
             }
         }
     }
+    // Running out of data is fine as long as more is coming
+    return !_reader.hasError() || _reader.error() == QXmlStreamReader::PrematureEndOfDocumentError;
+}
 
-    if (reader.hasError()) {
-        // XML Parser error? Whatever had been emitted before will come as directoryListingIterated
-        qCWarning(lcLsColJob) << "ERROR" << reader.errorString() << xml;
-        return false;
-    } else if (!insideMultiStatus) {
-        qCWarning(lcLsColJob) << "ERROR no WebDAV response?" << xml;
-        return false;
-    } else {
-        emit directoryListingSubfolders(folders);
-        emit finishedWithoutError();
+void LsColXMLParser::finishElement()
+{
+    const Capture capture = _capture;
+    _capture = Capture::None;
+    switch (capture) {
+    case Capture::Href: {
+        // We don't use URL encoding in our request URL (which is the expected path) (QNAM will do it for us)
+        // but the result will have URL encoding..
+        QString hrefString = QUrl::fromLocalFile(QUrl::fromPercentEncoding(_captureText.toUtf8()))
+                .adjusted(QUrl::NormalizePathSegments)
+                .path();
+        if (!hrefString.startsWith(_expectedPath)) {
+            qCWarning(lcLsColJob) << "Invalid href" << hrefString << "expected starting with" << _expectedPath;
+            _failed = true;
+            return;
+        }
+        _currentHref = hrefString;
+        break;
+    }
+    case Capture::Status:
+        _currentPropsHaveHttp200 = _captureText.startsWith("HTTP/1.1 200");
+        break;
+    case Capture::Property:
+        if (_captureName == QLatin1String("resourcetype") && _captureText.contains("collection")) {
+            _folders.append(_currentHref);
+        } else if (_captureName == QLatin1String("size")) {
+            bool ok = false;
+            auto s = _captureText.toLongLong(&ok);
+            if (ok && _fileInfo) {
+                (*_fileInfo)[_currentHref].size = s;
+            }
+        } else if (_captureName == QLatin1String("fileid") && _fileInfo) {
+            (*_fileInfo)[_currentHref].fileId = _captureText.toUtf8();
+        }
+        _currentTmpProperties.insert(_captureName, _captureText);
+        break;
+    case Capture::None:
+        break;
     }
-    return true;
 }
 
 /*********************************************************************************************/
@@ -313,13 +406,9 @@ QList<QByteArray> LsColJob::properties() const
     return _properties;
 }
 
-void LsColJob::start()
+// The <d:prop> children for the properties, assumes the d: and oc: namespace prefixes
+static QByteArray propertiesToXml(const QList<QByteArray> &properties)
 {
-    QList<QByteArray> properties = _properties;
-
-    if (properties.isEmpty()) {
-        qCWarning(lcLsColJob) << "Propfind with no properties!";
-    }
     QByteArray propStr;
     foreach (const QByteArray &prop, properties) {
         if (prop.contains(':')) {
@@ -334,9 +423,20 @@ void LsColJob::start()
             propStr += "    <d:" + prop + " />\n";
         }
     }
+    return propStr;
+}
+
+void LsColJob::start()
+{
+    QList<QByteArray> properties = _properties;
+
+    if (properties.isEmpty()) {
+        qCWarning(lcLsColJob) << "Propfind with no properties!";
+    }
+    QByteArray propStr = propertiesToXml(properties);
 
     QNetworkRequest req;
-    req.setRawHeader("Depth", "1");
+    req.setRawHeader("Depth", _depth);
     QByteArray xml("<?xml version=\"1.0\" ?>\n"
                    "<d:propfind xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">\n"
                    "  <d:prop>\n"
@@ -353,29 +453,50 @@ void LsColJob::start()
     AbstractNetworkJob::start();
 }
 
-// TODO: Instead of doing all in this slot, we should iteratively parse in readyRead(). This
-// would allow us to be more asynchronous in processing while data is coming from the network,
-// not all in one big blob at the end.
+void LsColJob::newReplyHook(QNetworkReply *reply)
+{
+    // The entries are parsed and reported while the reply comes in
+    _parseFailed = false;
+    _parser.reset(new LsColXMLParser);
+    connect(_parser.data(), &LsColXMLParser::directoryListingSubfolders,
+        this, &LsColJob::directoryListingSubfolders);
+    connect(_parser.data(), &LsColXMLParser::directoryListingIterated,
+        this, &LsColJob::directoryListingIterated);
+    connect(_parser.data(), &LsColXMLParser::finishedWithError,
+        this, &LsColJob::finishedWithError);
+    connect(_parser.data(), &LsColXMLParser::finishedWithoutError,
+        this, &LsColJob::finishedWithoutError);
+    QString expectedPath = reply->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
+    _parser->start(&_folderInfos, expectedPath);
+    connect(reply, &QNetworkReply::readyRead, this, &LsColJob::slotReadyRead);
+}
+
+bool LsColJob::isMultiStatusReply() const
+{
+    QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
+    int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    return httpCode == 207 && contentType.contains("application/xml; charset=utf-8");
+}
+
+void LsColJob::slotReadyRead()
+{
+    if (!isMultiStatusReply() || _parseFailed)
+        return;
+    if (!_parser->addData(reply()->readAll())) {
+        // Report it once the reply is finished
+        _parseFailed = true;
+    }
+}
+
 bool LsColJob::finished()
 {
     qCInfo(lcLsColJob) << "LSCOL of" << reply()->request().url() << "FINISHED WITH STATUS"
                        << replyStatusString();
 
-    QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
     int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    if (httpCode == 207 && contentType.contains("application/xml; charset=utf-8")) {
-        LsColXMLParser parser;
-        connect(&parser, &LsColXMLParser::directoryListingSubfolders,
-            this, &LsColJob::directoryListingSubfolders);
-        connect(&parser, &LsColXMLParser::directoryListingIterated,
-            this, &LsColJob::directoryListingIterated);
-        connect(&parser, &LsColXMLParser::finishedWithError,
-            this, &LsColJob::finishedWithError);
-        connect(&parser, &LsColXMLParser::finishedWithoutError,
-            this, &LsColJob::finishedWithoutError);
-
-        QString expectedPath = reply()->request().url().path(); // something like "/owncloud/remote.php/webdav/folder"
-        if (!parser.parse(reply()->readAll(), &_folderInfos, expectedPath)) {
+    if (isMultiStatusReply()) {
+        slotReadyRead();
+        if (_parseFailed || !_parser->finish()) {
             // XML parse error
             emit finishedWithError(reply());
         }
@@ -392,6 +513,187 @@ bool LsColJob::finished()
 
 /*********************************************************************************************/
 
+SyncCollectionJob::SyncCollectionJob(AccountPtr account, const QString &path, const QByteArray &syncToken, QObject *parent)
+    : AbstractNetworkJob(account, path, parent)
+    , _syncToken(syncToken)
+{
+}
+
+void SyncCollectionJob::setProperties(QList<QByteArray> properties)
+{
+    _properties = properties;
+}
+
+QList<QByteArray> SyncCollectionJob::properties() const
+{
+    return _properties;
+}
+
+void SyncCollectionJob::start()
+{
+    if (_properties.isEmpty()) {
+        qCWarning(lcSyncCollectionJob) << "sync-collection REPORT with no properties!";
+    }
+
+    QNetworkRequest req;
+    req.setHeader(QNetworkRequest::ContentTypeHeader, QByteArrayLiteral("application/xml; charset=utf-8"));
+    const QByteArray token = QString::fromUtf8(_syncToken).toHtmlEscaped().toUtf8();
+    QByteArray xml = "<?xml version=\"1.0\" ?>\n"
+                     "<d:sync-collection xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">\n";
+    xml += "  <d:sync-token>" + token + "</d:sync-token>\n";
+    xml += "  <d:sync-level>infinite</d:sync-level>\n";
+    xml += "  <d:prop>\n" + propertiesToXml(_properties) + "  </d:prop>\n";
+    xml += "</d:sync-collection>\n";
+    auto *buf = new QBuffer(this);
+    buf->setData(xml);
+    buf->open(QIODevice::ReadOnly);
+    sendRequest("REPORT", makeDavUrl(path()), req, buf);
+    AbstractNetworkJob::start();
+}
+
+bool SyncCollectionJob::parse(const QByteArray &xml, const QString &expectedPath)
+{
+    QXmlStreamReader reader(xml);
+    reader.addExtraNamespaceDeclaration(QXmlStreamNamespaceDeclaration("d", "DAV:"));
+
+    QString currentHref;
+    QString currentStatus;
+    QMap<QString, QString> currentTmpProperties;
+    QMap<QString, QString> currentHttp200Properties;
+    bool currentPropsHaveHttp200 = false;
+    bool insideResponse = false;
+    bool insidePropstat = false;
+    bool insideProp = false;
+    bool insideMultiStatus = false;
+    bool truncated = false;
+
+    while (!reader.atEnd()) {
+        QXmlStreamReader::TokenType type = reader.readNext();
+        QString name = reader.name().toString();
+        if (type == QXmlStreamReader::StartElement && reader.namespaceUri() == QLatin1String("DAV:")) {
+            if (name == QLatin1String("href") && insideResponse) {
+                // Same normalization as in LsColXMLParser::parse
+                QString hrefString = QUrl::fromLocalFile(QUrl::fromPercentEncoding(reader.readElementText().toUtf8()))
+                                         .adjusted(QUrl::NormalizePathSegments)
+                                         .path();
+                if (!hrefString.startsWith(expectedPath)) {
+                    qCWarning(lcSyncCollectionJob) << "Invalid href" << hrefString << "expected starting with" << expectedPath;
+                    return false;
+                }
+                currentHref = hrefString;
+            } else if (name == QLatin1String("response")) {
+                insideResponse = true;
+            } else if (name == QLatin1String("propstat")) {
+                insidePropstat = true;
+            } else if (name == QLatin1String("status") && insideResponse) {
+                QString httpStatus = reader.readElementText();
+                if (insidePropstat) {
+                    currentPropsHaveHttp200 = httpStatus.startsWith("HTTP/1.1 200");
+                } else {
+                    // The status of the whole response: 404 for removed members
+                    currentStatus = httpStatus;
+                }
+            } else if (name == QLatin1String("prop")) {
+                insideProp = true;
+                continue;
+            } else if (name == QLatin1String("multistatus")) {
+                insideMultiStatus = true;
+                continue;
+            } else if (name == QLatin1String("sync-token") && !insideResponse) {
+                _newSyncToken = reader.readElementText().trimmed().toUtf8();
+            }
+        }
+
+        if (type == QXmlStreamReader::StartElement && insidePropstat && insideProp) {
+            QString propertyContent = readContentsAsString(reader);
+            currentTmpProperties.insert(reader.name().toString(), propertyContent);
+        }
+
+        if (type == QXmlStreamReader::EndElement && reader.namespaceUri() == QLatin1String("DAV:")) {
+            if (reader.name() == "response") {
+                QString file = currentHref.mid(expectedPath.length());
+                while (file.endsWith('/')) {
+                    file.chop(1);
+                }
+                while (file.startsWith('/')) {
+                    file.remove(0, 1);
+                }
+                if (currentStatus.startsWith("HTTP/1.1 507") && file.isEmpty()) {
+                    // RFC 6578 3.6: the server truncated the result
+                    truncated = true;
+                } else if (currentStatus.startsWith("HTTP/1.1 404")) {
+                    if (!file.isEmpty())
+                        emit itemDeleted(file);
+                } else if (!file.isEmpty() && !currentHttp200Properties.isEmpty()) {
+                    emit itemChanged(file, currentHttp200Properties);
+                }
+                currentHref.clear();
+                currentStatus.clear();
+                currentHttp200Properties.clear();
+                insideResponse = false;
+            } else if (reader.name() == "propstat") {
+                insidePropstat = false;
+                if (currentPropsHaveHttp200) {
+                    currentHttp200Properties = currentTmpProperties;
+                }
+                currentTmpProperties.clear();
+                currentPropsHaveHttp200 = false;
+            } else if (reader.name() == "prop") {
+                insideProp = false;
+            }
+        }
+    }
+
+    if (reader.hasError()) {
+        qCWarning(lcSyncCollectionJob) << "ERROR" << reader.errorString() << xml;
+        return false;
+    } else if (!insideMultiStatus) {
+        qCWarning(lcSyncCollectionJob) << "ERROR no WebDAV response?" << xml;
+        return false;
+    } else if (_newSyncToken.isEmpty()) {
+        qCWarning(lcSyncCollectionJob) << "ERROR no sync-token in the response";
+        return false;
+    } else if (truncated) {
+        // Paging through the changes would need several round trips, listing
+        // the collection is as good.
+        qCInfo(lcSyncCollectionJob) << "The server truncated the changes";
+        _tokenInvalid = true;
+        return false;
+    }
+    return true;
+}
+
+bool SyncCollectionJob::finished()
+{
+    qCInfo(lcSyncCollectionJob) << "REPORT sync-collection of" << reply()->request().url() << "FINISHED WITH STATUS"
+                                << replyStatusString();
+
+    QString contentType = reply()->header(QNetworkRequest::ContentTypeHeader).toString();
+    int httpCode = reply()->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (httpCode == 207 && contentType.contains("application/xml; charset=utf-8")) {
+        QString expectedPath = reply()->request().url().path();
+        if (parse(reply()->readAll(), expectedPath)) {
+            emit finishedWithoutError();
+        } else {
+            emit finishedWithError(reply());
+        }
+        return true;
+    }
+
+    const QByteArray body = reply()->readAll();
+    if ((httpCode == 403 || httpCode == 409) && body.contains("valid-sync-token")) {
+        // RFC 6578 3.2: the token is no longer valid
+        _tokenInvalid = true;
+    } else if (httpCode == 400 || httpCode == 405 || httpCode == 415 || httpCode == 501
+        || (httpCode == 403 && body.contains("supported-report"))) {
+        _unsupported = true;
+    }
+    emit finishedWithError(reply());
+    return true;
+}
+
+/*********************************************************************************************/
+
 namespace {
     const char statusphpC[] = "status.php";
     const char nextcloudDirC[] = "nextcloud/";
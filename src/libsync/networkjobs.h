@@ -20,6 +20,7 @@
 
 #include <QBuffer>
 #include <QUrlQuery>
+#include <QXmlStreamReader>
 #include <functional>
 
 class QUrl;
@@ -85,11 +86,53 @@ public:
                QHash<QString, ExtraFolderInfo> *sizes,
                const QString &expectedPath);
 
+    /**
+     * Incremental parsing: after start(), feed the reply with addData() as it
+     * arrives and call finish() at the end. Every entry is reported with
+     * directoryListingIterated() as soon as it is complete.
+     *
+     * addData() and finish() return false once the reply is invalid.
+     */
+    void start(QHash<QString, ExtraFolderInfo> *sizes, const QString &expectedPath);
+    bool addData(const QByteArray &data);
+    bool finish();
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
+
+private:
+    bool parseAvailable();
+    void finishElement();
+
+    enum class Capture {
+        None,
+        Href,
+        Status,
+        Property
+    };
+
+    QXmlStreamReader _reader;
+    QHash<QString, ExtraFolderInfo> *_fileInfo = nullptr;
+    QString _expectedPath;
+    bool _failed = false;
+
+    QStringList _folders;
+    QString _currentHref;
+    QMap<QString, QString> _currentTmpProperties;
+    QMap<QString, QString> _currentHttp200Properties;
+    bool _currentPropsHaveHttp200 = false;
+    bool _insidePropstat = false;
+    bool _insideProp = false;
+    bool _insideMultiStatus = false;
+
+    // The element whose text is being collected
+    Capture _capture = Capture::None;
+    QString _captureName;
+    QString _captureText;
+    int _captureLevel = 0;
 };
 
 class OWNCLOUDSYNC_EXPORT LsColJob : public AbstractNetworkJob
@@ -112,20 +155,87 @@ public:
     void setProperties(QList<QByteArray> properties);
     QList<QByteArray> properties() const;
 
+    /**
+     * The Depth header of the PROPFIND, "1" by default.
+     *
+     * With "0" only the collection itself is reported, with "infinity"
+     * everything below it. The entries are reported while the reply is
+     * still coming in.
+     */
+    void setDepth(const QByteArray &depth) { _depth = depth; }
+
 signals:
     void directoryListingSubfolders(const QStringList &items);
     void directoryListingIterated(const QString &name, const QMap<QString, QString> &properties);
     void finishedWithError(QNetworkReply *reply);
     void finishedWithoutError();
 
+protected:
+    void newReplyHook(QNetworkReply *reply) override;
+
 private slots:
     bool finished() override;
+    void slotReadyRead();
 
 private:
+    bool isMultiStatusReply() const;
+
     QList<QByteArray> _properties;
+    QByteArray _depth = "1";
+    QScopedPointer<LsColXMLParser> _parser;
+    bool _parseFailed = false;
     QUrl _url; // Used instead of path() if the url is specified in the constructor
 };
 
+/**
+ * @brief Asks for the changes below a collection since a sync-token (RFC 6578)
+ *
+ * Sends a sync-collection REPORT with sync-level infinite. Every changed or new
+ * entry is reported with itemChanged(), every removed one with itemDeleted().
+ * The paths are relative to the collection. Once finishedWithoutError() was
+ * emitted, syncToken() is the token to use for the next request.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT SyncCollectionJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+public:
+    explicit SyncCollectionJob(AccountPtr account, const QString &path, const QByteArray &syncToken, QObject *parent = nullptr);
+    void start() override;
+
+    /// Same format as LsColJob::setProperties()
+    void setProperties(QList<QByteArray> properties);
+    QList<QByteArray> properties() const;
+
+    /// The new sync-token, valid after finishedWithoutError()
+    QByteArray syncToken() const { return _newSyncToken; }
+
+    /// Whether the server rejected the sync-token, a full listing is required
+    bool isTokenInvalid() const { return _tokenInvalid; }
+
+    /// Whether the server does not support the sync-collection REPORT
+    bool isUnsupported() const { return _unsupported; }
+
+signals:
+    void itemChanged(const QString &path, const QMap<QString, QString> &properties);
+    void itemDeleted(const QString &path);
+    void finishedWithError(QNetworkReply *reply);
+    void finishedWithoutError();
+
+private slots:
+    bool finished() override;
+
+private:
+    bool parse(const QByteArray &xml, const QString &expectedPath);
+
+    QList<QByteArray> _properties;
+    QByteArray _syncToken;
+    QByteArray _newSyncToken;
+    bool _tokenInvalid = false;
+    bool _unsupported = false;
+};
+
 /**
  * @brief The PropfindJob class
  *
@@ -339,6 +449,30 @@ private slots:
     bool finished() override;
 };
 
+/**
+ * @brief The etags of a collection and of its direct children in one request
+ *
+ * Polling several folders below the same collection this way needs a single
+ * PROPFIND instead of one per folder. Only meaningful if the server updates
+ * the etag of a collection when something inside it changes, see
+ * Account::rootEtagChangesNotOnlySubFolderEtags().
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT RequestEtagsJob : public LsColJob
+{
+    Q_OBJECT
+public:
+    explicit RequestEtagsJob(AccountPtr account, const QString &path, QObject *parent = nullptr);
+
+signals:
+    /// \a name is empty for the collection itself, otherwise the name of the child
+    void etagRetreived(const QString &name, const QString &etag);
+
+private slots:
+    void slotListingIterated(const QString &href, const QMap<QString, QString> &properties);
+};
+
 /**
  * @brief Job to check an API that return JSON
  *
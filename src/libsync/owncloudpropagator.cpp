@@ -22,6 +22,7 @@
 #include "propagateremotemove.h"
 #include "propagateremotemkdir.h"
 #include "propagatorjobs.h"
+#include "encryptedfoldersession.h"
 #include "filesystem.h"
 #include "common/utility.h"
 #include "account.h"
@@ -78,10 +79,11 @@ OwncloudPropagator::~OwncloudPropagator() = default;
 
 int OwncloudPropagator::maximumActiveTransferJob()
 {
-    if (_downloadLimit.fetchAndAddAcquire(0) != 0
-        || _uploadLimit.fetchAndAddAcquire(0) != 0
+    if (_downloadLimit.fetchAndAddAcquire(0) < 0
+        || _uploadLimit.fetchAndAddAcquire(0) < 0
         || !_syncOptions._parallelNetworkJobs) {
-        // disable parallelism when there is a network limit.
+        // disable parallelism when the limit is relative to the measured bandwidth.
+        // Absolute limits are shared fairly between parallel transfers.
         return 1;
     }
     return qMin(3, qCeil(hardMaximumActiveJob() / 2.));
@@ -654,6 +656,17 @@ AccountPtr OwncloudPropagator::account() const
     return _account;
 }
 
+EncryptedFolderSession *OwncloudPropagator::encryptedFolderSession(const QByteArray &folderId)
+{
+    QPointer<EncryptedFolderSession> &session = _encryptedFolderSessions[folderId];
+    if (!session || !session->isAcquirable()) {
+        // A session that is unlocking the folder still exists, the new one
+        // locks the folder after it is done
+        session = new EncryptedFolderSession(_account, folderId, session.data(), this);
+    }
+    return session.data();
+}
+
 OwncloudPropagator::DiskSpaceResult OwncloudPropagator::diskSpaceCheck() const
 {
     const qint64 freeBytes = Utility::freeDiskSpace(_localDir);
@@ -722,7 +735,7 @@ bool OwncloudPropagator::createConflict(const SyncFileItemPtr &item,
     // Create a new upload job if the new conflict file should be uploaded
     if (account()->capabilities().uploadConflictFiles()) {
         if (composite && !QFileInfo(conflictFilePath).isDir()) {
-            SyncFileItemPtr conflictItem = SyncFileItemPtr(new SyncFileItem);
+            auto conflictItem = SyncFileItemPtr::create();
             conflictItem->_file = conflictFileName;
             conflictItem->_type = ItemTypeFile;
             conflictItem->_direction = SyncFileItem::Up;
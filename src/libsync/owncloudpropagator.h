@@ -50,6 +50,7 @@ qint64 freeSpaceLimit();
 class SyncJournalDb;
 class OwncloudPropagator;
 class PropagatorCompositeJob;
+class EncryptedFolderSession;
 
 /**
  * @brief the base class of propagator jobs
@@ -292,7 +293,7 @@ public:
 
     PropagatorCompositeJob _subJobs;
 
-    explicit PropagateDirectory(OwncloudPropagator *propagator, const SyncFileItemPtr &item = SyncFileItemPtr(new SyncFileItem));
+    explicit PropagateDirectory(OwncloudPropagator *propagator, const SyncFileItemPtr &item = SyncFileItemPtr::create());
 
     void appendJob(PropagatorJob *job)
     {
@@ -357,7 +358,7 @@ public:
     }
 };
 
-class OwncloudPropagator : public QObject
+class OWNCLOUDSYNC_EXPORT OwncloudPropagator : public QObject
 {
     Q_OBJECT
 public:
@@ -510,6 +511,14 @@ public:
     bool createConflict(const SyncFileItemPtr &item,
         PropagatorCompositeJob *composite, QString *error);
 
+    /** The lock and metadata of the encrypted folder folderId.
+     *
+     * All jobs of this sync that change the same encrypted folder share one
+     * session, so that the folder is only locked and its metadata only
+     * fetched once for all of them.
+     */
+    EncryptedFolderSession *encryptedFolderSession(const QByteArray &folderId);
+
 private slots:
 
     void abortTimeout()
@@ -552,6 +561,7 @@ private:
     AccountPtr _account;
     QScopedPointer<PropagateDirectory> _rootJob;
     SyncOptions _syncOptions;
+    QHash<QByteArray, QPointer<EncryptedFolderSession>> _encryptedFolderSessions;
 };
 
 
@@ -143,6 +143,7 @@ void ProgressInfo::reset()
     _sizeProgress = Progress();
     _fileProgress = Progress();
     _totalSizeOfCompletedJobs = 0;
+    _completedSizeOfRunningJobs = 0;
 
     // Historically, these starting estimates were way lower, but that lead
     // to gross overestimation of ETA when a good estimate wasn't available.
@@ -226,12 +227,17 @@ void ProgressInfo::setProgressComplete(const SyncFileItem &item)
         return;
     }
 
-    _currentItems.remove(item._file);
+    auto it = _currentItems.find(item._file);
+    if (it != _currentItems.end()) {
+        if (isSizeDependent(it->_item))
+            _completedSizeOfRunningJobs -= it->_progress._completed;
+        _currentItems.erase(it);
+    }
     _fileProgress.setCompleted(_fileProgress._completed + item._affectedItems);
     if (ProgressInfo::isSizeDependent(item)) {
         _totalSizeOfCompletedJobs += item._size;
     }
-    recomputeCompletedSize();
+    _sizeProgress.setCompleted(_totalSizeOfCompletedJobs + _completedSizeOfRunningJobs);
     _lastCompletedItem = item;
 }
 
@@ -241,10 +247,17 @@ void ProgressInfo::setProgressItem(const SyncFileItem &item, quint64 completed)
         return;
     }
 
-    _currentItems[item._file]._item = item;
-    _currentItems[item._file]._progress._total = item._size;
-    _currentItems[item._file]._progress.setCompleted(completed);
-    recomputeCompletedSize();
+    // This is called for every bit of progress: only copy the item once
+    auto it = _currentItems.find(item._file);
+    if (it == _currentItems.end())
+        it = _currentItems.insert(item._file, ProgressItem{ item, Progress() });
+
+    const quint64 previous = it->_progress._completed;
+    it->_progress._total = item._size;
+    it->_progress.setCompleted(completed);
+    if (isSizeDependent(it->_item))
+        _completedSizeOfRunningJobs += it->_progress._completed - previous;
+    _sizeProgress.setCompleted(_totalSizeOfCompletedJobs + _completedSizeOfRunningJobs);
 
     // This seems dubious!
     _lastCompletedItem = SyncFileItem();
@@ -348,16 +361,6 @@ void ProgressInfo::updateEstimates()
         _maxBytesPerSecond);
 }
 
-void ProgressInfo::recomputeCompletedSize()
-{
-    quint64 r = _totalSizeOfCompletedJobs;
-    foreach (const ProgressItem &i, _currentItems) {
-        if (isSizeDependent(i._item))
-            r += i._progress._completed;
-    }
-    _sizeProgress.setCompleted(r);
-}
-
 ProgressInfo::Estimates ProgressInfo::Progress::estimates() const
 {
     Estimates est;
@@ -213,10 +213,6 @@ private slots:
     void updateEstimates();
 
 private:
-    // Sets the completed size by summing finished jobs with the progress
-    // of active ones.
-    void recomputeCompletedSize();
-
     // Triggers the update() slot every second once propagation started.
     QTimer _updateEstimatesTimer;
 
@@ -226,6 +222,10 @@ private:
     // All size from completed jobs only.
     quint64 _totalSizeOfCompletedJobs;
 
+    // The sum of the progress of the _currentItems, kept up to date
+    // incrementally since it changes with every bit of progress.
+    quint64 _completedSizeOfRunningJobs;
+
     // The fastest observed rate of files per second in this sync.
     double _maxFilesPerSecond;
     double _maxBytesPerSecond;
@@ -26,11 +26,13 @@
 #include "common/asserts.h"
 #include "clientsideencryptionjobs.h"
 #include "propagatedownloadencrypted.h"
+#include "propagatedownloaddelta.h"
 
 #include <QLoggingCategory>
 #include <QNetworkAccessManager>
 #include <QFileInfo>
 #include <QDir>
+#include <QtConcurrentRun>
 #include <cmath>
 
 #ifdef Q_OS_UNIX
@@ -78,7 +80,6 @@ GETFileJob::GETFileJob(AccountPtr account, const QString &path, QFile *device,
     , _resumeStart(resumeStart)
     , _errorStatus(SyncFileItem::NoStatus)
     , _bandwidthLimited(false)
-    , _bandwidthChoked(false)
     , _bandwidthQuota(0)
     , _bandwidthManager(nullptr)
     , _hasEmittedFinishedSignal(false)
@@ -98,7 +99,6 @@ GETFileJob::GETFileJob(AccountPtr account, const QUrl &url, QFile *device,
     , _errorStatus(SyncFileItem::NoStatus)
     , _directDownloadUrl(url)
     , _bandwidthLimited(false)
-    , _bandwidthChoked(false)
     , _bandwidthQuota(0)
     , _bandwidthManager(nullptr)
     , _hasEmittedFinishedSignal(false)
@@ -109,10 +109,18 @@ GETFileJob::GETFileJob(AccountPtr account, const QUrl &url, QFile *device,
 
 void GETFileJob::start()
 {
-    if (_resumeStart > 0) {
+    if (_rangeEnd >= 0) {
+        _headers["Range"] = "bytes=" + QByteArray::number(_resumeStart) + '-' + QByteArray::number(_rangeEnd);
+        _headers["Accept-Ranges"] = "bytes";
+    } else if (_resumeStart > 0) {
         _headers["Range"] = "bytes=" + QByteArray::number(_resumeStart) + '-';
         _headers["Accept-Ranges"] = "bytes";
         qCDebug(lcGetJob) << "Retry with range " << _headers["Range"];
+    } else if (_directDownloadUrl.isEmpty()
+        && account()->capabilities().supportedContentEncodings().contains(ContentEncoding::gzipC)) {
+        // Ranges of a compressed body can't be resumed, so only ask for it on full downloads.
+        // Setting the header ourselves keeps QNAM from decompressing, see slotReadyRead().
+        _headers["Accept-Encoding"] = ContentEncoding::gzipC;
     }
 
     QNetworkRequest req;
@@ -129,7 +137,7 @@ void GETFileJob::start()
         sendRequest("GET", _directDownloadUrl, req);
     }
 
-    qCDebug(lcGetJob) << _bandwidthManager << _bandwidthChoked << _bandwidthLimited;
+    qCDebug(lcGetJob) << _bandwidthManager << _bandwidthLimited;
     if (_bandwidthManager) {
         _bandwidthManager->registerDownloadJob(this);
     }
@@ -146,7 +154,11 @@ void GETFileJob::newReplyHook(QNetworkReply *reply)
     connect(reply, &QNetworkReply::metaDataChanged, this, &GETFileJob::slotMetaDataChanged);
     connect(reply, &QIODevice::readyRead, this, &GETFileJob::slotReadyRead);
     connect(reply, &QNetworkReply::finished, this, &GETFileJob::slotReadyRead);
-    connect(reply, &QNetworkReply::downloadProgress, this, &GETFileJob::downloadProgress);
+    connect(reply, &QNetworkReply::downloadProgress, this, [this](qint64 received, qint64 total) {
+        // Compressed bodies report the progress of the decompressed data in slotReadyRead()
+        if (!_decompressor)
+            emit downloadProgress(received, total);
+    });
 }
 
 void GETFileJob::slotMetaDataChanged()
@@ -193,6 +205,14 @@ void GETFileJob::slotMetaDataChanged()
 
     quint64 start = 0;
     QByteArray ranges = reply()->rawHeader("Content-Range");
+    if (_rangeEnd >= 0 && ranges.isEmpty()) {
+        // Writing the whole file at the range's position would corrupt it
+        qCWarning(lcGetJob) << "Server ignored the range request" << _headers["Range"];
+        _errorString = tr("Server does not support range requests");
+        _errorStatus = SyncFileItem::SoftError;
+        reply()->abort();
+        return;
+    }
     if (!ranges.isEmpty()) {
         QRegExp rx("bytes (\\d+)-");
         if (rx.indexIn(ranges) >= 0) {
@@ -224,6 +244,17 @@ void GETFileJob::slotMetaDataChanged()
         _lastModified = Utility::qDateTimeToTime_t(lastModified.toDateTime());
     }
 
+    const QByteArray contentEncoding = reply()->rawHeader("Content-Encoding").trimmed().toLower();
+    if (contentEncoding == ContentEncoding::gzipC) {
+        _decompressor.reset(new GzipDecompressor);
+    } else if (!contentEncoding.isEmpty() && contentEncoding != "identity") {
+        qCWarning(lcGetJob) << "Unsupported content encoding" << contentEncoding;
+        _errorString = tr("Server replied with an unsupported content encoding");
+        _errorStatus = SyncFileItem::NormalError;
+        reply()->abort();
+        return;
+    }
+
     _saveBodyToFile = true;
 }
 
@@ -232,12 +263,6 @@ void GETFileJob::setBandwidthManager(BandwidthManager *bwm)
     _bandwidthManager = bwm;
 }
 
-void GETFileJob::setChoked(bool c)
-{
-    _bandwidthChoked = c;
-    QMetaObject::invokeMethod(this, "slotReadyRead", Qt::QueuedConnection);
-}
-
 void GETFileJob::setBandwidthLimited(bool b)
 {
     _bandwidthLimited = b;
@@ -265,20 +290,16 @@ void GETFileJob::slotReadyRead()
         return;
     int bufferSize = qMin(1024 * 8ll, reply()->bytesAvailable());
     QByteArray buffer(bufferSize, Qt::Uninitialized);
+    QByteArray decompressed;
 
     while (reply()->bytesAvailable() > 0) {
-        if (_bandwidthChoked) {
-            qCWarning(lcGetJob) << "Download choked";
-            break;
-        }
         qint64 toRead = bufferSize;
         if (_bandwidthLimited) {
             toRead = qMin(qint64(bufferSize), _bandwidthQuota);
-            if (toRead == 0) {
-                qCWarning(lcGetJob) << "Out of quota";
+            if (toRead <= 0) {
+                qCDebug(lcGetJob) << "Out of quota";
                 break;
             }
-            _bandwidthQuota -= toRead;
         }
 
         qint64 r = reply()->read(buffer.data(), toRead);
@@ -289,8 +310,24 @@ void GETFileJob::slotReadyRead()
             reply()->abort();
             return;
         }
+        if (_bandwidthLimited)
+            _bandwidthQuota -= r;
+
+        const char *data = buffer.constData();
+        if (_decompressor) {
+            // The bandwidth quota counts the bytes on the wire, not the decompressed ones
+            decompressed.clear();
+            if (!_decompressor->decompress(buffer.constData(), r, &decompressed)) {
+                _errorString = tr("The compressed data received from the server is corrupt");
+                _errorStatus = SyncFileItem::SoftError;
+                reply()->abort();
+                return;
+            }
+            data = decompressed.constData();
+            r = decompressed.size();
+        }
 
-        qint64 w = _device->write(buffer.constData(), r);
+        qint64 w = _device->write(data, r);
         if (w != r) {
             _errorString = _device->errorString();
             _errorStatus = SyncFileItem::NormalError;
@@ -298,6 +335,8 @@ void GETFileJob::slotReadyRead()
             reply()->abort();
             return;
         }
+        if (_decompressor)
+            emit downloadProgress(_device->pos() - qint64(_resumeStart), -1);
     }
 
     if (reply()->isFinished() && reply()->bytesAvailable() == 0) {
@@ -489,6 +528,11 @@ void PropagateDownloadFile::startDownload()
         return;
     }
 
+    // Before the download info is stored: a partly filled file must not be resumed
+    if (_resumeStart == 0 && startDeltaDownload()) {
+        return;
+    }
+
     {
         SyncJournalDb::DownloadInfo pi;
         pi._etag = _item->_etag;
@@ -498,22 +542,26 @@ void PropagateDownloadFile::startDownload()
         propagator()->_journal->commit("download file start");
     }
 
+    if (_resumeStart == 0 && startLocalCopy()) {
+        return;
+    }
+
     QMap<QByteArray, QByteArray> headers;
 
-    if (_item->_directDownloadUrl.isEmpty()) {
+    if (_item->directDownloadUrl().isEmpty()) {
         // Normal job, download from oC instance
         _job = new GETFileJob(propagator()->account(),
             propagator()->_remoteFolder + _item->_file,
             &_tmpFile, headers, expectedEtagForResume, _resumeStart, this);
     } else {
         // We were provided a direct URL, use that one
-        qCInfo(lcPropagateDownload) << "directDownloadUrl given for " << _item->_file << _item->_directDownloadUrl;
+        qCInfo(lcPropagateDownload) << "directDownloadUrl given for " << _item->_file << _item->directDownloadUrl();
 
-        if (!_item->_directDownloadCookies.isEmpty()) {
-            headers["Cookie"] = _item->_directDownloadCookies.toUtf8();
+        if (!_item->directDownloadCookies().isEmpty()) {
+            headers["Cookie"] = _item->directDownloadCookies().toUtf8();
         }
 
-        QUrl url = QUrl::fromUserInput(_item->_directDownloadUrl);
+        QUrl url = QUrl::fromUserInput(_item->directDownloadUrl());
         _job = new GETFileJob(propagator()->account(),
             url,
             &_tmpFile, headers, expectedEtagForResume, _resumeStart, this);
@@ -525,6 +573,130 @@ void PropagateDownloadFile::startDownload()
     _job->start();
 }
 
+bool PropagateDownloadFile::startLocalCopy()
+{
+    // Only a collision safe checksum allows to trust that the content is the same
+    if (_triedLocalCopy || !propagator()->syncOptions()._localCopyForDownloads
+        || _isEncrypted || _item->_instruction != CSYNC_INSTRUCTION_NEW
+        || !_item->directDownloadUrl().isEmpty()
+        || !csync_is_collision_safe_hash(_item->_checksumHeader)) {
+        return false;
+    }
+
+    QString source;
+    const QByteArray path = _item->_file.toUtf8();
+    propagator()->_journal->getFileRecordsByChecksum(_item->_checksumHeader, _item->_size, [&](const SyncJournalFileRecord &rec) {
+        if (!source.isEmpty() || rec._type != ItemTypeFile || rec._path == path
+            || !rec._e2eMangledName.isEmpty()) {
+            return;
+        }
+        // The local file must still be the one that was synced
+        const QString fn = propagator()->getFilePath(QString::fromUtf8(rec._path));
+        if (FileSystem::fileChanged(fn, rec._fileSize, rec._modtime)) {
+            return;
+        }
+        source = fn;
+    });
+    if (source.isEmpty()) {
+        return false;
+    }
+
+    qCInfo(lcPropagateDownload) << "Copying" << source << "instead of downloading" << _item->_file;
+    _triedLocalCopy = true;
+    _tmpFile.close();
+    const QString destination = _tmpFile.fileName();
+    propagator()->_activeJobList.append(this);
+    connect(&_localCopyWatcher, &QFutureWatcherBase::finished,
+        this, &PropagateDownloadFile::slotLocalCopyFinished, Qt::UniqueConnection);
+    _localCopyWatcher.setFuture(QtConcurrent::run([source, destination]() {
+        QString error;
+        if (!FileSystem::cloneFile(source, destination, &error)) {
+            qCWarning(lcPropagateDownload) << "Could not copy" << source << error;
+            return false;
+        }
+        return true;
+    }));
+    return true;
+}
+
+void PropagateDownloadFile::slotLocalCopyFinished()
+{
+    propagator()->_activeJobList.removeOne(this);
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
+    if (!_localCopyWatcher.future().result()) {
+        slotRestartDownload(QString());
+        return;
+    }
+    validateLocalContent();
+}
+
+bool PropagateDownloadFile::startDeltaDownload()
+{
+    const auto &options = propagator()->syncOptions();
+    if (_triedDeltaDownload || !options._deltaDownloads
+        || _isEncrypted || _item->_instruction != CSYNC_INSTRUCTION_SYNC
+        || !_item->directDownloadUrl().isEmpty()
+        || _item->_size < options._minDeltaDownloadSize
+        || !csync_is_collision_safe_hash(_item->_checksumHeader)) {
+        return false;
+    }
+    // The local blocks can only be trusted if the file is what was synced
+    if (FileSystem::fileChanged(propagator()->getFilePath(_item->_file),
+            _item->_previousSize, _item->_previousModtime)) {
+        return false;
+    }
+
+    qCInfo(lcPropagateDownload) << "Trying to download only the changed parts of" << _item->_file;
+    _triedDeltaDownload = true;
+    _tmpFile.close();
+    propagator()->_activeJobList.append(this);
+    _deltaDownload = new PropagateDownloadDelta(propagator(), _item, &_tmpFile, this);
+    connect(_deltaDownload.data(), &PropagateDownloadDelta::finished, this, &PropagateDownloadFile::slotDeltaDownloadFinished);
+    connect(_deltaDownload.data(), &PropagateDownloadDelta::failed, this, &PropagateDownloadFile::slotDeltaDownloadFailed);
+    _deltaDownload->start();
+    return true;
+}
+
+void PropagateDownloadFile::slotDeltaDownloadFinished()
+{
+    propagator()->_activeJobList.removeOne(this);
+    _deltaDownload->deleteLater();
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
+    validateLocalContent();
+}
+
+void PropagateDownloadFile::slotDeltaDownloadFailed()
+{
+    propagator()->_activeJobList.removeOne(this);
+    _deltaDownload->deleteLater();
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
+    slotRestartDownload(QString());
+}
+
+void PropagateDownloadFile::validateLocalContent()
+{
+    // The local file may have changed while it was read
+    auto *validator = new ValidateChecksumHeader(this);
+    connect(validator, &ValidateChecksumHeader::validated,
+        this, &PropagateDownloadFile::transmissionChecksumValidated);
+    connect(validator, &ValidateChecksumHeader::validationFailed,
+        this, &PropagateDownloadFile::slotRestartDownload);
+    validator->start(_tmpFile.fileName(), _item->_checksumHeader);
+}
+
+void PropagateDownloadFile::slotRestartDownload(const QString &reason)
+{
+    qCInfo(lcPropagateDownload) << "Downloading" << _item->_file << "after all" << reason;
+    FileSystem::remove(_tmpFile.fileName());
+    startDownload();
+}
+
 qint64 PropagateDownloadFile::committedDiskSpace() const
 {
     if (_state == Running) {
@@ -578,10 +750,10 @@ void PropagateDownloadFile::slotGetFinished()
             propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
         }
 
-        if (!_item->_directDownloadUrl.isEmpty() && err != QNetworkReply::OperationCanceledError) {
+        if (!_item->directDownloadUrl().isEmpty() && err != QNetworkReply::OperationCanceledError) {
             // If this was with a direct download, retry without direct download
-            qCWarning(lcPropagateDownload) << "Direct download of" << _item->_directDownloadUrl << "failed. Retrying through owncloud.";
-            _item->_directDownloadUrl.clear();
+            qCWarning(lcPropagateDownload) << "Direct download of" << _item->directDownloadUrl() << "failed. Retrying through owncloud.";
+            _item->setDirectDownloadUrl(QString());
             start();
             return;
         }
@@ -636,10 +808,20 @@ void PropagateDownloadFile::slotGetFinished()
      * reported that if a server breaks behind a proxy, the GET is still a 200 but is
      * truncated, as described here: https://github.com/owncloud/mirall/issues/2528
      */
+    if (job->isCompressed()) {
+        // Content-Length is the compressed size; the gzip trailer tells whether all arrived
+        if (!job->isDecompressionComplete()) {
+            qCDebug(lcPropagateDownload) << "Compressed body was truncated" << _tmpFile.size();
+            propagator()->_anotherSyncNeeded = true;
+            done(SyncFileItem::SoftError, tr("The file could not be downloaded completely."));
+            return;
+        }
+    }
+
     const QByteArray sizeHeader("Content-Length");
-    quint64 bodySize = job->reply()->rawHeader(sizeHeader).toULongLong();
+    quint64 bodySize = job->isCompressed() ? 0 : job->reply()->rawHeader(sizeHeader).toULongLong();
 
-    if (!job->reply()->rawHeader(sizeHeader).isEmpty() && _tmpFile.size() > 0 && bodySize == 0) {
+    if (!job->isCompressed() && !job->reply()->rawHeader(sizeHeader).isEmpty() && _tmpFile.size() > 0 && bodySize == 0) {
         // Strange bug with broken webserver or webfirewall https://github.com/owncloud/client/issues/3373#issuecomment-122672322
         // This happened when trying to resume a file. The Content-Range header was files, Content-Length was == 0
         qCDebug(lcPropagateDownload) << bodySize << _item->_size << _tmpFile.size() << job->resumeStart();
@@ -945,7 +1127,7 @@ void PropagateDownloadFile::updateMetadata(bool isConflict)
     if (_isEncrypted) {
         propagator()->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
     } else {
-        propagator()->_journal->setDownloadInfo(_item->_encryptedFileName, SyncJournalDb::DownloadInfo());
+        propagator()->_journal->setDownloadInfo(_item->encryptedFileName(), SyncJournalDb::DownloadInfo());
     }
 
     propagator()->_journal->commit("download file start2");
@@ -977,6 +1159,8 @@ void PropagateDownloadFile::abort(PropagatorJob::AbortType abortType)
 {
     if (_job && _job->reply())
         _job->reply()->abort();
+    if (_deltaDownload)
+        _deltaDownload->abort();
 
     if (abortType == AbortType::Asynchronous) {
         emit abortFinished();
@@ -16,12 +16,17 @@
 #include "owncloudpropagator.h"
 #include "networkjobs.h"
 #include "clientsideencryption.h"
+#include "contentencoding.h"
 
 #include <QBuffer>
 #include <QFile>
+#include <QFutureWatcher>
+
+#include <memory>
 
 namespace OCC {
 class PropagateDownloadEncrypted;
+class PropagateDownloadDelta;
 
 /**
  * @brief The GETFileJob class
@@ -39,11 +44,12 @@ class GETFileJob : public AbstractNetworkJob
     QUrl _directDownloadUrl;
     QByteArray _etag;
     bool _bandwidthLimited; // if _bandwidthQuota will be used
-    bool _bandwidthChoked; // if download is paused (won't read on readyRead())
     qint64 _bandwidthQuota;
     QPointer<BandwidthManager> _bandwidthManager;
     bool _hasEmittedFinishedSignal;
     time_t _lastModified;
+    qint64 _rangeEnd = -1;
+    std::unique_ptr<GzipDecompressor> _decompressor;
 
     /// Will be set to true once we've seen a 2xx response header
     bool _saveBodyToFile = false;
@@ -83,10 +89,17 @@ public:
 
     void newReplyHook(QNetworkReply *reply) override;
 
+    /**
+     * Only download the bytes from resumeStart up to \a end (inclusive).
+     *
+     * Fails if the server does not reply with that range.
+     */
+    void setRangeEnd(quint64 end) { _rangeEnd = end; }
+
     void setBandwidthManager(BandwidthManager *bwm);
-    void setChoked(bool c);
     void setBandwidthLimited(bool b);
     void giveBandwidthQuota(qint64 q);
+    qint64 bandwidthQuota() const { return _bandwidthQuota; }
     qint64 currentDownloadPosition();
 
     QString errorString() const;
@@ -101,6 +114,12 @@ public:
     quint64 resumeStart() { return _resumeStart; }
     time_t lastModified() { return _lastModified; }
 
+    /** Whether the server sent the body with the gzip Content-Encoding */
+    bool isCompressed() const { return _decompressor != nullptr; }
+
+    /** For compressed bodies: whether the complete gzip stream arrived */
+    bool isDecompressionComplete() const { return _decompressor && _decompressor->isFinished(); }
+
 
 signals:
     void finishedSignal();
@@ -129,7 +148,11 @@ private slots:
     +-> startDownload() <--------------------------+
           |                                        |
           +-> run a GETFileJob                     | checksum identical?
-                                                   |
+          |                                        |
+          +-> or startDeltaDownload()              |
+          |   or startLocalCopy()                  |
+          |     done?-> validateLocalContent()     |
+          |                                        |
       done?-> slotGetFinished()                    |
                 |                                  |
                 +-> validate checksum header       |
@@ -184,6 +207,13 @@ private slots:
     void startDownload();
     /// Called when the GETFileJob finishes
     void slotGetFinished();
+    /// Called when the content was copied from a local file instead of downloaded
+    void slotLocalCopyFinished();
+    /// Called when the changed parts of the file were downloaded
+    void slotDeltaDownloadFinished();
+    void slotDeltaDownloadFailed();
+    /// Called when the content could not be taken from local files after all
+    void slotRestartDownload(const QString &reason);
     /// Called when the download's checksum header was validated
     void transmissionChecksumValidated(const QByteArray &checksumType, const QByteArray &checksum);
     /// Called when the download's checksum computation is done
@@ -199,6 +229,18 @@ private slots:
 private:
     void startAfterIsEncryptedIsChecked();
     void deleteExistingFolder();
+    /**
+     * Copies a local file with the same content into the temporary file,
+     * see SyncOptions::_localCopyForDownloads. Returns false if there is none.
+     */
+    bool startLocalCopy();
+    /**
+     * Only downloads the parts of the file that changed, see
+     * SyncOptions::_deltaDownloads. Returns false if that is not possible.
+     */
+    bool startDeltaDownload();
+    /// Validates content taken from local files against the remote checksum
+    void validateLocalContent();
 
     quint64 _resumeStart;
     qint64 _downloadProgress;
@@ -206,6 +248,10 @@ private:
     QFile _tmpFile;
     bool _deleteExisting;
     bool _isEncrypted = false;
+    bool _triedLocalCopy = false;
+    bool _triedDeltaDownload = false;
+    QFutureWatcher<bool> _localCopyWatcher;
+    QPointer<PropagateDownloadDelta> _deltaDownload;
     EncryptedFile _encryptedInfo;
     ConflictRecord _conflictRecord;
 
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "propagatedownloaddelta.h"
+#include "propagatedownload.h"
+#include "networkjobs.h"
+#include "account.h"
+#include "common/asserts.h"
+#include "common/checksums.h"
+
+#include <QCryptographicHash>
+#include <QLoggingCategory>
+#include <QtConcurrentRun>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcPropagateDownloadDelta, "nextcloud.sync.propagator.download.delta", QtInfoMsg)
+
+static const char blockChecksumsPropertyC[] = "block-checksums";
+
+// Block sizes outside of this range are rejected, tiny blocks make the list of
+// checksums huge and the local file is read in pieces of at most copyBufferSize.
+static const qint64 minBlockSize = 4 * 1024;
+static const qint64 maxBlockSize = 16 * 1024 * 1024;
+static const qint64 copyBufferSize = 1024 * 1024;
+
+/**
+ * Parses the nc:block-checksums property, see PropagateDownloadDelta.
+ *
+ * Only accepts collision safe checksum types, block sizes between
+ * minBlockSize and maxBlockSize and exactly one checksum per block of a
+ * file with \a size bytes.
+ */
+static bool parseBlockChecksums(const QByteArray &value, qint64 size,
+    QByteArray *checksumType, qint64 *blockSize, QVector<QByteArray> *checksums)
+{
+    const auto parts = value.simplified().split(' ');
+    if (parts.size() < 2)
+        return false;
+    *checksumType = parts[0].toUpper();
+    if (*checksumType != checkSumSHA1C && *checksumType != checkSumMD5C)
+        return false;
+    bool ok = false;
+    *blockSize = parts[1].toLongLong(&ok);
+    if (!ok || *blockSize < minBlockSize || *blockSize > maxBlockSize)
+        return false;
+    checksums->clear();
+    for (int i = 2; i < parts.size(); ++i)
+        checksums->append(parts[i].toLower());
+    return checksums->size() == (size + *blockSize - 1) / *blockSize;
+}
+
+PropagateDownloadDelta::PropagateDownloadDelta(OwncloudPropagator *propagator, const SyncFileItemPtr &item,
+    QFile *tmpFile, QObject *parent)
+    : QObject(parent)
+    , _propagator(propagator)
+    , _item(item)
+    , _tmpFile(tmpFile)
+{
+}
+
+void PropagateDownloadDelta::start()
+{
+    auto job = new PropfindJob(_propagator->account(), _propagator->_remoteFolder + _item->_file, this);
+    job->setProperties(QList<QByteArray>() << QByteArray("http://nextcloud.org/ns:") + blockChecksumsPropertyC);
+    connect(job, &PropfindJob::result, this, &PropagateDownloadDelta::slotBlockChecksumsReceived);
+    connect(job, &PropfindJob::finishedWithError, this, &PropagateDownloadDelta::failed);
+    _job = job;
+    job->start();
+}
+
+void PropagateDownloadDelta::abort()
+{
+    _aborting = true;
+    // The block copy can't be interrupted, but its result must not start any request
+    disconnect(&_watcher, nullptr, this, nullptr);
+    _canceled->storeRelease(1);
+    if (_job && _job->reply())
+        _job->reply()->abort();
+}
+
+void PropagateDownloadDelta::slotBlockChecksumsReceived(const QVariantMap &values)
+{
+    QByteArray checksumType;
+    qint64 blockSize = 0;
+    QVector<QByteArray> checksums;
+    if (!parseBlockChecksums(values.value(blockChecksumsPropertyC).toByteArray(), _item->_size,
+            &checksumType, &blockSize, &checksums)) {
+        qCInfo(lcPropagateDownloadDelta) << "No usable block checksums for" << _item->_file;
+        emit failed();
+        return;
+    }
+
+    const QString localPath = _propagator->getFilePath(_item->_file);
+    const QString tmpPath = _tmpFile->fileName();
+    const qint64 size = _item->_size;
+    const auto canceled = _canceled;
+    connect(&_watcher, &QFutureWatcherBase::finished, this, &PropagateDownloadDelta::slotLocalBlocksCopied);
+    _watcher.setFuture(QtConcurrent::run([=]() {
+        return copyMatchingBlocks(localPath, tmpPath, checksumType, blockSize, checksums, size, canceled.data());
+    }));
+}
+
+void PropagateDownloadDelta::slotLocalBlocksCopied()
+{
+    if (_aborting)
+        return;
+    const LocalBlocks result = _watcher.future().result();
+    if (!result.ok || result.reusedBytes == 0) {
+        // Nothing to gain over a normal download
+        emit failed();
+        return;
+    }
+    qCInfo(lcPropagateDownloadDelta) << "Reusing" << result.reusedBytes << "of" << _item->_size
+                                     << "bytes of" << _item->_file << "," << result.missing.size() << "ranges to download";
+
+    if (!_tmpFile->open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        qCWarning(lcPropagateDownloadDelta) << "Could not open" << _tmpFile->fileName() << _tmpFile->errorString();
+        emit failed();
+        return;
+    }
+    _missing = result.missing;
+    _doneBytes = result.reusedBytes;
+    _propagator->reportProgress(*_item, _doneBytes);
+    startNextRange();
+}
+
+void PropagateDownloadDelta::startNextRange()
+{
+    if (_missing.isEmpty()) {
+        _tmpFile->close();
+        emit finished();
+        return;
+    }
+
+    const auto range = _missing.takeFirst();
+    if (!_tmpFile->seek(range.first)) {
+        _tmpFile->close();
+        emit failed();
+        return;
+    }
+    // The etag check makes sure that all ranges come from the same version
+    auto job = new GETFileJob(_propagator->account(), _propagator->_remoteFolder + _item->_file,
+        _tmpFile, QMap<QByteArray, QByteArray>(), _item->_etag, range.first, this);
+    job->setRangeEnd(range.second - 1);
+    job->setBandwidthManager(&_propagator->_bandwidthManager);
+    connect(job, &GETFileJob::finishedSignal, this, &PropagateDownloadDelta::slotGetFinished);
+    connect(job, &GETFileJob::downloadProgress, this, [this](qint64 received) {
+        _propagator->reportProgress(*_item, _doneBytes + received);
+    });
+    _currentRangeSize = range.second - range.first;
+    _job = job;
+    job->start();
+}
+
+void PropagateDownloadDelta::slotGetFinished()
+{
+    auto job = qobject_cast<GETFileJob *>(_job.data());
+    ASSERT(job);
+    if (job->reply()->error() != QNetworkReply::NoError || job->errorStatus() != SyncFileItem::NoStatus) {
+        qCInfo(lcPropagateDownloadDelta) << "Range request for" << _item->_file << "failed" << job->errorString();
+        _tmpFile->close();
+        emit failed();
+        return;
+    }
+    _doneBytes += _currentRangeSize;
+    _propagator->reportProgress(*_item, _doneBytes);
+    startNextRange();
+}
+
+/* Whether the \a length bytes at \a offset of \a file have \a checksum, reads them in pieces */
+static bool blockMatches(QFile *file, qint64 offset, qint64 length,
+    QCryptographicHash::Algorithm algorithm, const QByteArray &checksum)
+{
+    if (!file->seek(offset))
+        return false;
+    QCryptographicHash hash(algorithm);
+    for (qint64 done = 0; done < length;) {
+        const QByteArray piece = file->read(qMin(copyBufferSize, length - done));
+        if (piece.isEmpty())
+            return false;
+        hash.addData(piece);
+        done += piece.size();
+    }
+    return hash.result().toHex() == checksum;
+}
+
+static bool copyRange(QFile *from, QFile *to, qint64 offset, qint64 length)
+{
+    if (!from->seek(offset) || !to->seek(offset))
+        return false;
+    for (qint64 done = 0; done < length;) {
+        const QByteArray piece = from->read(qMin(copyBufferSize, length - done));
+        if (piece.isEmpty() || to->write(piece) != piece.size())
+            return false;
+        done += piece.size();
+    }
+    return true;
+}
+
+PropagateDownloadDelta::LocalBlocks PropagateDownloadDelta::copyMatchingBlocks(const QString &localPath,
+    const QString &tmpPath, const QByteArray &checksumType, qint64 blockSize,
+    const QVector<QByteArray> &blockChecksums, qint64 size, const QAtomicInt *canceled)
+{
+    LocalBlocks result;
+    QFile local(localPath);
+    QFile tmp(tmpPath);
+    if (!local.open(QIODevice::ReadOnly) || !tmp.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(lcPropagateDownloadDelta) << "Could not open" << localPath << "or" << tmpPath;
+        return result;
+    }
+
+    const auto algorithm = checksumType == checkSumMD5C ? QCryptographicHash::Md5 : QCryptographicHash::Sha1;
+    for (int i = 0; i < blockChecksums.size(); ++i) {
+        if (canceled && canceled->loadAcquire())
+            return LocalBlocks();
+        const qint64 offset = i * blockSize;
+        const qint64 length = qMin(blockSize, size - offset);
+        if (blockMatches(&local, offset, length, algorithm, blockChecksums[i])) {
+            if (!copyRange(&local, &tmp, offset, length)) {
+                qCWarning(lcPropagateDownloadDelta) << "Could not copy to" << tmpPath << tmp.errorString();
+                return LocalBlocks();
+            }
+            result.reusedBytes += length;
+        } else if (!result.missing.isEmpty() && result.missing.last().second == offset) {
+            result.missing.last().second = offset + length;
+        } else {
+            result.missing.append(qMakePair(offset, offset + length));
+        }
+    }
+    if (!tmp.resize(size)) {
+        qCWarning(lcPropagateDownloadDelta) << "Could not resize" << tmpPath << tmp.errorString();
+        return LocalBlocks();
+    }
+    result.ok = true;
+    return result;
+}
+}
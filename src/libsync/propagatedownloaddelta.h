@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include "owncloudpropagator.h"
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QPair>
+#include <QSharedPointer>
+#include <QVector>
+
+namespace OCC {
+
+class GETFileJob;
+
+/**
+ * @brief Downloads only the parts of a file that differ from the local file
+ *
+ * Used by PropagateDownloadFile for large files that changed on the server
+ * while the local file is unchanged, see SyncOptions::_deltaDownloads.
+ *
+ * The server has to provide the checksums of fixed size blocks of the file
+ * in the nc:block-checksums property: the checksum type, the block size and
+ * the checksum of every block, separated by spaces. For example
+ * "SHA1 1048576 a4f3...e1 93be...07".
+ *
+ * Blocks with the same checksum as the local file are copied from it into
+ * the temporary file, the others are downloaded with range requests. The
+ * owner still has to validate the checksum of the whole file. The progress
+ * of the item counts the reused bytes as done.
+ *
+ * emits:
+ * finished() if the temporary file has the complete content
+ * failed() if the file needs to be downloaded normally
+ *
+ * @ingroup libsync
+ */
+class PropagateDownloadDelta : public QObject
+{
+    Q_OBJECT
+public:
+    /// Byte ranges, the end is exclusive
+    using Ranges = QVector<QPair<qint64, qint64>>;
+
+    struct LocalBlocks
+    {
+        bool ok = false;
+        qint64 reusedBytes = 0;
+        Ranges missing;
+    };
+
+    PropagateDownloadDelta(OwncloudPropagator *propagator, const SyncFileItemPtr &item,
+        QFile *tmpFile, QObject *parent = nullptr);
+
+    void start();
+    void abort();
+
+    /**
+     * Copies the blocks of \a localPath that match \a blockChecksums into
+     * \a tmpPath at the same offset. The temporary file gets \a size bytes.
+     *
+     * Returns the byte ranges that still need to be downloaded. Stops with
+     * an invalid result as soon as \a canceled is set.
+     */
+    static LocalBlocks copyMatchingBlocks(const QString &localPath, const QString &tmpPath,
+        const QByteArray &checksumType, qint64 blockSize, const QVector<QByteArray> &blockChecksums,
+        qint64 size, const QAtomicInt *canceled = nullptr);
+
+signals:
+    void finished();
+    void failed();
+
+private slots:
+    void slotBlockChecksumsReceived(const QVariantMap &values);
+    void slotLocalBlocksCopied();
+    void slotGetFinished();
+
+private:
+    void startNextRange();
+
+    OwncloudPropagator *_propagator;
+    SyncFileItemPtr _item;
+    QFile *_tmpFile;
+    Ranges _missing;
+    qint64 _doneBytes = 0; /// reused bytes and bytes of the finished range requests
+    qint64 _currentRangeSize = 0;
+    QFutureWatcher<LocalBlocks> _watcher;
+    QPointer<AbstractNetworkJob> _job;
+    bool _aborting = false;
+    QSharedPointer<QAtomicInt> _canceled{ new QAtomicInt(0) }; /// shared with the block copy, which may outlive this
+};
+}
@@ -1,5 +1,9 @@
 #include "propagatedownloadencrypted.h"
 #include "clientsideencryptionjobs.h"
+#include "filesystem.h"
+#include "account.h"
+
+#include <QDir>
 
 Q_LOGGING_CATEGORY(lcPropagateDownloadEncrypted, "nextcloud.sync.propagator.download.encrypted", QtInfoMsg)
 
@@ -63,6 +67,7 @@ void PropagateDownloadEncrypted::checkFolderId(const QStringList &list)
   qCDebug(lcPropagateDownloadEncrypted) << "Received id of folder" << folderId;
 
   const ExtraFolderInfo &folderInfo = job->_folderInfos.value(folderId);
+  _folderId = folderInfo.fileId;
 
   // Now that we have the folder-id we need it's JSON metadata
   auto metadataJob = new GetMetadataApiJob(_propagator->account(), folderInfo.fileId);
@@ -75,14 +80,16 @@ void PropagateDownloadEncrypted::checkFolderId(const QStringList &list)
 void PropagateDownloadEncrypted::checkFolderEncryptedMetadata(const QJsonDocument &json)
 {
   qCDebug(lcPropagateDownloadEncrypted) << "Metadata Received reading" <<
-                                           csync_instruction_str(_item->_instruction) << _item->_file << _item->_encryptedFileName;
+                                           csync_instruction_str(_item->_instruction) << _item->_file << _item->encryptedFileName();
   const QString filename = _info.fileName();
-  auto meta = new FolderMetadata(_propagator->account(), json.toJson(QJsonDocument::Compact));
-  const QVector<EncryptedFile> files = meta->files();
+  // Downloading many files of one folder gets the same metadata for each
+  const FolderMetadata meta = _propagator->account()->e2e()->metadataCache()->metadata(
+      _propagator->account(), _folderId, json);
+  const QVector<EncryptedFile> files = meta.files();
 
   const QString encryptedFilename = _item->_instruction == CSYNC_INSTRUCTION_NEW ?
               _item->_file.section(QLatin1Char('/'), -1) :
-              _item->_encryptedFileName.section(QLatin1Char('/'), -1);
+              _item->encryptedFileName().section(QLatin1Char('/'), -1);
   for (const EncryptedFile &file : files) {
     if (encryptedFilename == file.encryptedFilename) {
       _encryptedInfo = file;
@@ -96,39 +103,32 @@ void PropagateDownloadEncrypted::checkFolderEncryptedMetadata(const QJsonDocumen
   qCCritical(lcPropagateDownloadEncrypted) << "Failed to find encrypted metadata information of remote file" << filename;
 }
 
-// TODO: Fix this. Exported in the wrong place.
-QString createDownloadTmpFileName(const QString &previous);
-
 bool PropagateDownloadEncrypted::decryptFile(QFile& tmpFile)
 {
-    const QString tmpFileName = createDownloadTmpFileName(_item->_file + QLatin1String("_dec"));
-    qCDebug(lcPropagateDownloadEncrypted) << "Content Checksum Computed starting decryption" << tmpFileName;
-
-    tmpFile.close();
-    QFile _tmpOutput(_propagator->getFilePath(tmpFileName), this);
-    EncryptionHelper::fileDecryption(_encryptedInfo.encryptionKey,
-                                     _encryptedInfo.initializationVector,
-                                     &tmpFile,
-                                     &_tmpOutput);
-
-    qCDebug(lcPropagateDownloadEncrypted) << "Decryption finished" << tmpFile.fileName() << _tmpOutput.fileName();
+    qCDebug(lcPropagateDownloadEncrypted) << "Content Checksum Computed starting decryption" << tmpFile.fileName();
 
     tmpFile.close();
-    _tmpOutput.close();
 
-    // we decripted the temporary into another temporary, so good bye old one
-    if (!tmpFile.remove()) {
-        qCDebug(lcPropagateDownloadEncrypted) << "Failed to remove temporary file" << tmpFile.errorString();
-        _errorString = tmpFile.errorString();
+    // Decrypting in place avoids writing a second full temporary copy of the file.
+    if (!EncryptionHelper::fileDecryptionInPlace(_encryptedInfo.encryptionKey,
+                                                 _encryptedInfo.initializationVector,
+                                                 &tmpFile)) {
+        qCDebug(lcPropagateDownloadEncrypted) << "Failed to decrypt" << tmpFile.fileName();
+        _errorString = tr("File %1 could not be decrypted.").arg(QDir::toNativeSeparators(_item->_file));
+        tmpFile.close();
+        FileSystem::remove(tmpFile.fileName());
+        _propagator->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
         return false;
     }
 
-    // Let's fool the rest of the logic into thinking this was the actual download
-    tmpFile.setFileName(_tmpOutput.fileName());
+    qCDebug(lcPropagateDownloadEncrypted) << "Decryption finished" << tmpFile.fileName();
+
+    // The temporary file is no longer a resumable partial download of the encrypted file
+    _propagator->_journal->setDownloadInfo(_item->_file, SyncJournalDb::DownloadInfo());
 
     //TODO: This seems what's breaking the logic.
     // Let's fool the rest of the logic into thinking this is the right name of the DAV file
-    _item->_encryptedFileName = _item->_file;
+    _item->setEncryptedFileName(_item->_file);
     _item->_file = _item->_file.section(QLatin1Char('/'), 0, -2)
             + QLatin1Char('/') + _encryptedInfo.originalFilename;
 
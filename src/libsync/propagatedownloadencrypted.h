@@ -41,6 +41,7 @@ private:
   QFileInfo _info;
   EncryptedFile _encryptedInfo;
   QString _errorString;
+  QByteArray _folderId;
 };
 
 }
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "propagateremotecopy.h"
+#include "account.h"
+#include "common/checksums.h"
+#include "common/syncjournaldb.h"
+#include "common/utility.h"
+
+#include <QDir>
+#include <QLoggingCategory>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcCopyJob, "nextcloud.sync.networkjob.copy", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcPropagateRemoteCopy, "nextcloud.sync.propagator.remotecopy", QtInfoMsg)
+
+CopyJob::CopyJob(AccountPtr account, const QString &path, const QString &destination,
+    const QByteArray &sourceEtag, QObject *parent)
+    : AbstractNetworkJob(account, path, parent)
+    , _destination(destination)
+    , _sourceEtag(sourceEtag)
+{
+}
+
+void CopyJob::start()
+{
+    QNetworkRequest req;
+    req.setRawHeader("Destination", QUrl::toPercentEncoding(_destination, "/"));
+    req.setRawHeader("Overwrite", "F");
+    // We add quotes because the server always adds quotes around the etag
+    req.setRawHeader("If-Match", '"' + _sourceEtag + '"');
+    sendRequest("COPY", makeDavUrl(path()), req);
+
+    if (reply()->error() != QNetworkReply::NoError) {
+        qCWarning(lcCopyJob) << " Network error: " << reply()->errorString();
+    }
+    AbstractNetworkJob::start();
+}
+
+bool CopyJob::finished()
+{
+    qCInfo(lcCopyJob) << "COPY of" << reply()->request().url() << "FINISHED WITH STATUS"
+                      << replyStatusString();
+
+    emit finishedSignal();
+    return true;
+}
+
+PropagateRemoteCopy::PropagateRemoteCopy(OwncloudPropagator *propagator, const SyncFileItemPtr &item, QObject *parent)
+    : QObject(parent)
+    , _propagator(propagator)
+    , _item(item)
+{
+}
+
+SyncJournalFileRecord PropagateRemoteCopy::findSource(OwncloudPropagator *propagator, const SyncFileItem &item, quint64 size)
+{
+    SyncJournalFileRecord source;
+    // The content is never compared, a weak checksum could match a different file
+    if (!csync_is_collision_safe_hash(item._checksumHeader)) {
+        return source;
+    }
+
+    const QByteArray path = item._file.toUtf8();
+    propagator->_journal->getFileRecordsByChecksum(item._checksumHeader, size, [&](const SyncJournalFileRecord &rec) {
+        // Encrypted files have a different content on the server
+        if (source.isValid() || rec._type != ItemTypeFile || rec._path == path
+            || rec._etag.isEmpty() || !rec._e2eMangledName.isEmpty()) {
+            return;
+        }
+        source = rec;
+    });
+    return source;
+}
+
+void PropagateRemoteCopy::start(const SyncJournalFileRecord &source, quint64 size)
+{
+    _source = QString::fromUtf8(source._path);
+    _size = size;
+    qCInfo(lcPropagateRemoteCopy) << "Copying" << _source << "to" << _item->_file << "on the server";
+
+    const auto account = _propagator->account();
+    QString destination = QDir::cleanPath(account->url().path() + QLatin1Char('/')
+        + account->davPath() + _propagator->_remoteFolder + _item->_file);
+    auto job = new CopyJob(account, _propagator->_remoteFolder + _source, destination, source._etag, this);
+    connect(job, &CopyJob::finishedSignal, this, &PropagateRemoteCopy::slotCopyFinished);
+    _copyJob = job;
+    emit networkJobStarted(job);
+    job->start();
+}
+
+void PropagateRemoteCopy::slotCopyFinished()
+{
+    auto reply = _copyJob->reply();
+    const int httpCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error() != QNetworkReply::NoError || httpCode != 201) {
+        // The source is gone or changed, or the destination exists already
+        qCInfo(lcPropagateRemoteCopy) << "Could not copy" << _source << httpCode << reply->errorString();
+        emit failed();
+        return;
+    }
+
+    // Make sure the server really has the expected content
+    auto job = new LsColJob(_propagator->account(), _propagator->_remoteFolder + _item->_file, this);
+    job->setDepth("0");
+    job->setProperties(QList<QByteArray>() << "getetag"
+                                           << "getcontentlength"
+                                           << "http://owncloud.org/ns:id"
+                                           << "http://owncloud.org/ns:checksums");
+    connect(job, &LsColJob::directoryListingIterated, this, &PropagateRemoteCopy::slotPropertiesReceived);
+    connect(job, &LsColJob::finishedWithoutError, this, &PropagateRemoteCopy::slotVerifyFinished);
+    connect(job, &LsColJob::finishedWithError, this, &PropagateRemoteCopy::slotVerifyFailed);
+    emit networkJobStarted(job);
+    job->start();
+}
+
+void PropagateRemoteCopy::slotPropertiesReceived(const QString &, const QMap<QString, QString> &properties)
+{
+    _properties = properties;
+}
+
+void PropagateRemoteCopy::slotVerifyFinished()
+{
+    const QByteArray etag = Utility::normalizeEtag(_properties.value("getetag").toUtf8());
+    const QByteArray fileId = _properties.value("id").toUtf8();
+    bool sizeOk = false;
+    const qint64 size = _properties.value("getcontentlength").toLongLong(&sizeOk);
+    if (etag.isEmpty() || fileId.isEmpty() || !sizeOk || quint64(size) != _size) {
+        qCWarning(lcPropagateRemoteCopy) << "Copy of" << _source << "to" << _item->_file << "has unexpected properties"
+                                         << etag << fileId << size << _size;
+        emit failed();
+        return;
+    }
+
+    // Only comparable if the server knows a checksum of the same type
+    const QByteArray serverChecksum = findBestChecksum(_properties.value("checksums").toUtf8());
+    if (!serverChecksum.isEmpty()
+        && parseChecksumHeaderType(serverChecksum) == parseChecksumHeaderType(_item->_checksumHeader)
+        && serverChecksum != _item->_checksumHeader) {
+        qCWarning(lcPropagateRemoteCopy) << "Copy of" << _source << "to" << _item->_file << "has checksum"
+                                         << serverChecksum << "expected" << _item->_checksumHeader;
+        emit failed();
+        return;
+    }
+
+    _item->_etag = etag;
+    _item->_fileId = fileId;
+    emit copied();
+}
+
+void PropagateRemoteCopy::slotVerifyFailed(QNetworkReply *reply)
+{
+    qCWarning(lcPropagateRemoteCopy) << "Could not check the copy" << _item->_file << reply->errorString();
+    emit failed();
+}
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+#pragma once
+
+#include "owncloudpropagator.h"
+#include "networkjobs.h"
+#include "common/syncjournalfilerecord.h"
+
+namespace OCC {
+
+/**
+ * @brief The CopyJob class
+ *
+ * Copies a file on the server. Never replaces an existing destination, and
+ * fails with 412 if the etag of the source is not \a sourceEtag.
+ *
+ * @ingroup libsync
+ */
+class CopyJob : public AbstractNetworkJob
+{
+    Q_OBJECT
+    const QString _destination;
+    const QByteArray _sourceEtag;
+
+public:
+    explicit CopyJob(AccountPtr account, const QString &path, const QString &destination,
+        const QByteArray &sourceEtag, QObject *parent = nullptr);
+
+    void start() override;
+    bool finished() override;
+
+signals:
+    void finishedSignal();
+};
+
+/**
+ * @brief Creates a new file on the server by copying a known one
+ *
+ * Used by PropagateUploadFileCommon for new local files whose content is
+ * already on the server: the source is a journal record with the same
+ * content checksum and size. After the COPY the destination is checked
+ * with a PROPFIND; its size, and its checksum if the server reports one,
+ * must match the local file.
+ *
+ * On success the etag and file id of the item are updated.
+ *
+ * emits:
+ * networkJobStarted() for each request
+ * copied() if the file is on the server now
+ * failed() if it needs to be uploaded after all
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT PropagateRemoteCopy : public QObject
+{
+    Q_OBJECT
+public:
+    PropagateRemoteCopy(OwncloudPropagator *propagator, const SyncFileItemPtr &item, QObject *parent = nullptr);
+
+    /**
+     * Finds a record the item can be copied from. Returns an invalid record
+     * if there is none or the checksum of the item is not collision safe.
+     */
+    static SyncJournalFileRecord findSource(OwncloudPropagator *propagator, const SyncFileItem &item, quint64 size);
+
+    void start(const SyncJournalFileRecord &source, quint64 size);
+
+signals:
+    /// For the owner to be able to abort the request
+    void networkJobStarted(AbstractNetworkJob *job);
+    void copied();
+    void failed();
+
+private slots:
+    void slotCopyFinished();
+    void slotPropertiesReceived(const QString &href, const QMap<QString, QString> &properties);
+    void slotVerifyFinished();
+    void slotVerifyFailed(QNetworkReply *reply);
+
+private:
+    OwncloudPropagator *_propagator;
+    SyncFileItemPtr _item;
+    QString _source;
+    quint64 _size = 0;
+    QMap<QString, QString> _properties;
+    QPointer<CopyJob> _copyJob;
+};
+}
@@ -65,11 +65,11 @@ void PropagateRemoteDelete::start()
     if (propagator()->_abortRequested.fetchAndAddRelaxed(0))
         return;
 
-    if (!_item->_encryptedFileName.isEmpty()) {
+    if (!_item->encryptedFileName().isEmpty()) {
         auto job = new PropagateRemoteDeleteEncrypted(propagator(), _item, this);
         connect(job, &PropagateRemoteDeleteEncrypted::finished, this, [this] (bool success) {
             Q_UNUSED(success) // Should we skip file deletion in case of failure?
-            createDeleteJob(_item->_encryptedFileName);
+            createDeleteJob(_item->encryptedFileName());
         });
         job->start();
     } else {
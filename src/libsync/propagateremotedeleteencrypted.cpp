@@ -1,6 +1,7 @@
 #include "propagateremotedeleteencrypted.h"
 #include "clientsideencryptionjobs.h"
 #include "clientsideencryption.h"
+#include "encryptedfoldersession.h"
 #include "owncloudpropagator.h"
 
 #include <QLoggingCategory>
@@ -20,6 +21,11 @@ PropagateRemoteDeleteEncrypted::PropagateRemoteDeleteEncrypted(OwncloudPropagato
 
 }
 
+PropagateRemoteDeleteEncrypted::~PropagateRemoteDeleteEncrypted()
+{
+    releaseFolder();
+}
+
 void PropagateRemoteDeleteEncrypted::start()
 {
     QFileInfo info(_item->_file);
@@ -36,52 +42,29 @@ void PropagateRemoteDeleteEncrypted::slotFolderEncryptedIdReceived(const QString
     qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Received id of folder, trying to lock it so we can prepare the metadata";
     auto job = qobject_cast<LsColJob *>(sender());
     const ExtraFolderInfo folderInfo = job->_folderInfos.value(list.first());
-    slotTryLock(folderInfo.fileId);
-}
-
-void PropagateRemoteDeleteEncrypted::slotTryLock(const QByteArray &folderId)
-{
-    auto lockJob = new LockEncryptFolderApiJob(_propagator->account(), folderId, this);
-    connect(lockJob, &LockEncryptFolderApiJob::success, this, &PropagateRemoteDeleteEncrypted::slotFolderLockedSuccessfully);
-    connect(lockJob, &LockEncryptFolderApiJob::error, this, &PropagateRemoteDeleteEncrypted::taskFailed);
-    lockJob->start();
-}
+    _folderId = folderInfo.fileId;
 
-void PropagateRemoteDeleteEncrypted::slotFolderLockedSuccessfully(const QByteArray &folderId, const QByteArray &token)
-{
-    qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Folder id" << folderId << "Locked Successfully for Upload, Fetching Metadata";
+    // The lock and the metadata are shared with the other jobs changing this folder
+    _folderSession = _propagator->encryptedFolderSession(_folderId);
     _folderLocked = true;
-    _folderToken = token;
-    _folderId = folderId;
-
-    auto job = new GetMetadataApiJob(_propagator->account(), _folderId);
-    connect(job, &GetMetadataApiJob::jsonReceived, this, &PropagateRemoteDeleteEncrypted::slotFolderEncryptedMetadataReceived);
-    connect(job, &GetMetadataApiJob::error, this, &PropagateRemoteDeleteEncrypted::taskFailed);
-    job->start();
+    _folderSession->acquire(this,
+        [this](FolderMetadata *metadata) { slotFolderEncryptedMetadataReceived(metadata); },
+        [this] { taskFailed(); });
 }
 
-void PropagateRemoteDeleteEncrypted::slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode)
+void PropagateRemoteDeleteEncrypted::slotFolderEncryptedMetadataReceived(FolderMetadata *metadata)
 {
-    if (statusCode == 404) {
-        qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Metadata not found, ignoring.";
-        unlockFolder();
-        return;
-    }
-
     qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Metadata Received, Preparing it for the new file.";
 
-    // Encrypt File!
-    FolderMetadata metadata(_propagator->account(), json.toJson(QJsonDocument::Compact), statusCode);
-
     QFileInfo info(_propagator->_localDir + QDir::separator() + _item->_file);
     const QString fileName = info.fileName();
 
     // Find existing metadata for this file
     bool found = false;
-    const QVector<EncryptedFile> files = metadata.files();
+    const QVector<EncryptedFile> files = metadata->files();
     for (const EncryptedFile &file : files) {
         if (file.encryptedFilename == fileName) {
-            metadata.removeEncryptedFile(file);
+            metadata->removeEncryptedFile(file);
             found = true;
             break;
         }
@@ -90,41 +73,38 @@ void PropagateRemoteDeleteEncrypted::slotFolderEncryptedMetadataReceived(const Q
     if (!found) {
         // The removed file was not in the JSON so nothing else to do
         unlockFolder();
+        return;
     }
 
     qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Metadata updated, sending to the server.";
+    _folderSession->storeMetadata(this, [this](bool success) {
+        if (success) {
+            unlockFolder();
+        } else {
+            taskFailed();
+        }
+    });
+}
 
-    auto job = new UpdateMetadataApiJob(_propagator->account(),
-                                        _folderId,
-                                        metadata.encryptedMetadata(),
-                                        _folderToken);
-
-    connect(job, &UpdateMetadataApiJob::success, this, &PropagateRemoteDeleteEncrypted::unlockFolder);
-    connect(job, &UpdateMetadataApiJob::error, this, &PropagateRemoteDeleteEncrypted::taskFailed);
-    job->start();
+void PropagateRemoteDeleteEncrypted::releaseFolder()
+{
+    if (!_folderLocked)
+        return;
+    _folderLocked = false;
+    if (_folderSession)
+        _folderSession->release();
 }
 
 void PropagateRemoteDeleteEncrypted::unlockFolder()
 {
-    qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Unlocking folder" << _folderId;
-    auto unlockJob = new UnlockEncryptFolderApiJob(_propagator->account(),
-                                                   _folderId, _folderToken, this);
-
-    connect(unlockJob, &UnlockEncryptFolderApiJob::success, [this] {
-        qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Folder successfully unlocked" << _folderId;
-        _folderLocked = false;
-        emit finished(true);
-    });
-    connect(unlockJob, &UnlockEncryptFolderApiJob::error, this, &PropagateRemoteDeleteEncrypted::taskFailed);
-    unlockJob->start();
+    qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Releasing folder" << _folderId;
+    releaseFolder();
+    emit finished(true);
 }
 
 void PropagateRemoteDeleteEncrypted::taskFailed()
 {
     qCDebug(PROPAGATE_REMOVE_ENCRYPTED) << "Task failed of job" << sender();
-    if (_folderLocked) {
-        unlockFolder();
-    } else {
-        emit finished(false);
-    }
+    releaseFolder();
+    emit finished(false);
 }
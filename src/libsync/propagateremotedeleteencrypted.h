@@ -3,17 +3,21 @@
 
 #include <QObject>
 #include <QElapsedTimer>
+#include <QPointer>
 
 #include "syncfileitem.h"
 
 namespace OCC {
 
 class OwncloudPropagator;
+class EncryptedFolderSession;
+class FolderMetadata;
 class PropagateRemoteDeleteEncrypted : public QObject
 {
     Q_OBJECT
 public:
     PropagateRemoteDeleteEncrypted(OwncloudPropagator *_propagator, SyncFileItemPtr item, QObject *parent);
+    ~PropagateRemoteDeleteEncrypted();
 
     void start();
 
@@ -22,16 +26,15 @@ signals:
 
 private:
     void slotFolderEncryptedIdReceived(const QStringList &list);
-    void slotTryLock(const QByteArray &folderId);
-    void slotFolderLockedSuccessfully(const QByteArray &fileId, const QByteArray &token);
-    void slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode);
+    void slotFolderEncryptedMetadataReceived(FolderMetadata *metadata);
+    void releaseFolder();
     void unlockFolder();
     void taskFailed();
 
     OwncloudPropagator *_propagator;
     SyncFileItemPtr _item;
-    QByteArray _folderToken;
     QByteArray _folderId;
+    QPointer<EncryptedFolderSession> _folderSession;
     bool _folderLocked = false;
 };
 
@@ -15,6 +15,8 @@
 #include "config.h"
 #include "propagateupload.h"
 #include "propagateuploadencrypted.h"
+#include "propagateremotecopy.h"
+#include "contentencoding.h"
 #include "owncloudpropagator_p.h"
 #include "networkjobs.h"
 #include "account.h"
@@ -24,6 +26,7 @@
 #include "filesystem.h"
 #include "propagatorjobs.h"
 #include "common/checksums.h"
+#include "common/iouring.h"
 #include "syncengine.h"
 #include "propagateremotedelete.h"
 #include "common/asserts.h"
@@ -37,6 +40,8 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QFileInfo>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
 
 #include <cmath>
 #include <cstring>
@@ -172,13 +177,15 @@ void PropagateUploadFileCommon::setDeleteExisting(bool enabled)
 void PropagateUploadFileCommon::start()
 {
     if (propagator()->account()->capabilities().clientSideEncryptionAvaliable()) {
-      _uploadEncryptedHelper = new PropagateUploadEncrypted(propagator(), _item);
+      _uploadEncryptedHelper = new PropagateUploadEncrypted(propagator(), _item, this);
       connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::folerNotEncrypted,
         this, &PropagateUploadFileCommon::setupUnencryptedFile);
       connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::finalized,
         this, &PropagateUploadFileCommon::setupEncryptedFile);
-      connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::error,
-        []{ qCDebug(lcPropagateUpload) << "Error setting up encryption."; });
+      connect(_uploadEncryptedHelper, &PropagateUploadEncrypted::error, this, [this] {
+          qCDebug(lcPropagateUpload) << "Error setting up encryption.";
+          done(SyncFileItem::NormalError, tr("Error setting up the encryption of the file"));
+      });
       _uploadEncryptedHelper->start();
    } else {
       setupUnencryptedFile();
@@ -364,6 +371,56 @@ void PropagateUploadFileCommon::slotStartUpload(const QByteArray &transmissionCh
         return;
     }
 
+    if (startRemoteCopy()) {
+        return;
+    }
+
+    doStartUpload();
+}
+
+bool PropagateUploadFileCommon::startRemoteCopy()
+{
+    // Replacing files keeps going through the upload, for the If-Match check
+    if (!propagator()->syncOptions()._serverSideCopy
+        || _item->_instruction != CSYNC_INSTRUCTION_NEW
+        || _deleteExisting || _uploadingEncrypted) {
+        return false;
+    }
+
+    const auto source = PropagateRemoteCopy::findSource(propagator(), *_item, _fileToUpload._size);
+    if (!source.isValid()) {
+        return false;
+    }
+
+    propagator()->_activeJobList.append(this);
+    auto remoteCopy = new PropagateRemoteCopy(propagator(), _item, this);
+    connect(remoteCopy, &PropagateRemoteCopy::networkJobStarted, this, [this](AbstractNetworkJob *job) {
+        _jobs.append(job);
+        connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
+    });
+    connect(remoteCopy, &PropagateRemoteCopy::copied, this, &PropagateUploadFileCommon::slotRemoteCopyFinished);
+    connect(remoteCopy, &PropagateRemoteCopy::failed, this, &PropagateUploadFileCommon::slotRemoteCopyFailed);
+    connect(remoteCopy, &PropagateRemoteCopy::copied, remoteCopy, &QObject::deleteLater);
+    connect(remoteCopy, &PropagateRemoteCopy::failed, remoteCopy, &QObject::deleteLater);
+    remoteCopy->start(source, _fileToUpload._size);
+    return true;
+}
+
+void PropagateUploadFileCommon::slotRemoteCopyFinished()
+{
+    propagator()->_activeJobList.removeOne(this);
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
+    finalize();
+}
+
+void PropagateUploadFileCommon::slotRemoteCopyFailed()
+{
+    propagator()->_activeJobList.removeOne(this);
+    if (propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+        return;
+    }
     doStartUpload();
 }
 
@@ -371,9 +428,7 @@ UploadDevice::UploadDevice(BandwidthManager *bwm)
     : _read(0)
     , _bandwidthManager(bwm)
     , _bandwidthQuota(0)
-    , _readWithProgress(0)
     , _bandwidthLimited(false)
-    , _choked(false)
 {
     _bandwidthManager->registerUploadDevice(this);
 }
@@ -400,16 +455,35 @@ bool UploadDevice::prepareAndOpen(const QString &fileName, qint64 start, qint64
 
     size = qBound(0ll, size, FileSystem::getSize(fileName) - start);
     _data.resize(size);
-    auto read = file.read(_data.data(), size);
-    if (read != size) {
-        setErrorString(file.errorString());
-        return false;
+    if (auto ring = IoUring::threadInstance()) {
+        // Large chunks are read with several reads in flight
+        char *dest = _data.data();
+        auto read = ring->readFile(file.handle(), start, size, [&dest](const char *data, qint64 len) {
+            std::memcpy(dest, data, len);
+            dest += len;
+        });
+        if (read != size) {
+            setErrorString(qt_error_string(read < 0 ? errno : EIO));
+            return false;
+        }
+    } else {
+        auto read = file.read(_data.data(), size);
+        if (read != size) {
+            setErrorString(file.errorString());
+            return false;
+        }
     }
 
     return QIODevice::open(QIODevice::ReadOnly);
 }
 
 
+void UploadDevice::setCompressedData(const QByteArray &compressed)
+{
+    ASSERT(_read == 0);
+    _data = compressed;
+}
+
 qint64 UploadDevice::writeData(const char *, qint64)
 {
     ASSERT(false, "write to read only device");
@@ -429,9 +503,6 @@ qint64 UploadDevice::readData(char *data, qint64 maxlen)
     if (maxlen == 0) {
         return 0;
     }
-    if (isChoked()) {
-        return 0;
-    }
     if (isBandwidthLimited()) {
         maxlen = qMin(maxlen, _bandwidthQuota);
         if (maxlen <= 0) { // no quota
@@ -444,14 +515,6 @@ qint64 UploadDevice::readData(char *data, qint64 maxlen)
     return maxlen;
 }
 
-void UploadDevice::slotJobUploadProgress(qint64 sent, qint64 t)
-{
-    if (sent == 0 || t == 0) {
-        return;
-    }
-    _readWithProgress = sent;
-}
-
 bool UploadDevice::atEnd() const
 {
     return _read >= _data.size();
@@ -499,13 +562,6 @@ void UploadDevice::setBandwidthLimited(bool b)
     QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
 }
 
-void UploadDevice::setChoked(bool b)
-{
-    _choked = b;
-    if (!_choked) {
-        QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
-    }
-}
 
 void PropagateUploadFileCommon::startPollJob(const QString &path)
 {
@@ -629,6 +685,43 @@ void PropagateUploadFileCommon::abortWithError(SyncFileItem::Status status, cons
     done(status, error);
 }
 
+void PropagateUploadFileCommon::compressUploadDevice(std::unique_ptr<UploadDevice> device,
+    const QMap<QByteArray, QByteArray> &headers, const UploadFunction &upload)
+{
+    const auto encodings = propagator()->account()->capabilities().supportedContentEncodings();
+    if (!encodings.contains(ContentEncoding::gzipC) || ContentEncoding::isCompressedFormat(device->data())) {
+        upload(std::move(device), headers);
+        return;
+    }
+
+    // Compressing a chunk takes too long for the event loop. The watcher owns
+    // the device meanwhile, both go away if this job does.
+    propagator()->_activeJobList.append(this);
+    _compressingChunks++;
+    auto watcher = new QFutureWatcher<QByteArray>(this);
+    auto devicePtr = device.release();
+    devicePtr->setParent(watcher);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, devicePtr, headers, upload] {
+        propagator()->_activeJobList.removeOne(this);
+        _compressingChunks--;
+        watcher->deleteLater();
+        if (_finished || propagator()->_abortRequested.fetchAndAddRelaxed(0)) {
+            return;
+        }
+
+        const QByteArray compressed = watcher->result();
+        std::unique_ptr<UploadDevice> device(devicePtr);
+        device->setParent(nullptr);
+        auto uploadHeaders = headers;
+        if (!compressed.isEmpty()) {
+            device->setCompressedData(compressed);
+            uploadHeaders["Content-Encoding"] = ContentEncoding::gzipC;
+        }
+        upload(std::move(device), uploadHeaders);
+    });
+    watcher->setFuture(QtConcurrent::run(&ContentEncoding::gzipCompressIfSmaller, devicePtr->data()));
+}
+
 QMap<QByteArray, QByteArray> PropagateUploadFileCommon::headers()
 {
     QMap<QByteArray, QByteArray> headers;
@@ -20,6 +20,9 @@
 #include <QFile>
 #include <QElapsedTimer>
 
+#include <functional>
+#include <memory>
+
 
 namespace OCC {
 
@@ -42,6 +45,15 @@ public:
     /** Reads the data from the file and opens the device */
     bool prepareAndOpen(const QString &fileName, qint64 start, qint64 size);
 
+    /** The data that will be sent */
+    const QByteArray &data() const { return _data; }
+
+    /**
+     * Replaces the data by its gzip compressed form.
+     * Must be called before anything is read.
+     */
+    void setCompressedData(const QByteArray &compressed);
+
     qint64 writeData(const char *, qint64) override;
     qint64 readData(char *data, qint64 maxlen) override;
     bool atEnd() const override;
@@ -52,9 +64,8 @@ public:
 
     void setBandwidthLimited(bool);
     bool isBandwidthLimited() { return _bandwidthLimited; }
-    void setChoked(bool);
-    bool isChoked() { return _choked; }
     void giveBandwidthQuota(qint64 bwq);
+    qint64 bandwidthQuota() const { return _bandwidthQuota; }
 
 signals:
 
@@ -67,12 +78,7 @@ private:
     // Bandwidth manager related
     QPointer<BandwidthManager> _bandwidthManager;
     qint64 _bandwidthQuota;
-    qint64 _readWithProgress;
     bool _bandwidthLimited; // if _bandwidthQuota will be used
-    bool _choked; // if upload is paused (readData() will return 0)
-    friend class BandwidthManager;
-public slots:
-    void slotJobUploadProgress(qint64 sent, qint64 t);
 };
 
 /**
@@ -182,6 +188,7 @@ signals:
 };
 
 class PropagateUploadEncrypted;
+class PropagateRemoteCopy;
 
 /**
  * @brief The PropagateUploadFileCommon class is the code common between all chunking algorithms
@@ -198,6 +205,8 @@ class PropagateUploadEncrypted;
  *         |
  *         v
  *    slotStartUpload()  -> doStartUpload()
+ *         |                        .
+ *         +-> (copy job) ---> finalize() or doStartUpload()
  *                                  .
  *                                  .
  *                                  v
@@ -211,6 +220,7 @@ protected:
     QVector<AbstractNetworkJob *> _jobs; /// network jobs that are currently in transit
     bool _finished BITFIELD(1); /// Tells that all the jobs have been finished
     bool _deleteExisting BITFIELD(1);
+    int _compressingChunks = 0; /// chunks that are being compressed before their upload starts
 
     /* This is a minified version of the SyncFileItem,
      * that holds only the specifics about the file that's
@@ -259,6 +269,9 @@ private slots:
     void slotComputeTransmissionChecksum(const QByteArray &contentChecksumType, const QByteArray &contentChecksum);
     // transmission checksum computed, prepare the upload
     void slotStartUpload(const QByteArray &transmissionChecksumType, const QByteArray &transmissionChecksum);
+    // The server copied the content from another file, or it needs to be uploaded after all
+    void slotRemoteCopyFinished();
+    void slotRemoteCopyFailed();
 
 public:
     virtual void doStartUpload() = 0;
@@ -309,7 +322,26 @@ protected:
 
     // Bases headers that need to be sent with every chunk
     QMap<QByteArray, QByteArray> headers();
+
+    using UploadFunction = std::function<void(std::unique_ptr<UploadDevice> device, const QMap<QByteArray, QByteArray> &headers)>;
+
+    /**
+     * Compresses the data of \a device in a worker thread if the server
+     * accepts compressed uploads, then calls \a upload with the device and
+     * \a headers, with Content-Encoding set if the data was compressed.
+     *
+     * upload is called right away if there is nothing to compress, and not at
+     * all if the job was aborted or finished meanwhile.
+     */
+    void compressUploadDevice(std::unique_ptr<UploadDevice> device, const QMap<QByteArray, QByteArray> &headers,
+        const UploadFunction &upload);
 private:
+  /**
+   * Copies a file with the same content on the server instead of uploading,
+   * see SyncOptions::_serverSideCopy. Returns false if there is nothing to copy.
+   */
+  bool startRemoteCopy();
+
   PropagateUploadEncrypted *_uploadEncryptedHelper;
   bool _uploadingEncrypted;
 };
@@ -346,6 +378,9 @@ private:
         return propagator()->syncOptions()._initialChunkSize;
     }
 
+    /** Starts the next chunk right away if parallel chunk upload is possible */
+    void scheduleParallelChunk();
+
 public:
     PropagateUploadFileV1(OwncloudPropagator *propagator, const SyncFileItemPtr &item)
         : PropagateUploadFileCommon(propagator, item)
@@ -1,5 +1,6 @@
 #include "propagateuploadencrypted.h"
 #include "clientsideencryptionjobs.h"
+#include "encryptedfoldersession.h"
 #include "networkjobs.h"
 #include "clientsideencryption.h"
 #include "account.h"
@@ -16,13 +17,19 @@ namespace OCC {
 
 Q_LOGGING_CATEGORY(lcPropagateUploadEncrypted, "nextcloud.sync.propagator.upload.encrypted", QtInfoMsg)
 
-PropagateUploadEncrypted::PropagateUploadEncrypted(OwncloudPropagator *propagator, SyncFileItemPtr item)
-: _propagator(propagator),
- _item(item),
- _metadata(nullptr)
+PropagateUploadEncrypted::PropagateUploadEncrypted(OwncloudPropagator *propagator, SyncFileItemPtr item, QObject *parent)
+: QObject(parent),
+ _propagator(propagator),
+ _item(item)
 {
 }
 
+PropagateUploadEncrypted::~PropagateUploadEncrypted()
+{
+    // Aborted uploads don't unlock explicitly
+    unlockFolder();
+}
+
 void PropagateUploadEncrypted::start()
 {
   /* If the file is in a encrypted-enabled nextcloud instance, we need to
@@ -35,6 +42,9 @@ void PropagateUploadEncrypted::start()
       * upload the metadata
       * unlock the folder.
       *
+      * The lock and the metadata are shared with the other jobs of the sync
+      * that change the same folder, see EncryptedFolderSession.
+      *
       * If the folder is unencrypted we just follow the old way.
       */
       qCDebug(lcPropagateUploadEncrypted) << "Starting to send an encrypted file!";
@@ -69,63 +79,23 @@ void PropagateUploadEncrypted::slotFolderEncryptedStatusFetched(const QString &f
 
 
 
-/* We try to lock a folder, if it's locked we try again in one second.
- * if it's still locked we try again in one second. looping untill one minute.
- *                                                                      -> fail.
- * the 'loop':                                                         /
- *    slotFolderEncryptedIdReceived -> slotTryLock -> lockError -> stillTime? -> slotTryLock
- *                                        \
- *                                         -> success.
- */
-
 void PropagateUploadEncrypted::slotFolderEncryptedIdReceived(const QStringList &list)
 {
   qCDebug(lcPropagateUploadEncrypted) << "Received id of folder, trying to lock it so we can prepare the metadata";
   auto job = qobject_cast<LsColJob *>(sender());
   const auto& folderInfo = job->_folderInfos.value(list.first());
-  _folderLockFirstTry.start();
-  slotTryLock(folderInfo.fileId);
-}
-
-void PropagateUploadEncrypted::slotTryLock(const QByteArray& fileId)
-{
-  auto *lockJob = new LockEncryptFolderApiJob(_propagator->account(), fileId, this);
-  connect(lockJob, &LockEncryptFolderApiJob::success, this, &PropagateUploadEncrypted::slotFolderLockedSuccessfully);
-  connect(lockJob, &LockEncryptFolderApiJob::error, this, &PropagateUploadEncrypted::slotFolderLockedError);
-  lockJob->start();
+  _folderId = folderInfo.fileId;
+  _folderSession = _propagator->encryptedFolderSession(_folderId);
+  _folderSessionAcquired = true;
+  _folderSession->acquire(this,
+      [this](FolderMetadata *metadata) { folderEncryptedMetadataReceived(metadata); },
+      [this] { folderLockedError(); });
 }
 
-void PropagateUploadEncrypted::slotFolderLockedSuccessfully(const QByteArray& fileId, const QByteArray& token)
+void PropagateUploadEncrypted::folderEncryptedMetadataReceived(FolderMetadata *metadata)
 {
-  qCDebug(lcPropagateUploadEncrypted) << "Folder" << fileId << "Locked Successfully for Upload, Fetching Metadata";
-  // Should I use a mutex here?
-  _currentLockingInProgress = true;
-  _folderToken = token;
-  _folderId = fileId;
-
-  auto job = new GetMetadataApiJob(_propagator->account(), _folderId);
-  connect(job, &GetMetadataApiJob::jsonReceived,
-          this, &PropagateUploadEncrypted::slotFolderEncryptedMetadataReceived);
-  connect(job, &GetMetadataApiJob::error,
-          this, &PropagateUploadEncrypted::slotFolderEncryptedMetadataError);
-
-  job->start();
-}
-
-void PropagateUploadEncrypted::slotFolderEncryptedMetadataError(const QByteArray& fileId, int httpReturnCode)
-{
-    Q_UNUSED(fileId);
-    Q_UNUSED(httpReturnCode);
-    qCDebug(lcPropagateUploadEncrypted()) << "Error Getting the encrypted metadata. unlock the folder.";
-    unlockFolder();
-}
-
-void PropagateUploadEncrypted::slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode)
-{
-  qCDebug(lcPropagateUploadEncrypted) << "Metadata Received, Preparing it for the new file." << json.toVariant();
-
-  // Encrypt File!
-  _metadata = new FolderMetadata(_propagator->account(), json.toJson(QJsonDocument::Compact), statusCode);
+  qCDebug(lcPropagateUploadEncrypted) << "Metadata Received, Preparing it for the new file.";
+  _folderToken = _folderSession->token();
 
   QFileInfo info(_propagator->_localDir + QDir::separator() + _item->_file);
   const QString fileName = info.fileName();
@@ -133,7 +103,7 @@ void PropagateUploadEncrypted::slotFolderEncryptedMetadataReceived(const QJsonDo
   // Find existing metadata for this file
   bool found = false;
   EncryptedFile encryptedFile;
-  const QVector<EncryptedFile> files = _metadata->files();
+  const QVector<EncryptedFile> files = metadata->files();
 
   for(const EncryptedFile &file : files) {
     if (file.originalFilename == fileName) {
@@ -157,8 +127,8 @@ void PropagateUploadEncrypted::slotFolderEncryptedMetadataReceived(const QJsonDo
       encryptedFile.mimetype = mdb.mimeTypeForFile(info).name().toLocal8Bit();
   }
 
-  _item->_encryptedFileName = _item->_file.section(QLatin1Char('/'), 0, -2)
-          + QLatin1Char('/') + encryptedFile.encryptedFilename;
+  _item->setEncryptedFileName(_item->_file.section(QLatin1Char('/'), 0, -2)
+          + QLatin1Char('/') + encryptedFile.encryptedFilename);
 
   qCDebug(lcPropagateUploadEncrypted) << "Creating the encrypted file.";
 
@@ -174,6 +144,7 @@ void PropagateUploadEncrypted::slotFolderEncryptedMetadataReceived(const QJsonDo
   if (!encryptionResult) {
     qCDebug(lcPropagateUploadEncrypted()) << "There was an error encrypting the file, aborting upload.";
     unlockFolder();
+    emit error();
     return;
   }
 
@@ -183,33 +154,23 @@ void PropagateUploadEncrypted::slotFolderEncryptedMetadataReceived(const QJsonDo
 
   encryptedFile.authenticationTag = tag;
 
-  _metadata->addEncryptedFile(encryptedFile);
+  metadata->addEncryptedFile(encryptedFile);
   _encryptedFile = encryptedFile;
 
   qCDebug(lcPropagateUploadEncrypted) << "Metadata created, sending to the server.";
-
-  if (statusCode == 404) {
-    auto job = new StoreMetaDataApiJob(_propagator->account(),
-                                       _folderId,
-                                       _metadata->encryptedMetadata());
-    connect(job, &StoreMetaDataApiJob::success, this, &PropagateUploadEncrypted::slotUpdateMetadataSuccess);
-    connect(job, &StoreMetaDataApiJob::error, this, &PropagateUploadEncrypted::slotUpdateMetadataError);
-    job->start();
-  } else {
-    auto job = new UpdateMetadataApiJob(_propagator->account(),
-                                      _folderId,
-                                      _metadata->encryptedMetadata(),
-                                      _folderToken);
-
-    connect(job, &UpdateMetadataApiJob::success, this, &PropagateUploadEncrypted::slotUpdateMetadataSuccess);
-    connect(job, &UpdateMetadataApiJob::error, this, &PropagateUploadEncrypted::slotUpdateMetadataError);
-    job->start();
-  }
+  _folderSession->storeMetadata(this, [this](bool success) { updateMetadataFinished(success); });
 }
 
-void PropagateUploadEncrypted::slotUpdateMetadataSuccess(const QByteArray& fileId)
+void PropagateUploadEncrypted::updateMetadataFinished(bool success)
 {
-    Q_UNUSED(fileId);
+    if (!success) {
+        qCDebug(lcPropagateUploadEncrypted) << "Update metadata error for folder" << _folderId;
+        qCDebug(lcPropagateUploadEncrypted()) << "Unlocking the folder.";
+        unlockFolder();
+        emit error();
+        return;
+    }
+
     qCDebug(lcPropagateUploadEncrypted) << "Uploading of the metadata success, Encrypting the file";
     QFileInfo outputInfo(_completeFileName);
 
@@ -220,57 +181,33 @@ void PropagateUploadEncrypted::slotUpdateMetadataSuccess(const QByteArray& fileI
                    outputInfo.size());
 }
 
-void PropagateUploadEncrypted::slotUpdateMetadataError(const QByteArray& fileId, int httpErrorResponse)
-{
-  qCDebug(lcPropagateUploadEncrypted) << "Update metadata error for folder" << fileId << "with error" << httpErrorResponse;
-  qCDebug(lcPropagateUploadEncrypted()) << "Unlocking the folder.";
-  unlockFolder();
-}
-
-void PropagateUploadEncrypted::slotFolderLockedError(const QByteArray& fileId, int httpErrorCode)
+void PropagateUploadEncrypted::folderLockedError()
 {
-    Q_UNUSED(httpErrorCode);
-    /* try to call the lock from 5 to 5 seconds
-     * and fail if it's more than 5 minutes. */
-    QTimer::singleShot(5000, this, [this, fileId]{
-        if (!_currentLockingInProgress) {
-            qCDebug(lcPropagateUploadEncrypted) << "Error locking the folder while no other update is locking it up.";
-            qCDebug(lcPropagateUploadEncrypted) << "Perhaps another client locked it.";
-            qCDebug(lcPropagateUploadEncrypted) << "Abort";
-        return;
-        }
-
-        // Perhaps I should remove the elapsed timer if the lock is from this client?
-        if (_folderLockFirstTry.elapsed() > /* five minutes */ 1000 * 60 * 5 ) {
-            qCDebug(lcPropagateUploadEncrypted) << "One minute passed, ignoring more attempts to lock the folder.";
-        return;
-        }
-        slotTryLock(fileId);
-    });
-
-    qCDebug(lcPropagateUploadEncrypted) << "Folder" << fileId << "Coundn't be locked.";
+    qCDebug(lcPropagateUploadEncrypted) << "Folder" << _folderId << "Coundn't be locked or its metadata fetched.";
+    unlockFolder();
+    emit error();
 }
 
 void PropagateUploadEncrypted::slotFolderEncryptedIdError(QNetworkReply *r)
 {
     Q_UNUSED(r);
     qCDebug(lcPropagateUploadEncrypted) << "Error retrieving the Id of the encrypted folder.";
+    emit error();
 }
 
 void PropagateUploadEncrypted::slotFolderEncryptedStatusError(int error)
 {
     qCDebug(lcPropagateUploadEncrypted) << "Failed to retrieve the status of the folders." << error;
+    emit this->error();
 }
 
 void PropagateUploadEncrypted::unlockFolder()
 {
-    qDebug() << "Calling Unlock";
-    auto *unlockJob = new UnlockEncryptFolderApiJob(_propagator->account(),
-        _folderId, _folderToken, this);
-
-    connect(unlockJob, &UnlockEncryptFolderApiJob::success, []{ qDebug() << "Successfully Unlocked"; });
-    connect(unlockJob, &UnlockEncryptFolderApiJob::error, []{ qDebug() << "Unlock Error"; });
-    unlockJob->start();
+    if (!_folderSessionAcquired)
+        return;
+    _folderSessionAcquired = false;
+    if (_folderSession)
+        _folderSession->release();
 }
 
 } // namespace OCC
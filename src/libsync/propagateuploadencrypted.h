@@ -9,12 +9,14 @@
 #include <QNetworkReply>
 #include <QFile>
 #include <QTemporaryFile>
+#include <QPointer>
 
 #include "owncloudpropagator.h"
 #include "clientsideencryption.h"
 
 namespace OCC {
 class FolderMetadata;
+class EncryptedFolderSession;
 
   /* This class is used if the server supports end to end encryption.
  * It will fire for *any* folder, encrypted or not, because when the
@@ -32,10 +34,12 @@ class PropagateUploadEncrypted : public QObject
 {
   Q_OBJECT
 public:
-    PropagateUploadEncrypted(OwncloudPropagator *propagator, SyncFileItemPtr item);
+    PropagateUploadEncrypted(OwncloudPropagator *propagator, SyncFileItemPtr item, QObject *parent = nullptr);
+    ~PropagateUploadEncrypted();
     void start();
 
-    /* unlocks the current folder that holds this file */
+    /* releases the lock of the folder that holds this file, the folder is
+     * unlocked once no other job of the sync uses it anymore */
     void unlockFolder();
   // Used by propagateupload
   QByteArray _folderToken;
@@ -46,13 +50,6 @@ private slots:
     void slotFolderEncryptedStatusError(int error);
     void slotFolderEncryptedIdReceived(const QStringList &list);
     void slotFolderEncryptedIdError(QNetworkReply *r);
-    void slotFolderLockedSuccessfully(const QByteArray& fileId, const QByteArray& token);
-    void slotFolderLockedError(const QByteArray& fileId, int httpErrorCode);
-    void slotTryLock(const QByteArray& fileId);
-    void slotFolderEncryptedMetadataReceived(const QJsonDocument &json, int statusCode);
-    void slotFolderEncryptedMetadataError(const QByteArray& fileId, int httpReturnCode);
-    void slotUpdateMetadataSuccess(const QByteArray& fileId);
-    void slotUpdateMetadataError(const QByteArray& fileId, int httpReturnCode);
 
 signals:
     // Emmited after the file is encrypted and everythign is setup.
@@ -63,15 +60,18 @@ signals:
     void folerNotEncrypted();
 
 private:
+  void folderLockedError();
+  void folderEncryptedMetadataReceived(FolderMetadata *metadata);
+  void updateMetadataFinished(bool success);
+
   OwncloudPropagator *_propagator;
   SyncFileItemPtr _item;
 
-  QElapsedTimer _folderLockFirstTry;
-  bool _currentLockingInProgress = false;
+  QPointer<EncryptedFolderSession> _folderSession;
+  bool _folderSessionAcquired = false;
 
   QByteArray _generatedKey;
   QByteArray _generatedIv;
-  FolderMetadata *_metadata;
   EncryptedFile _encryptedFile;
   QString _completeFileName;
 };
@@ -325,21 +325,22 @@ void PropagateUploadFileNG::startNextChunk()
     headers["OC-Chunk-Offset"] = QByteArray::number(_sent);
 
     _sent += _currentChunkSize;
-    QUrl url = chunkUrl(_currentChunk);
-
-    // job takes ownership of device via a QScopedPointer. Job deletes itself when finishing
-    auto devicePtr = device.get(); // for connections later
-    auto *job = new PUTFileJob(propagator()->account(), url, std::move(device), headers, _currentChunk, this);
-    _jobs.append(job);
-    connect(job, &PUTFileJob::finishedSignal, this, &PropagateUploadFileNG::slotPutFinished);
-    connect(job, &PUTFileJob::uploadProgress,
-        this, &PropagateUploadFileNG::slotUploadProgress);
-    connect(job, &PUTFileJob::uploadProgress,
-        devicePtr, &UploadDevice::slotJobUploadProgress);
-    connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
-    job->start();
-    propagator()->_activeJobList.append(this);
+    const int chunk = _currentChunk;
     _currentChunk++;
+
+    compressUploadDevice(std::move(device), headers, [this, chunk](std::unique_ptr<UploadDevice> device, const QMap<QByteArray, QByteArray> &headers) {
+        QUrl url = chunkUrl(chunk);
+
+        // job takes ownership of device via a QScopedPointer. Job deletes itself when finishing
+        auto *job = new PUTFileJob(propagator()->account(), url, std::move(device), headers, chunk, this);
+        _jobs.append(job);
+        connect(job, &PUTFileJob::finishedSignal, this, &PropagateUploadFileNG::slotPutFinished);
+        connect(job, &PUTFileJob::uploadProgress,
+            this, &PropagateUploadFileNG::slotUploadProgress);
+        connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
+        job->start();
+        propagator()->_activeJobList.append(this);
+    });
 }
 
 void PropagateUploadFileNG::slotPutFinished()
@@ -74,7 +74,7 @@ void PropagateUploadFileV1::startNextChunk()
     if (propagator()->_abortRequested.fetchAndAddRelaxed(0))
         return;
 
-    if (!_jobs.isEmpty() && _currentChunk + _startChunk >= _chunkCount - 1) {
+    if ((!_jobs.isEmpty() || _compressingChunks > 0) && _currentChunk + _startChunk >= _chunkCount - 1) {
         // Don't do parallel upload of chunk if this might be the last chunk because the server cannot handle that
         // https://github.com/owncloud/core/issues/11106
         // We return now and when the _jobs are finished we will proceed with the last chunk
@@ -137,20 +137,26 @@ void PropagateUploadFileV1::startNextChunk()
         return;
     }
 
-    // job takes ownership of device via a QScopedPointer. Job deletes itself when finishing
-    auto devicePtr = device.get(); // for connections later
-    auto *job = new PUTFileJob(propagator()->account(), propagator()->_remoteFolder + path, std::move(device), headers, _currentChunk, this);
-    _jobs.append(job);
-    connect(job, &PUTFileJob::finishedSignal, this, &PropagateUploadFileV1::slotPutFinished);
-    connect(job, &PUTFileJob::uploadProgress, this, &PropagateUploadFileV1::slotUploadProgress);
-    connect(job, &PUTFileJob::uploadProgress, devicePtr, &UploadDevice::slotJobUploadProgress);
-    connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
-    if (isFinalChunk)
-        adjustLastJobTimeout(job, fileSize);
-    job->start();
-    propagator()->_activeJobList.append(this);
+    const int chunk = _currentChunk;
     _currentChunk++;
+    compressUploadDevice(std::move(device), headers,
+        [this, path, chunk, isFinalChunk, fileSize](std::unique_ptr<UploadDevice> device, const QMap<QByteArray, QByteArray> &headers) {
+            // job takes ownership of device via a QScopedPointer. Job deletes itself when finishing
+            auto *job = new PUTFileJob(propagator()->account(), propagator()->_remoteFolder + path, std::move(device), headers, chunk, this);
+            _jobs.append(job);
+            connect(job, &PUTFileJob::finishedSignal, this, &PropagateUploadFileV1::slotPutFinished);
+            connect(job, &PUTFileJob::uploadProgress, this, &PropagateUploadFileV1::slotUploadProgress);
+            connect(job, &QObject::destroyed, this, &PropagateUploadFileCommon::slotJobDestroyed);
+            if (isFinalChunk)
+                adjustLastJobTimeout(job, fileSize);
+            job->start();
+            propagator()->_activeJobList.append(this);
+            scheduleParallelChunk();
+        });
+}
 
+void PropagateUploadFileV1::scheduleParallelChunk()
+{
     bool parallelChunkUpload = true;
 
     if (propagator()->account()->capabilities().chunkingParallelUploadDisabled()) {
@@ -258,7 +264,7 @@ void PropagateUploadFileV1::slotPutFinished()
     if (!_finished) {
         // Proceed to next chunk.
         if (_currentChunk >= _chunkCount) {
-            if (!_jobs.empty()) {
+            if (!_jobs.empty() || _compressingChunks > 0) {
                 // just wait for the other job to finish.
                 return;
             }
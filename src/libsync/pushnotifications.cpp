@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "pushnotifications.h"
+#include "account.h"
+#include "networkjobs.h"
+
+#include <QLoggingCategory>
+#include <QNetworkReply>
+#include <QWebSocket>
+
+namespace OCC {
+
+Q_LOGGING_CATEGORY(lcPushNotifications, "nextcloud.sync.pushnotifications", QtInfoMsg)
+
+PushNotifications::PushNotifications(AccountPtr account, const QUrl &webSocketUrl, const QUrl &preAuthUrl, QObject *parent)
+    : QObject(parent)
+    , _account(account)
+    , _webSocketUrl(webSocketUrl)
+    , _preAuthUrl(preAuthUrl)
+    , _socket(new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this))
+{
+    connect(_socket, &QWebSocket::connected, this, &PushNotifications::slotConnected);
+    connect(_socket, &QWebSocket::disconnected, this, &PushNotifications::slotDisconnected);
+    connect(_socket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), this, [this] {
+        qCWarning(lcPushNotifications) << "Websocket error" << _socket->errorString();
+        // A failed connection attempt doesn't necessarily emit disconnected()
+        if (_socket->state() == QAbstractSocket::UnconnectedState)
+            slotDisconnected();
+    });
+    connect(_socket, &QWebSocket::textMessageReceived, this, &PushNotifications::slotTextMessageReceived);
+    connect(_socket, &QWebSocket::sslErrors, this, &PushNotifications::slotSslErrors);
+    connect(_socket, &QWebSocket::pong, this, [this] { _pongPending = false; });
+
+    _retryTimer.setSingleShot(true);
+    connect(&_retryTimer, &QTimer::timeout, this, &PushNotifications::requestToken);
+    _pingTimer.setInterval(std::chrono::seconds(30));
+    connect(&_pingTimer, &QTimer::timeout, this, &PushNotifications::slotPing);
+}
+
+PushNotifications::~PushNotifications()
+{
+    stop();
+}
+
+void PushNotifications::setRetryDelays(std::chrono::milliseconds initial, std::chrono::milliseconds max)
+{
+    _initialRetryDelay = initial;
+    _maxRetryDelay = max;
+    _retryDelay = initial;
+}
+
+void PushNotifications::setPingInterval(std::chrono::milliseconds interval)
+{
+    _pingTimer.setInterval(interval);
+}
+
+void PushNotifications::start()
+{
+    if (_running)
+        return;
+    qCInfo(lcPushNotifications) << "Listening for remote changes at" << _webSocketUrl;
+    _running = true;
+    _retryDelay = _initialRetryDelay;
+    requestToken();
+}
+
+void PushNotifications::stop()
+{
+    _running = false;
+    _retryTimer.stop();
+    _pingTimer.stop();
+    if (_tokenJob) {
+        disconnect(_tokenJob.data(), nullptr, this, nullptr);
+        if (_tokenJob->reply())
+            _tokenJob->reply()->abort();
+        _tokenJob->deleteLater();
+        _tokenJob.clear();
+    }
+    _socket->abort();
+    setConnected(false);
+}
+
+void PushNotifications::requestToken()
+{
+    if (!_running || _tokenJob)
+        return;
+
+    _tokenJob = new SimpleNetworkJob(_account, this);
+    // Leave credential problems to the regular requests of the account
+    _tokenJob->setIgnoreCredentialFailure(true);
+    connect(_tokenJob.data(), &SimpleNetworkJob::finishedSignal, this, &PushNotifications::slotTokenReceived);
+    _tokenJob->startRequest("POST", _preAuthUrl);
+}
+
+void PushNotifications::slotTokenReceived(QNetworkReply *reply)
+{
+    _tokenJob.clear();
+    if (!_running)
+        return;
+
+    const int httpCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    _token = reply->readAll().trimmed();
+    if (reply->error() != QNetworkReply::NoError || httpCode != 200 || _token.isEmpty()) {
+        qCWarning(lcPushNotifications) << "Could not get a token for the websocket" << httpCode << reply->errorString();
+        retryLater();
+        return;
+    }
+
+    if (_webSocketUrl.scheme() == QLatin1String("wss"))
+        _socket->setSslConfiguration(_account->getOrCreateSslConfig());
+    _socket->open(_webSocketUrl);
+}
+
+void PushNotifications::slotConnected()
+{
+    // The token stands in for user name and password
+    _socket->sendTextMessage(QString());
+    _socket->sendTextMessage(QString::fromUtf8(_token));
+    _token.clear();
+}
+
+void PushNotifications::slotDisconnected()
+{
+    _pingTimer.stop();
+    if (!_running)
+        return;
+    qCInfo(lcPushNotifications) << "Websocket closed" << _socket->closeCode() << _socket->closeReason();
+    retryLater();
+}
+
+void PushNotifications::slotTextMessageReceived(const QString &message)
+{
+    if (message == QLatin1String("notify_file")) {
+        qCInfo(lcPushNotifications) << "Remote files changed";
+        emit filesChanged();
+    } else if (message == QLatin1String("authenticated")) {
+        _retryDelay = _initialRetryDelay;
+        _pongPending = false;
+        _pingTimer.start();
+        setConnected(true);
+    } else if (message.startsWith(QLatin1String("err:"))) {
+        qCWarning(lcPushNotifications) << "Websocket refused the connection:" << message;
+        _socket->close();
+    }
+    // Activity and notification updates are not of interest here
+}
+
+void PushNotifications::slotSslErrors(const QList<QSslError> &errors)
+{
+    // Accept what the user approved for the account, everything else fails
+    const auto approved = _account->approvedCerts();
+    for (const auto &error : errors) {
+        if (!approved.contains(error.certificate())) {
+            qCWarning(lcPushNotifications) << "SSL error on the websocket" << error.errorString();
+            return;
+        }
+    }
+    _socket->ignoreSslErrors(errors);
+}
+
+void PushNotifications::slotPing()
+{
+    if (_pongPending) {
+        qCWarning(lcPushNotifications) << "Websocket doesn't answer pings, reconnecting";
+        _socket->abort();
+        slotDisconnected();
+        return;
+    }
+    _pongPending = true;
+    _socket->ping();
+}
+
+void PushNotifications::retryLater()
+{
+    setConnected(false);
+    if (_retryTimer.isActive())
+        return;
+    qCInfo(lcPushNotifications) << "Retrying in" << _retryDelay.count() << "ms";
+    _retryTimer.start(_retryDelay.count());
+    _retryDelay = std::min(_retryDelay * 2, _maxRetryDelay);
+}
+
+void PushNotifications::setConnected(bool connected)
+{
+    if (_connected == connected)
+        return;
+    _connected = connected;
+    emit connectedChanged(connected);
+}
+}
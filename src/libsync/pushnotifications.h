@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef PUSHNOTIFICATIONS_H
+#define PUSHNOTIFICATIONS_H
+
+#include <QObject>
+#include <QPointer>
+#include <QSslError>
+#include <QTimer>
+#include <QUrl>
+#include <chrono>
+
+#include "owncloudlib.h"
+#include "accountfwd.h"
+
+class QNetworkReply;
+class QWebSocket;
+
+namespace OCC {
+
+class SimpleNetworkJob;
+
+/**
+ * @brief Websocket of the notify_push server app that reports remote changes
+ *
+ * The endpoints are advertised in the capabilities, see
+ * Capabilities::pushNotificationsWebSocketUrl(). To connect, the client
+ * POSTs to the pre_auth endpoint with the regular credentials of the
+ * account and gets a short lived token back. On the websocket it sends an
+ * empty user name and the token as two text messages, the server answers
+ * "authenticated" or "err: <reason>".
+ *
+ * Afterwards the server sends "notify_file" whenever a file of the user
+ * changed. It doesn't tell which one, so the etags have to be checked to
+ * find out.
+ *
+ * Errors and lost connections are retried with an increasing delay, each
+ * attempt with a new token. While the channel is down remote changes are
+ * only noticed by polling.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT PushNotifications : public QObject
+{
+    Q_OBJECT
+public:
+    PushNotifications(AccountPtr account, const QUrl &webSocketUrl, const QUrl &preAuthUrl, QObject *parent = nullptr);
+    ~PushNotifications() override;
+
+    AccountPtr account() const { return _account; }
+    QUrl webSocketUrl() const { return _webSocketUrl; }
+
+    void start();
+    void stop();
+
+    /// True while the websocket is authenticated
+    bool isConnected() const { return _connected; }
+
+    /// The delay before the first retry after an error, doubled up to \a max
+    void setRetryDelays(std::chrono::milliseconds initial, std::chrono::milliseconds max);
+
+    /// How often the connection is checked with a ping
+    void setPingInterval(std::chrono::milliseconds interval);
+
+signals:
+    void filesChanged();
+    void connectedChanged(bool connected);
+
+private slots:
+    void requestToken();
+    void slotTokenReceived(QNetworkReply *reply);
+    void slotConnected();
+    void slotDisconnected();
+    void slotTextMessageReceived(const QString &message);
+    void slotSslErrors(const QList<QSslError> &errors);
+    void slotPing();
+
+private:
+    void setConnected(bool connected);
+    void retryLater();
+
+    AccountPtr _account;
+    QUrl _webSocketUrl;
+    QUrl _preAuthUrl;
+    QWebSocket *_socket;
+    QByteArray _token;
+    QPointer<SimpleNetworkJob> _tokenJob;
+    QTimer _retryTimer;
+    QTimer _pingTimer;
+    std::chrono::milliseconds _initialRetryDelay = std::chrono::seconds(1);
+    std::chrono::milliseconds _maxRetryDelay = std::chrono::minutes(5);
+    std::chrono::milliseconds _retryDelay = _initialRetryDelay;
+    bool _pongPending = false;
+    bool _running = false;
+    bool _connected = false;
+};
+}
+
+#endif // PUSHNOTIFICATIONS_H
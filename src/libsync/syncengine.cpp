@@ -25,6 +25,7 @@
 #include "filesystem.h"
 #include "propagateremotedelete.h"
 #include "propagatedownload.h"
+#include "networkjobs.h"
 #include "common/asserts.h"
 #include "configfile.h"
 
@@ -35,6 +36,7 @@
 #include <unistd.h>
 #endif
 
+#include <algorithm>
 #include <climits>
 #include <assert.h>
 
@@ -44,6 +46,7 @@
 #include <QLoggingCategory>
 #include <QMutexLocker>
 #include <QThread>
+#include <QTimer>
 #include <QStringList>
 #include <QTextStream>
 #include <QTime>
@@ -51,6 +54,7 @@
 #include <QSslCertificate>
 #include <QProcess>
 #include <QElapsedTimer>
+#include <QJsonDocument>
 #include <qtextcodec.h>
 
 namespace OCC {
@@ -370,17 +374,69 @@ void SyncEngine::conflictRecordMaintenance()
     }
 }
 
+namespace {
+    /** An entry of a csync tree, with the path its SyncFileItem will have */
+    struct TreewalkEntry
+    {
+        QByteArray key; // the rename target for renames
+        csync_file_stat_t *file;
+        csync_file_stat_t *other;
+    };
+
+    /**
+     * Orders the paths like SyncFileItem's operator< does, slashes first:
+     *  "foo", "foo/bar", "foo-bar"
+     */
+    bool pathLessThan(const QByteArray &p1, const QByteArray &p2)
+    {
+        const auto minSize = std::min(p1.size(), p2.size());
+        const int prefixL = std::mismatch(p1.constData(), p1.constData() + minSize, p2.constData()).first - p1.constData();
+        if (prefixL == p2.size())
+            return false;
+        if (prefixL == p1.size())
+            return true;
+        if (p1[prefixL] == '/')
+            return true;
+        if (p2[prefixL] == '/')
+            return false;
+        return uchar(p1[prefixL]) < uchar(p2[prefixL]);
+    }
+
+    /** The entries of a csync tree, in the order of their keys */
+    std::vector<TreewalkEntry> sortedTreewalkEntries(CSYNC *ctx, bool remote)
+    {
+        std::vector<TreewalkEntry> entries;
+        entries.reserve(remote ? ctx->remote.files.size() : ctx->local.files.size());
+        auto collect = [&entries](csync_file_stat_t *file, csync_file_stat_t *other) {
+            const auto &key = file->instruction == CSYNC_INSTRUCTION_RENAME ? file->rename_path : file->path;
+            entries.push_back({ key, file, other });
+            return 0;
+        };
+        if (remote) {
+            csync_walk_remote_tree(ctx, collect);
+        } else {
+            csync_walk_local_tree(ctx, collect);
+        }
+        std::sort(entries.begin(), entries.end(), [](const TreewalkEntry &e1, const TreewalkEntry &e2) {
+            return pathLessThan(e1.key, e2.key);
+        });
+        return entries;
+    }
+}
+
 /**
  * The main function in the post-reconcile phase.
  *
- * Called on each entry in the local and remote trees by
- * csync_walk_local_tree()/csync_walk_remote_tree().
+ * Called on each entry in the local and remote trees in the order of their
+ * paths, see walkTrees().
  *
- * It merges the two csync file trees into a single map of SyncFileItems.
+ * If mergedItem is set, the entry is merged into this SyncFileItem of the
+ * entry with the same path in the other tree. Otherwise a new one is created
+ * and mergedItem is set to it if there is something to propagate.
  *
  * See doc/dev/sync-algorithm.md for an overview.
  */
-int SyncEngine::treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other, bool remote)
+int SyncEngine::treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other, bool remote, SyncFileItemPtr &mergedItem)
 {
     if (!file)
         return -1;
@@ -413,22 +469,16 @@ int SyncEngine::treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other,
         }
     }
 
-    // key is the handle that the SyncFileItem will have in the map.
-    QString key = fileUtf8;
-    if (instruction == CSYNC_INSTRUCTION_RENAME) {
-        key = renameTarget;
-    }
-
-    // Gets a default-constructed SyncFileItemPtr or the one from the first walk (=local walk)
-    SyncFileItemPtr item = _syncItemMap.value(key);
+    // A new item, or the one from the first walk (=local walk)
+    SyncFileItemPtr item = mergedItem;
     if (!item)
-        item = SyncFileItemPtr(new SyncFileItem);
+        item = SyncFileItemPtr::create();
 
     if (item->_file.isEmpty() || instruction == CSYNC_INSTRUCTION_RENAME) {
         item->_file = fileUtf8;
     }
     item->_originalFile = item->_file;
-    item->_encryptedFileName = file->e2eMangledName;
+    item->setEncryptedFileName(QString::fromUtf8(file->e2eMangledName));
 
     if (item->_instruction == CSYNC_INSTRUCTION_NONE
         || (item->_instruction == CSYNC_INSTRUCTION_IGNORE && instruction != CSYNC_INSTRUCTION_NONE)) {
@@ -452,10 +502,10 @@ int SyncEngine::treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other,
         item->_fileId = file->file_id;
     }
     if (!file->directDownloadUrl.isEmpty()) {
-        item->_directDownloadUrl = QString::fromUtf8(file->directDownloadUrl);
+        item->setDirectDownloadUrl(QString::fromUtf8(file->directDownloadUrl));
     }
     if (!file->directDownloadCookies.isEmpty()) {
-        item->_directDownloadCookies = QString::fromUtf8(file->directDownloadCookies);
+        item->setDirectDownloadCookies(QString::fromUtf8(file->directDownloadCookies));
     }
     if (!file->remotePerm.isNull()) {
         item->_remotePerm = file->remotePerm;
@@ -715,10 +765,80 @@ int SyncEngine::treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other,
     }
 
     slotNewItem(item);
-    _syncItemMap.insert(key, item);
+    mergedItem = item;
     return re;
 }
 
+SyncFileItemVector SyncEngine::walkTrees()
+{
+    const auto localEntries = sortedTreewalkEntries(_csync_ctx.data(), false);
+    const auto remoteEntries = sortedTreewalkEntries(_csync_ctx.data(), true);
+
+    // The items of the local entries, null if there was nothing to propagate
+    SyncFileItemVector localItems;
+    localItems.reserve(int(localEntries.size()));
+    bool walkOk = true;
+    for (const auto &entry : localEntries) {
+        SyncFileItemPtr item;
+        if (!localItems.isEmpty() && localEntries[localItems.size() - 1].key == entry.key)
+            item = localItems.last();
+        if (treewalkFile(entry.file, entry.other, false, item) < 0) {
+            qCWarning(lcEngine) << "Error in local treewalk.";
+            walkOk = false;
+            break;
+        }
+        localItems.append(item);
+    }
+
+    // The remote entries are merged into the local items with the same path,
+    // both lists are ordered by path.
+    SyncFileItemVector remoteItems;
+    std::vector<const QByteArray *> remoteKeys;
+    size_t localPos = 0;
+    for (size_t i = 0; walkOk && i < remoteEntries.size(); ++i) {
+        const auto &entry = remoteEntries[i];
+        while (localPos < size_t(localItems.size()) && pathLessThan(localEntries[localPos].key, entry.key))
+            ++localPos;
+
+        // Several local entries may share the path, the first ones without an item
+        SyncFileItemPtr item;
+        for (size_t pos = localPos; !item && pos < size_t(localItems.size()) && localEntries[pos].key == entry.key; ++pos) {
+            item = localItems[int(pos)];
+        }
+        if (!item && !remoteKeys.empty() && *remoteKeys.back() == entry.key) {
+            item = remoteItems.last();
+        }
+        const bool isNew = item.isNull();
+        if (treewalkFile(entry.file, entry.other, true, item) < 0) {
+            qCWarning(lcEngine) << "Error in remote treewalk.";
+            break;
+        }
+        if (isNew && item) {
+            remoteItems.append(item);
+            remoteKeys.push_back(&entry.key);
+        }
+    }
+
+    // Merge both lists, for equal paths the local item comes first
+    SyncFileItemVector syncItems;
+    syncItems.reserve(localItems.size() + remoteItems.size());
+    int l = 0;
+    int r = 0;
+    while (l < localItems.size() || r < remoteItems.size()) {
+        if (r == remoteItems.size()
+            || (l < localItems.size() && !pathLessThan(*remoteKeys[r], localEntries[l].key))) {
+            // Local entries with the same path share their item
+            const auto &item = localItems[l];
+            if (item && (l == 0 || item != localItems[l - 1]))
+                syncItems.append(item);
+            ++l;
+        } else {
+            syncItems.append(remoteItems[r++]);
+        }
+    }
+    return syncItems;
+}
+
 void SyncEngine::handleSyncError(CSYNC *ctx, const char *state)
 {
     CSYNC_STATUS err = csync_get_status(ctx);
@@ -783,6 +903,7 @@ void SyncEngine::startSync()
     _syncRunning = true;
     _anotherSyncNeeded = NoFollowUpSync;
     _clearTouchedFilesTimer.stop();
+    _syncStatistics.start();
 
     _progressInfo->reset();
 
@@ -816,7 +937,6 @@ void SyncEngine::startSync()
         qCWarning(lcEngine) << "Could not determine free space available at" << _localPath;
     }
 
-    _syncItemMap.clear();
     _needsUpdate = false;
 
     csync_resume(_csync_ctx.data());
@@ -851,6 +971,14 @@ void SyncEngine::startSync()
     _csync_ctx->upload_conflict_files = _account->capabilities().uploadConflictFiles();
     _excludedFiles->setExcludeConflictFiles(!_account->capabilities().uploadConflictFiles());
 
+    // The entries read from the db were checked against the excludes of the
+    // last sync already. The excludes can still change while the tree is
+    // walked, when a .sync-exclude.lst is found.
+    const QByteArray lastExcludesFingerprint = _journal->excludesFingerprint();
+    _csync_ctx->db_excludes_changed_fn = [this, lastExcludesFingerprint] {
+        return lastExcludesFingerprint.isEmpty() || _excludedFiles->fingerprint() != lastExcludesFingerprint;
+    };
+
     _csync_ctx->read_remote_from_db = true;
 
     _lastLocalDiscoveryStyle = _localDiscoveryStyle;
@@ -883,6 +1011,54 @@ void SyncEngine::startSync()
     _progressInfo->_status = ProgressInfo::Discovery;
     emit transmissionProgress(*_progressInfo);
 
+    _remoteRootEtag.clear();
+    if (canSkipDiscovery()) {
+        checkRemoteRootEtag(selectiveSyncBlackList);
+    } else {
+        _cleanRootEtag.clear();
+        startDiscovery(selectiveSyncBlackList);
+    }
+}
+
+bool SyncEngine::canSkipDiscovery()
+{
+    return _localDiscoveryStyle == LocalDiscoveryStyle::DatabaseAndFilesystem
+        && _localDiscoveryPaths.empty()
+        && !_cleanRootEtag.isEmpty()
+        && account()->rootEtagChangesNotOnlySubFolderEtags()
+        && !_journal->hasInvalidatedEtags()
+        && !_journal->hasErrorBlacklistEntriesToRetry();
+}
+
+void SyncEngine::checkRemoteRootEtag(const QStringList &selectiveSyncBlackList)
+{
+    QElapsedTimer timer;
+    timer.start();
+    _rootEtagJob = new RequestEtagJob(_account, _remotePath, this);
+    _rootEtagJob->setTimeout(60 * 1000);
+    connect(_rootEtagJob.data(), &RequestEtagJob::etagRetreived, this, [this, timer, selectiveSyncBlackList](const QString &etag) {
+        _rootEtagJob->disconnect(this);
+        _rootEtagJob.clear();
+        _syncStatistics.addPhaseTime(SyncStatistics::RemoteDiscovery, timer.elapsed());
+        if (etag == _cleanRootEtag) {
+            finishWithoutChanges(etag);
+        } else {
+            qCInfo(lcEngine) << "Root etag changed from" << _cleanRootEtag << "to" << etag;
+            _cleanRootEtag.clear();
+            startDiscovery(selectiveSyncBlackList);
+        }
+    });
+    // Errors and unexpected replies end the job without an etag: sync normally
+    connect(_rootEtagJob.data(), &QObject::destroyed, this, [this, selectiveSyncBlackList]() {
+        qCInfo(lcEngine) << "Could not check the root etag, discovering all changes";
+        _cleanRootEtag.clear();
+        startDiscovery(selectiveSyncBlackList);
+    });
+    _rootEtagJob->start();
+}
+
+void SyncEngine::startDiscovery(const QStringList &selectiveSyncBlackList)
+{
     // Usually the discovery runs in the background: We want to avoid
     // stealing too much time from other processes that the user might
     // be interacting with at the time.
@@ -899,6 +1075,7 @@ void SyncEngine::startSync()
         connect(_discoveryMainThread.data(), &DiscoveryMainThread::etagConcatenation, this, &SyncEngine::slotRootEtagReceived);
     }
 
+    bool ok = false;
     auto *discoveryJob = new DiscoveryJob(_csync_ctx.data());
     discoveryJob->_selectiveSyncBlackList = selectiveSyncBlackList;
     discoveryJob->_selectiveSyncWhiteList =
@@ -912,6 +1089,18 @@ void SyncEngine::startSync()
     }
 
     discoveryJob->_syncOptions = _syncOptions;
+    // The delta is only complete if changes propagate up to the root, see csync_update_remote_from_delta
+    if (_syncOptions._incrementalRemoteDiscovery && !_remoteDeltaUnsupported
+        && account()->rootEtagChangesNotOnlySubFolderEtags()) {
+        discoveryJob->_useRemoteDelta = true;
+        _discoveryMainThread->_syncToken = _journal->syncToken();
+    }
+    // Only the etag of the root is known after a bulk listing, not the concatenation
+    if (_syncOptions._bulkInitialDiscovery && _journal->isMetadataTableEmpty()
+        && account()->rootEtagChangesNotOnlySubFolderEtags()) {
+        discoveryJob->_useBulkDiscovery = true;
+    }
+    _hasItemErrors = false;
     discoveryJob->moveToThread(&_thread);
     connect(discoveryJob, &DiscoveryJob::finished, this, &SyncEngine::slotDiscoveryJobFinished);
     connect(discoveryJob, &DiscoveryJob::folderDiscovered,
@@ -953,6 +1142,22 @@ void SyncEngine::slotRootEtagReceived(const QString &e)
     }
 }
 
+void SyncEngine::finishWithoutChanges(const QString &rootEtag)
+{
+    qCInfo(lcEngine) << "#### Discovery skipped, the root etag is unchanged and no local changes were reported ####"
+                     << _stopWatch.addLapTime(QLatin1String("Discovery Finished")) << "ms";
+    _remoteRootEtag = rootEtag;
+    emit rootEtag(_remoteRootEtag);
+
+    // Nothing was propagated: there are no stale upload or download infos,
+    // conflict records or files to clean up in the journal
+    _progressInfo->_lastCompletedItem = SyncFileItem();
+    _progressInfo->_status = ProgressInfo::Done;
+    emit transmissionProgress(*_progressInfo);
+
+    finalize(true);
+}
+
 void SyncEngine::slotNewItem(const SyncFileItemPtr &item)
 {
     _progressInfo->adjustTotalsForFile(*item);
@@ -965,6 +1170,8 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
         return;
     }
     qCInfo(lcEngine) << "#### Discovery end #################################################### " << _stopWatch.addLapTime(QLatin1String("Discovery Finished")) << "ms";
+    _syncStatistics.addPhaseTime(SyncStatistics::LocalDiscovery, _csync_ctx->local_discovery_msecs);
+    _syncStatistics.addPhaseTime(SyncStatistics::RemoteDiscovery, _csync_ctx->remote_discovery_msecs);
 
     // Sanity check
     if (!_journal->isConnected()) {
@@ -982,10 +1189,13 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     _progressInfo->_status = ProgressInfo::Reconcile;
     emit transmissionProgress(*_progressInfo);
 
+    QElapsedTimer phaseTimer;
+    phaseTimer.start();
     if (csync_reconcile(_csync_ctx.data()) < 0) {
         handleSyncError(_csync_ctx.data(), "csync_reconcile");
         return;
     }
+    _syncStatistics.addPhaseTime(SyncStatistics::Reconcile, phaseTimer.restart());
 
     qCInfo(lcEngine) << "#### Reconcile end #################################################### " << _stopWatch.addLapTime(QLatin1String("Reconcile Finished")) << "ms";
 
@@ -993,30 +1203,22 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     _hasRemoveFile = false;
     _hasForwardInTimeFiles = false;
     _backInTimeFiles = 0;
-    bool walkOk = true;
     _seenFiles.clear();
     _temporarilyUnavailablePaths.clear();
     _renamedFolders.clear();
 
-    if (csync_walk_local_tree(_csync_ctx.data(), [this](csync_file_stat_t *f, csync_file_stat_t *o) { return treewalkFile(f, o, false); }) < 0) {
-        qCWarning(lcEngine) << "Error in local treewalk.";
-        walkOk = false;
-    }
-    if (walkOk && csync_walk_remote_tree(_csync_ctx.data(), [this](csync_file_stat_t *f, csync_file_stat_t *o) { return treewalkFile(f, o, true); }) < 0) {
-        qCWarning(lcEngine) << "Error in remote treewalk.";
-    }
+    SyncFileItemVector syncItems = walkTrees();
 
     qCInfo(lcEngine) << "Permissions of the root folder: " << _csync_ctx->remote.root_perms.toString();
 
-    // The map was used for merging trees, convert it to a list:
-    SyncFileItemVector syncItems = _syncItemMap.values().toVector();
-    _syncItemMap.clear(); // free memory
-
     // Adjust the paths for the renames.
-    for (SyncFileItemVector::iterator it = syncItems.begin();
-         it != syncItems.end(); ++it) {
-        (*it)->_file = adjustRenamedPath((*it)->_file);
+    if (!_renamedFolders.isEmpty()) {
+        for (SyncFileItemVector::iterator it = syncItems.begin();
+             it != syncItems.end(); ++it) {
+            (*it)->_file = adjustRenamedPath((*it)->_file);
+        }
     }
+    _syncStatistics.addPhaseTime(SyncStatistics::TreeWalk, phaseTimer.elapsed());
 
     // Check for invalid character in old server version
     QString invalidFilenamePattern = _account->capabilities().invalidFilenameRegex();
@@ -1079,51 +1281,32 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     int lastChangeInstruction = 0;
     int lastDeleteInstruction = 0;
 
-    // Only if list is populated, can be empty under certain circumstances
-    // Get CHANGE instructions to the top first
-    if (syncItems.count() > 0) {
-        std::sort(syncItems.begin(), syncItems.end(),
-            [](SyncFileItemVector::const_reference &a, SyncFileItemVector::const_reference &b) -> bool {
-				return ((a->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE) && (b->_instruction != CSYNC_INSTRUCTION_TYPE_CHANGE));
-            });
-        if (syncItems.at(0)->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE) {
-            hasChange = true;
-            lastChangeInstruction = std::distance(syncItems.begin(), std::find_if(syncItems.begin(), syncItems.end(), [](SyncFileItemVector::const_reference &a) -> bool { return a->_instruction != CSYNC_INSTRUCTION_TYPE_CHANGE; }));
-        }
-        if (hasChange) {
-            std::sort(syncItems.begin(), syncItems.begin() + lastChangeInstruction);
-            if (syncItems.count() > lastChangeInstruction) {
-                std::sort(syncItems.begin() + (lastChangeInstruction + 1), syncItems.end(),
-                    [](SyncFileItemVector::const_reference &a, SyncFileItemVector::const_reference &b) -> bool {
-                        return ((a->_instruction == CSYNC_INSTRUCTION_REMOVE) && (b->_instruction != CSYNC_INSTRUCTION_REMOVE));
-                    });
-                if (syncItems.at(lastChangeInstruction + 1)->_instruction == CSYNC_INSTRUCTION_REMOVE) {
-                    hasDelete = true;
-                    lastDeleteInstruction = std::distance(syncItems.begin(), std::find_if(syncItems.begin() + (lastChangeInstruction + 1), syncItems.end(), [](SyncFileItemVector::const_reference &a) -> bool { return a->_instruction != CSYNC_INSTRUCTION_REMOVE; }));
-                    std::sort(syncItems.begin() + (lastChangeInstruction + 1), syncItems.begin() + lastDeleteInstruction);
-                    if (syncItems.count() > lastDeleteInstruction) {
-                        std::sort(syncItems.begin() + (lastDeleteInstruction + 1), syncItems.end());
-                    }
-                } else {
-                    std::sort(syncItems.begin() + (lastChangeInstruction + 1), syncItems.end());
-                }
-            }
-        } else if (syncItems.at(0)->_instruction == CSYNC_INSTRUCTION_REMOVE) {
-            hasDelete = true;
-            lastDeleteInstruction = std::distance(syncItems.begin(), std::find_if(syncItems.begin(), syncItems.end(), [](SyncFileItemVector::const_reference &a) -> bool { return a->_instruction != CSYNC_INSTRUCTION_REMOVE; }));
-            std::sort(syncItems.begin(), syncItems.begin() + lastDeleteInstruction);
-			if (syncItems.count() > lastDeleteInstruction) {
-                std::sort(syncItems.begin() + (lastDeleteInstruction + 1), syncItems.end());
-            }
-        } else {
-            std::sort(syncItems.begin(), syncItems.end());
-        }
+    phaseTimer.restart();
+
+    // The items are ordered by their paths unless folder renames adjusted them
+    if (!std::is_sorted(syncItems.begin(), syncItems.end())) {
+        std::stable_sort(syncItems.begin(), syncItems.end());
     }
 
-    //std::sort(syncItems.begin(), syncItems.end());
+    // Get CHANGE instructions to the top first, then the REMOVE ones. The
+    // partitions keep the path order within each group.
+    auto removesBegin = std::stable_partition(syncItems.begin(), syncItems.end(),
+        [](SyncFileItemVector::const_reference &a) { return a->_instruction == CSYNC_INSTRUCTION_TYPE_CHANGE; });
+    auto othersBegin = std::stable_partition(removesBegin, syncItems.end(),
+        [](SyncFileItemVector::const_reference &a) { return a->_instruction == CSYNC_INSTRUCTION_REMOVE; });
+    if (removesBegin != syncItems.begin()) {
+        hasChange = true;
+        lastChangeInstruction = std::distance(syncItems.begin(), removesBegin);
+    }
+    if (othersBegin != removesBegin) {
+        hasDelete = true;
+        lastDeleteInstruction = std::distance(syncItems.begin(), othersBegin);
+    }
+    _syncStatistics.addPhaseTime(SyncStatistics::Sort, phaseTimer.restart());
 
     // make sure everything is allowed
     checkForPermission(syncItems);
+    _syncStatistics.addPhaseTime(SyncStatistics::CheckForPermission, phaseTimer.elapsed());
 
     // Re-init the csync context to free memory
     _csync_ctx->reinitialize();
@@ -1150,7 +1333,9 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     }
 
     // do a database commit
+    phaseTimer.restart();
     _journal->commit("post treewalk");
+    _syncStatistics.addPhaseTime(SyncStatistics::JournalCommit, phaseTimer.elapsed());
 
     _propagator = QSharedPointer<OwncloudPropagator>(
         new OwncloudPropagator(_account, _localPath, _remotePath, _journal));
@@ -1172,12 +1357,15 @@ void SyncEngine::slotDiscoveryJobFinished(int discoveryResult)
     deleteStaleDownloadInfos(syncItems);
     deleteStaleUploadInfos(syncItems);
     deleteStaleErrorBlacklistEntries(syncItems);
+    phaseTimer.restart();
     _journal->commit("post stale entry removal");
+    _syncStatistics.addPhaseTime(SyncStatistics::JournalCommit, phaseTimer.elapsed());
 
     // Emit the started signal only after the propagator has been set up.
     if (_needsUpdate)
         emit(started());
 
+    _propagationTimer.start();
     _propagator->start(syncItems, hasChange, lastChangeInstruction, hasDelete, lastDeleteInstruction);
 
     qCInfo(lcEngine) << "#### Post-Reconcile end #################################################### " << _stopWatch.addLapTime(QLatin1String("Post-Reconcile Finished")) << "ms";
@@ -1216,27 +1404,59 @@ void SyncEngine::slotItemCompleted(const SyncFileItemPtr &item)
         csyncError(item->_errorString);
     }
 
+    switch (item->_status) {
+    case SyncFileItem::FatalError:
+    case SyncFileItem::NormalError:
+    case SyncFileItem::SoftError:
+    case SyncFileItem::DetailError:
+    case SyncFileItem::BlacklistedError:
+    case SyncFileItem::FileLocked:
+        _hasItemErrors = true;
+        break;
+    default:
+        break;
+    }
+
     emit transmissionProgress(*_progressInfo);
     emit itemCompleted(item);
 }
 
 void SyncEngine::slotFinished(bool success)
 {
+    _syncStatistics.addPhaseTime(SyncStatistics::Propagation, _propagationTimer.elapsed());
+
     if (_propagator->_anotherSyncNeeded && _anotherSyncNeeded == NoFollowUpSync) {
         _anotherSyncNeeded = ImmediateFollowUp;
     }
 
     if (success) {
         _journal->setDataFingerprint(_discoveryMainThread->_dataFingerprint);
+        _journal->setExcludesFingerprint(_excludedFiles->fingerprint());
+    }
+
+    // The next delta must still contain what failed this time
+    if (_discoveryMainThread->_remoteDeltaUnsupported) {
+        _remoteDeltaUnsupported = true;
+        _journal->setSyncToken(QByteArray());
+    } else if (success && !_hasItemErrors && !_discoveryMainThread->_newSyncToken.isEmpty()) {
+        _journal->setSyncToken(_discoveryMainThread->_newSyncToken);
     }
 
+    QElapsedTimer commitTimer;
+    commitTimer.start();
     if (!_journal->postSyncCleanup(_seenFiles, _temporarilyUnavailablePaths)) {
         qCDebug(lcEngine) << "Cleaning of synced ";
     }
 
     conflictRecordMaintenance();
 
+    // The next sync can skip the discovery if the root etag stays the same
+    if (success && !_hasItemErrors && _anotherSyncNeeded == NoFollowUpSync) {
+        _cleanRootEtag = _remoteRootEtag;
+    }
+
     _journal->commit("All Finished.", false);
+    _syncStatistics.addPhaseTime(SyncStatistics::JournalCommit, commitTimer.elapsed());
 
     // Send final progress information even if no
     // files needed propagation, but clear the lastCompletedItem
@@ -1259,6 +1479,9 @@ void SyncEngine::finalize(bool success)
     qCInfo(lcEngine) << "CSync run took " << _stopWatch.addLapTime(QLatin1String("Sync Finished")) << "ms";
     _stopWatch.stop();
 
+    _syncStatistics.finish();
+    qCInfo(lcEngine) << "Sync statistics:" << QJsonDocument(_syncStatistics.toJson()).toJson(QJsonDocument::Compact);
+
     s_anySyncRunning = false;
     _syncRunning = false;
     emit finished(success);
@@ -1307,6 +1530,19 @@ void SyncEngine::checkForPermission(SyncFileItemVector &syncItems)
     std::sort(selectiveSyncBlackList.begin(), selectiveSyncBlackList.end());
     SyncFileItemPtr needle;
 
+    // Many items share the same few parent directories (think of a bulk upload into a
+    // shared folder), so the permissions of directories are looked up only once per
+    // sync run. The remote tree doesn't change while this function runs.
+    QHash<QString, RemotePermissions> directoryPermissions;
+    auto getDirectoryPermissions = [&](const QString &dir) {
+        auto cached = directoryPermissions.constFind(dir);
+        if (cached != directoryPermissions.constEnd())
+            return *cached;
+        const auto perms = getPermissions(dir);
+        directoryPermissions.insert(dir, perms);
+        return perms;
+    };
+
     for (SyncFileItemVector::iterator it = syncItems.begin(); it != syncItems.end(); ++it) {
         if ((*it)->_direction != SyncFileItem::Up
             || !isFileModifyingInstruction((*it)->_instruction)) {
@@ -1372,7 +1608,7 @@ void SyncEngine::checkForPermission(SyncFileItemVector &syncItems)
         case CSYNC_INSTRUCTION_NEW: {
             int slashPos = (*it)->_file.lastIndexOf('/');
             QString parentDir = slashPos <= 0 ? "" : (*it)->_file.mid(0, slashPos);
-            const auto perms = getPermissions(parentDir);
+            const auto perms = getDirectoryPermissions(parentDir);
             if (perms.isNull()) {
                 // No permissions set
                 break;
@@ -1491,7 +1727,7 @@ void SyncEngine::checkForPermission(SyncFileItemVector &syncItems)
         case CSYNC_INSTRUCTION_RENAME: {
             int slashPos = (*it)->_renameTarget.lastIndexOf('/');
             const QString parentDir = slashPos <= 0 ? "" : (*it)->_renameTarget.mid(0, slashPos);
-            const auto destPerms = getPermissions(parentDir);
+            const auto destPerms = getDirectoryPermissions(parentDir);
             const auto filePerms = getPermissions((*it)->_file);
 
             //true when it is just a rename in the same directory. (not a move)
@@ -1713,6 +1949,17 @@ void SyncEngine::abort()
     // Sets a flag for the update phase
     csync_request_abort(_csync_ctx.data());
 
+    // Aborts the root etag check
+    if (_rootEtagJob) {
+        _rootEtagJob->disconnect(this);
+        _rootEtagJob->deleteLater();
+        _rootEtagJob.clear();
+        qCInfo(lcEngine) << "Root etag check was aborted by user!";
+        // Like for an aborted discovery, finished() is emitted after abort() returned
+        QTimer::singleShot(0, this, [this]() { finalize(false); });
+        return;
+    }
+
     // Aborts the discovery phase job
     if (_discoveryMainThread) {
         _discoveryMainThread->abort();
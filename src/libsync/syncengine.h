@@ -39,6 +39,7 @@
 #include "accountfwd.h"
 #include "discoveryphase.h"
 #include "common/checksums.h"
+#include "syncstatistics.h"
 
 class QProcess;
 
@@ -47,6 +48,7 @@ namespace OCC {
 class SyncJournalFileRecord;
 class SyncJournalDb;
 class OwncloudPropagator;
+class RequestEtagJob;
 
 enum AnotherSyncNeeded {
     NoFollowUpSync,
@@ -82,6 +84,8 @@ public:
 
     ExcludedFiles &excludedFiles() { return *_excludedFiles; }
     Utility::StopWatch &stopWatch() { return _stopWatch; }
+    /** Phase timings and counters of the current or last sync, complete once finished() was emitted */
+    const SyncStatistics &syncStatistics() const { return _syncStatistics; }
     SyncFileStatusTracker &syncFileStatusTracker() { return *_syncFileStatusTracker; }
 
     /* Returns whether another sync is needed to complete the sync */
@@ -198,12 +202,31 @@ private slots:
     void slotInsufficientRemoteStorage();
 
 private:
+    /**
+     * Whether a sync may be finished early if the remote root etag is still
+     * the one of the last clean sync.
+     *
+     * Only if the caller vouched that nothing changed locally by asking for
+     * a DatabaseAndFilesystem discovery without any paths.
+     */
+    bool canSkipDiscovery();
+
+    // Requests the remote root etag and continues with startDiscovery() if it changed
+    void checkRemoteRootEtag(const QStringList &selectiveSyncBlackList);
+    void startDiscovery(const QStringList &selectiveSyncBlackList);
+
+    // Ends a sync that found no changes without running discovery and reconcile
+    void finishWithoutChanges(const QString &rootEtag);
+
     void handleSyncError(CSYNC *ctx, const char *state);
     void csyncError(const QString &message);
 
     QString journalDbFilePath() const;
 
-    int treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other, bool);
+    int treewalkFile(csync_file_stat_t *file, csync_file_stat_t *other, bool remote, SyncFileItemPtr &item);
+
+    // Merges the local and remote trees into SyncFileItems, ordered by path
+    SyncFileItemVector walkTrees();
     bool checkErrorBlacklisting(SyncFileItem &item);
 
     // Cleans up unnecessary downloadinfo entries in the journal as well
@@ -224,9 +247,6 @@ private:
 
     static bool s_anySyncRunning; //true when one sync is running somewhere (for debugging)
 
-    // Must only be acessed during update and reconcile
-    QMap<QString, SyncFileItemPtr> _syncItemMap;
-
     AccountPtr _account;
     QScopedPointer<CSYNC> _csync_ctx;
     bool _needsUpdate;
@@ -234,6 +254,9 @@ private:
     QString _localPath;
     QString _remotePath;
     QString _remoteRootEtag;
+    // The remote root etag of the last sync that completed without errors or pending follow-ups
+    QString _cleanRootEtag;
+    QPointer<RequestEtagJob> _rootEtagJob;
     SyncJournalDb *_journal;
     QPointer<DiscoveryMainThread> _discoveryMainThread;
     QSharedPointer<OwncloudPropagator> _propagator;
@@ -259,6 +282,8 @@ private:
     QScopedPointer<ExcludedFiles> _excludedFiles;
     QScopedPointer<SyncFileStatusTracker> _syncFileStatusTracker;
     Utility::StopWatch _stopWatch;
+    SyncStatistics _syncStatistics;
+    QElapsedTimer _propagationTimer;
 
     // maps the origin and the target of the folders that have been renamed
     QHash<QString, QString> _renamedFolders;
@@ -279,6 +304,12 @@ private:
     // true if there is at least one file which was not changed on the server
     bool _hasNoneFiles;
 
+    // true if an item failed or was skipped in this sync, the sync-token must not advance
+    bool _hasItemErrors = false;
+
+    // true once the server failed to report the changes since a sync-token
+    bool _remoteDeltaUnsupported = false;
+
     // true if there is at leasr one file with instruction REMOVE
     bool _hasRemoveFile;
 
@@ -35,7 +35,7 @@ SyncJournalFileRecord SyncFileItem::toSyncJournalFileRecordWithInode(const QStri
     rec._remotePerm = _remotePerm;
     rec._serverHasIgnoredFiles = _serverHasIgnoredFiles;
     rec._checksumHeader = _checksumHeader;
-    rec._e2eMangledName = _encryptedFileName.toUtf8();
+    rec._e2eMangledName = encryptedFileName().toUtf8();
 
     // Go through csync vio just to get the inode.
     csync_file_stat_t fs;
@@ -55,7 +55,7 @@ SyncJournalFileRecord SyncFileItem::toSyncJournalFileRecordWithInode(const QStri
 
 SyncFileItemPtr SyncFileItem::fromSyncJournalFileRecord(const SyncJournalFileRecord &rec)
 {
-    SyncFileItemPtr item(new SyncFileItem);
+    auto item = SyncFileItemPtr::create();
     item->_file = QString::fromUtf8(rec._path);
     item->_inode = rec._inode;
     item->_modtime = rec._modtime;
@@ -66,7 +66,7 @@ SyncFileItemPtr SyncFileItem::fromSyncJournalFileRecord(const SyncJournalFileRec
     item->_remotePerm = rec._remotePerm;
     item->_serverHasIgnoredFiles = rec._serverHasIgnoredFiles;
     item->_checksumHeader = rec._checksumHeader;
-    item->_encryptedFileName = QString::fromUtf8(rec._e2eMangledName);
+    item->setEncryptedFileName(QString::fromUtf8(rec._e2eMangledName));
     return item;
 }
 
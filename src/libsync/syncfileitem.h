@@ -20,6 +20,7 @@
 #include <QDateTime>
 #include <QMetaType>
 #include <QSharedPointer>
+#include <QSharedData>
 
 #include <csync.h>
 
@@ -190,14 +191,36 @@ public:
             && !(_instruction == CSYNC_INSTRUCTION_CONFLICT && _status == SyncFileItem::Success);
     }
 
+    /// Whether there's end to end encryption on this file.
+    /// If the file is encrypted, this is the encrypted name on the server.
+    QString encryptedFileName() const { return _extra ? _extra->_encryptedFileName : QString(); }
+    void setEncryptedFileName(const QString &name)
+    {
+        if (!_extra && name.isEmpty())
+            return;
+        extra()._encryptedFileName = name;
+    }
+
+    /// The url to download the file from instead of the WebDAV url, see csync_file_stat_t
+    QString directDownloadUrl() const { return _extra ? _extra->_directDownloadUrl : QString(); }
+    void setDirectDownloadUrl(const QString &url)
+    {
+        if (!_extra && url.isEmpty())
+            return;
+        extra()._directDownloadUrl = url;
+    }
+    QString directDownloadCookies() const { return _extra ? _extra->_directDownloadCookies : QString(); }
+    void setDirectDownloadCookies(const QString &cookies)
+    {
+        if (!_extra && cookies.isEmpty())
+            return;
+        extra()._directDownloadCookies = cookies;
+    }
+
     // Variables useful for everybody
     QString _file;
     QString _renameTarget;
 
-    /// Whether there's end to end encryption on this file.
-    /// If the file is encrypted, the _encryptedFilename is
-    /// the encrypted name on the server.
-    QString _encryptedFileName;
     ItemType _type BITFIELD(3);
     Direction _direction BITFIELD(3);
     bool _serverHasIgnoredFiles BITFIELD(1);
@@ -245,8 +268,26 @@ public:
     quint64 _previousSize = 0;
     time_t _previousModtime = 0;
 
-    QString _directDownloadUrl;
-    QString _directDownloadCookies;
+private:
+    /**
+     * The members that are empty for almost every item. They are allocated
+     * on demand so the millions of items of a large sync stay small.
+     */
+    struct Extra : public QSharedData
+    {
+        QString _encryptedFileName;
+        QString _directDownloadUrl;
+        QString _directDownloadCookies;
+    };
+
+    Extra &extra()
+    {
+        if (!_extra)
+            _extra = new Extra;
+        return *_extra;
+    }
+
+    QSharedDataPointer<Extra> _extra;
 };
 
 inline bool operator<(const SyncFileItemPtr &item1, const SyncFileItemPtr &item2)
@@ -59,6 +59,46 @@ struct SyncOptions
 
     /** Whether parallel network jobs are allowed. */
     bool _parallelNetworkJobs = true;
+
+    /** Whether the remote discovery may ask the server for the changes since the
+     * previous sync (sync-collection REPORT) instead of walking the whole tree.
+     *
+     * Falls back to the full walk if the server doesn't support it.
+     */
+    bool _incrementalRemoteDiscovery = false;
+
+    /** Whether the first sync of a folder may list the remote tree with
+     * Depth:infinity PROPFINDs instead of one request per directory.
+     *
+     * Falls back to the regular listing where the server refuses it.
+     */
+    bool _bulkInitialDiscovery = false;
+
+    /** Whether new files whose content the server already has are created
+     * with a COPY of the known file instead of being uploaded.
+     *
+     * The source is found by content checksum in the journal, and the copy
+     * is checked before it is accepted. Falls back to the upload otherwise.
+     */
+    bool _serverSideCopy = false;
+
+    /** Whether new remote files whose content exists locally under another
+     * name are copied from that file instead of downloaded.
+     *
+     * Only used with collision safe checksums; the copy is validated against
+     * the remote checksum and downloaded if it does not match.
+     */
+    bool _localCopyForDownloads = false;
+
+    /** Whether large files that changed on the server are downloaded in parts,
+     * only fetching the blocks that differ from the local file.
+     *
+     * Needs block checksums from the server, see PropagateDownloadDelta.
+     */
+    bool _deltaDownloads = false;
+
+    /** The minimum size in bytes of files that are downloaded in parts */
+    quint64 _minDeltaDownloadSize = 10 * 1000 * 1000; // 10MB
 };
 
 
@@ -21,6 +21,7 @@
 
 #include "owncloudlib.h"
 #include "syncfileitem.h"
+#include "syncstatistics.h"
 
 namespace OCC {
 
@@ -85,6 +86,10 @@ public:
 
     void processCompletedItem(const SyncFileItemPtr &item);
 
+    /** Phase timings and counters of the sync, see SyncEngine::syncStatistics() */
+    const SyncStatistics &syncStatistics() const { return _syncStatistics; }
+    void setSyncStatistics(const SyncStatistics &statistics) { _syncStatistics = statistics; }
+
 private:
     Status _status = Undefined;
     SyncFileItemVector _syncItems;
@@ -114,6 +119,8 @@ private:
     SyncFileItemPtr _firstNewConflictItem;
     SyncFileItemPtr _firstItemError;
     SyncFileItemPtr _firstItemLocked;
+
+    SyncStatistics _syncStatistics;
 };
 }
 
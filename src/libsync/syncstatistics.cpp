@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "syncstatistics.h"
+
+#include <QJsonArray>
+
+namespace OCC {
+
+void SyncStatistics::start()
+{
+    *this = SyncStatistics();
+    _totalTimer.start();
+    // Temporarily store the baseline, finish() turns it into the delta
+    for (int i = 0; i < PerformanceCounters::CounterCount; ++i)
+        _counters[i] = PerformanceCounters::value(PerformanceCounters::Counter(i));
+    _jobLatencies = PerformanceCounters::jobLatencies();
+}
+
+void SyncStatistics::finish()
+{
+    if (!_totalTimer.isValid() || _finished)
+        return;
+    _totalMsecs = _totalTimer.elapsed();
+    for (int i = 0; i < PerformanceCounters::CounterCount; ++i)
+        _counters[i] = PerformanceCounters::value(PerformanceCounters::Counter(i)) - _counters[i];
+
+    const auto baseline = _jobLatencies;
+    _jobLatencies.clear();
+    const auto current = PerformanceCounters::jobLatencies();
+    for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+        auto delta = it.value().minus(baseline.value(it.key()));
+        if (delta.count > 0)
+            _jobLatencies.insert(it.key(), delta);
+    }
+    _finished = true;
+}
+
+QJsonObject SyncStatistics::toJson() const
+{
+    QJsonObject phases;
+    for (int i = 0; i < PhaseCount; ++i)
+        phases.insert(QLatin1String(phaseName(Phase(i))), _phaseMsecs[i]);
+
+    QJsonObject counters;
+    for (int i = 0; i < PerformanceCounters::CounterCount; ++i)
+        counters.insert(QLatin1String(PerformanceCounters::name(PerformanceCounters::Counter(i))), _counters[i]);
+
+    QJsonObject latencies;
+    for (auto it = _jobLatencies.constBegin(); it != _jobLatencies.constEnd(); ++it) {
+        const auto &histogram = it.value();
+        QJsonArray buckets;
+        for (auto bucket : histogram.buckets)
+            buckets.append(bucket);
+        QJsonObject job;
+        job.insert(QStringLiteral("count"), histogram.count);
+        job.insert(QStringLiteral("totalMsecs"), histogram.totalMsecs);
+        job.insert(QStringLiteral("p50UpperBoundMsecs"), histogram.quantileUpperBound(0.5));
+        job.insert(QStringLiteral("p90UpperBoundMsecs"), histogram.quantileUpperBound(0.9));
+        job.insert(QStringLiteral("log2MsecsBuckets"), buckets);
+        latencies.insert(QString::fromLatin1(it.key()), job);
+    }
+
+    QJsonObject result;
+    result.insert(QStringLiteral("totalMsecs"), _totalMsecs);
+    result.insert(QStringLiteral("phasesMsecs"), phases);
+    result.insert(QStringLiteral("counters"), counters);
+    result.insert(QStringLiteral("jobLatencies"), latencies);
+    return result;
+}
+
+const char *SyncStatistics::phaseName(Phase phase)
+{
+    switch (phase) {
+    case LocalDiscovery:
+        return "localDiscovery";
+    case RemoteDiscovery:
+        return "remoteDiscovery";
+    case Reconcile:
+        return "reconcile";
+    case TreeWalk:
+        return "treeWalk";
+    case Sort:
+        return "sort";
+    case CheckForPermission:
+        return "checkForPermission";
+    case Propagation:
+        return "propagation";
+    case JournalCommit:
+        return "journalCommit";
+    case PhaseCount:
+        break;
+    }
+    return "";
+}
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) by Nextcloud GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef SYNCSTATISTICS_H
+#define SYNCSTATISTICS_H
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QMap>
+
+#include "owncloudlib.h"
+#include "common/performancecounters.h"
+
+namespace OCC {
+
+/**
+ * @brief Timings and counters of one sync run
+ *
+ * The SyncEngine records how long each phase took. The counters and job latencies
+ * are the difference of the process wide PerformanceCounters between start() and
+ * finish(), which is accurate as long as only one sync runs at a time.
+ *
+ * @ingroup libsync
+ */
+class OWNCLOUDSYNC_EXPORT SyncStatistics
+{
+public:
+    enum Phase {
+        LocalDiscovery,
+        RemoteDiscovery,
+        Reconcile,
+        TreeWalk,
+        Sort,
+        CheckForPermission,
+        Propagation,
+        JournalCommit,
+
+        PhaseCount
+    };
+
+    /// Resets all values and takes the baseline of the counters
+    void start();
+    /// Computes the counter deltas since start()
+    void finish();
+
+    bool isValid() const { return _finished; }
+
+    void addPhaseTime(Phase phase, qint64 msecs) { _phaseMsecs[phase] += msecs; }
+    qint64 phaseTime(Phase phase) const { return _phaseMsecs[phase]; }
+    qint64 totalTime() const { return _totalMsecs; }
+
+    qint64 counter(PerformanceCounters::Counter counter) const { return _counters[counter]; }
+    const QMap<QByteArray, PerformanceCounters::LatencyHistogram> &jobLatencies() const { return _jobLatencies; }
+
+    QJsonObject toJson() const;
+
+    static const char *phaseName(Phase phase);
+
+private:
+    QElapsedTimer _totalTimer;
+    qint64 _totalMsecs = 0;
+    qint64 _phaseMsecs[PhaseCount] = {};
+    qint64 _counters[PerformanceCounters::CounterCount] = {};
+    QMap<QByteArray, PerformanceCounters::LatencyHistogram> _jobLatencies;
+    bool _finished = false;
+};
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+int numDirs = 0;
+int numFiles = 0;
+
+template<int filesPerDir, int dirPerDir, int maxDepth>
+void addBunchOfFiles(int depth, const QString &path, FileModifier &fi) {
+    for (int fileNum = 1; fileNum <= filesPerDir; ++fileNum) {
+        QString name = QStringLiteral("file") + QString::number(fileNum);
+        fi.insert(path.isEmpty() ? name : path + "/" + name);
+        numFiles++;
+    }
+    if (depth >= maxDepth)
+        return;
+    for (char dirNum = 1; dirNum <= dirPerDir; ++dirNum) {
+        QString name = QStringLiteral("dir") + QString::number(dirNum);
+        QString subPath = path.isEmpty() ? name : path + "/" + name;
+        fi.mkdir(subPath);
+        numDirs++;
+        addBunchOfFiles<filesPerDir, dirPerDir, maxDepth>(depth + 1, subPath, fi);
+    }
+}
+
+// Runs the first sync of a folder and reports the PROPFINDs it needed and
+// how long it took until the first download started.
+static bool initialSync(bool bulk)
+{
+    FakeFolder fakeFolder{ FileInfo{} };
+    fakeFolder.syncEngine().account()->setServerVersion("10.0.0");
+    fakeFolder.setServerPropfindDepthInfinityAllowed(true);
+    addBunchOfFiles<10, 8, 4>(0, "", fakeFolder.remoteModifier());
+    SyncOptions options;
+    options._bulkInitialDiscovery = bulk;
+    fakeFolder.syncEngine().setSyncOptions(options);
+
+    QElapsedTimer timer;
+    int propfinds = 0;
+    qint64 firstTransfer = -1;
+    fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+        if (request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() == "PROPFIND")
+            ++propfinds;
+        else if (op == QNetworkAccessManager::GetOperation && firstTransfer < 0)
+            firstTransfer = timer.elapsed();
+        return nullptr;
+    });
+
+    timer.start();
+    bool result = fakeFolder.syncOnce();
+    qDebug() << (bulk ? "BULK" : "PER DIRECTORY") << result
+             << "PROPFINDS:" << propfinds
+             << "FIRST TRANSFER:" << firstTransfer
+             << "TOTAL:" << timer.elapsed();
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    bool result1 = initialSync(false);
+    qDebug() << "NUMFILES" << numFiles;
+    qDebug() << "NUMDIRS" << numDirs;
+    bool result2 = initialSync(true);
+    return (result1 && result2) ? 0 : -1;
+}
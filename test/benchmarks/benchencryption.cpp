@@ -0,0 +1,113 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtCore>
+
+#include <openssl/evp.h>
+
+#include "clientsideencryption.h"
+
+using namespace OCC;
+
+/*
+ * Reference implementation of the previous file encryption: 1 KiB reads
+ * and a freshly allocated QByteArray per block.
+ */
+static bool smallBlockEncryption(const QByteArray &key, const QByteArray &iv, QFile *input, QFile *output)
+{
+    input->open(QIODevice::ReadOnly);
+    output->open(QIODevice::WriteOnly);
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), nullptr, nullptr, nullptr);
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, iv.size(), nullptr);
+    EVP_EncryptInit_ex(ctx, nullptr, nullptr, (const unsigned char *)key.constData(), (const unsigned char *)iv.constData());
+    QByteArray out(1024 + 16 - 1, '\0');
+    int len = 0;
+    bool ok = true;
+    while (ok && !input->atEnd()) {
+        QByteArray data = input->read(1024);
+        ok = EVP_EncryptUpdate(ctx, (unsigned char *)out.data(), &len, (const unsigned char *)data.constData(), data.size());
+        output->write(out, len);
+    }
+    ok = ok && EVP_EncryptFinal_ex(ctx, (unsigned char *)out.data(), &len);
+    output->write(out, len);
+    QByteArray tag(16, '\0');
+    ok = ok && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, 16, (unsigned char *)tag.data());
+    output->write(tag);
+    EVP_CIPHER_CTX_free(ctx);
+    input->close();
+    output->close();
+    return ok;
+}
+
+static double mbPerSecond(qint64 bytes, qint64 msecs)
+{
+    return msecs > 0 ? (bytes / (1024.0 * 1024.0)) / (msecs / 1000.0) : 0;
+}
+
+/*
+ * Measures the throughput of the end-to-end encryption file pipeline.
+ *
+ * Usage: EncryptionBench [sizeInMB]
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const qint64 size = (argc > 1 ? QByteArray(argv[1]).toLongLong() : 512) * 1024 * 1024;
+
+    QTemporaryDir tempDir;
+    const QString plainPath = tempDir.path() + "/plain";
+    const QString encryptedPath = tempDir.path() + "/encrypted";
+    const QString referencePath = tempDir.path() + "/reference";
+    const QString decryptedPath = tempDir.path() + "/decrypted";
+
+    {
+        QFile plain(plainPath);
+        plain.open(QIODevice::WriteOnly);
+        QByteArray block(1024 * 1024, Qt::Uninitialized);
+        for (int i = 0; i < block.size(); ++i)
+            block[i] = static_cast<char>(i * 31 + 7);
+        for (qint64 written = 0; written < size; written += block.size())
+            plain.write(block.constData(), qMin<qint64>(block.size(), size - written));
+    }
+
+    const QByteArray key = EncryptionHelper::generateRandom(16);
+    const QByteArray iv = EncryptionHelper::generateRandom(16);
+    QElapsedTimer timer;
+    bool ok = true;
+
+    {
+        QFile input(plainPath);
+        QFile output(referencePath);
+        timer.start();
+        ok = smallBlockEncryption(key, iv, &input, &output) && ok;
+        qDebug() << "ENCRYPT (1 KiB blocks):" << mbPerSecond(size, timer.elapsed()) << "MB/s";
+    }
+    {
+        QFile input(plainPath);
+        QFile output(encryptedPath);
+        QByteArray tag;
+        timer.start();
+        ok = EncryptionHelper::fileEncryption(key, iv, &input, &output, tag) && ok;
+        qDebug() << "ENCRYPT:" << mbPerSecond(size, timer.elapsed()) << "MB/s";
+    }
+    {
+        QFile input(encryptedPath);
+        QFile output(decryptedPath);
+        timer.start();
+        ok = EncryptionHelper::fileDecryption(key, iv, &input, &output) && ok;
+        qDebug() << "DECRYPT:" << mbPerSecond(size, timer.elapsed()) << "MB/s";
+    }
+    {
+        QFile file(encryptedPath);
+        timer.start();
+        ok = EncryptionHelper::fileDecryptionInPlace(key, iv, &file) && ok;
+        qDebug() << "DECRYPT IN PLACE:" << mbPerSecond(size, timer.elapsed()) << "MB/s";
+    }
+
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,119 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtCore>
+
+#include "csync/vio/csync_vio_local.h"
+#include "common/performancecounters.h"
+
+#include <dirent.h>
+
+using namespace OCC;
+
+/*
+ * Creates a deep local tree and reads it with the local vio, the way the
+ * local discovery does, and reports the entries stat'ed per second.
+ * For comparison it also reads the tree stat'ing every entry by its full
+ * path, like the vio did before it used the directory fd.
+ *
+ * Usage: LocalDiscoveryBench [filesPerDir] [depth] [existing tree]
+ */
+
+// Three subdirectories per directory, depth levels deep
+static int createTree(const QString &dir, int filesPerDir, int depth)
+{
+    int entries = 0;
+    for (int i = 0; i < filesPerDir; ++i) {
+        QFile f(dir + QStringLiteral("/file") + QString::number(i));
+        if (!f.open(QFile::WriteOnly))
+            qFatal("Could not create %s", qPrintable(f.fileName()));
+        f.write("content");
+        ++entries;
+    }
+    if (depth == 0)
+        return entries;
+    for (int i = 0; i < 3; ++i) {
+        const QString sub = dir + QStringLiteral("/dir") + QString::number(i);
+        QDir().mkdir(sub);
+        entries += 1 + createTree(sub, filesPerDir, depth - 1);
+    }
+    return entries;
+}
+
+static int readWithVio(const QByteArray &dir)
+{
+    int entries = 0;
+    auto dh = csync_vio_local_opendir(dir.constData());
+    if (!dh)
+        return 0;
+    while (auto fs = csync_vio_local_readdir(dh)) {
+        ++entries;
+        if (fs->type == ItemTypeDirectory)
+            entries += readWithVio(dir + '/' + fs->path);
+    }
+    csync_vio_local_closedir(dh);
+    return entries;
+}
+
+static int readWithFullPaths(const QByteArray &dir)
+{
+    int entries = 0;
+    DIR *dh = opendir(dir.constData());
+    if (!dh)
+        return 0;
+    while (struct dirent *dirent = readdir(dh)) {
+        if (qstrcmp(dirent->d_name, ".") == 0 || qstrcmp(dirent->d_name, "..") == 0)
+            continue;
+        const QByteArray fullPath = dir + '/' + dirent->d_name;
+        struct stat sb;
+        if (lstat(fullPath.constData(), &sb) < 0)
+            continue;
+        ++entries;
+        if (S_ISDIR(sb.st_mode))
+            entries += readWithFullPaths(fullPath);
+    }
+    closedir(dh);
+    return entries;
+}
+
+static void report(const char *name, const std::function<int()> &read)
+{
+    const qint64 statsBefore = PerformanceCounters::value(PerformanceCounters::StatCalls);
+    QElapsedTimer timer;
+    timer.start();
+    const int entries = read();
+    const qint64 msecs = qMax<qint64>(1, timer.elapsed());
+    qDebug() << name << "ENTRIES:" << entries << "in" << msecs << "ms"
+             << "ENTRIES/S:" << entries * 1000 / msecs
+             << "STAT CALLS:" << PerformanceCounters::value(PerformanceCounters::StatCalls) - statsBefore;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int filesPerDir = argc > 1 ? QByteArray(argv[1]).toInt() : 50;
+    const int depth = argc > 2 ? QByteArray(argv[2]).toInt() : 6;
+
+    QTemporaryDir tempDir;
+    QString root = tempDir.path();
+    if (argc > 3) {
+        root = QString::fromLocal8Bit(argv[3]);
+    } else {
+        QElapsedTimer timer;
+        timer.start();
+        const int entries = createTree(root, filesPerDir, depth);
+        qDebug() << "CREATED:" << entries << "entries in" << timer.elapsed() << "ms";
+    }
+    const QByteArray rootPath = root.toUtf8();
+
+    // The first run warms the dentry and inode caches for both
+    for (int run = 0; run < 3; ++run) {
+        report("VIO", [&] { return readWithVio(rootPath); });
+        report("FULLPATH", [&] { return readWithFullPaths(rootPath); });
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtCore>
+
+#include "csync/vio/csync_vio_local.h"
+#include "common/filesystembase.h"
+#include "common/iouring.h"
+
+using namespace OCC;
+
+/*
+ * Compares the local I/O with io_uring to the plain syscalls: stat'ing a
+ * tree with the local vio and hashing large files.
+ *
+ * Usage: LocalIoBench [directory]
+ *
+ * Without a directory a tree of 20000 files and four 256 MiB files are
+ * created in a temporary directory. The page cache hides the device, drop
+ * it between the runs to measure that (echo 3 > /proc/sys/vm/drop_caches).
+ */
+
+static int readTree(const QByteArray &dir, QStringList *largeFiles)
+{
+    int entries = 0;
+    auto dh = csync_vio_local_opendir(dir.constData());
+    if (!dh)
+        return 0;
+    while (auto fs = csync_vio_local_readdir(dh)) {
+        ++entries;
+        const QByteArray path = dir + '/' + fs->path;
+        if (fs->type == ItemTypeDirectory)
+            entries += readTree(path, largeFiles);
+        else if (fs->type == ItemTypeFile && fs->size >= 64 * 1024 * 1024 && largeFiles)
+            largeFiles->append(QString::fromUtf8(path));
+    }
+    csync_vio_local_closedir(dh);
+    return entries;
+}
+
+static void createFiles(const QString &root)
+{
+    for (int dir = 0; dir < 200; ++dir) {
+        const QString dirPath = root + QStringLiteral("/dir") + QString::number(dir);
+        QDir().mkdir(dirPath);
+        for (int i = 0; i < 100; ++i) {
+            QFile f(dirPath + QStringLiteral("/file") + QString::number(i));
+            if (!f.open(QFile::WriteOnly))
+                qFatal("Could not create %s", qPrintable(f.fileName()));
+            f.write("content");
+        }
+    }
+    QByteArray block(1024 * 1024, 'x');
+    for (int i = 0; i < 4; ++i) {
+        QFile f(root + QStringLiteral("/large") + QString::number(i));
+        if (!f.open(QFile::WriteOnly))
+            qFatal("Could not create %s", qPrintable(f.fileName()));
+        for (int mb = 0; mb < 256; ++mb) {
+            block[0] = char(mb);
+            f.write(block);
+        }
+    }
+}
+
+static void run(const char *name, const QByteArray &root)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QStringList largeFiles;
+    const int entries = readTree(root, &largeFiles);
+    const qint64 statMsecs = qMax<qint64>(1, timer.elapsed());
+
+    timer.restart();
+    qint64 bytes = 0;
+    for (const auto &file : qAsConst(largeFiles)) {
+        FileSystem::calcSha1(file);
+        bytes += FileSystem::getSize(file);
+    }
+    const qint64 hashMsecs = qMax<qint64>(1, timer.elapsed());
+
+    qDebug() << name << "STAT:" << entries << "entries in" << statMsecs << "ms"
+             << "ENTRIES/S:" << entries * 1000 / statMsecs
+             << "HASH:" << bytes / (1024 * 1024) << "MiB in" << hashMsecs << "ms"
+             << "MIB/S:" << bytes * 1000 / (1024 * 1024) / hashMsecs;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QTemporaryDir tempDir;
+    QString root = tempDir.path();
+    if (argc > 1) {
+        root = QString::fromLocal8Bit(argv[1]);
+    } else {
+        createFiles(root);
+    }
+    const QByteArray rootPath = root.toUtf8();
+
+    if (!IoUring::threadInstance())
+        qDebug() << "io_uring is not available, both runs use the plain syscalls";
+
+    for (int i = 0; i < 3; ++i) {
+        IoUring::setEnabled(false);
+        run("SYSCALLS", rootPath);
+        IoUring::setEnabled(true);
+        run("IO_URING", rootPath);
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtCore>
+
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+
+using namespace OCC;
+
+/*
+ * Fills a journal with numFiles records spread over directories of 1000 files
+ * and measures SyncJournalDb::postSyncCleanup() when 10% of the rows are stale
+ * and a number of selective sync style prefixes need to be honoured.
+ *
+ * Usage: PostSyncCleanupBench [numFiles] [numPrefixes]
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int numFiles = argc > 1 ? QByteArray(argv[1]).toInt() : 1000000;
+    const int numPrefixes = argc > 2 ? QByteArray(argv[2]).toInt() : 200;
+    const int filesPerDir = 1000;
+
+    QTemporaryDir tempDir;
+    SyncJournalDb db(tempDir.path() + "/sync.db");
+
+    QSet<QString> filesToKeep;
+    QSet<QString> prefixesToKeep;
+    filesToKeep.reserve(numFiles);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < numFiles; ++i) {
+        SyncJournalFileRecord record;
+        record._path = "dir" + QByteArray::number(i / filesPerDir) + "/file" + QByteArray::number(i);
+        record._etag = "etag";
+        db.setFileRecord(record);
+        // Every tenth file is stale, unless a prefix keeps it
+        if (i % 10 != 0)
+            filesToKeep.insert(QString::fromUtf8(record._path));
+    }
+    for (int i = 0; i < numPrefixes; ++i)
+        prefixesToKeep.insert(QStringLiteral("dir%1/").arg(i * 3));
+    db.commit("bench setup");
+    qDebug() << "SETUP:" << numFiles << "files" << numPrefixes << "prefixes" << timer.restart() << "ms";
+
+    bool ok = db.postSyncCleanup(filesToKeep, prefixesToKeep);
+    qDebug() << "POST SYNC CLEANUP:" << ok << timer.restart() << "ms";
+
+    // A second run has nothing left to delete and only measures the scan
+    ok = db.postSyncCleanup(filesToKeep, prefixesToKeep) && ok;
+    qDebug() << "POST SYNC CLEANUP (NOTHING TO DO):" << ok << timer.restart() << "ms";
+
+    return ok ? 0 : -1;
+}
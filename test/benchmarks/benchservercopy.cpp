@@ -0,0 +1,69 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+int numFiles = 0;
+
+// Creates the same files in every directory, like a copied project tree
+static void addBunchOfFiles(const QString &path, FileModifier &fi)
+{
+    fi.mkdir(path);
+    for (int fileNum = 1; fileNum <= 50; ++fileNum) {
+        QString name = path + QStringLiteral("/file") + QString::number(fileNum);
+        fi.insert(name, 10000 + fileNum, 'A' + fileNum % 26);
+        numFiles++;
+    }
+}
+
+// Uploads a tree, copies it locally a few times and reports the bytes
+// needed to sync the copies.
+static bool syncCopies(bool serverSideCopy)
+{
+    FakeFolder fakeFolder{ FileInfo{} };
+    SyncOptions options;
+    options._serverSideCopy = serverSideCopy;
+    fakeFolder.syncEngine().setSyncOptions(options);
+
+    addBunchOfFiles("original", fakeFolder.localModifier());
+    if (!fakeFolder.syncOnce())
+        return false;
+
+    qint64 uploadedBytes = 0;
+    int copies = 0;
+    fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+        if (op == QNetworkAccessManager::PutOperation && outgoingData)
+            uploadedBytes += outgoingData->size();
+        else if (request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() == "COPY")
+            ++copies;
+        return nullptr;
+    });
+    for (int i = 1; i <= 4; ++i)
+        addBunchOfFiles(QStringLiteral("copy") + QString::number(i), fakeFolder.localModifier());
+
+    QElapsedTimer timer;
+    timer.start();
+    bool result = fakeFolder.syncOnce();
+    qDebug() << (serverSideCopy ? "SERVER SIDE COPY" : "UPLOAD") << result
+             << "UPLOADED BYTES:" << uploadedBytes
+             << "COPIES:" << copies
+             << "TOTAL:" << timer.elapsed();
+    return result && fakeFolder.currentLocalState() == fakeFolder.currentRemoteState();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    bool result1 = syncCopies(false);
+    qDebug() << "NUMFILES" << numFiles;
+    bool result2 = syncCopies(true);
+    return (result1 && result2) ? 0 : -1;
+}
@@ -0,0 +1,85 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtCore>
+
+#include "syncfileitem.h"
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace OCC;
+
+/*
+ * Creates numItems SyncFileItems filled like the treewalk of a sync fills
+ * them and reports the memory used per item.
+ *
+ * Usage: SyncFileItemBench [numItems]
+ */
+
+// The bytes allocated on the heap, -1 if unknown
+static qint64 heapInUse()
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    return qint64(mallinfo2().uordblks);
+#elif defined(__GLIBC__)
+    return qint64(uint(mallinfo().uordblks));
+#else
+    return -1;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int numItems = argc > 1 ? QByteArray(argv[1]).toInt() : 1000000;
+    const int filesPerDir = 100;
+
+    // The paths of the csync tree, they are freed before the propagation
+    std::vector<QByteArray> paths;
+    paths.reserve(numItems);
+    for (int i = 0; i < numItems; ++i)
+        paths.push_back("top" + QByteArray::number(i / filesPerDir / 100) + "/dir" + QByteArray::number(i / filesPerDir) + "/file" + QByteArray::number(i));
+
+    const qint64 heapBefore = heapInUse();
+    QElapsedTimer timer;
+    timer.start();
+
+    SyncFileItemVector items;
+    items.reserve(numItems);
+    for (int i = 0; i < numItems; ++i) {
+        auto item = SyncFileItemPtr::create();
+        item->_file = QString::fromUtf8(paths[i]);
+        item->_originalFile = item->_file;
+        item->setEncryptedFileName(QString()); // like treewalkFile() for every item
+        item->_instruction = CSYNC_INSTRUCTION_NEW;
+        item->_type = ItemTypeFile;
+        item->_direction = SyncFileItem::Down;
+        item->_modtime = 1500000000 + i;
+        item->_size = 1000 + i;
+        item->_etag = QByteArray::number(i, 16);
+        item->_fileId = QByteArray::number(i).rightJustified(8, '0') + "ocabcdefgh";
+        items.append(item);
+    }
+    const qint64 createMsec = timer.elapsed();
+    const qint64 heapAfter = heapInUse();
+
+    qDebug() << "ITEMS:" << numItems << "in" << createMsec << "ms";
+    qDebug() << "SIZEOF SyncFileItem:" << sizeof(SyncFileItem) << "bytes";
+    if (heapBefore >= 0) {
+        qDebug() << "HEAP PER ITEM:" << double(heapAfter - heapBefore) / numItems << "bytes"
+                 << "(including the item vector and the strings)";
+    }
+
+    // Everything is released
+    timer.restart();
+    items.clear();
+    items.squeeze();
+    qDebug() << "FREE:" << timer.elapsed() << "ms";
+    return 0;
+}
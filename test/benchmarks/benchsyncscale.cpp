@@ -0,0 +1,150 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+#include <cmath>
+
+using namespace OCC;
+
+/*
+ * Syncs trees of the given numbers of files (default 100000) and writes the
+ * timings as JSON:
+ *
+ *   SyncScaleBench [-o results.json] [files...]
+ *
+ * Every scenario reports the wall time and the phase timings of the sync, so
+ * the discovery, reconcile and treewalk costs can be looked at separately.
+ */
+
+struct Tree
+{
+    int files = 0;
+    int dirs = 0;
+    QStringList topDirs;
+};
+
+// Spreads the files over directories of 100 files, two levels deep
+static Tree addTree(FileModifier &fi, int files)
+{
+    const int filesPerDir = 100;
+    const int leafDirs = (files + filesPerDir - 1) / filesPerDir;
+    const int topDirs = qMax(1, int(std::ceil(std::sqrt(double(leafDirs)))));
+
+    Tree tree;
+    for (int leaf = 0; leaf < leafDirs; ++leaf) {
+        const QString top = QStringLiteral("top") + QString::number(leaf % topDirs);
+        if (leaf < topDirs) {
+            fi.mkdir(top);
+            tree.topDirs.append(top);
+            tree.dirs++;
+        }
+        const QString dir = top + QStringLiteral("/dir") + QString::number(leaf / topDirs);
+        fi.mkdir(dir);
+        tree.dirs++;
+        for (int fileNum = 0; fileNum < filesPerDir && tree.files < files; ++fileNum, ++tree.files)
+            fi.insert(dir + QStringLiteral("/file") + QString::number(fileNum), 16);
+    }
+    return tree;
+}
+
+static QJsonObject record(const char *scenario, const Tree &tree, bool result, qint64 msecs, const SyncEngine &engine)
+{
+    const auto &stats = engine.syncStatistics();
+    qDebug() << scenario << result << "TOTAL:" << msecs;
+
+    QJsonObject r;
+    r.insert(QStringLiteral("scenario"), QLatin1String(scenario));
+    r.insert(QStringLiteral("files"), tree.files);
+    r.insert(QStringLiteral("dirs"), tree.dirs);
+    r.insert(QStringLiteral("success"), result);
+    r.insert(QStringLiteral("msec"), msecs);
+    r.insert(QStringLiteral("discoveryMsec"),
+        stats.phaseTime(SyncStatistics::LocalDiscovery) + stats.phaseTime(SyncStatistics::RemoteDiscovery));
+    r.insert(QStringLiteral("reconcileMsec"), stats.phaseTime(SyncStatistics::Reconcile));
+    r.insert(QStringLiteral("treewalkMsec"),
+        stats.phaseTime(SyncStatistics::TreeWalk) + stats.phaseTime(SyncStatistics::Sort));
+    r.insert(QStringLiteral("statistics"), stats.toJson());
+    return r;
+}
+
+static bool runScenarios(int files, QJsonArray &records)
+{
+    FakeFolder fakeFolder{ FileInfo{} };
+    fakeFolder.setServerPropfindCacheEnabled(true);
+    const Tree tree = addTree(fakeFolder.remoteModifier(), files);
+    qDebug() << "NUMFILES" << tree.files << "NUMDIRS" << tree.dirs;
+
+    bool ok = true;
+    QElapsedTimer timer;
+    auto sync = [&](const char *scenario) {
+        timer.start();
+        const bool result = fakeFolder.syncOnce();
+        records.append(record(scenario, tree, result, timer.elapsed(), fakeFolder.syncEngine()));
+        ok = ok && result;
+    };
+
+    sync("first_sync");
+    sync("noop_resync");
+
+    // Every file changed on the server: all of the tree is discovered and reconciled
+    QStringList paths;
+    for (const auto &top : tree.topDirs) {
+        for (const auto &dir : qAsConst(fakeFolder.remoteModifier().find(top)->children)) {
+            for (const auto &file : dir.children)
+                paths.append(file.path());
+        }
+    }
+    for (const auto &path : paths)
+        fakeFolder.remoteModifier().appendByte(path);
+    sync("remote_change");
+
+    for (const auto &top : tree.topDirs)
+        fakeFolder.localModifier().rename(top, top + QStringLiteral("_renamed"));
+    sync("bulk_rename");
+
+    for (int i = 0; i < tree.topDirs.size(); i += 2)
+        fakeFolder.remoteModifier().remove(tree.topDirs[i] + QStringLiteral("_renamed"));
+    sync("bulk_delete");
+
+    return ok && fakeFolder.currentLocalState() == fakeFolder.currentRemoteState();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QString output = QStringLiteral("syncscale.json");
+    QList<int> sizes;
+    const auto args = app.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        if (args[i] == "-o" && i + 1 < args.size())
+            output = args[++i];
+        else
+            sizes.append(args[i].toInt());
+    }
+    if (sizes.isEmpty())
+        sizes.append(100000);
+
+    bool result = true;
+    QJsonArray records;
+    for (int files : sizes)
+        result = runScenarios(files, records) && result;
+
+    QJsonObject root;
+    root.insert(QStringLiteral("benchmark"), QStringLiteral("SyncScale"));
+    root.insert(QStringLiteral("results"), records);
+    QFile f(output);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+        qWarning() << "Could not write" << output << f.errorString();
+        return -1;
+    }
+    f.write(QJsonDocument(root).toJson());
+    qDebug() << "RESULTS WRITTEN TO" << output;
+    return result ? 0 : -1;
+}
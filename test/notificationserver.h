@@ -0,0 +1,122 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+#pragma once
+
+#include <QHostAddress>
+#include <QList>
+#include <QPointer>
+#include <QUrl>
+#include <QWebSocket>
+#include <QWebSocketServer>
+
+/**
+ * A minimal local stand-in for the websocket of the notify_push app,
+ * see OCC::PushNotifications.
+ *
+ * Clients authenticate with an empty user name and token() as password.
+ */
+class NotificationServer : public QWebSocketServer
+{
+    Q_OBJECT
+
+    struct Client
+    {
+        QPointer<QWebSocket> socket;
+        QStringList credentials;
+    };
+
+    QList<Client> _clients;
+    QString _token = QStringLiteral("push-token");
+    bool _available = true;
+    int _connectionCount = 0;
+
+public:
+    explicit NotificationServer(QObject *parent = nullptr)
+        : QWebSocketServer(QStringLiteral("notify_push"), QWebSocketServer::NonSecureMode, parent)
+    {
+        connect(this, &QWebSocketServer::newConnection, this, &NotificationServer::slotNewConnection);
+        listen(QHostAddress::LocalHost);
+    }
+
+    QUrl url() const
+    {
+        return QUrl(QStringLiteral("ws://127.0.0.1:%1/push/ws").arg(serverPort()));
+    }
+
+    QString token() const { return _token; }
+
+    int connectionCount() const { return _connectionCount; }
+
+    int authenticatedCount() const
+    {
+        int count = 0;
+        for (const auto &client : _clients) {
+            if (client.socket && client.credentials.size() == 2)
+                ++count;
+        }
+        return count;
+    }
+
+    void notifyFile() { sendToAuthenticated(QStringLiteral("notify_file")); }
+    void notifyActivity() { sendToAuthenticated(QStringLiteral("notify_activity")); }
+
+    /// While unavailable all connections are closed right away
+    void setAvailable(bool available)
+    {
+        _available = available;
+        if (available)
+            return;
+        const auto clients = _clients;
+        _clients.clear();
+        for (const auto &client : clients) {
+            if (client.socket)
+                client.socket->close(QWebSocketProtocol::CloseCodeGoingAway);
+        }
+    }
+
+private slots:
+    void slotNewConnection()
+    {
+        while (auto socket = nextPendingConnection()) {
+            ++_connectionCount;
+            connect(socket, &QWebSocket::disconnected, socket, &QObject::deleteLater);
+            if (!_available) {
+                socket->close(QWebSocketProtocol::CloseCodeGoingAway);
+                continue;
+            }
+            _clients.append({ socket, QStringList() });
+            connect(socket, &QWebSocket::textMessageReceived, this, [this, socket](const QString &message) {
+                for (auto &client : _clients) {
+                    if (client.socket == socket && client.credentials.size() < 2)
+                        authenticate(client, message);
+                }
+            });
+        }
+    }
+
+private:
+    void authenticate(Client &client, const QString &message)
+    {
+        client.credentials.append(message);
+        if (client.credentials.size() < 2)
+            return;
+        if (client.credentials[0].isEmpty() && client.credentials[1] == _token) {
+            client.socket->sendTextMessage(QStringLiteral("authenticated"));
+        } else {
+            client.socket->sendTextMessage(QStringLiteral("err: Invalid credentials"));
+            client.socket->close();
+        }
+    }
+
+    void sendToAuthenticated(const QString &message)
+    {
+        for (const auto &client : _clients) {
+            if (client.socket && client.credentials.size() == 2)
+                client.socket->sendTextMessage(message);
+        }
+    }
+};
@@ -10,12 +10,14 @@
 #include "creds/abstractcredentials.h"
 #include "logger.h"
 #include "filesystem.h"
+#include "contentencoding.h"
 #include "syncengine.h"
 #include "common/syncjournaldb.h"
 
 #include <QDir>
 #include <QNetworkReply>
 #include <QMap>
+#include <QVarLengthArray>
 #include <QtTest>
 #include <memory>
 
@@ -43,7 +45,9 @@ inline QString getFilePathFromUrl(const QUrl &url) {
 
 
 inline QString generateEtag() {
-    return QString::number(QDateTime::currentDateTimeUtc().toMSecsSinceEpoch(), 16);
+    // Unique even within a millisecond, the PROPFIND cache relies on it
+    static quint64 counter = 0;
+    return QString::number(QDateTime::currentMSecsSinceEpoch(), 16) + QLatin1Char('-') + QString::number(++counter, 16);
 }
 inline QByteArray generateFileId() {
     return QByteArray::number(qrand(), 16);
@@ -178,8 +182,7 @@ public:
         const PathComponents pathComponents{relativePath};
         FileInfo *parent = findInvalidatingEtags(pathComponents.parentDirComponents());
         Q_ASSERT(parent);
-        parent->children.erase(std::find_if(parent->children.begin(), parent->children.end(),
-                [&pathComponents](const FileInfo &fi){ return fi.name == pathComponents.fileName(); }));
+        parent->children.remove(pathComponents.fileName());
     }
 
     void insert(const QString &relativePath, qint64 size = 64, char contentChar = 'W') override {
@@ -224,21 +227,24 @@ public:
     }
 
     FileInfo *find(const PathComponents &pathComponents, const bool invalidateEtags = false) {
-        if (pathComponents.isEmpty()) {
-            if (invalidateEtags)
-                etag = generateEtag();
-            return this;
+        // Walks down without copying the components, this is called for
+        // every request the fake server gets
+        QVarLengthArray<FileInfo *, 16> parents;
+        FileInfo *file = this;
+        for (const auto &childName : pathComponents) {
+            auto it = file->children.find(childName);
+            if (it == file->children.end())
+                return nullptr;
+            parents.append(file);
+            file = &*it;
         }
-        QString childName = pathComponents.pathRoot();
-        auto it = children.find(childName);
-        if (it != children.end()) {
-            auto file = it->find(pathComponents.subComponents(), invalidateEtags);
-            if (file && invalidateEtags)
-                // Update parents on the way back
-                etag = file->etag;
-            return file;
+        if (invalidateEtags) {
+            file->etag = generateEtag();
+            // The parents get the same etag
+            for (auto parent : parents)
+                parent->etag = file->etag;
         }
-        return 0;
+        return file;
     }
 
     FileInfo *createDir(const QString &relativePath) {
@@ -291,7 +297,7 @@ public:
     QString name;
     bool isDir = true;
     bool isShared = false;
-    QDateTime lastModified = QDateTime::currentDateTime().addDays(-7);
+    QDateTime lastModified = defaultLastModified();
     QString etag = generateEtag();
     QByteArray fileId = generateFileId();
     QByteArray checksums;
@@ -308,18 +314,76 @@ private:
         return find(pathComponents, true);
     }
 
+    // Computing the local time for every new FileInfo is slow for big trees
+    static QDateTime defaultLastModified() {
+        static const QDateTime lastWeek = QDateTime::currentDateTime().addDays(-7);
+        return lastWeek;
+    }
+
     friend inline QDebug operator<<(QDebug dbg, const FileInfo& fi) {
         return dbg << "{ " << fi.path() << ": " << fi.children;
     }
 };
 
+// Writes the <d:response> with all the properties the client asks for
+inline void writeFakeFileResponse(QXmlStreamWriter &xml, QBuffer &buffer, const QString &prefix, const FileInfo &fileInfo,
+    const QByteArray &extraProperties = QByteArray())
+{
+    const QString davUri{QStringLiteral("DAV:")};
+    const QString ocUri{QStringLiteral("http://owncloud.org/ns")};
+    xml.writeStartElement(davUri, QStringLiteral("response"));
+
+    xml.writeTextElement(davUri, QStringLiteral("href"), prefix + fileInfo.path());
+    xml.writeStartElement(davUri, QStringLiteral("propstat"));
+    xml.writeStartElement(davUri, QStringLiteral("prop"));
+
+    if (fileInfo.isDir) {
+        xml.writeStartElement(davUri, QStringLiteral("resourcetype"));
+        xml.writeEmptyElement(davUri, QStringLiteral("collection"));
+        xml.writeEndElement(); // resourcetype
+    } else
+        xml.writeEmptyElement(davUri, QStringLiteral("resourcetype"));
+
+    auto gmtDate = fileInfo.lastModified.toUTC();
+    auto stringDate = QLocale::c().toString(gmtDate, "ddd, dd MMM yyyy HH:mm:ss 'GMT'");
+    xml.writeTextElement(davUri, QStringLiteral("getlastmodified"), stringDate);
+    xml.writeTextElement(davUri, QStringLiteral("getcontentlength"), QString::number(fileInfo.size));
+    xml.writeTextElement(davUri, QStringLiteral("getetag"), fileInfo.etag);
+    xml.writeTextElement(ocUri, QStringLiteral("permissions"), fileInfo.isShared ? QStringLiteral("SRDNVCKW") : QStringLiteral("RDNVCKW"));
+    xml.writeTextElement(ocUri, QStringLiteral("id"), fileInfo.fileId);
+    xml.writeTextElement(ocUri, QStringLiteral("checksums"), fileInfo.checksums);
+    buffer.write(fileInfo.extraDavProperties);
+    buffer.write(extraProperties);
+    xml.writeEndElement(); // prop
+    xml.writeTextElement(davUri, QStringLiteral("status"), "HTTP/1.1 200 OK");
+    xml.writeEndElement(); // propstat
+    xml.writeEndElement(); // response
+}
+
+// An entry of a Depth:infinity listing that the server failed to read
+inline void writeFakeErrorResponse(QXmlStreamWriter &xml, const QString &prefix, const FileInfo &fileInfo, int httpCode)
+{
+    const QString davUri{QStringLiteral("DAV:")};
+    xml.writeStartElement(davUri, QStringLiteral("response"));
+    xml.writeTextElement(davUri, QStringLiteral("href"), prefix + fileInfo.path());
+    xml.writeStartElement(davUri, QStringLiteral("propstat"));
+    xml.writeEmptyElement(davUri, QStringLiteral("prop"));
+    xml.writeTextElement(davUri, QStringLiteral("status"), QStringLiteral("HTTP/1.1 %1 Error").arg(httpCode));
+    xml.writeEndElement(); // propstat
+    xml.writeEndElement(); // response
+}
+
 class FakePropfindReply : public QNetworkReply
 {
     Q_OBJECT
 public:
     QByteArray payload;
 
-    FakePropfindReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    // If syncToken is set it is reported as property of the requested collection.
+    // The entries of errorPaths are only used for Depth:infinity, they are listed
+    // with an error status and without their children.
+    FakePropfindReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent,
+        const QString &syncToken = QString(), const QHash<QString, int> &errorPaths = {})
     : QNetworkReply{parent} {
         setRequest(request);
         setUrl(request.url());
@@ -335,54 +399,55 @@ public:
         }
         QString prefix = request.url().path().left(request.url().path().size() - fileName.size());
 
-        // Don't care about the request and just return a full propfind
+        // Don't care about the properties of the request and just return a full propfind
         const QString davUri{QStringLiteral("DAV:")};
-        const QString ocUri{QStringLiteral("http://owncloud.org/ns")};
         QBuffer buffer{&payload};
         buffer.open(QIODevice::WriteOnly);
         QXmlStreamWriter xml( &buffer );
         xml.writeNamespace(davUri, "d");
-        xml.writeNamespace(ocUri, "oc");
+        xml.writeNamespace(QStringLiteral("http://owncloud.org/ns"), "oc");
         xml.writeStartDocument();
         xml.writeStartElement(davUri, QStringLiteral("multistatus"));
-        auto writeFileResponse = [&](const FileInfo &fileInfo) {
-            xml.writeStartElement(davUri, QStringLiteral("response"));
-
-            xml.writeTextElement(davUri, QStringLiteral("href"), prefix + fileInfo.path());
-            xml.writeStartElement(davUri, QStringLiteral("propstat"));
-            xml.writeStartElement(davUri, QStringLiteral("prop"));
-
-            if (fileInfo.isDir) {
-                xml.writeStartElement(davUri, QStringLiteral("resourcetype"));
-                xml.writeEmptyElement(davUri, QStringLiteral("collection"));
-                xml.writeEndElement(); // resourcetype
-            } else
-                xml.writeEmptyElement(davUri, QStringLiteral("resourcetype"));
-
-            auto gmtDate = fileInfo.lastModified.toUTC();
-            auto stringDate = QLocale::c().toString(gmtDate, "ddd, dd MMM yyyy HH:mm:ss 'GMT'");
-            xml.writeTextElement(davUri, QStringLiteral("getlastmodified"), stringDate);
-            xml.writeTextElement(davUri, QStringLiteral("getcontentlength"), QString::number(fileInfo.size));
-            xml.writeTextElement(davUri, QStringLiteral("getetag"), fileInfo.etag);
-            xml.writeTextElement(ocUri, QStringLiteral("permissions"), fileInfo.isShared ? QStringLiteral("SRDNVCKW") : QStringLiteral("RDNVCKW"));
-            xml.writeTextElement(ocUri, QStringLiteral("id"), fileInfo.fileId);
-            xml.writeTextElement(ocUri, QStringLiteral("checksums"), fileInfo.checksums);
-            buffer.write(fileInfo.extraDavProperties);
-            xml.writeEndElement(); // prop
-            xml.writeTextElement(davUri, QStringLiteral("status"), "HTTP/1.1 200 OK");
-            xml.writeEndElement(); // propstat
-            xml.writeEndElement(); // response
-        };
 
-        writeFileResponse(*fileInfo);
-        foreach(const FileInfo &childFileInfo, fileInfo->children)
-           writeFileResponse(childFileInfo);
+        QByteArray extraProperties;
+        if (!syncToken.isEmpty())
+            extraProperties = "<d:sync-token>" + syncToken.toHtmlEscaped().toUtf8() + "</d:sync-token>";
+        writeFakeFileResponse(xml, buffer, prefix, *fileInfo, extraProperties);
+        if (request.rawHeader("Depth") == "infinity") {
+            writeDescendants(xml, buffer, prefix, *fileInfo, errorPaths);
+        } else if (request.rawHeader("Depth") != "0") {
+            foreach(const FileInfo &childFileInfo, fileInfo->children)
+                writeFakeFileResponse(xml, buffer, prefix, childFileInfo);
+        }
         xml.writeEndElement(); // multistatus
         xml.writeEndDocument();
 
         QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
     }
 
+    // Replies with a body that was generated before, see FakeQNAM::setPropfindCacheEnabled()
+    FakePropfindReply(const QByteArray &cachedPayload, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    : QNetworkReply{parent}, payload{cachedPayload} {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    static void writeDescendants(QXmlStreamWriter &xml, QBuffer &buffer, const QString &prefix, const FileInfo &fileInfo,
+        const QHash<QString, int> &errorPaths)
+    {
+        foreach (const FileInfo &childFileInfo, fileInfo.children) {
+            if (errorPaths.contains(childFileInfo.path())) {
+                writeFakeErrorResponse(xml, prefix, childFileInfo, errorPaths[childFileInfo.path()]);
+                continue;
+            }
+            writeFakeFileResponse(xml, buffer, prefix, childFileInfo);
+            writeDescendants(xml, buffer, prefix, childFileInfo, errorPaths);
+        }
+    }
+
     Q_INVOKABLE void respond() {
         setHeader(QNetworkRequest::ContentLengthHeader, payload.size());
         setHeader(QNetworkRequest::ContentTypeHeader, "application/xml; charset=utf-8");
@@ -412,6 +477,108 @@ public:
     }
 };
 
+// Answers a sync-collection REPORT (RFC 6578) by comparing the current remote
+// state with the state the sync-token stands for.
+class FakeSyncCollectionReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    QByteArray payload;
+
+    // previousState is null if the sync-token in the request is unknown
+    FakeSyncCollectionReply(const FileInfo *previousState, const FileInfo &currentState, const QString &newSyncToken,
+        QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    : QNetworkReply{parent} {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+
+        if (!previousState) {
+            payload = "<?xml version=\"1.0\"?>\n<d:error xmlns:d=\"DAV:\"><d:valid-sync-token/></d:error>";
+            QMetaObject::invokeMethod(this, "respondInvalidToken", Qt::QueuedConnection);
+            return;
+        }
+
+        QHash<QString, const FileInfo *> previous;
+        QHash<QString, const FileInfo *> current;
+        flatten(*previousState, previous);
+        flatten(currentState, current);
+
+        const QString prefix = request.url().path();
+        const QString davUri{QStringLiteral("DAV:")};
+        QBuffer buffer{&payload};
+        buffer.open(QIODevice::WriteOnly);
+        QXmlStreamWriter xml( &buffer );
+        xml.writeNamespace(davUri, "d");
+        xml.writeNamespace(QStringLiteral("http://owncloud.org/ns"), "oc");
+        xml.writeStartDocument();
+        xml.writeStartElement(davUri, QStringLiteral("multistatus"));
+        for (auto it = current.constBegin(); it != current.constEnd(); ++it) {
+            const FileInfo *old = previous.value(it.key());
+            const FileInfo &fi = **it;
+            if (!old || old->isDir != fi.isDir || old->etag != fi.etag || old->size != fi.size
+                || old->contentChar != fi.contentChar || old->lastModified != fi.lastModified
+                || old->fileId != fi.fileId) {
+                writeFakeFileResponse(xml, buffer, prefix, fi);
+            }
+        }
+        for (auto it = previous.constBegin(); it != previous.constEnd(); ++it) {
+            if (current.contains(it.key()))
+                continue;
+            xml.writeStartElement(davUri, QStringLiteral("response"));
+            xml.writeTextElement(davUri, QStringLiteral("href"), prefix + it.key());
+            xml.writeTextElement(davUri, QStringLiteral("status"), "HTTP/1.1 404 Not Found");
+            xml.writeEndElement(); // response
+        }
+        xml.writeTextElement(davUri, QStringLiteral("sync-token"), newSyncToken);
+        xml.writeEndElement(); // multistatus
+        xml.writeEndDocument();
+
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    static void flatten(const FileInfo &dir, QHash<QString, const FileInfo *> &result) {
+        for (const auto &child : dir.children) {
+            result.insert(child.path(), &child);
+            flatten(child, result);
+        }
+    }
+
+    Q_INVOKABLE void respond() {
+        setHeader(QNetworkRequest::ContentLengthHeader, payload.size());
+        setHeader(QNetworkRequest::ContentTypeHeader, "application/xml; charset=utf-8");
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 207);
+        setFinished(true);
+        emit metaDataChanged();
+        if (bytesAvailable())
+            emit readyRead();
+        emit finished();
+    }
+
+    Q_INVOKABLE void respondInvalidToken() {
+        setHeader(QNetworkRequest::ContentLengthHeader, payload.size());
+        setHeader(QNetworkRequest::ContentTypeHeader, "application/xml; charset=utf-8");
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 403);
+        setError(ContentOperationNotPermittedError, "Forbidden");
+        setFinished(true);
+        emit metaDataChanged();
+        if (bytesAvailable())
+            emit readyRead();
+        emit finished();
+    }
+
+    void abort() override { }
+
+    qint64 bytesAvailable() const override { return payload.size() + QIODevice::bytesAvailable(); }
+    qint64 readData(char *data, qint64 maxlen) override {
+        qint64 len = std::min(qint64{payload.size()}, maxlen);
+        memcpy(data, payload.constData(), len);
+        payload.remove(0, len);
+        return len;
+    }
+};
+
 class FakePutReply : public QNetworkReply
 {
     Q_OBJECT
@@ -552,6 +719,52 @@ public:
     qint64 readData(char *, qint64) override { return 0; }
 };
 
+class FakeCopyReply : public QNetworkReply
+{
+    Q_OBJECT
+    int _httpCode = 201;
+public:
+    FakeCopyReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
+    : QNetworkReply{parent} {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+
+        QString fileName = getFilePathFromUrl(request.url());
+        Q_ASSERT(!fileName.isEmpty());
+        QString dest = getFilePathFromUrl(QUrl::fromEncoded(request.rawHeader("Destination")));
+        Q_ASSERT(!dest.isEmpty());
+        QByteArray ifMatch = request.rawHeader("If-Match");
+        ifMatch.replace('"', "");
+        const FileInfo *source = remoteRootFileInfo.find(fileName);
+        if (!source) {
+            _httpCode = 404;
+        } else if ((!ifMatch.isEmpty() && ifMatch != source->etag.toLatin1())
+            || (request.rawHeader("Overwrite") == "F" && remoteRootFileInfo.find(dest))) {
+            _httpCode = 412;
+        } else {
+            const FileInfo copy = *source;
+            FileInfo *fileInfo = remoteRootFileInfo.create(dest, copy.size, copy.contentChar);
+            fileInfo->checksums = copy.checksums;
+            fileInfo->lastModified = copy.lastModified;
+            remoteRootFileInfo.find(dest, /*invalidate_etags=*/true);
+        }
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    Q_INVOKABLE void respond() {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, _httpCode);
+        if (_httpCode != 201)
+            setError(_httpCode == 404 ? ContentNotFoundError : UnknownContentError, "Copy failed");
+        emit metaDataChanged();
+        emit finished();
+    }
+
+    void abort() override { }
+    qint64 readData(char *, qint64) override { return 0; }
+};
+
 class FakeGetReply : public QNetworkReply
 {
     Q_OBJECT
@@ -560,6 +773,7 @@ public:
     char payload;
     int size;
     bool aborted = false;
+    QByteArray compressedBody; // the gzip encoded body if the client accepts it
 
     FakeGetReply(FileInfo &remoteRootFileInfo, QNetworkAccessManager::Operation op, const QNetworkRequest &request, QObject *parent)
     : QNetworkReply{parent} {
@@ -583,8 +797,25 @@ public:
         }
         payload = fileInfo->contentChar;
         size = fileInfo->size;
+        int httpStatus = 200;
+        if (request().rawHeader("Accept-Encoding").contains(OCC::ContentEncoding::gzipC)
+            && request().rawHeader("Range").isEmpty() && size > 0) {
+            compressedBody = OCC::ContentEncoding::gzipCompress(QByteArray(size, payload));
+            size = compressedBody.size();
+            setRawHeader("Content-Encoding", OCC::ContentEncoding::gzipC);
+        }
+        QRegularExpression rangeRe(QStringLiteral("^bytes=(\\d+)-(\\d*)$"));
+        auto range = rangeRe.match(QString::fromLatin1(request().rawHeader("Range")));
+        if (range.hasMatch() && range.captured(1).toLongLong() < size) {
+            const qint64 start = range.captured(1).toLongLong();
+            const qint64 end = range.captured(2).isEmpty() ? size - 1 : qMin<qint64>(range.captured(2).toLongLong(), size - 1);
+            setRawHeader("Content-Range", "bytes " + QByteArray::number(start) + '-' + QByteArray::number(end)
+                    + '/' + QByteArray::number(size));
+            size = end - start + 1;
+            httpStatus = 206;
+        }
         setHeader(QNetworkRequest::ContentLengthHeader, size);
-        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, httpStatus);
         setRawHeader("OC-ETag", fileInfo->etag.toLatin1());
         setRawHeader("ETag", fileInfo->etag.toLatin1());
         setRawHeader("OC-FileId", fileInfo->fileId);
@@ -605,7 +836,10 @@ public:
 
     qint64 readData(char *data, qint64 maxlen) override {
         qint64 len = std::min(qint64{size}, maxlen);
-        std::fill_n(data, len, payload);
+        if (compressedBody.isEmpty())
+            std::fill_n(data, len, payload);
+        else
+            std::copy_n(compressedBody.constData() + compressedBody.size() - size, len, data);
         size -= len;
         return len;
     }
@@ -752,6 +986,46 @@ public:
     int _httpErrorCode;
 };
 
+// A successful reply with the given body
+class FakePayloadReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    FakePayloadReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request,
+        const QByteArray &body, QObject *parent)
+        : QNetworkReply{ parent }
+        , _body(body)
+    {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(op);
+        open(QIODevice::ReadOnly);
+        QMetaObject::invokeMethod(this, "respond", Qt::QueuedConnection);
+    }
+
+    Q_INVOKABLE void respond()
+    {
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+        setHeader(QNetworkRequest::ContentLengthHeader, _body.size());
+        emit metaDataChanged();
+        emit readyRead();
+        setFinished(true);
+        emit finished();
+    }
+
+    void abort() override {}
+    qint64 bytesAvailable() const override { return _body.size() + QIODevice::bytesAvailable(); }
+    qint64 readData(char *buf, qint64 max) override
+    {
+        max = qMin<qint64>(max, _body.size());
+        memcpy(buf, _body.constData(), max);
+        _body = _body.mid(max);
+        return max;
+    }
+
+    QByteArray _body;
+};
+
 // A reply that never responds
 class FakeHangingReply : public QNetworkReply
 {
@@ -766,7 +1040,13 @@ public:
         open(QIODevice::ReadOnly);
     }
 
-    void abort() override {}
+    // Like a real reply, aborting finishes it right away
+    void abort() override
+    {
+        setError(OperationCanceledError, "abort");
+        setFinished(true);
+        emit finished();
+    }
     qint64 readData(char *, qint64) override { return 0; }
 };
 
@@ -804,6 +1084,45 @@ private:
     QHash<QString, int> _errorPaths;
     // monitor requests and optionally provide custom replies
     Override _override;
+    // The remote state for each sync-token handed out, see FakeSyncCollectionReply
+    bool _syncCollectionEnabled = false;
+    // Like Sabre's default, Depth:infinity PROPFINDs are refused with 403
+    bool _propfindDepthInfinityAllowed = false;
+    int _syncTokenCount = 0;
+    QHash<QString, FileInfo> _syncTokenStates;
+    // The last PROPFIND body of a url and depth, with the etag it was made for
+    bool _propfindCacheEnabled = false;
+    QHash<QString, QPair<QString, QByteArray>> _propfindCache;
+
+    QString newSyncToken() {
+        const QString token = QStringLiteral("http://fake/sync/%1").arg(++_syncTokenCount);
+        _syncTokenStates.insert(token, _remoteRootFileInfo);
+        return token;
+    }
+
+    // Like a server that accepts gzip encoded uploads
+    static QByteArray decodedPayload(const QNetworkRequest &request, const QByteArray &payload) {
+        if (request.rawHeader("Content-Encoding") != OCC::ContentEncoding::gzipC)
+            return payload;
+        QByteArray decoded;
+        OCC::GzipDecompressor decompressor;
+        if (!decompressor.decompress(payload.constData(), payload.size(), &decoded) || !decompressor.isFinished())
+            return QByteArray();
+        return decoded;
+    }
+
+    QNetworkReply *cachedPropfindReply(FileInfo &info, Operation op, const QNetworkRequest &request) {
+        const FileInfo *fileInfo = info.find(getFilePathFromUrl(request.url()));
+        if (!fileInfo)
+            return new FakePropfindReply{info, op, request, this};
+        const QString key = request.url().path() + QLatin1Char('\n') + QString::fromLatin1(request.rawHeader("Depth"));
+        auto it = _propfindCache.constFind(key);
+        if (it != _propfindCache.constEnd() && it->first == fileInfo->etag)
+            return new FakePropfindReply{it->second, op, request, this};
+        auto reply = new FakePropfindReply{info, op, request, this};
+        _propfindCache.insert(key, qMakePair(fileInfo->etag, reply->payload));
+        return reply;
+    }
 
 public:
     FakeQNAM(FileInfo initialRoot) : _remoteRootFileInfo{std::move(initialRoot)} { }
@@ -814,6 +1133,18 @@ public:
 
     void setOverride(const Override &override) { _override = override; }
 
+    void setSyncCollectionEnabled(bool enabled) { _syncCollectionEnabled = enabled; }
+    void invalidateSyncTokens() { _syncTokenStates.clear(); }
+    void setPropfindDepthInfinityAllowed(bool allowed) { _propfindDepthInfinityAllowed = allowed; }
+
+    // Reuses the PROPFIND bodies while the etag of the collection stays the same.
+    // Only for trees that are changed through the FileModifier interface or by
+    // the sync: changing the members of a FileInfo directly keeps its etag.
+    void setPropfindCacheEnabled(bool enabled) {
+        _propfindCacheEnabled = enabled;
+        _propfindCache.clear();
+    }
+
 protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &request,
                                          QIODevice *outgoingData = 0) {
@@ -830,13 +1161,31 @@ protected:
         FileInfo &info = isUpload ? _uploadFileInfo : _remoteRootFileInfo;
 
         auto verb = request.attribute(QNetworkRequest::CustomVerbAttribute);
-        if (verb == "PROPFIND")
+        if (verb == "PROPFIND" && _syncCollectionEnabled && !isUpload && fileName.isEmpty()
+            && outgoingData && outgoingData->peek(outgoingData->size()).contains("sync-token"))
+            return new FakePropfindReply{info, op, request, this, newSyncToken()};
+        else if (verb == "PROPFIND" && request.rawHeader("Depth") == "infinity" && !_propfindDepthInfinityAllowed)
+            return new FakeErrorReply{op, request, this, 403};
+        else if (verb == "PROPFIND" && request.rawHeader("Depth") == "infinity")
+            return new FakePropfindReply{info, op, request, this, QString(), _errorPaths};
+        else if (verb == "PROPFIND" && _propfindCacheEnabled && !isUpload)
+            return cachedPropfindReply(info, op, request);
+        else if (verb == "PROPFIND")
             // Ignore outgoingData always returning somethign good enough, works for now.
             return new FakePropfindReply{info, op, request, this};
+        else if (verb == "REPORT" && _syncCollectionEnabled) {
+            QRegularExpression tokenRe(QStringLiteral("<d:sync-token>(.*)</d:sync-token>"));
+            auto token = tokenRe.match(QString::fromUtf8(outgoingData->readAll())).captured(1);
+            const QString newToken = newSyncToken(); // before taking pointers into the hash
+            auto it = _syncTokenStates.constFind(token);
+            const FileInfo *previousState = it == _syncTokenStates.constEnd() ? nullptr : &*it;
+            return new FakeSyncCollectionReply{previousState, info, newToken, op, request, this};
+        } else if (verb == "REPORT")
+            return new FakeErrorReply{op, request, this, 501};
         else if (verb == QLatin1String("GET") || op == QNetworkAccessManager::GetOperation)
             return new FakeGetReply{info, op, request, this};
         else if (verb == QLatin1String("PUT") || op == QNetworkAccessManager::PutOperation)
-            return new FakePutReply{info, op, request, outgoingData->readAll(), this};
+            return new FakePutReply{info, op, request, decodedPayload(request, outgoingData->readAll()), this};
         else if (verb == QLatin1String("MKCOL"))
             return new FakeMkcolReply{info, op, request, this};
         else if (verb == QLatin1String("DELETE") || op == QNetworkAccessManager::DeleteOperation)
@@ -845,6 +1194,8 @@ protected:
             return new FakeMoveReply{info, op, request, this};
         else if (verb == QLatin1String("MOVE") && isUpload)
             return new FakeChunkMoveReply{ info, _remoteRootFileInfo, op, request, this };
+        else if (verb == QLatin1String("COPY") && !isUpload)
+            return new FakeCopyReply{info, op, request, this};
         else {
             qDebug() << verb << outgoingData;
             Q_UNREACHABLE();
@@ -930,6 +1281,10 @@ public:
     };
     ErrorList serverErrorPaths() { return {_fakeQnam}; }
     void setServerOverride(const FakeQNAM::Override &override) { _fakeQnam->setOverride(override); }
+    void setServerSyncCollectionEnabled(bool enabled) { _fakeQnam->setSyncCollectionEnabled(enabled); }
+    void invalidateServerSyncTokens() { _fakeQnam->invalidateSyncTokens(); }
+    void setServerPropfindDepthInfinityAllowed(bool allowed) { _fakeQnam->setPropfindDepthInfinityAllowed(allowed); }
+    void setServerPropfindCacheEnabled(bool enabled) { _fakeQnam->setPropfindCacheEnabled(enabled); }
 
     QString localPath() const {
         // SyncEngine wants a trailing slash
@@ -0,0 +1,219 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+#include <bandwidthmanager.h>
+
+#include <numeric>
+
+using namespace OCC;
+
+/*
+ * Runs transfers through a TokenBucket the way BandwidthManager does, with
+ * ticks that arrive late by a random amount, and records what they got.
+ */
+class PacingSimulation
+{
+public:
+    struct Transfer
+    {
+        qint64 start = 0; // in msec
+        qint64 size = -1; // -1 for transfers that always want more
+        int usedPercent = 100; // of the quota it gets
+        qint64 done = 0;
+        qint64 finished = -1; // in msec
+    };
+
+    explicit PacingSimulation(qint64 rate)
+    {
+        _bucket.setRate(rate);
+    }
+
+    QVector<Transfer> transfers;
+
+    /** The bytes transferred in every second */
+    QVector<qint64> run(qint64 durationMsec)
+    {
+        QVector<qint64> perSecond(int(durationMsec / 1000), 0);
+        QVector<qint64> quota(transfers.size(), 0);
+        quint32 random = 42;
+        for (qint64 now = 0; now < durationMsec;) {
+            random = random * 1103515245 + 12345;
+            const qint64 elapsed = BandwidthManager::tickMsec + (random >> 16) % 40;
+            now += elapsed;
+
+            // The transfers use their quota between the ticks
+            for (int i = 0; i < transfers.size(); ++i) {
+                auto &t = transfers[i];
+                const qint64 used = quota[i] * t.usedPercent / 100;
+                t.done += used;
+                if (now / 1000 < perSecond.size())
+                    perSecond[int(now / 1000)] += used;
+                if (t.size >= 0 && t.done == t.size && t.finished < 0)
+                    t.finished = now;
+                _bucket.giveBack(quota[i] - used);
+                quota[i] = 0;
+            }
+
+            _bucket.refill(elapsed);
+            QVector<int> active;
+            QVector<qint64> demands;
+            for (int i = 0; i < transfers.size(); ++i) {
+                const auto &t = transfers[i];
+                if (t.start <= now && t.finished < 0) {
+                    active.append(i);
+                    demands.append(t.size < 0 ? std::numeric_limits<qint32>::max() : t.size - t.done);
+                }
+            }
+            const auto shares = fairShares(_bucket.available(), demands);
+            for (int i = 0; i < active.size(); ++i)
+                quota[active[i]] = _bucket.take(shares[i]);
+        }
+        return perSecond;
+    }
+
+private:
+    TokenBucket _bucket;
+};
+
+class TestBandwidthManager : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testTokenBucket()
+    {
+        TokenBucket bucket;
+        QVERIFY(!bucket.isLimited());
+        QCOMPARE(bucket.take(12345), qint64(12345));
+
+        bucket.setRate(100000);
+        QCOMPARE(bucket.available(), qint64(0));
+        bucket.refill(100);
+        QCOMPARE(bucket.available(), qint64(10000));
+        QCOMPARE(bucket.take(4000), qint64(4000));
+        QCOMPARE(bucket.take(10000), qint64(6000));
+        QCOMPARE(bucket.take(1), qint64(0));
+
+        // An idle period doesn't allow a big burst later
+        bucket.refill(5000);
+        QCOMPARE(bucket.available(), qint64(100000 * TokenBucket::burstMsec / 1000));
+        bucket.take(bucket.available());
+        bucket.giveBack(1000000);
+        QCOMPARE(bucket.available(), qint64(100000 * TokenBucket::burstMsec / 1000));
+
+        // Fractions of tokens are not lost
+        TokenBucket slow;
+        slow.setRate(3);
+        qint64 taken = 0;
+        for (int i = 0; i < 10; ++i) {
+            slow.refill(100);
+            taken += slow.take(10);
+        }
+        QCOMPARE(taken, qint64(3));
+    }
+
+    void testFairShares()
+    {
+        QCOMPARE(fairShares(100, {}), QVector<qint64>());
+        QCOMPARE(fairShares(100, { 1000, 1000 }), (QVector<qint64>{ 50, 50 }));
+        QCOMPARE(fairShares(100, { 1000, 10, 1000 }), (QVector<qint64>{ 45, 10, 45 }));
+        QCOMPARE(fairShares(100, { 10, 20 }), (QVector<qint64>{ 10, 20 }));
+        QCOMPARE(fairShares(100, { 0, 1000 }), (QVector<qint64>{ 0, 100 }));
+        QCOMPARE(fairShares(0, { 10, 20 }), (QVector<qint64>{ 0, 0 }));
+
+        const auto shares = fairShares(1000, { 7, 500, 300, 333, 1000 });
+        const auto sum = std::accumulate(shares.begin(), shares.end(), qint64(0));
+        QVERIFY(sum <= 1000 && sum > 990);
+        QCOMPARE(shares[0], qint64(7));
+        QVERIFY(shares[2] == shares[3] && shares[3] == shares[1]);
+    }
+
+    void testPacing_data()
+    {
+        QTest::addColumn<qint64>("rate");
+        QTest::newRow("slow") << qint64(10 * 1000);
+        QTest::newRow("medium") << qint64(500 * 1000);
+        QTest::newRow("fast") << qint64(50 * 1000 * 1000);
+    }
+
+    void testPacing()
+    {
+        QFETCH(qint64, rate);
+        PacingSimulation sim(rate);
+        sim.transfers.resize(4);
+        sim.transfers[2].usedPercent = 30; // a slow connection to the server
+        sim.transfers[3].start = 5000;
+        sim.transfers[3].size = rate / 100; // small compared to the rate
+
+        const qint64 duration = 20 * 1000;
+        const auto perSecond = sim.run(duration);
+
+        // The limit is reached but not exceeded
+        const qint64 total = std::accumulate(perSecond.begin(), perSecond.end(), qint64(0));
+        const qint64 expected = rate * perSecond.size();
+        qDebug() << "achieved" << double(total) / expected * 100 << "% of the limit";
+        QVERIFY(total <= expected + rate * TokenBucket::burstMsec / 1000);
+        QVERIFY(total >= expected * 97 / 100);
+
+        // Smooth: every second is close to the limit
+        qint64 minSecond = rate, maxSecond = 0;
+        for (int i = 1; i < perSecond.size(); ++i) {
+            minSecond = qMin(minSecond, perSecond[i]);
+            maxSecond = qMax(maxSecond, perSecond[i]);
+        }
+        qDebug() << "jitter" << double(maxSecond - minSecond) / rate * 100 << "% of the limit";
+        QVERIFY(maxSecond <= rate * 115 / 100);
+        QVERIFY(minSecond >= rate * 85 / 100);
+
+        // The small transfer isn't starved
+        QVERIFY(sim.transfers[3].finished >= 0);
+        QVERIFY(sim.transfers[3].finished - sim.transfers[3].start <= 3 * BandwidthManager::tickMsec);
+
+        // The greedy transfers share equally what the slow one leaves them
+        const double done0 = sim.transfers[0].done;
+        const double done1 = sim.transfers[1].done;
+        QVERIFY(qAbs(done0 - done1) / done1 < 0.01);
+        QVERIFY(sim.transfers[2].done < done1 / 2);
+    }
+
+    void testLimitedDownload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        const qint64 limit = 200 * 1000;
+        fakeFolder.syncEngine().setNetworkLimits(0, limit);
+        fakeFolder.remoteModifier().insert("A/big1", limit / 2);
+        fakeFolder.remoteModifier().insert("B/big2", limit / 2);
+
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        // A second at the limit, minus what the burst allows
+        QVERIFY(timer.elapsed() >= 1000 - TokenBucket::burstMsec - BandwidthManager::tickMsec);
+    }
+
+    void testGlobalLimit()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        const qint64 limit = 200 * 1000;
+        BandwidthManager::setGlobalLimits(0, limit);
+        fakeFolder.remoteModifier().insert("A/big", limit);
+
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(fakeFolder.syncOnce());
+        BandwidthManager::setGlobalLimits(0, 0);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QVERIFY(timer.elapsed() >= 1000 - TokenBucket::burstMsec - BandwidthManager::tickMsec);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBandwidthManager)
+#include "testbandwidthmanager.moc"
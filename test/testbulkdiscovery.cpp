@@ -0,0 +1,148 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+struct RequestCounter
+{
+    int bulkListings = 0; // Depth infinity PROPFIND
+    int listings = 0; // Depth 1 PROPFIND
+    QStringList bulkPaths;
+
+    void reset() { *this = RequestCounter(); }
+};
+
+static void fillRemote(FileModifier &remote)
+{
+    remote.mkdir("A");
+    remote.insert("A/a1");
+    remote.insert("A/a2");
+    remote.mkdir("A/sub");
+    remote.insert("A/sub/s1");
+    remote.mkdir("B");
+    remote.insert("B/b1");
+    remote.mkdir("B/sub");
+    remote.mkdir("B/sub/deeper");
+    remote.insert("B/sub/deeper/d1");
+    remote.mkdir("C");
+    remote.insert("r1");
+}
+
+static void setupBulkDiscovery(FakeFolder &fakeFolder, RequestCounter &counter)
+{
+    // Only used if parent etags change with their contents
+    fakeFolder.syncEngine().account()->setServerVersion("10.0.0");
+    SyncOptions options;
+    options._bulkInitialDiscovery = true;
+    fakeFolder.syncEngine().setSyncOptions(options);
+
+    fakeFolder.setServerOverride([&counter](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+        auto verb = request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+        if (verb == "PROPFIND" && request.rawHeader("Depth") == "infinity") {
+            ++counter.bulkListings;
+            counter.bulkPaths.append(getFilePathFromUrl(request.url()));
+        } else if (verb == "PROPFIND" && request.rawHeader("Depth") == "1") {
+            ++counter.listings;
+        }
+        return nullptr;
+    });
+}
+
+class TestBulkDiscovery : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testInitialSync()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.setServerPropfindDepthInfinityAllowed(true);
+        fillRemote(fakeFolder.remoteModifier());
+        RequestCounter counter;
+        setupBulkDiscovery(fakeFolder, counter);
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.bulkListings, 1);
+        QCOMPARE(counter.listings, 0);
+
+        // Later syncs only list what changed
+        fakeFolder.remoteModifier().insert("B/sub/deeper/d2");
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.bulkListings, 0);
+        QVERIFY(counter.listings > 0);
+    }
+
+    void testRefusedByServer()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        fillRemote(fakeFolder.remoteModifier());
+        RequestCounter counter;
+        setupBulkDiscovery(fakeFolder, counter);
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.bulkListings, 1);
+        QCOMPARE(counter.listings, 7);
+    }
+
+    void testErrorInSubtree()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.setServerPropfindDepthInfinityAllowed(true);
+        fillRemote(fakeFolder.remoteModifier());
+        RequestCounter counter;
+        setupBulkDiscovery(fakeFolder, counter);
+
+        // B can't be read in the bulk listing, but on its own
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            auto verb = request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+            if (verb == "PROPFIND" && request.rawHeader("Depth") == "infinity") {
+                ++counter.bulkListings;
+                return new FakePropfindReply{ fakeFolder.remoteModifier(), op, request, this, QString(), { { "B", 503 } } };
+            }
+            if (verb == "PROPFIND")
+                ++counter.listings;
+            return nullptr;
+        });
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.bulkListings, 1);
+        // The root, B and everything in B
+        QCOMPARE(counter.listings, 4);
+    }
+
+    void testSelectiveSync()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        fakeFolder.setServerPropfindDepthInfinityAllowed(true);
+        fillRemote(fakeFolder.remoteModifier());
+        RequestCounter counter;
+        setupBulkDiscovery(fakeFolder, counter);
+        fakeFolder.syncEngine().journal()->setSelectiveSyncList(SyncJournalDb::SelectiveSyncBlackList,
+            QStringList() << "B/sub/");
+
+        QVERIFY(fakeFolder.syncOnce());
+        // The excluded folder is never listed
+        QCOMPARE(counter.bulkPaths, (QStringList{ "A", "C" }));
+        // The root and B
+        QCOMPARE(counter.listings, 2);
+        QVERIFY(fakeFolder.currentLocalState().find("B/b1"));
+        QVERIFY(!fakeFolder.currentLocalState().find("B/sub"));
+        QVERIFY(fakeFolder.currentLocalState().find("A/sub/s1"));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestBulkDiscovery)
+#include "testbulkdiscovery.moc"
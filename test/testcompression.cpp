@@ -0,0 +1,180 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+#include <contentencoding.h>
+
+using namespace OCC;
+
+static void enableCompression(FakeFolder &fakeFolder)
+{
+    fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "contentEncodings", QStringList{ "gzip" } } } } });
+}
+
+class TestCompression : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCompressibility()
+    {
+        QVERIFY(ContentEncoding::isLikelyCompressible(QByteArray(100000, 'A')));
+        QVERIFY(!ContentEncoding::isLikelyCompressible(QByteArray()));
+
+        QByteArray random(100000, Qt::Uninitialized);
+        for (auto &c : random)
+            c = char(qrand());
+        QVERIFY(!ContentEncoding::isLikelyCompressible(random));
+    }
+
+    void testCompressedFormats()
+    {
+        // The content doesn't matter, the magic bytes are enough to not even try
+        const QByteArray text(100000, 'A');
+        QVERIFY(!ContentEncoding::isCompressedFormat(text));
+        QVERIFY(!ContentEncoding::gzipCompressIfSmaller(text).isEmpty());
+
+        for (const QByteArray magic : { QByteArray("\x1f\x8b", 2), QByteArray("PK\x03\x04"), QByteArray("\xff\xd8\xff") }) {
+            const auto data = magic + text;
+            QVERIFY(ContentEncoding::isCompressedFormat(data));
+            QVERIFY(!ContentEncoding::isLikelyCompressible(data));
+            QVERIFY(ContentEncoding::gzipCompressIfSmaller(data).isEmpty());
+        }
+    }
+
+    void testDecompressInPieces()
+    {
+        QByteArray data;
+        for (int i = 0; i < 10000; ++i)
+            data += QByteArray::number(i) + ' ';
+        const auto compressed = ContentEncoding::gzipCompress(data);
+        QVERIFY(compressed.size() < data.size());
+
+        GzipDecompressor decompressor;
+        QByteArray result;
+        for (int pos = 0; pos < compressed.size(); pos += 100) {
+            QVERIFY(!decompressor.isFinished());
+            QVERIFY(decompressor.decompress(compressed.constData() + pos, qMin(100, compressed.size() - pos), &result));
+        }
+        QVERIFY(decompressor.isFinished());
+        QCOMPARE(result, data);
+
+        // Nothing may follow the end of the stream
+        QVERIFY(!decompressor.decompress("x", 1, &result));
+
+        GzipDecompressor corrupt;
+        QVERIFY(!corrupt.decompress(data.constData(), data.size(), &result));
+    }
+
+    void testUpload_data()
+    {
+        QTest::addColumn<bool>("chunkingNG");
+        QTest::newRow("v1") << false;
+        QTest::newRow("ng") << true;
+    }
+
+    void testUpload()
+    {
+        QFETCH(bool, chunkingNG);
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        enableCompression(fakeFolder);
+        if (chunkingNG) {
+            fakeFolder.syncEngine().account()->setCapabilities({ { "dav", QVariantMap{ { "chunking", "1.0" }, { "contentEncodings", QStringList{ "gzip" } } } } });
+            SyncOptions options;
+            options._initialChunkSize = 1000 * 1000;
+            options._minChunkSize = options._maxChunkSize = options._initialChunkSize;
+            fakeFolder.syncEngine().setSyncOptions(options);
+        }
+        qint64 sentBytes = 0;
+        int nCompressed = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation) {
+                sentBytes += outgoingData->size();
+                if (request.rawHeader("Content-Encoding") == "gzip")
+                    ++nCompressed;
+            }
+            return nullptr;
+        });
+
+        const qint64 size = 3 * 1000 * 1000;
+        fakeFolder.localModifier().insert("A/big", size);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(fakeFolder.currentRemoteState().find("A/big")->size, size);
+        QVERIFY(nCompressed > 0);
+        QVERIFY(sentBytes < size / 10);
+    }
+
+    void testDownload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        enableCompression(fakeFolder);
+        int nAccepted = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && request.rawHeader("Accept-Encoding") == "gzip")
+                ++nAccepted;
+            return nullptr;
+        });
+
+        fakeFolder.remoteModifier().insert("A/big", 3 * 1000 * 1000);
+        fakeFolder.remoteModifier().appendByte("A/a1");
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nAccepted, 2);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testTruncatedDownload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().setIgnoreHiddenFiles(true);
+        enableCompression(fakeFolder);
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation) {
+                auto reply = new FakeGetReply(fakeFolder.remoteModifier(), op, request, &fakeFolder.syncEngine());
+                QObject::connect(reply, &QNetworkReply::metaDataChanged, reply, [reply] {
+                    // The connection breaks halfway through the body
+                    const int half = reply->compressedBody.size() / 2;
+                    reply->compressedBody.chop(half);
+                    reply->size -= half;
+                });
+                return reply;
+            }
+            return nullptr;
+        });
+
+        fakeFolder.remoteModifier().insert("A/big", 100 * 1000);
+        QVERIFY(!fakeFolder.syncOnce());
+        QVERIFY(!fakeFolder.currentLocalState().find("A/big"));
+        QVERIFY(fakeFolder.syncEngine().isAnotherSyncNeeded());
+
+        fakeFolder.setServerOverride(nullptr);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testNoCapability()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        int nEncoded = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (request.hasRawHeader("Content-Encoding") || request.hasRawHeader("Accept-Encoding"))
+                ++nEncoded;
+            return nullptr;
+        });
+
+        fakeFolder.localModifier().insert("A/up", 100 * 1000);
+        fakeFolder.remoteModifier().insert("B/down", 100 * 1000);
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nEncoded, 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestCompression)
+#include "testcompression.moc"
@@ -40,6 +40,21 @@ public:
 };
 
 
+static QByteArray sha1Hex(qint64 size, char contentChar)
+{
+    return QCryptographicHash::hash(QByteArray(size, contentChar), QCryptographicHash::Sha1).toHex();
+}
+
+/* The nc:block-checksums property of a file filled with contentChar */
+static QByteArray blockChecksumsProperty(qint64 size, char contentChar, qint64 blockSize)
+{
+    QByteArray value = "SHA1 " + QByteArray::number(blockSize);
+    for (qint64 offset = 0; offset < size; offset += blockSize)
+        value += ' ' + sha1Hex(qMin(blockSize, size - offset), contentChar);
+    return "<nc:block-checksums xmlns:nc=\"http://nextcloud.org/ns\">" + value + "</nc:block-checksums>";
+}
+
+
 SyncFileItemPtr getItem(const QSignalSpy &spy, const QString &path)
 {
     for (const QList<QVariant> &args : spy) {
@@ -242,6 +257,156 @@ private slots:
         QCOMPARE(getItem(completeSpy, "A/resendme")->_status, SyncFileItem::NormalError);
         QVERIFY(getItem(completeSpy, "A/resendme")->_errorString.contains(serverMessage));
     }
+
+    void testDeltaDownload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions options;
+        options._deltaDownloads = true;
+        options._minDeltaDownloadSize = 0;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.remoteModifier().insert("A/big", 3 * 4096, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+
+        // Only the appended byte is downloaded
+        fakeFolder.remoteModifier().appendByte("A/big");
+        auto big = fakeFolder.remoteModifier().find("A/big");
+        big->checksums = "SHA1:" + sha1Hex(3 * 4096 + 1, 'X');
+        big->extraDavProperties = blockChecksumsProperty(3 * 4096 + 1, 'X', 4096);
+        QByteArrayList ranges;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ranges.append(request.rawHeader("Range"));
+            return nullptr;
+        });
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(ranges, QByteArrayList{ "bytes=12288-12288" });
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testDeltaDownloadWithStaleBlockChecksums()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions options;
+        options._deltaDownloads = true;
+        options._minDeltaDownloadSize = 0;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.remoteModifier().insert("A/big", 3 * 4096, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+
+        // The block checksums don't match the content: the whole file is downloaded again
+        fakeFolder.remoteModifier().setContents("A/big", 'Y');
+        fakeFolder.remoteModifier().appendByte("A/big");
+        auto big = fakeFolder.remoteModifier().find("A/big");
+        big->checksums = "SHA1:" + sha1Hex(3 * 4096 + 1, 'Y');
+        big->extraDavProperties = blockChecksumsProperty(3 * 4096 + 1, 'X', 4096);
+        QByteArrayList ranges;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ranges.append(request.rawHeader("Range"));
+            return nullptr;
+        });
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(ranges, (QByteArrayList{ "bytes=12288-12288", QByteArray() }));
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testDeltaDownloadProgress()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions options;
+        options._deltaDownloads = true;
+        options._minDeltaDownloadSize = 0;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.remoteModifier().insert("A/big", 3 * 4096, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+
+        fakeFolder.remoteModifier().appendByte("A/big");
+        auto big = fakeFolder.remoteModifier().find("A/big");
+        big->checksums = "SHA1:" + sha1Hex(3 * 4096 + 1, 'X');
+        big->extraDavProperties = blockChecksumsProperty(3 * 4096 + 1, 'X', 4096);
+        quint64 completed = 0;
+        connect(&fakeFolder.syncEngine(), &SyncEngine::transmissionProgress, this, [&](const ProgressInfo &pi) {
+            completed = pi.completedSize();
+        });
+        quint64 completedBeforeRange = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation && !request.rawHeader("Range").isEmpty())
+                completedBeforeRange = completed;
+            return nullptr;
+        });
+        QVERIFY(fakeFolder.syncOnce());
+        // The reused blocks count as done before the missing byte is fetched
+        QCOMPARE(completedBeforeRange, quint64(3 * 4096));
+    }
+
+    void testDeltaDownloadRejectsBlockSize_data()
+    {
+        QTest::addColumn<qint64>("blockSize");
+        QTest::newRow("too small") << qint64(1000);
+        QTest::newRow("too large") << qint64(32 * 1024 * 1024);
+    }
+
+    void testDeltaDownloadRejectsBlockSize()
+    {
+        QFETCH(qint64, blockSize);
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions options;
+        options._deltaDownloads = true;
+        options._minDeltaDownloadSize = 0;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.remoteModifier().insert("A/big", 3 * 4096, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+
+        // A normal download instead of the range requests
+        fakeFolder.remoteModifier().appendByte("A/big");
+        auto big = fakeFolder.remoteModifier().find("A/big");
+        big->checksums = "SHA1:" + sha1Hex(3 * 4096 + 1, 'X');
+        big->extraDavProperties = blockChecksumsProperty(3 * 4096 + 1, 'X', blockSize);
+        QByteArrayList ranges;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ranges.append(request.rawHeader("Range"));
+            return nullptr;
+        });
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(ranges, QByteArrayList{ QByteArray() });
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testDeltaDownloadAbortDuringBlockCopy()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions options;
+        options._deltaDownloads = true;
+        options._minDeltaDownloadSize = 0;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        fakeFolder.remoteModifier().insert("A/big", 3 * 4096, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+
+        fakeFolder.remoteModifier().appendByte("A/big");
+        auto big = fakeFolder.remoteModifier().find("A/big");
+        big->checksums = "SHA1:" + sha1Hex(3 * 4096 + 1, 'X');
+        big->extraDavProperties = blockChecksumsProperty(3 * 4096 + 1, 'X', 4096);
+        QByteArrayList ranges;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ranges.append(request.rawHeader("Range"));
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute) == "PROPFIND"
+                && request.url().path().endsWith("A/big")) {
+                // Abort once the block checksums arrived, while the local blocks are copied
+                auto reply = new FakePropfindReply(fakeFolder.remoteModifier(), op, request, this);
+                connect(reply, &QNetworkReply::finished, this, [&] {
+                    QTimer::singleShot(0, &fakeFolder.syncEngine(), [&] { fakeFolder.syncEngine().abort(); });
+                });
+                return reply;
+            }
+            return nullptr;
+        });
+        QVERIFY(!fakeFolder.syncOnce());
+        QTest::qWait(100);
+        QCOMPARE(ranges, QByteArrayList());
+    }
 };
 
 QTEST_GUILESS_MAIN(TestDownload)
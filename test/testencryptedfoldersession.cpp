@@ -0,0 +1,212 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <encryptedfoldersession.h>
+#include <clientsideencryption.h>
+
+using namespace OCC;
+
+// Only needed to encrypt the metadata key
+static const char publicKeyPem[] =
+    "-----BEGIN PUBLIC KEY-----\n"
+    "MIIBIjANBgkqhkiG9w0BAQEFAAOCAQ8AMIIBCgKCAQEAtor3wLGNVPiHbRICKYcN\n"
+    "+OYNx/+1NrOgjN+Peu5DVnz0X0gTelspOBJU6uk41eMyRtom0LDS5pjjD5iFPFvr\n"
+    "WelsRh0G6Sf51VO9wjicfaomGPGBm6yxR38WrdHEpzv6YVJF9XNyHjrUwvtviigG\n"
+    "5lFqAGFJrAD5cnrY5EN1nUUbQ/ndh8IV9GQBOzrRMCLMEDX0SZZGCvMuLE7OLacz\n"
+    "Zrz7jve6jAp9X8vEzeRqtYQkmxRWyQ3vtH6phY5TLO3oOYrM+NV+iyLxHodwCQyn\n"
+    "CgtRjyYMBxb8Z27ZU2yqRm0fWIupBrlyeURoROG5Elbuy/MyX6us3Ol0HXG/M7PM\n"
+    "+QIDAQAB\n"
+    "-----END PUBLIC KEY-----\n";
+
+// The end-to-end encryption API of the server for one folder without metadata
+struct FakeE2eServer
+{
+    int locks = 0;
+    int unlocks = 0;
+    int metadataGets = 0;
+    int metadataSends = 0;
+    bool failSends = false;
+
+    FakeQNAM::Override override(QObject *parent)
+    {
+        return [this, parent](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            const QString path = request.url().path();
+            if (path.contains(QLatin1String("/lock/"))) {
+                if (op == QNetworkAccessManager::PostOperation) {
+                    ++locks;
+                    return new FakePayloadReply(op, request, R"({"ocs":{"data":{"token":"the-token"}}})", parent);
+                }
+                ++unlocks;
+                return new FakePayloadReply(op, request, QByteArray(), parent);
+            }
+            if (path.contains(QLatin1String("/meta-data/"))) {
+                if (op == QNetworkAccessManager::GetOperation) {
+                    ++metadataGets;
+                    return new FakeErrorReply(op, request, parent, 404);
+                }
+                ++metadataSends;
+                if (failSends)
+                    return new FakeErrorReply(op, request, parent, 500);
+                return new FakePayloadReply(op, request, QByteArray(), parent);
+            }
+            return nullptr;
+        };
+    }
+};
+
+static EncryptedFile makeFile(const QString &name)
+{
+    EncryptedFile file;
+    file.encryptionKey = EncryptionHelper::generateRandom(16);
+    file.initializationVector = EncryptionHelper::generateRandom(16);
+    file.encryptedFilename = EncryptionHelper::generateRandomFilename();
+    file.originalFilename = name;
+    file.mimetype = "text/plain";
+    file.fileVersion = 1;
+    file.metadataKey = 1;
+    return file;
+}
+
+class TestEncryptedFolderSession : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testSharedLock()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        auto account = fakeFolder.syncEngine().account();
+        account->e2e()->_publicKey = QSslKey(publicKeyPem, QSsl::Rsa, QSsl::Pem, QSsl::PublicKey);
+        FakeE2eServer server;
+        fakeFolder.setServerOverride(server.override(this));
+
+        QPointer<EncryptedFolderSession> session = new EncryptedFolderSession(account, "42", nullptr);
+        QVector<FolderMetadata *> ready;
+        int failed = 0;
+        for (int i = 0; i < 3; ++i) {
+            session->acquire(this, [&](FolderMetadata *metadata) { ready.append(metadata); }, [&] { ++failed; });
+        }
+        QTRY_COMPARE(ready.size(), 3);
+        QCOMPARE(failed, 0);
+        QCOMPARE(server.locks, 1);
+        QCOMPARE(server.metadataGets, 1);
+        QCOMPARE(session->token(), QByteArray("the-token"));
+
+        // The first update is sent right away, the two following ones
+        // are folded into one update sent after it
+        QVector<bool> stored;
+        for (int i = 0; i < 3; ++i) {
+            ready[i]->addEncryptedFile(makeFile(QStringLiteral("file%1").arg(i)));
+            session->storeMetadata(this, [&](bool success) { stored.append(success); });
+        }
+        QTRY_COMPARE(stored.size(), 3);
+        QCOMPARE(stored, QVector<bool>({ true, true, true }));
+        QCOMPARE(server.metadataSends, 2);
+        QCOMPARE(ready[0]->files().size(), 3);
+
+        // Unlocked once everybody is done
+        session->release();
+        session->release();
+        QTest::qWait(50);
+        QCOMPARE(server.unlocks, 0);
+        session->release();
+        QTRY_COMPARE(server.unlocks, 1);
+        QTRY_VERIFY(!session);
+        QCOMPARE(server.locks, 1);
+    }
+
+    void testFailedUpdate()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        auto account = fakeFolder.syncEngine().account();
+        account->e2e()->_publicKey = QSslKey(publicKeyPem, QSsl::Rsa, QSsl::Pem, QSsl::PublicKey);
+        FakeE2eServer server;
+        fakeFolder.setServerOverride(server.override(this));
+
+        QPointer<EncryptedFolderSession> session = new EncryptedFolderSession(account, "42", nullptr);
+        QVector<FolderMetadata *> ready;
+        for (int i = 0; i < 3; ++i) {
+            session->acquire(this, [&](FolderMetadata *metadata) { ready.append(metadata); }, [] {});
+        }
+        QTRY_COMPARE(ready.size(), 3);
+
+        // The second change waits for the failing update and fails with it
+        server.failSends = true;
+        QVector<bool> stored;
+        ready[0]->addEncryptedFile(makeFile(QStringLiteral("failing")));
+        session->storeMetadata(this, [&](bool success) { stored.append(success); });
+        ready[1]->addEncryptedFile(makeFile(QStringLiteral("waiting")));
+        session->storeMetadata(this, [&](bool success) { stored.append(success); });
+        QTRY_COMPARE(stored.size(), 2);
+        QCOMPARE(stored, QVector<bool>({ false, false }));
+        QCOMPARE(server.metadataSends, 1);
+        QVERIFY(!session->isAcquirable());
+
+        // A later change doesn't publish the failed ones either
+        server.failSends = false;
+        ready[2]->addEncryptedFile(makeFile(QStringLiteral("later")));
+        session->storeMetadata(this, [&](bool success) { stored.append(success); });
+        QTRY_COMPARE(stored.size(), 3);
+        QCOMPARE(stored.last(), false);
+        QCOMPARE(server.metadataSends, 1);
+
+        for (int i = 0; i < 3; ++i)
+            session->release();
+        QTRY_COMPARE(server.unlocks, 1);
+        QTRY_VERIFY(!session);
+    }
+
+    // Like when the propagator goes away during an abort
+    void testUnlockOnDestruction()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        auto account = fakeFolder.syncEngine().account();
+        FakeE2eServer server;
+        fakeFolder.setServerOverride(server.override(this));
+
+        auto parent = new QObject;
+        QPointer<EncryptedFolderSession> session = new EncryptedFolderSession(account, "42", nullptr, parent);
+        bool isReady = false;
+        session->acquire(this, [&](FolderMetadata *) { isReady = true; }, [] {});
+        QTRY_VERIFY(isReady);
+
+        delete parent;
+        QVERIFY(!session);
+        QTRY_COMPARE(server.unlocks, 1);
+    }
+
+    // A new session of the folder only locks it after the previous one unlocked it
+    void testSessionsAfterEachOther()
+    {
+        FakeFolder fakeFolder{ FileInfo{} };
+        auto account = fakeFolder.syncEngine().account();
+        FakeE2eServer server;
+        fakeFolder.setServerOverride(server.override(this));
+
+        QPointer<EncryptedFolderSession> first = new EncryptedFolderSession(account, "42", nullptr);
+        bool firstReady = false;
+        first->acquire(this, [&](FolderMetadata *) { firstReady = true; }, [] {});
+        QTRY_VERIFY(firstReady);
+        first->release();
+        QVERIFY(!first->isAcquirable());
+
+        auto second = new EncryptedFolderSession(account, "42", first, this);
+        bool secondReady = false;
+        second->acquire(this, [&](FolderMetadata *) { secondReady = true; }, [] {});
+        QTRY_VERIFY(secondReady);
+        QVERIFY(!first);
+        QCOMPARE(server.unlocks, 1);
+        QCOMPARE(server.locks, 2);
+        second->release();
+        QTRY_COMPARE(server.unlocks, 2);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestEncryptedFolderSession)
+#include "testencryptedfoldersession.moc"
@@ -8,10 +8,12 @@
 #include <QDebug>
 
 #include "filesystem.h"
+#include "common/iouring.h"
 #include "common/utility.h"
 
 using namespace OCC::Utility;
 using namespace OCC::FileSystem;
+using OCC::IoUring;
 
 class TestFileSystem : public QObject
 {
@@ -70,6 +72,51 @@ private slots:
         QCOMPARE(sSum, sum);
     }
 
+    void testCloneFile()
+    {
+        QString source( _root.path() + "/file_c.bin");
+        QString destination( _root.path() + "/file_d.bin");
+        QVERIFY(writeRandomFile(source));
+
+        // Replaces what was there before
+        QFile existing(destination);
+        QVERIFY(existing.open(QIODevice::WriteOnly));
+        existing.write(QByteArray(100000, 'x'));
+        existing.close();
+
+        QString error;
+        QVERIFY(cloneFile(source, destination, &error));
+        QVERIFY(error.isEmpty());
+        QVERIFY(fileEquals(source, destination));
+
+        QVERIFY(!cloneFile(_root.path() + "/missing", destination, &error));
+        QVERIFY(!error.isEmpty());
+    }
+
+    void testChecksumsWithoutIoUring()
+    {
+        // Spans several of the reads io_uring keeps in flight
+        QString file( _root.path() + "/file_e.bin");
+        QVERIFY(writeRandomFile(file, 3 * 1024 * 1024 + 123));
+
+        const QByteArray md5 = calcMd5(file);
+        const QByteArray sha1 = calcSha1(file);
+#ifdef ZLIB_FOUND
+        const QByteArray adler = calcAdler32(file);
+#endif
+        QVERIFY(!sha1.isEmpty());
+
+        IoUring::setEnabled(false);
+        QCOMPARE(calcMd5(file), md5);
+        QCOMPARE(calcSha1(file), sha1);
+#ifdef ZLIB_FOUND
+        QCOMPARE(calcAdler32(file), adler);
+#endif
+        IoUring::setEnabled(true);
+
+        QVERIFY(calcSha1(_root.path() + "/missing").isEmpty());
+    }
+
 };
 
 QTEST_APPLESS_MAIN(TestFileSystem)
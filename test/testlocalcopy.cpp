@@ -0,0 +1,97 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+#include <filesystem.h>
+
+using namespace OCC;
+
+static QByteArray sha1Header(qint64 size, char contentChar)
+{
+    return "SHA1:" + QCryptographicHash::hash(QByteArray(size, contentChar), QCryptographicHash::Sha1).toHex();
+}
+
+// The server copies a file: same content and checksum, new path
+static void remoteCopy(FakeFolder &fakeFolder, const QString &path, qint64 size, char contentChar)
+{
+    fakeFolder.remoteModifier().insert(path, size, contentChar);
+    fakeFolder.remoteModifier().find(path)->checksums = sha1Header(size, contentChar);
+}
+
+class TestLocalCopy : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCopyInsteadOfDownload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions options;
+        options._localCopyForDownloads = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        int nGET = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ++nGET;
+            return nullptr;
+        });
+
+        remoteCopy(fakeFolder, "A/big", 1000, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nGET, 1);
+
+        remoteCopy(fakeFolder, "B/big", 1000, 'X');
+        remoteCopy(fakeFolder, "C/big", 1000, 'X');
+        remoteCopy(fakeFolder, "C/other", 1000, 'Y');
+        nGET = 0;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(nGET, 1);
+
+        // The copies are in the journal like downloaded files
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("C/big"), &record));
+        QCOMPARE(record._checksumHeader, sha1Header(1000, 'X'));
+        QCOMPARE(record._etag, fakeFolder.remoteModifier().find("C/big")->etag.toUtf8());
+        QCOMPARE(record._modtime, (qint64)FileSystem::getModTime(fakeFolder.localPath() + "C/big"));
+
+        nGET = 0;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nGET, 0);
+    }
+
+    void testChangedSourceIsNotUsed()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        SyncOptions options;
+        options._localCopyForDownloads = true;
+        fakeFolder.syncEngine().setSyncOptions(options);
+        int nGET = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::GetOperation)
+                ++nGET;
+            return nullptr;
+        });
+
+        remoteCopy(fakeFolder, "A/big", 1000, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+
+        // The local file differs from what the journal knows
+        fakeFolder.localModifier().setContents("A/big", 'Z');
+        remoteCopy(fakeFolder, "B/big", 1000, 'X');
+        nGET = 0;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(nGET, 1);
+        QCOMPARE(fakeFolder.currentLocalState().find("B/big")->contentChar, 'X');
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestLocalCopy)
+#include "testlocalcopy.moc"
@@ -0,0 +1,105 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "logger.h"
+
+using namespace OCC;
+
+class TestLogger : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        // Small enough for the bursts to fill it
+        qputenv("OWNCLOUD_LOG_QUEUE_SIZE", "64");
+    }
+
+    // Logging threads don't wait for the drain thread: what doesn't fit is
+    // dropped and counted, everything else arrives in order
+    void testBurstDoesNotBlock()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString logFile = dir.path() + QStringLiteral("/burst.log");
+        auto logger = Logger::instance();
+        const quint64 droppedBefore = logger->droppedMessageCount();
+        logger->setLogFile(logFile);
+
+        const int threads = 4;
+        const int messages = 20000;
+        QVector<QThread *> producers;
+        for (int t = 0; t < threads; ++t) {
+            producers.append(QThread::create([logger, t] {
+                for (int i = 0; i < messages; ++i)
+                    logger->doLog(QStringLiteral("burst %1 %2").arg(t).arg(i));
+            }));
+            producers.last()->start();
+        }
+        for (auto producer : producers) {
+            producer->wait();
+            delete producer;
+        }
+        logger->setLogFile(QString());
+
+        QFile file(logFile);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QVector<int> last(threads, -1);
+        int written = 0;
+        while (!file.atEnd()) {
+            const QList<QByteArray> parts = file.readLine().trimmed().split(' ');
+            if (parts.size() != 3 || parts[0] != "burst")
+                continue;
+            const int t = parts[1].toInt();
+            const int i = parts[2].toInt();
+            QVERIFY(i > last[t]);
+            last[t] = i;
+            ++written;
+        }
+        QCOMPARE(written + logger->droppedMessageCount() - droppedBefore, quint64(threads * messages));
+    }
+
+    // The messages of different threads are written in the order they were logged
+    void testChronologicalAcrossThreads()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString logFile = dir.path() + QStringLiteral("/order.log");
+        auto logger = Logger::instance();
+        logger->setLogFile(logFile);
+
+        const int steps = 40;
+        for (int step = 0; step < steps; step += 2) {
+            logger->doLog(QStringLiteral("step %1").arg(step));
+            QScopedPointer<QThread> other(QThread::create([logger, step] {
+                logger->doLog(QStringLiteral("step %1").arg(step + 1));
+            }));
+            other->start();
+            other->wait();
+        }
+        logger->setLogFile(QString());
+
+        QFile file(logFile);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        int next = 0;
+        while (!file.atEnd()) {
+            const QList<QByteArray> parts = file.readLine().trimmed().split(' ');
+            if (parts.size() != 2 || parts[0] != "step")
+                continue;
+            QCOMPARE(parts[1].toInt(), next);
+            ++next;
+        }
+        QCOMPARE(next, steps);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestLogger)
+#include "testlogger.moc"
@@ -0,0 +1,175 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+
+#include "progressdispatcher.h"
+
+using namespace OCC;
+
+static SyncFileItem makeItem(const QString &file, quint64 size, csync_instructions_e instruction = CSYNC_INSTRUCTION_NEW)
+{
+    SyncFileItem item;
+    item._file = file;
+    item._size = size;
+    item._type = ItemTypeFile;
+    item._instruction = instruction;
+    item._direction = SyncFileItem::Down;
+    return item;
+}
+
+class TestProgressInfo : public QObject
+{
+    Q_OBJECT
+
+    QVector<SyncFileItem> _completed;
+
+    // What completedSize() was before it was kept up to date incrementally
+    quint64 recomputedSize(const ProgressInfo &pi) const
+    {
+        quint64 size = 0;
+        for (const auto &item : _completed) {
+            if (ProgressInfo::isSizeDependent(item))
+                size += item._size;
+        }
+        for (const auto &current : pi._currentItems) {
+            if (ProgressInfo::isSizeDependent(current._item))
+                size += current._progress._completed;
+        }
+        return qMin(size, pi.totalSize());
+    }
+
+    void complete(ProgressInfo &pi, const SyncFileItem &item)
+    {
+        pi.setProgressComplete(item);
+        _completed.append(item);
+    }
+
+private slots:
+    void init()
+    {
+        _completed.clear();
+    }
+
+    void testParallelItems()
+    {
+        ProgressInfo pi;
+        const QVector<SyncFileItem> items = {
+            makeItem("a", 1000),
+            makeItem("b", 2000),
+            makeItem("c", 500, CSYNC_INSTRUCTION_SYNC),
+            // Counted as a file but not by size
+            makeItem("d", 700, CSYNC_INSTRUCTION_REMOVE),
+        };
+        for (const auto &item : items)
+            pi.adjustTotalsForFile(item);
+        QCOMPARE(pi.totalSize(), quint64(3500));
+
+        pi.setProgressItem(items[0], 100);
+        pi.setProgressItem(items[1], 300);
+        pi.setProgressItem(items[3], 0);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        QCOMPARE(pi.completedSize(), quint64(400));
+
+        pi.setProgressItem(items[2], 250);
+        pi.setProgressItem(items[0], 900);
+        pi.setProgressItem(items[1], 1200);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        QCOMPARE(pi.completedSize(), quint64(2350));
+
+        complete(pi, items[0]);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        QCOMPARE(pi.completedSize(), quint64(2450));
+
+        complete(pi, items[3]);
+        complete(pi, items[2]);
+        pi.setProgressItem(items[1], 2000);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        complete(pi, items[1]);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        QCOMPARE(pi.completedSize(), pi.totalSize());
+        QCOMPARE(pi.completedFiles(), pi.totalFiles());
+        QVERIFY(pi._currentItems.isEmpty());
+    }
+
+    void testRestartedItem()
+    {
+        ProgressInfo pi;
+        const auto a = makeItem("a", 1000);
+        const auto b = makeItem("b", 1000);
+        pi.adjustTotalsForFile(a);
+        pi.adjustTotalsForFile(b);
+
+        pi.setProgressItem(a, 800);
+        pi.setProgressItem(b, 100);
+        QCOMPARE(pi.completedSize(), quint64(900));
+
+        // A download that starts over reports less than before
+        pi.setProgressItem(a, 0);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        QCOMPARE(pi.completedSize(), quint64(100));
+
+        pi.setProgressItem(a, 400);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+
+        // More than the size is capped to the size of the item
+        pi.setProgressItem(b, 5000);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        QCOMPARE(pi.completedSize(), quint64(1400));
+
+        complete(pi, a);
+        complete(pi, b);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        QCOMPARE(pi.completedSize(), quint64(2000));
+    }
+
+    void testCompletedTwice()
+    {
+        ProgressInfo pi;
+        const auto a = makeItem("a", 1000);
+        const auto b = makeItem("b", 1000);
+        pi.adjustTotalsForFile(a);
+        pi.adjustTotalsForFile(b);
+
+        pi.setProgressItem(a, 600);
+        pi.setProgressItem(b, 300);
+        complete(pi, a);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+
+        // The second completion must not take the running progress of other items away
+        complete(pi, a);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        QCOMPARE(pi._currentItems.size(), 1);
+
+        // An item that is completed and then reports progress again runs anew
+        pi.setProgressItem(a, 200);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        complete(pi, a);
+        complete(pi, b);
+        QCOMPARE(pi.completedSize(), recomputedSize(pi));
+        QVERIFY(pi._currentItems.isEmpty());
+    }
+
+    void testReset()
+    {
+        ProgressInfo pi;
+        const auto a = makeItem("a", 1000);
+        pi.adjustTotalsForFile(a);
+        pi.setProgressItem(a, 600);
+
+        pi.reset();
+        QCOMPARE(pi.completedSize(), quint64(0));
+        pi.adjustTotalsForFile(a);
+        pi.setProgressItem(a, 100);
+        QCOMPARE(pi.completedSize(), quint64(100));
+        complete(pi, a);
+        QCOMPARE(pi.completedSize(), quint64(1000));
+    }
+};
+
+QTEST_GUILESS_MAIN(TestProgressInfo)
+#include "testprogressinfo.moc"
@@ -0,0 +1,199 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include "notificationserver.h"
+#include "pushnotifications.h"
+#include "capabilities.h"
+
+using namespace OCC;
+
+static const QUrl preAuthUrl(QStringLiteral("http://127.0.0.1/owncloud/index.php/apps/notify_push/pre_auth"));
+
+/// An account whose pre_auth requests are answered with \a token, or fail if it's empty
+class PushAccount
+{
+public:
+    explicit PushAccount(const QString &token)
+        : _token(token)
+    {
+        auto qnam = new FakeQNAM({});
+        qnam->setOverride([this, qnam](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op != QNetworkAccessManager::PostOperation || request.url() != preAuthUrl)
+                return new FakeErrorReply(op, request, qnam, 404);
+            ++preAuthCount;
+            if (_token.isEmpty())
+                return new FakeErrorReply(op, request, qnam, 500);
+            return new FakePayloadReply(op, request, _token.toUtf8(), qnam);
+        });
+        account = Account::create();
+        account->setUrl(QUrl(QStringLiteral("http://127.0.0.1/owncloud")));
+        account->setCredentials(new FakeCredentials{ qnam });
+    }
+
+    AccountPtr account;
+    int preAuthCount = 0;
+
+private:
+    QString _token;
+};
+
+class TestPushNotifications : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCapabilities()
+    {
+        QVariantMap endpoints{
+            { "websocket", "wss://cloud.example.com/push/ws" },
+            { "pre_auth", "https://cloud.example.com/apps/notify_push/pre_auth" },
+        };
+        QVariantMap notifyPush{
+            { "type", QStringList{ "files", "activities", "notifications" } },
+            { "endpoints", endpoints },
+        };
+        Capabilities caps({ { "notify_push", notifyPush } });
+        QCOMPARE(caps.pushNotificationsWebSocketUrl(), QUrl("wss://cloud.example.com/push/ws"));
+        QCOMPARE(caps.pushNotificationsPreAuthUrl(), QUrl("https://cloud.example.com/apps/notify_push/pre_auth"));
+
+        // Only file notifications are of use
+        notifyPush["type"] = QStringList{ "activities" };
+        QVERIFY(Capabilities({ { "notify_push", notifyPush } }).pushNotificationsWebSocketUrl().isEmpty());
+
+        // Can't authenticate without pre_auth
+        notifyPush["type"] = QStringList{ "files" };
+        endpoints.remove("pre_auth");
+        notifyPush["endpoints"] = endpoints;
+        QVERIFY(Capabilities({ { "notify_push", notifyPush } }).pushNotificationsWebSocketUrl().isEmpty());
+
+        QVERIFY(Capabilities(QVariantMap()).pushNotificationsWebSocketUrl().isEmpty());
+    }
+
+    void testFilesChanged()
+    {
+        NotificationServer server;
+        PushAccount pushAccount(server.token());
+        PushNotifications push(pushAccount.account, server.url(), preAuthUrl);
+        QSignalSpy connectedSpy(&push, &PushNotifications::connectedChanged);
+        QSignalSpy changedSpy(&push, &PushNotifications::filesChanged);
+
+        push.start();
+        QVERIFY(connectedSpy.wait());
+        QVERIFY(push.isConnected());
+        QCOMPARE(server.authenticatedCount(), 1);
+        QCOMPARE(pushAccount.preAuthCount, 1);
+
+        // Only file changes are reported
+        server.notifyActivity();
+        server.notifyFile();
+        QVERIFY(changedSpy.wait());
+        QCOMPARE(changedSpy.count(), 1);
+
+        server.notifyFile();
+        QVERIFY(changedSpy.wait());
+        QCOMPARE(changedSpy.count(), 2);
+
+        push.stop();
+        QVERIFY(!push.isConnected());
+        QTRY_COMPARE(server.authenticatedCount(), 0);
+    }
+
+    void testStaysConnectedWithPings()
+    {
+        NotificationServer server;
+        PushAccount pushAccount(server.token());
+        PushNotifications push(pushAccount.account, server.url(), preAuthUrl);
+        push.setPingInterval(std::chrono::milliseconds(20));
+        QSignalSpy connectedSpy(&push, &PushNotifications::connectedChanged);
+
+        push.start();
+        QVERIFY(connectedSpy.wait());
+        QTest::qWait(300);
+        QVERIFY(push.isConnected());
+        QCOMPARE(connectedSpy.count(), 1);
+        QCOMPARE(server.connectionCount(), 1);
+    }
+
+    void testInvalidToken()
+    {
+        NotificationServer server;
+        PushAccount pushAccount(QStringLiteral("stale"));
+        PushNotifications push(pushAccount.account, server.url(), preAuthUrl);
+        push.setRetryDelays(std::chrono::milliseconds(10), std::chrono::milliseconds(10));
+        QSignalSpy connectedSpy(&push, &PushNotifications::connectedChanged);
+
+        push.start();
+        // Every attempt asks for a new token
+        QTRY_VERIFY(server.connectionCount() >= 3);
+        QVERIFY(pushAccount.preAuthCount >= 3);
+        QVERIFY(!push.isConnected());
+        QCOMPARE(connectedSpy.count(), 0);
+    }
+
+    void testPreAuthFails()
+    {
+        NotificationServer server;
+        PushAccount pushAccount(QString());
+        PushNotifications push(pushAccount.account, server.url(), preAuthUrl);
+        push.setRetryDelays(std::chrono::milliseconds(10), std::chrono::milliseconds(10));
+
+        push.start();
+        QTRY_VERIFY(pushAccount.preAuthCount >= 3);
+        QCOMPARE(server.connectionCount(), 0);
+        QVERIFY(!push.isConnected());
+    }
+
+    void testReconnect()
+    {
+        NotificationServer server;
+        PushAccount pushAccount(server.token());
+        PushNotifications push(pushAccount.account, server.url(), preAuthUrl);
+        push.setRetryDelays(std::chrono::milliseconds(50), std::chrono::milliseconds(200));
+        QSignalSpy connectedSpy(&push, &PushNotifications::connectedChanged);
+        QSignalSpy changedSpy(&push, &PushNotifications::filesChanged);
+
+        push.start();
+        QVERIFY(connectedSpy.wait());
+
+        server.setAvailable(false);
+        QVERIFY(connectedSpy.wait());
+        QVERIFY(!push.isConnected());
+        // Keeps retrying
+        const int connections = server.connectionCount();
+        QTRY_VERIFY(server.connectionCount() > connections + 1);
+
+        server.setAvailable(true);
+        QVERIFY(connectedSpy.wait());
+        QVERIFY(push.isConnected());
+        QVERIFY(pushAccount.preAuthCount > 2);
+
+        server.notifyFile();
+        QVERIFY(changedSpy.wait());
+    }
+
+    void testUnreachable()
+    {
+        quint16 port;
+        {
+            NotificationServer server;
+            port = server.serverPort();
+        }
+        PushAccount pushAccount(QStringLiteral("push-token"));
+        PushNotifications push(pushAccount.account, QUrl(QStringLiteral("ws://127.0.0.1:%1/push/ws").arg(port)), preAuthUrl);
+        push.setRetryDelays(std::chrono::milliseconds(10), std::chrono::milliseconds(10));
+        QSignalSpy connectedSpy(&push, &PushNotifications::connectedChanged);
+        push.start();
+        QTRY_VERIFY(pushAccount.preAuthCount >= 3);
+        QVERIFY(!push.isConnected());
+        QCOMPARE(connectedSpy.count(), 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestPushNotifications)
+#include "testpushnotifications.moc"
@@ -0,0 +1,321 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *       support, and with no warranty, express or implied, as to its usefulness for
+ *          any purpose.
+ *          */
+
+#include <QtTest>
+
+#include <random>
+
+#include "csync_private.h"
+#include "common/syncjournaldb.h"
+#include "common/syncjournalfilerecord.h"
+
+using namespace OCC;
+
+/*
+ * The parallel reconcile must come to exactly the same result as the serial
+ * one. Both are run over the same randomly changed trees and compared.
+ */
+
+namespace {
+
+struct Scenario
+{
+    std::vector<csync_file_stat_t> local;
+    std::vector<csync_file_stat_t> remote;
+    std::vector<std::pair<QByteArray, QByteArray>> renamedDirs;
+};
+
+QByteArray parentPath(const QByteArray &path)
+{
+    const int slash = path.lastIndexOf('/');
+    return slash < 0 ? QByteArray() : path.left(slash);
+}
+
+QByteArray fileName(const QByteArray &path)
+{
+    return path.mid(path.lastIndexOf('/') + 1);
+}
+
+class ScenarioGenerator
+{
+public:
+    ScenarioGenerator(quint32 seed, int width, SyncJournalDb &db)
+        : _rng(seed)
+        , _width(width)
+        , _db(db)
+    {
+    }
+
+    Scenario generate()
+    {
+        addDir(QByteArray(), 0);
+        Scenario s;
+        changeSide(s.local, s, 'l');
+        changeSide(s.remote, s, 'r');
+        addMangledNames(s);
+        addNewEntries(s);
+        return s;
+    }
+
+private:
+    bool chance(int percent) { return int(_rng() % 100) < percent; }
+
+    csync_file_stat_t makeEntry(const QByteArray &path, ItemType type)
+    {
+        csync_file_stat_t fs;
+        fs.path = path;
+        fs.type = type;
+        fs.inode = ++_lastInode;
+        fs.file_id = "id" + QByteArray::number(fs.inode);
+        fs.etag = "etag" + QByteArray::number(fs.inode);
+        fs.modtime = 1500000000 + fs.inode;
+        fs.size = type == ItemTypeDirectory ? 0 : 100 + fs.inode;
+        return fs;
+    }
+
+    void addDir(const QByteArray &dir, int depth)
+    {
+        const int entries = 1 + _rng() % _width;
+        for (int i = 0; i < entries; ++i) {
+            const bool isDir = depth < 3 && chance(30);
+            const QByteArray name = (isDir ? "d" : "f") + QByteArray::number(i);
+            auto fs = makeEntry(dir.isEmpty() ? name : dir + '/' + name, isDir ? ItemTypeDirectory : ItemTypeFile);
+            _base.push_back(fs);
+            if (isDir) {
+                _dirs.push_back(fs.path);
+                addDir(fs.path, depth + 1);
+            }
+
+            SyncJournalFileRecord rec;
+            rec._path = fs.path;
+            rec._inode = fs.inode;
+            rec._fileId = fs.file_id;
+            rec._etag = fs.etag;
+            rec._modtime = fs.modtime;
+            rec._fileSize = fs.size;
+            rec._type = fs.type;
+            QVERIFY(_db.setFileRecord(rec));
+        }
+    }
+
+    // Changes, removes, ignores and moves the entries of the base tree like
+    // the discovery of one side could find them
+    void changeSide(std::vector<csync_file_stat_t> &side, Scenario &s, char sideName)
+    {
+        QHash<QByteArray, QByteArray> movedDirs;
+        QSet<QByteArray> goneDirs;
+        for (const auto &base : _base) {
+            const QByteArray parent = parentPath(base.path);
+            const bool isDir = base.type == ItemTypeDirectory;
+            if (goneDirs.contains(parent)) {
+                if (isDir)
+                    goneDirs.insert(base.path);
+                continue;
+            }
+
+            csync_file_stat_t fs = base;
+            if (movedDirs.contains(parent)) {
+                fs.path = movedDirs.value(parent) + '/' + fileName(base.path);
+                fs.instruction = chance(80) ? CSYNC_INSTRUCTION_NONE : CSYNC_INSTRUCTION_EVAL_RENAME;
+                if (isDir)
+                    movedDirs.insert(base.path, fs.path);
+                side.push_back(fs);
+                continue;
+            }
+
+            const int roll = _rng() % 100;
+            if (roll < 45) {
+                fs.instruction = CSYNC_INSTRUCTION_NONE;
+            } else if (roll < 60) {
+                fs.instruction = CSYNC_INSTRUCTION_EVAL;
+                fs.modtime += 10;
+                if (!isDir && chance(50))
+                    fs.size += 1;
+                if (sideName == 'r' && chance(50))
+                    fs.checksumHeader = "SHA1:" + QByteArray::number(fs.inode);
+            } else if (roll < 65) {
+                fs.instruction = CSYNC_INSTRUCTION_UPDATE_METADATA;
+            } else if (roll < 73) {
+                if (isDir)
+                    goneDirs.insert(base.path);
+                continue;
+            } else if (roll < 78) {
+                fs.instruction = CSYNC_INSTRUCTION_IGNORE;
+                if (isDir)
+                    goneDirs.insert(base.path);
+            } else if (roll < 93) {
+                // Moved within the same directory or into another one
+                const QByteArray target = chance(50) || _dirs.empty() ? parent : _dirs[_rng() % _dirs.size()];
+                const QByteArray name = fileName(base.path) + "_moved" + sideName + QByteArray::number(base.inode);
+                fs.path = target.isEmpty() ? name : target + '/' + name;
+                if (fs.path.startsWith(base.path + '/'))
+                    fs.path = name;
+                fs.instruction = CSYNC_INSTRUCTION_EVAL_RENAME;
+                if (isDir) {
+                    movedDirs.insert(base.path, fs.path);
+                    s.renamedDirs.emplace_back(base.path, fs.path);
+                }
+            } else {
+                // Changed type
+                fs.instruction = CSYNC_INSTRUCTION_EVAL;
+                if (!isDir) {
+                    fs.type = ItemTypeDirectory;
+                    fs.size = 0;
+                } else {
+                    fs.type = ItemTypeFile;
+                    goneDirs.insert(base.path);
+                }
+            }
+            side.push_back(fs);
+        }
+    }
+
+    // Some unchanged remote files get an encrypted name that the local
+    // entry knows as its mangled name
+    void addMangledNames(Scenario &s)
+    {
+        QHash<QByteArray, csync_file_stat_t *> localByPath;
+        for (auto &fs : s.local)
+            localByPath.insert(fs.path, &fs);
+        for (auto &fs : s.remote) {
+            if (fs.type != ItemTypeFile || fs.instruction != CSYNC_INSTRUCTION_NONE || !chance(5))
+                continue;
+            auto local = localByPath.find(fs.path);
+            if (local == localByPath.end())
+                continue;
+            const QByteArray parent = parentPath(fs.path);
+            const QByteArray mangled = "e2e" + QByteArray::number(fs.inode, 16);
+            fs.path = parent.isEmpty() ? mangled : parent + '/' + mangled;
+            local.value()->e2eMangledName = fs.path;
+        }
+    }
+
+    // New entries, some of them created on both sides
+    void addNewEntries(Scenario &s)
+    {
+        const int count = 1 + _rng() % (_base.size() / 4 + 1);
+        for (int i = 0; i < count; ++i) {
+            const QByteArray dir = _dirs.empty() || chance(20) ? QByteArray() : _dirs[_rng() % _dirs.size()];
+            const QByteArray name = "new" + QByteArray::number(i);
+            auto fs = makeEntry(dir.isEmpty() ? name : dir + '/' + name, chance(20) ? ItemTypeDirectory : ItemTypeFile);
+            fs.instruction = CSYNC_INSTRUCTION_EVAL;
+            const int roll = _rng() % 3;
+            if (roll != 1)
+                s.local.push_back(fs);
+            if (roll != 0) {
+                if (chance(50)) {
+                    fs.modtime += 1;
+                    fs.inode = ++_lastInode;
+                }
+                s.remote.push_back(fs);
+            }
+        }
+    }
+
+    std::mt19937 _rng;
+    int _width;
+    SyncJournalDb &_db;
+    quint64 _lastInode = 0;
+    std::vector<csync_file_stat_t> _base;
+    std::vector<QByteArray> _dirs;
+};
+
+void fillContext(CSYNC &ctx, const Scenario &s)
+{
+    for (const auto &fs : s.local)
+        ctx.local.files[fs.path] = std::unique_ptr<csync_file_stat_t>(new csync_file_stat_t(fs));
+    for (const auto &fs : s.remote)
+        ctx.remote.files[fs.path] = std::unique_ptr<csync_file_stat_t>(new csync_file_stat_t(fs));
+    for (const auto &rename : s.renamedDirs) {
+        ctx.renames.folder_renamed_to[rename.first] = rename.second;
+        ctx.renames.folder_renamed_from[rename.second] = rename.first;
+    }
+}
+
+void compareTrees(const csync_s::FileMap &serial, const csync_s::FileMap &parallel)
+{
+    QCOMPARE(parallel.size(), serial.size());
+    for (const auto &pair : serial) {
+        const csync_file_stat_t *a = pair.second.get();
+        const csync_file_stat_t *b = parallel.findFile(pair.first);
+        QVERIFY2(b, a->path.constData());
+        QVERIFY2(b->instruction == a->instruction, a->path.constData());
+        QCOMPARE(b->rename_path, a->rename_path);
+        QCOMPARE(b->file_id, a->file_id);
+        QCOMPARE(b->inode, a->inode);
+        QCOMPARE(b->modtime, a->modtime);
+        QCOMPARE(b->etag, a->etag);
+        QCOMPARE(b->checksumHeader, a->checksumHeader);
+        QCOMPARE(ItemType(b->type), ItemType(a->type));
+    }
+}
+
+}
+
+class TestReconcile : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase()
+    {
+        // Every entry that isn't unchanged is logged
+        QLoggingCategory::setFilterRules(QStringLiteral("nextcloud.sync.csync.reconciler.info=false"));
+    }
+
+    void testParallelMatchesSerial_data()
+    {
+        QTest::addColumn<quint32>("seed");
+        QTest::addColumn<int>("width");
+
+        for (quint32 seed = 1; seed <= 8; ++seed)
+            QTest::newRow(qPrintable(QStringLiteral("small %1").arg(seed))) << seed << 8;
+        QTest::newRow("large") << quint32(42) << 50;
+    }
+
+    void testParallelMatchesSerial()
+    {
+        QFETCH(quint32, seed);
+        QFETCH(int, width);
+
+        QTemporaryDir tempDir;
+        SyncJournalDb db(tempDir.path() + "/sync.db");
+        const Scenario scenario = ScenarioGenerator(seed, width, db).generate();
+        if (QTest::currentTestFailed())
+            return;
+
+        CSYNC serial(tempDir.path().toUtf8().constData(), &db);
+        serial.parallel_reconcile_threshold = -1;
+        fillContext(serial, scenario);
+
+        CSYNC parallel(tempDir.path().toUtf8().constData(), &db);
+        parallel.parallel_reconcile_threshold = 0;
+        fillContext(parallel, scenario);
+
+        QCOMPARE(csync_reconcile(&serial), 0);
+        QCOMPARE(csync_reconcile(&parallel), 0);
+
+        compareTrees(serial.local.files, parallel.local.files);
+        compareTrees(serial.remote.files, parallel.remote.files);
+
+        // The scenario did exercise the interesting cases
+        int renames = 0;
+        int conflicts = 0;
+        for (const auto &pair : serial.local.files) {
+            renames += pair.second->instruction == CSYNC_INSTRUCTION_RENAME;
+            conflicts += pair.second->instruction == CSYNC_INSTRUCTION_CONFLICT;
+        }
+        for (const auto &pair : serial.remote.files)
+            renames += pair.second->instruction == CSYNC_INSTRUCTION_RENAME;
+        if (width > 20) {
+            QVERIFY(renames > 0);
+            QVERIFY(conflicts > 0);
+        }
+    }
+};
+
+QTEST_GUILESS_MAIN(TestReconcile)
+#include "testreconcile.moc"
@@ -0,0 +1,80 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <networkjobs.h>
+
+using namespace OCC;
+
+class TestRequestEtagsJob : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testEtagsOfChildren()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        int requests = 0;
+        fakeFolder.setServerOverride([&requests](QNetworkAccessManager::Operation, const QNetworkRequest &, QIODevice *) -> QNetworkReply * {
+            ++requests;
+            return nullptr;
+        });
+
+        QHash<QString, QString> etags;
+        auto job = new RequestEtagsJob(fakeFolder.syncEngine().account(), "/", this);
+        connect(job, &RequestEtagsJob::etagRetreived, this, [&etags](const QString &name, const QString &etag) {
+            etags.insert(name, etag);
+        });
+        QSignalSpy finishedSpy(job, &RequestEtagsJob::finishedWithoutError);
+        job->start();
+        QVERIFY(finishedSpy.wait());
+
+        QCOMPARE(requests, 1);
+        auto &remote = fakeFolder.remoteModifier();
+        QCOMPARE(etags.size(), 5);
+        QCOMPARE(etags.value(""), remote.etag);
+        for (const auto &name : { "A", "B", "C", "S" })
+            QCOMPARE(etags.value(name), remote.find(name)->etag);
+    }
+
+    void testSubDirectory()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.remoteModifier().mkdir("A/sub one");
+        fakeFolder.remoteModifier().insert("A/sub one/f");
+
+        QHash<QString, QString> etags;
+        auto job = new RequestEtagsJob(fakeFolder.syncEngine().account(), "/A/", this);
+        connect(job, &RequestEtagsJob::etagRetreived, this, [&etags](const QString &name, const QString &etag) {
+            etags.insert(name, etag);
+        });
+        QSignalSpy finishedSpy(job, &RequestEtagsJob::finishedWithoutError);
+        job->start();
+        QVERIFY(finishedSpy.wait());
+
+        auto &remote = fakeFolder.remoteModifier();
+        QCOMPARE(etags.value(""), remote.find("A")->etag);
+        QCOMPARE(etags.value("sub one"), remote.find("A/sub one")->etag);
+        QCOMPARE(etags.value("a1"), remote.find("A/a1")->etag);
+        QVERIFY(!etags.contains("sub one/f"));
+    }
+
+    void testMissingCollection()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        auto job = new RequestEtagsJob(fakeFolder.syncEngine().account(), "/missing", this);
+        QSignalSpy etagSpy(job, &RequestEtagsJob::etagRetreived);
+        QSignalSpy errorSpy(job, &RequestEtagsJob::finishedWithError);
+        job->start();
+        QVERIFY(errorSpy.wait());
+        QCOMPARE(etagSpy.count(), 0);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestRequestEtagsJob)
+#include "testrequestetagsjob.moc"
@@ -0,0 +1,179 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+#include <propagateremotecopy.h>
+
+using namespace OCC;
+
+struct RequestCounter
+{
+    int puts = 0;
+    int copies = 0;
+
+    void reset() { *this = RequestCounter(); }
+};
+
+static void setupServerCopy(FakeFolder &fakeFolder, RequestCounter &counter)
+{
+    SyncOptions options;
+    options._serverSideCopy = true;
+    fakeFolder.syncEngine().setSyncOptions(options);
+
+    fakeFolder.setServerOverride([&counter](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+        if (op == QNetworkAccessManager::PutOperation)
+            ++counter.puts;
+        else if (request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() == "COPY")
+            ++counter.copies;
+        return nullptr;
+    });
+}
+
+class TestServerCopy : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testCopyInsteadOfUpload()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        RequestCounter counter;
+        setupServerCopy(fakeFolder, counter);
+
+        fakeFolder.localModifier().insert("A/big", 1000, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(counter.puts, 1);
+
+        // The same content in a new place is copied on the server
+        fakeFolder.localModifier().insert("B/big", 1000, 'X');
+        fakeFolder.localModifier().insert("B/other", 1000, 'Y');
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.copies, 1);
+        QCOMPARE(counter.puts, 1);
+
+        // The copy was recorded with its own etag and file id
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("B/big"), &record));
+        QCOMPARE(record._etag, fakeFolder.remoteModifier().find("B/big")->etag.toUtf8());
+        QCOMPARE(record._fileId, fakeFolder.remoteModifier().find("B/big")->fileId);
+
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(counter.copies, 0);
+        QCOMPARE(counter.puts, 0);
+    }
+
+    void testSourceChangedOnServer()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        RequestCounter counter;
+        setupServerCopy(fakeFolder, counter);
+
+        fakeFolder.localModifier().insert("A/big", 1000, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+
+        // The source changes after discovery: the server refuses the copy
+        // because the journal has the old etag
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation)
+                ++counter.puts;
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() == "COPY") {
+                ++counter.copies;
+                fakeFolder.remoteModifier().setContents("A/big", 'Z');
+            }
+            return nullptr;
+        });
+        fakeFolder.localModifier().insert("B/big", 1000, 'X');
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(counter.copies, 1);
+        QCOMPARE(counter.puts, 1);
+        QCOMPARE(fakeFolder.currentRemoteState().find("B/big")->contentChar, 'X');
+
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    void testVerificationFails()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        RequestCounter counter;
+        setupServerCopy(fakeFolder, counter);
+
+        fakeFolder.localModifier().insert("A/big", 1000, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+
+        // The copy ends up with a different size than the local file
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (op == QNetworkAccessManager::PutOperation)
+                ++counter.puts;
+            if (request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() != "COPY")
+                return nullptr;
+            ++counter.copies;
+            auto reply = new FakeCopyReply{ fakeFolder.remoteModifier(), op, request, this };
+            fakeFolder.remoteModifier().appendByte("B/big");
+            return reply;
+        });
+        fakeFolder.localModifier().insert("B/big", 1000, 'X');
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.copies, 1);
+        QCOMPARE(counter.puts, 1);
+        QCOMPARE(fakeFolder.currentRemoteState().find("B/big")->size, qint64(1000));
+    }
+
+    // Only a collision safe checksum identifies the content well enough
+    void testWeakChecksumIsNotUsed()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        RequestCounter counter;
+        setupServerCopy(fakeFolder, counter);
+
+        fakeFolder.localModifier().insert("A/big", 1000, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+
+        SyncJournalFileRecord record;
+        QVERIFY(fakeFolder.syncJournal().getFileRecord(QByteArray("A/big"), &record));
+        OwncloudPropagator propagator(fakeFolder.syncEngine().account(), fakeFolder.localPath(), QString(), &fakeFolder.syncJournal());
+        SyncFileItem item;
+        item._file = QStringLiteral("B/big");
+        item._checksumHeader = record._checksumHeader;
+        QCOMPARE(PropagateRemoteCopy::findSource(&propagator, item, 1000)._path, QByteArray("A/big"));
+
+        // The uploads compute a SHA1 content checksum unless
+        // OWNCLOUD_CONTENT_CHECKSUM_TYPE says otherwise
+        record._checksumHeader = "Adler32:0a1b2c3d";
+        QVERIFY(fakeFolder.syncJournal().setFileRecord(record));
+        item._checksumHeader = record._checksumHeader;
+        QVERIFY(!PropagateRemoteCopy::findSource(&propagator, item, 1000).isValid());
+    }
+
+    void testDisabled()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        RequestCounter counter;
+        setupServerCopy(fakeFolder, counter);
+        fakeFolder.syncEngine().setSyncOptions(SyncOptions());
+
+        fakeFolder.localModifier().insert("A/big", 1000, 'X');
+        QVERIFY(fakeFolder.syncOnce());
+        fakeFolder.localModifier().insert("B/big", 1000, 'X');
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.copies, 0);
+        QCOMPARE(counter.puts, 1);
+    }
+};
+
+QTEST_GUILESS_MAIN(TestServerCopy)
+#include "testservercopy.moc"
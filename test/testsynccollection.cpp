@@ -0,0 +1,211 @@
+/*
+ *    This software is in the public domain, furnished "as is", without technical
+ *    support, and with no warranty, express or implied, as to its usefulness for
+ *    any purpose.
+ *
+ */
+
+#include <QtTest>
+#include "syncenginetestutils.h"
+#include <syncengine.h>
+
+using namespace OCC;
+
+struct RequestCounter
+{
+    int reports = 0;
+    int listings = 0; // Depth 1 PROPFIND
+    int rootProperties = 0; // Depth 0 PROPFIND
+
+    void reset() { *this = RequestCounter(); }
+};
+
+static void setupIncrementalDiscovery(FakeFolder &fakeFolder, RequestCounter &counter)
+{
+    // The delta is only used if parent etags change with their contents
+    fakeFolder.syncEngine().account()->setServerVersion("10.0.0");
+    SyncOptions options;
+    options._incrementalRemoteDiscovery = true;
+    fakeFolder.syncEngine().setSyncOptions(options);
+
+    fakeFolder.setServerOverride([&counter](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+        auto verb = request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+        if (verb == "REPORT")
+            ++counter.reports;
+        else if (verb == "PROPFIND" && request.rawHeader("Depth") == "0")
+            ++counter.rootProperties;
+        else if (verb == "PROPFIND")
+            ++counter.listings;
+        return nullptr;
+    });
+}
+
+class TestSyncCollection : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testRemoteChangesFromDelta()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.setServerSyncCollectionEnabled(true);
+        RequestCounter counter;
+        setupIncrementalDiscovery(fakeFolder, counter);
+
+        // No token yet: full walk, but the token gets recorded
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(counter.reports, 0);
+        QCOMPARE(counter.rootProperties, 1);
+        QVERIFY(counter.listings > 1);
+        const QByteArray firstToken = fakeFolder.syncJournal().syncToken();
+        QVERIFY(!firstToken.isEmpty());
+
+        fakeFolder.remoteModifier().appendByte("A/a1");
+        fakeFolder.remoteModifier().insert("B/b3");
+        fakeFolder.remoteModifier().remove("C/c1");
+        fakeFolder.remoteModifier().rename("A/a2", "B/a2");
+        fakeFolder.remoteModifier().mkdir("D");
+        fakeFolder.remoteModifier().mkdir("D/E");
+        fakeFolder.remoteModifier().insert("D/E/e1");
+        fakeFolder.localModifier().insert("C/local");
+
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.reports, 1);
+        // Only the new directories need to be listed
+        QCOMPARE(counter.listings, 2);
+        QVERIFY(fakeFolder.syncJournal().syncToken() != firstToken);
+
+        // Nothing changed: no listing at all
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.reports, 1);
+        QCOMPARE(counter.listings, 0);
+
+        // Removing a directory
+        fakeFolder.remoteModifier().remove("D");
+        fakeFolder.remoteModifier().setContents("S/s1", 'X');
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.reports, 1);
+        QCOMPARE(counter.listings, 0);
+        QVERIFY(!fakeFolder.currentLocalState().find("D"));
+    }
+
+    void testInvalidToken()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.setServerSyncCollectionEnabled(true);
+        RequestCounter counter;
+        setupIncrementalDiscovery(fakeFolder, counter);
+        QVERIFY(fakeFolder.syncOnce());
+
+        fakeFolder.invalidateServerSyncTokens();
+        fakeFolder.remoteModifier().insert("A/a3");
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.reports, 1);
+        QVERIFY(counter.listings > 1);
+
+        // The token of the full walk is good again
+        fakeFolder.remoteModifier().insert("A/a4");
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.reports, 1);
+        QCOMPARE(counter.listings, 0);
+    }
+
+    void testUnsupportedServer()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        RequestCounter counter;
+        setupIncrementalDiscovery(fakeFolder, counter);
+
+        for (int i = 0; i < 2; ++i) {
+            fakeFolder.remoteModifier().insert("A/new" + QString::number(i));
+            QVERIFY(fakeFolder.syncOnce());
+            QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        }
+        QCOMPARE(counter.reports, 0);
+        // Only asked once for the sync-token
+        QCOMPARE(counter.rootProperties, 1);
+        QVERIFY(fakeFolder.syncJournal().syncToken().isEmpty());
+    }
+
+    // Changes that failed to propagate must be part of the next delta
+    void testErrorKeepsToken()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.setServerSyncCollectionEnabled(true);
+        RequestCounter counter;
+        setupIncrementalDiscovery(fakeFolder, counter);
+        QVERIFY(fakeFolder.syncOnce());
+        const QByteArray token = fakeFolder.syncJournal().syncToken();
+
+        fakeFolder.remoteModifier().appendByte("B/b1");
+        fakeFolder.remoteModifier().appendByte("B/b2");
+        fakeFolder.serverErrorPaths().append("B/b1", 500);
+        fakeFolder.syncOnce();
+        QVERIFY(!(fakeFolder.currentLocalState() == fakeFolder.currentRemoteState()));
+        QCOMPARE(fakeFolder.syncJournal().syncToken(), token);
+
+        fakeFolder.serverErrorPaths().clear();
+        fakeFolder.syncJournal().wipeErrorBlacklist();
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+        QCOMPARE(counter.reports, 1);
+        QVERIFY(fakeFolder.syncJournal().syncToken() != token);
+    }
+
+    // A full rediscovery request bypasses the delta
+    void testInvalidatedEtags()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.setServerSyncCollectionEnabled(true);
+        RequestCounter counter;
+        setupIncrementalDiscovery(fakeFolder, counter);
+        QVERIFY(fakeFolder.syncOnce());
+
+        fakeFolder.syncJournal().avoidReadFromDbOnNextSync(QByteArray("A"));
+        counter.reset();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(counter.reports, 0);
+        QVERIFY(counter.listings > 1);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
+    // Aborting while the REPORT is running must not touch the delta anymore
+    void testAbortDuringReport()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.setServerSyncCollectionEnabled(true);
+        RequestCounter counter;
+        setupIncrementalDiscovery(fakeFolder, counter);
+        QVERIFY(fakeFolder.syncOnce());
+
+        bool hang = true;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            if (hang && request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray() == "REPORT") {
+                QTimer::singleShot(50, &fakeFolder.syncEngine(), [&]() { fakeFolder.syncEngine().abort(); });
+                return new FakeHangingReply(op, request, &fakeFolder.syncEngine());
+            }
+            return nullptr;
+        });
+
+        fakeFolder.remoteModifier().insert("A/a3");
+        QVERIFY(!fakeFolder.syncOnce());
+
+        hang = false;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+};
+
+QTEST_GUILESS_MAIN(TestSyncCollection)
+#include "testsynccollection.moc"
@@ -606,6 +606,71 @@ private slots:
         QCOMPARE(fakeFolder.syncEngine().lastLocalDiscoveryStyle(), LocalDiscoveryStyle::FilesystemOnly);
     }
 
+    // Without local changes, an unchanged root etag ends the sync before the discovery
+    void testSkipDiscoveryWithoutChanges()
+    {
+        FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
+        fakeFolder.syncEngine().account()->setServerVersion("10.0.0");
+        int listings = 0;
+        int etagChecks = 0;
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            auto verb = request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+            if (verb == "PROPFIND" && request.rawHeader("Depth") == "0")
+                ++etagChecks;
+            else if (verb == "PROPFIND")
+                ++listings;
+            return nullptr;
+        });
+        auto noLocalChanges = [&]() {
+            fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem);
+        };
+        QVERIFY(fakeFolder.syncOnce());
+
+        // Nothing changed: only the root etag is requested
+        listings = etagChecks = 0;
+        noLocalChanges();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(etagChecks, 1);
+        QCOMPARE(listings, 0);
+
+        // A remote change is found
+        listings = etagChecks = 0;
+        fakeFolder.remoteModifier().insert("A/a3");
+        noLocalChanges();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(etagChecks, 1);
+        QVERIFY(listings > 0);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // Reported local changes are never skipped
+        listings = etagChecks = 0;
+        fakeFolder.localModifier().insert("B/b3");
+        fakeFolder.syncEngine().setLocalDiscoveryOptions(LocalDiscoveryStyle::DatabaseAndFilesystem, { "B/b3" });
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(listings > 0);
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+
+        // The upload changed the root etag, so the next sync discovers once more
+        noLocalChanges();
+        QVERIFY(fakeFolder.syncOnce());
+        noLocalChanges();
+        listings = 0;
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(listings, 0);
+
+        // Failed etag checks fall back to a normal sync
+        fakeFolder.setServerOverride([&](QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *) -> QNetworkReply * {
+            auto verb = request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+            if (verb == "PROPFIND" && request.rawHeader("Depth") == "0")
+                return new FakeErrorReply(op, request, this, 500);
+            return nullptr;
+        });
+        fakeFolder.remoteModifier().insert("C/c3");
+        noLocalChanges();
+        QVERIFY(fakeFolder.syncOnce());
+        QCOMPARE(fakeFolder.currentLocalState(), fakeFolder.currentRemoteState());
+    }
+
     void testLocalDiscoveryDecision()
     {
         FakeFolder fakeFolder{ FileInfo::A12_B12_C12_S12() };
@@ -715,6 +780,30 @@ private slots:
         QTextCodec::setCodecForLocale(utf8Locale);
 #endif
     }
+
+    void testSyncStatistics()
+    {
+        FakeFolder fakeFolder{FileInfo::A12_B12_C12_S12()};
+        fakeFolder.remoteModifier().insert("A/a0");
+        QVERIFY(fakeFolder.syncOnce());
+
+        const auto &stats = fakeFolder.syncEngine().syncStatistics();
+        QVERIFY(stats.isValid());
+        QVERIFY(stats.counter(PerformanceCounters::SqlQueries) > 0);
+        QVERIFY(stats.counter(PerformanceCounters::PropfindRequests) > 0);
+        QVERIFY(stats.counter(PerformanceCounters::StatCalls) > 0);
+        QVERIFY(stats.jobLatencies().contains("OCC::GETFileJob"));
+        QVERIFY(stats.totalTime() >= stats.phaseTime(SyncStatistics::Propagation));
+
+        auto json = stats.toJson();
+        QVERIFY(json.value("phasesMsecs").toObject().contains("checkForPermission"));
+        QCOMPARE(json.value("counters").toObject().value("propfindRequests").toInt(),
+            int(stats.counter(PerformanceCounters::PropfindRequests)));
+
+        // The counters only cover the latest sync
+        QVERIFY(fakeFolder.syncOnce());
+        QVERIFY(!fakeFolder.syncEngine().syncStatistics().jobLatencies().contains("OCC::GETFileJob"));
+    }
 };
 
 QTEST_GUILESS_MAIN(TestSyncEngine)
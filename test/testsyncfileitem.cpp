@@ -63,6 +63,21 @@ private slots:
         QVERIFY(!(b < b));
         QVERIFY(!(c < c));
     }
+
+    void testRarelySetMembers() {
+        SyncFileItem a = createItem("dir/file");
+        QCOMPARE(a.encryptedFileName(), QString());
+        a.setEncryptedFileName("dir/0123abcd");
+        a.setDirectDownloadUrl("https://example.com/file");
+
+        // Copies don't change each other
+        SyncFileItem b = a;
+        b.setEncryptedFileName(QString());
+        QCOMPARE(a.encryptedFileName(), QString("dir/0123abcd"));
+        QCOMPARE(b.encryptedFileName(), QString());
+        QCOMPARE(b.directDownloadUrl(), QString("https://example.com/file"));
+        QCOMPARE(b.directDownloadCookies(), QString());
+    }
 };
 
 QTEST_APPLESS_MAIN(TestSyncFileItem)
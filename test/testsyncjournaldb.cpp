@@ -270,6 +270,58 @@ private slots:
         QCOMPARE(getEtag("foodir/sub"), initialEtag);
     }
 
+    void testFilesBelowPathPruned()
+    {
+        _db.clearFileTable();
+
+        auto makeEntry = [&](const QByteArray &path, const QByteArray &etag) {
+            SyncJournalFileRecord record;
+            record._path = path;
+            record._etag = etag;
+            _db.setFileRecord(record);
+        };
+        auto getPaths = [&](const QByteArray &path, bool skipInvalidEtags, const QVector<QByteArray> &skipPaths) {
+            QByteArrayList paths;
+            _db.getFilesBelowPathPruned(path, skipInvalidEtags, skipPaths, [&](const SyncJournalFileRecord &rec) {
+                paths.append(rec._path);
+            });
+            return paths;
+        };
+
+        makeEntry("foo", "etag");
+        makeEntry("foo/a", "etag");
+        makeEntry("foo/bar", "_invalid_");
+        makeEntry("foo/bar/x", "etag");
+        makeEntry("foo/bar-2", "etag"); // sorts between "foo/bar" and "foo/bar/"
+        makeEntry("foo/black", "etag");
+        makeEntry("foo/black/y", "etag");
+        makeEntry("foo/blacker", "etag");
+        makeEntry("foo-2", "etag");
+        makeEntry("foo.txt", "etag");
+        makeEntry("bar", "_invalid_");
+        makeEntry("bar/x", "etag");
+        makeEntry("black", "etag");
+        makeEntry("black/y", "etag");
+        makeEntry("zed", "etag");
+
+        const QByteArrayList all = {
+            "bar", "bar/x", "black", "black/y", "foo", "foo-2", "foo.txt",
+            "foo/a", "foo/bar", "foo/bar-2", "foo/bar/x", "foo/black", "foo/black/y", "foo/blacker", "zed"
+        };
+        QCOMPARE(getPaths("", false, {}), all);
+
+        QCOMPARE(getPaths("", true, { "black/", "foo/black/" }),
+            QByteArrayList({ "foo", "foo-2", "foo.txt", "foo/a", "foo/bar-2", "foo/blacker", "zed" }));
+        QCOMPARE(getPaths("foo", true, { "black/", "foo/black/" }),
+            QByteArrayList({ "foo/a", "foo/bar-2", "foo/blacker" }));
+        QCOMPARE(getPaths("foo", false, {}),
+            QByteArrayList({ "foo/a", "foo/bar", "foo/bar-2", "foo/bar/x", "foo/black", "foo/black/y", "foo/blacker" }));
+
+        // Everything at or below a skipped path is left out
+        QVERIFY(getPaths("black", false, { "black/" }).isEmpty());
+        QVERIFY(getPaths("", false, { "/" }).isEmpty());
+    }
+
     void testRecursiveDelete()
     {
         auto makeEntry = [&](const QByteArray &path) {
@@ -320,6 +372,68 @@ private slots:
         QVERIFY(checkElements());
     }
 
+    void testPostSyncCleanup()
+    {
+        _db.clearFileTable();
+
+        auto makeEntry = [&](const QByteArray &path) {
+            SyncJournalFileRecord record;
+            record._path = path;
+            _db.setFileRecord(record);
+        };
+
+        QByteArrayList elements;
+        elements
+            << "a"
+            << "a/file"
+            << "a-2"
+            << "b"
+            << "b/sub"
+            << "b/sub/file"
+            << "b/sub/other"
+            << "b/subway"
+            << "c"
+            << "c/file"
+            << "d"
+            << "\xc3\xa9t\xc3\xa9/file";
+        for (const auto &elem : elements)
+            makeEntry(elem);
+
+        QSet<QString> keep;
+        keep << "a" << "a-2" << "d" << "does/not/exist" << QString::fromUtf8("\xc3\xa9t\xc3\xa9/file");
+        QSet<QString> prefixes;
+        prefixes << "b/sub/" << "b/" << "c/f";
+        QVERIFY(_db.postSyncCleanup(keep, prefixes));
+
+        auto exists = [&](const QByteArray &path) {
+            SyncJournalFileRecord record;
+            _db.getFileRecord(path, &record);
+            return record.isValid();
+        };
+        QVERIFY(exists("a"));
+        QVERIFY(!exists("a/file"));
+        QVERIFY(exists("a-2"));
+        QVERIFY(!exists("b"));
+        QVERIFY(exists("b/sub"));
+        QVERIFY(exists("b/sub/file"));
+        QVERIFY(exists("b/sub/other"));
+        QVERIFY(exists("b/subway"));
+        QVERIFY(!exists("c"));
+        QVERIFY(exists("c/file"));
+        QVERIFY(exists("d"));
+        QVERIFY(exists("\xc3\xa9t\xc3\xa9/file"));
+
+        // Removing more rows than fit into one delete batch
+        _db.clearFileTable();
+        for (int i = 0; i < 1234; ++i)
+            makeEntry("many/file" + QByteArray::number(i));
+        makeEntry("kept");
+        QVERIFY(_db.postSyncCleanup(QSet<QString>{ "kept" }, QSet<QString>()));
+        QVERIFY(exists("kept"));
+        QVERIFY(!exists("many/file0"));
+        QVERIFY(!exists("many/file1233"));
+    }
+
 private:
     SyncJournalDb _db;
 };
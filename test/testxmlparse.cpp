@@ -613,6 +613,86 @@ private slots:
         QVERIFY(_subdirs.size() == 1);
     }
 
+    void testParserInChunks() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:s=\"http://sabredav.org/ns\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004213ocobzus5kn6s</oc:id>"
+              "<oc:size>121780</oc:size>"
+              "<d:getetag>\"5527beb0400b0\"</d:getetag>"
+              "<d:resourcetype>"
+              "<d:collection/>"
+              "</d:resourcetype>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/sub/quitte.pdf</d:href>"
+              "<d:propstat>"
+              "<d:prop>"
+              "<oc:id>00004215ocobzus5kn6s</oc:id>"
+              "<d:getetag>\"2fa2f0d9ed49ea0c3e409d49e652dea0\"</d:getetag>"
+              "<d:resourcetype/>"
+              "<d:getcontentlength>121780</d:getcontentlength>"
+              "</d:prop>"
+              "<d:status>HTTP/1.1 200 OK</d:status>"
+              "</d:propstat>"
+              "</d:response>"
+              "</d:multistatus>";
+
+        LsColXMLParser parser;
+        QList<QMap<QString, QString>> properties;
+        connect(&parser, &LsColXMLParser::directoryListingSubfolders, this, &TestXmlParse::slotDirectoryListingSubFolders);
+        connect(&parser, &LsColXMLParser::directoryListingIterated, this, [&](const QString &item, const QMap<QString, QString> &map) {
+            _items.append(item);
+            properties.append(map);
+        });
+        connect(&parser, &LsColXMLParser::finishedWithoutError, this, &TestXmlParse::slotFinishedSuccessfully);
+
+        // Entries are reported as soon as they are complete, wherever the data is split
+        QHash<QString, ExtraFolderInfo> sizes;
+        parser.start(&sizes, "/oc/remote.php/webdav/sharefolder");
+        const int firstResponseEnd = testXml.indexOf("</d:response>") + 13;
+        for (int pos = 0; pos < testXml.size(); pos += 7) {
+            QVERIFY(parser.addData(testXml.mid(pos, 7)));
+            if (pos + 7 < firstResponseEnd)
+                QCOMPARE(_items.size(), 0);
+            else if (pos + 7 < testXml.size() - 30)
+                QCOMPARE(_items.size(), 1);
+        }
+        QVERIFY(!_success);
+        QVERIFY(parser.finish());
+        QVERIFY(_success);
+
+        QCOMPARE(_items, (QStringList{ "/oc/remote.php/webdav/sharefolder", "/oc/remote.php/webdav/sharefolder/sub/quitte.pdf" }));
+        QCOMPARE(properties[0].value("getetag"), QString("\"5527beb0400b0\""));
+        QCOMPARE(properties[0].value("resourcetype"), QString("<collection></collection>"));
+        QCOMPARE(properties[1].value("getcontentlength"), QString("121780"));
+        QCOMPARE(sizes.value("/oc/remote.php/webdav/sharefolder/").size, 121780);
+        QCOMPARE(_subdirs, QStringList{ "/oc/remote.php/webdav/sharefolder/" });
+    }
+
+    void testParserInChunksTruncated() {
+        const QByteArray testXml = "<?xml version='1.0' encoding='utf-8'?>"
+              "<d:multistatus xmlns:d=\"DAV:\" xmlns:oc=\"http://owncloud.org/ns\">"
+              "<d:response>"
+              "<d:href>/oc/remote.php/webdav/sharefolder/</d:href>"
+              "<d:propstat>"
+              "<d:prop>";
+
+        LsColXMLParser parser;
+        connect(&parser, &LsColXMLParser::finishedWithoutError, this, &TestXmlParse::slotFinishedSuccessfully);
+        parser.start(nullptr, "/oc/remote.php/webdav/sharefolder");
+        // More data might come, so that's not an error yet
+        QVERIFY(parser.addData(testXml));
+        QVERIFY(!parser.finish());
+        QVERIFY(!_success);
+    }
+
 };
 
     QTEST_GUILESS_MAIN(TestXmlParse)